@@ -0,0 +1,505 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*! \defgroup pubif Public Interfaces */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "plugin.h"
+#include "auth-cache.h"
+
+#define CACHE_TTL          60   /* default lifetime of a decision (s) */
+#define CACHE_NEGATIVE_TTL 5    /* default lifetime of a denial (s) */
+#define CACHE_MAX_PROCS    256  /* flush everything beyond this */
+
+/*
+ * Processes are identified by their pid and their start time, so that a
+ * new process reusing the pid of a cached one never gets its decisions.
+ * A fingerprint of their credentials is kept along, so that decisions
+ * are dropped as soon as a process changes its ids, groups or capabilities.
+ * An exec keeps all of these, but the credentials that come with the
+ * binary may change, so the identity of the executable is kept as well.
+ */
+
+typedef unsigned long long proc_start_t;
+
+typedef struct {
+    dev_t         dev;
+    ino_t         ino;
+} proc_exe_t;
+
+typedef struct {
+    int      success;
+    char    *err;
+    gint64   expire;
+} decision_t;
+
+typedef struct {
+    pid_t         pid;
+    proc_start_t  start;
+    guint         creds;                /* credential fingerprint */
+    proc_exe_t    exe;                  /* executable identity */
+    GHashTable   *decisions;            /* request key -> decision_t */
+} proc_t;
+
+typedef struct {
+    pid_t         pid;
+    proc_start_t  start;
+    gint64        expire;
+} peer_t;
+
+typedef struct {
+    unsigned int  pid_hit;              /* D-Bus address -> pid lookups */
+    unsigned int  pid_miss;
+    unsigned int  hit;                  /* decision lookups */
+    unsigned int  miss;
+    unsigned int  expired;              /* decisions timed out */
+    unsigned int  reused;               /* pid reuse detected */
+    unsigned int  changed;              /* credential changes detected */
+    unsigned int  execs;                /* execs detected */
+    unsigned int  invalidated;          /* NameOwnerChanged */
+} stats_t;
+
+
+static int          enabled = TRUE;
+static int          ttl     = CACHE_TTL;
+static int          neg_ttl = CACHE_NEGATIVE_TTL;
+static GHashTable  *procs;              /* pid -> proc_t */
+static GHashTable  *peers;              /* D-Bus address -> peer_t */
+static stats_t      stats;
+
+static proc_start_t read_start_time(pid_t);
+static proc_start_t (*start_time)(pid_t) = read_start_time;
+static guint        read_creds_hash(pid_t);
+static guint        (*creds_hash)(pid_t) = read_creds_hash;
+static proc_exe_t   read_exe_id(pid_t);
+static proc_exe_t   (*exe_id)(pid_t) = read_exe_id;
+
+static proc_t *lookup_proc(pid_t, int);
+static void    free_proc(gpointer);
+static void    free_decision(gpointer);
+static int     parse_ttl(OhmPlugin *, char *, int);
+static gint64  now(void);
+
+
+/*! \addtogroup pubif
+ *  Functions
+ *  @{
+ */
+
+void auth_cache_init(OhmPlugin *plugin)
+{
+    const char *cache;
+
+    if ((cache = ohm_plugin_get_param(plugin, "cache")) != NULL)
+        enabled = !strcmp(cache, "yes") || !strcmp(cache, "true");
+
+    ttl     = parse_ttl(plugin, "cache-ttl", CACHE_TTL);
+    neg_ttl = parse_ttl(plugin, "cache-negative-ttl", CACHE_NEGATIVE_TTL);
+
+    procs = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                  NULL, free_proc);
+    peers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    OHM_INFO("auth: decision cache %s (ttl %d s, negative ttl %d s)",
+             enabled ? "enabled" : "disabled", ttl, neg_ttl);
+}
+
+void auth_cache_exit(OhmPlugin *plugin)
+{
+    char buf[256];
+
+    (void)plugin;
+
+    if (procs != NULL) {
+        OHM_INFO("auth: cache %s", auth_cache_stats(buf, sizeof(buf)));
+
+        g_hash_table_destroy(procs);
+        g_hash_table_destroy(peers);
+        procs = peers = NULL;
+    }
+}
+
+
+int auth_cache_lookup_pid(char *addr, pid_t *pid)
+{
+    peer_t *peer;
+
+    if (!enabled || peers == NULL)
+        return FALSE;
+
+    if ((peer = g_hash_table_lookup(peers, addr)) != NULL) {
+        if (peer->expire > now() && start_time(peer->pid) == peer->start) {
+            *pid = peer->pid;
+            stats.pid_hit++;
+
+            OHM_DEBUG(DBG_CACHE, "%s -> pid %u from cache", addr, *pid);
+
+            return TRUE;
+        }
+
+        g_hash_table_remove(peers, addr);
+    }
+
+    stats.pid_miss++;
+
+    return FALSE;
+}
+
+
+void auth_cache_add_pid(char *addr, pid_t pid)
+{
+    peer_t *peer;
+
+    if (!enabled || peers == NULL)
+        return;
+
+    if ((peer = g_new0(peer_t, 1)) != NULL) {
+        peer->pid    = pid;
+        peer->start  = start_time(pid);
+        peer->expire = now() + ttl * 1000;
+
+        g_hash_table_replace(peers, g_strdup(addr), peer);
+    }
+}
+
+
+void auth_cache_invalidate_addr(char *addr)
+{
+    peer_t *peer;
+
+    if (peers == NULL || (peer = g_hash_table_lookup(peers, addr)) == NULL)
+        return;
+
+    OHM_DEBUG(DBG_CACHE, "%s (pid %u) changed owner, invalidating",
+              addr, peer->pid);
+
+    stats.invalidated++;
+
+    g_hash_table_remove(procs, GINT_TO_POINTER(peer->pid));
+    g_hash_table_remove(peers, addr);
+}
+
+
+int auth_cache_lookup_decision(pid_t pid, char *key, int *success,
+                               char *err, int len)
+{
+    proc_t     *proc;
+    decision_t *d;
+
+    if (!enabled || procs == NULL)
+        return FALSE;
+
+    if ((proc = lookup_proc(pid, FALSE)) != NULL &&
+        (d    = g_hash_table_lookup(proc->decisions, key)) != NULL) {
+
+        if (d->expire > now()) {
+            *success = d->success;
+            snprintf(err, len, "%s", d->err);
+            stats.hit++;
+
+            OHM_DEBUG(DBG_CACHE, "decision for pid %u from cache: %s",
+                      pid, d->success ? "granted" : "denied");
+
+            return TRUE;
+        }
+
+        stats.expired++;
+        g_hash_table_remove(proc->decisions, key);
+    }
+
+    stats.miss++;
+
+    return FALSE;
+}
+
+
+void auth_cache_add_decision(pid_t pid, char *key, int success, char *err)
+{
+    proc_t     *proc;
+    decision_t *d;
+
+    if (!enabled || procs == NULL)
+        return;
+
+    if (g_hash_table_size(procs) >= CACHE_MAX_PROCS) {
+        OHM_DEBUG(DBG_CACHE, "cache full, flushing");
+        g_hash_table_remove_all(procs);
+    }
+
+    if ((proc = lookup_proc(pid, TRUE)) == NULL)
+        return;
+
+    if ((d = g_new0(decision_t, 1)) != NULL) {
+        d->success = success;
+        d->err     = g_strdup(err ? err : "");
+        d->expire  = now() + (success ? ttl : neg_ttl) * 1000;
+
+        g_hash_table_replace(proc->decisions, g_strdup(key), d);
+    }
+}
+
+
+char *auth_cache_stats(char *buf, int len)
+{
+    unsigned int npid = stats.pid_hit + stats.pid_miss;
+    unsigned int n    = stats.hit + stats.miss;
+
+    snprintf(buf, len, "pid lookups: %u hits, %u misses (%u%%), "
+             "decisions: %u hits, %u misses (%u%%), "
+             "%u expired, %u pid reuses, %u credential changes, "
+             "%u execs, %u invalidations",
+             stats.pid_hit, stats.pid_miss,
+             npid ? (100 * stats.pid_hit) / npid : 0,
+             stats.hit, stats.miss, n ? (100 * stats.hit) / n : 0,
+             stats.expired, stats.reused, stats.changed, stats.execs,
+             stats.invalidated);
+
+    return buf;
+}
+
+
+/*!
+ * @}
+ */
+
+static proc_t *lookup_proc(pid_t pid, int create)
+{
+    proc_t       *proc;
+    proc_start_t  start;
+    guint         creds;
+    proc_exe_t    exe;
+    int           same_exe;
+
+    if ((start = start_time(pid)) == 0) {
+        /* the process is gone */
+        g_hash_table_remove(procs, GINT_TO_POINTER(pid));
+        return NULL;
+    }
+
+    creds = creds_hash(pid);
+    exe   = exe_id(pid);
+
+    if ((proc = g_hash_table_lookup(procs, GINT_TO_POINTER(pid))) != NULL) {
+        same_exe = proc->exe.dev == exe.dev && proc->exe.ino == exe.ino;
+
+        if (proc->start == start && proc->creds == creds && same_exe)
+            return proc;
+
+        if (proc->start != start) {
+            OHM_DEBUG(DBG_CACHE, "pid %u has been reused, dropping its "
+                      "decisions", pid);
+            stats.reused++;
+        }
+        else if (!same_exe) {
+            OHM_DEBUG(DBG_CACHE, "pid %u executed another binary, dropping "
+                      "its decisions", pid);
+            stats.execs++;
+        }
+        else {
+            OHM_DEBUG(DBG_CACHE, "pid %u changed its credentials, dropping "
+                      "its decisions", pid);
+            stats.changed++;
+        }
+
+        g_hash_table_remove(procs, GINT_TO_POINTER(pid));
+    }
+
+    if (!create || (proc = g_new0(proc_t, 1)) == NULL)
+        return NULL;
+
+    proc->pid       = pid;
+    proc->start     = start;
+    proc->creds     = creds;
+    proc->exe       = exe;
+    proc->decisions = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, free_decision);
+
+    g_hash_table_insert(procs, GINT_TO_POINTER(pid), proc);
+
+    return proc;
+}
+
+
+static void free_proc(gpointer data)
+{
+    proc_t *proc = (proc_t *)data;
+
+    g_hash_table_destroy(proc->decisions);
+    g_free(proc);
+}
+
+
+static void free_decision(gpointer data)
+{
+    decision_t *d = (decision_t *)data;
+
+    g_free(d->err);
+    g_free(d);
+}
+
+
+static proc_start_t read_start_time(pid_t pid)
+{
+    char          path[64], buf[1024], *p;
+    int           fd;
+    proc_start_t  start;
+    ssize_t       size;
+
+    snprintf(path, sizeof(path), "/proc/%u/stat", pid);
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return 0;
+
+    size = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+
+    if (size <= 0)
+        return 0;
+
+    buf[size] = '\0';
+
+    /* the command may contain spaces and parentheses, skip past it */
+    if ((p = strrchr(buf, ')')) == NULL)
+        return 0;
+
+    if (sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+               "%*u %*u %*d %*d %*d %*d %*d %*d %llu", &start) != 1)
+        return 0;
+
+    return start;
+}
+
+
+/*
+ * Hash the lines of the task status that the credential checks depend on.
+ */
+static guint read_creds_hash(pid_t pid)
+{
+    static const char *fields[] = { "Uid:", "Gid:", "Groups:", "CapEff:" };
+
+    char    path[64], buf[4096], *line, *end;
+    int     fd;
+    ssize_t size;
+    guint   hash;
+    size_t  i;
+
+    snprintf(path, sizeof(path), "/proc/%u/status", pid);
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return 0;
+
+    size = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+
+    if (size <= 0)
+        return 0;
+
+    buf[size] = '\0';
+    hash      = 0;
+
+    for (line = buf; line != NULL && *line; line = end) {
+        if ((end = strchr(line, '\n')) != NULL)
+            *end++ = '\0';
+
+        for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+            if (!strncmp(line, fields[i], strlen(fields[i]))) {
+                hash = hash * 31 + g_str_hash(line);
+                break;
+            }
+        }
+    }
+
+    return hash;
+}
+
+
+/*
+ * Identify the executable of the process. If it cannot be looked at (a
+ * kernel thread or no permission) it stays unknown, which is consistent
+ * across lookups.
+ */
+static proc_exe_t read_exe_id(pid_t pid)
+{
+    char        path[64];
+    struct stat st;
+    proc_exe_t  exe;
+
+    snprintf(path, sizeof(path), "/proc/%u/exe", pid);
+
+    memset(&exe, 0, sizeof(exe));
+
+    if (stat(path, &st) == 0) {
+        exe.dev = st.st_dev;
+        exe.ino = st.st_ino;
+    }
+
+    return exe;
+}
+
+
+static int parse_ttl(OhmPlugin *plugin, char *name, int defval)
+{
+    const char *value;
+    char       *e;
+    int         seconds;
+
+    if ((value = ohm_plugin_get_param(plugin, name)) == NULL)
+        return defval;
+
+    seconds = (int)strtol(value, &e, 10);
+
+    if (*e || seconds < 0) {
+        OHM_ERROR("auth: invalid %s '%s'", name, value);
+        return defval;
+    }
+
+    return seconds;
+}
+
+
+static gint64 now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (gint64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
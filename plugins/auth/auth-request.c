@@ -30,6 +30,7 @@ USA.
 #include "plugin.h"
 #include "auth-request.h"
 #include "auth-creds.h"
+#include "auth-cache.h"
 #include "dbusif.h"
 
 #define MAX_CREDS 16
@@ -44,8 +45,10 @@ typedef enum {
 typedef struct req_s {
     struct req_s *next;
     pid_t         pid;
+    char         *addr;         /* D-Bus address, if pid is queried */
     req_type_t    type;
     char         *adump;
+    char         *key;          /* decision cache key */
     union {
         char *creds[MAX_CREDS + 1];
     }             args; 
@@ -64,7 +67,7 @@ static void   destroy_request(req_t *);
 static void   authorize_request(req_t *);
 
 static gboolean idle_callback(gpointer);
-static void dbus_callback(pid_t *, char *, void *);
+static void dbus_callback(pid_t, char *, void *);
 
 
 /*! \addtogroup pubif
@@ -90,6 +93,7 @@ int auth_request(char *id_type , void *id,
 {
     req_t *request;
     char  *dbusad;
+    pid_t  pid;
 
     if (!id_type || !id || !req_type || !req || !cb) {
         OHM_DEBUG(DBG_REQ, "%s() invalid argument", __FUNCTION__);
@@ -113,9 +117,20 @@ int auth_request(char *id_type , void *id,
         dbusad = (char *)id;
         OHM_DEBUG(DBG_REQ, "%s('%s','%s', '%s',<%s>, %p,%p)", __FUNCTION__,
                   id_type,dbusad, req_type,request->adump, cb,data);
-        if (dbusif_pid_query("system", dbusad, dbus_callback, request) != 0) {
-            OHM_ERROR("auth: can't query pid for D-Bus address %s", dbusad);
-            return EIO;
+        if (auth_cache_lookup_pid(dbusad, &pid)) {
+            request->pid = pid;
+            if (g_idle_add(idle_callback, request) == 0) {
+                OHM_ERROR("auth: failed to add idle callback");
+                return EIO;
+            }
+        }
+        else {
+            request->addr = strdup(dbusad);
+            if (dbusif_pid_query("system", dbusad, dbus_callback, request)) {
+                OHM_ERROR("auth: can't query pid for D-Bus address %s",
+                          dbusad);
+                return EIO;
+            }
         }
     }
     else {
@@ -170,6 +185,7 @@ static req_t *create_request(char *req_type, void *args,
             auth_creds_request_dump(args, req->adump, ARG_DUMP_LENGTH);
             for (list = (char **)args, i = 0;  i < MAX_CREDS && list[i];  i++)
                 req->args.creds[i] = strdup(list[i]);
+            req->key = g_strjoinv("\n", req->args.creds);
             break;
 
         default: /* should never get here */
@@ -204,6 +220,8 @@ static void destroy_request(req_t *request)
                 prev->next = request->next;
                 
                 free(request->adump);
+                free(request->addr);
+                g_free(request->key);
 
                 switch (request->type) {
                     
@@ -235,8 +253,13 @@ static void authorize_request(req_t *request)
         switch (request->type) {
 
         case request_creds:
-            success = auth_creds_check(request->pid, request->args.creds,
-                                       errbuf, sizeof(errbuf));
+            if (!auth_cache_lookup_decision(request->pid, request->key,
+                                            &success, errbuf, sizeof(errbuf))) {
+                success = auth_creds_check(request->pid, request->args.creds,
+                                           errbuf, sizeof(errbuf));
+                auth_cache_add_decision(request->pid, request->key,
+                                        success, errbuf);
+            }
             request->cb.func(success, errbuf, request->cb.data);
             destroy_request(request);
             break;
@@ -259,13 +282,16 @@ static gboolean idle_callback(gpointer data)
     return FALSE;
 }
 
-static void dbus_callback(pid_t *pid, char *err, void *data)
+static void dbus_callback(pid_t pid, char *err, void *data)
 {
     req_t *request = (req_t *)data;
 
     if (pid > 0) {
         request->pid = pid;
 
+        if (request->addr != NULL)
+            auth_cache_add_pid(request->addr, pid);
+
         authorize_request(request);
     }
     else {
@@ -28,6 +28,7 @@ USA.
 #include <dbus/dbus.h>
 
 #include "plugin.h"
+#include "auth-cache.h"
 #include "dbusif.h"
 
 typedef struct {
@@ -47,6 +48,14 @@ static void session_bus_init(const char *);
 static void session_bus_cleanup();
 
 static void pid_queried(DBusPendingCall *, void *);
+static DBusHandlerResult name_owner_changed(DBusConnection *, DBusMessage *,
+                                            void *);
+
+#define NAME_OWNER_MATCH                                        \
+    "type='signal',sender='" DBUS_ADMIN_SERVICE "',"            \
+    "interface='" DBUS_ADMIN_INTERFACE "',"                     \
+    "member='" DBUS_NAME_OWNER_CHANGED_SIGNAL "',"              \
+    "path='" DBUS_ADMIN_PATH "'"
 
 
 
@@ -65,6 +74,11 @@ void dbusif_init(OhmPlugin *plugin)
 void dbusif_exit(OhmPlugin *plugin)
 {
     (void)plugin;
+
+    if (sys_conn != NULL) {
+        dbus_connection_remove_filter(sys_conn, name_owner_changed, NULL);
+        dbus_bus_remove_match(sys_conn, NAME_OWNER_MATCH, NULL);
+    }
 }
 
 
@@ -202,6 +216,19 @@ static void system_bus_init(void)
             OHM_ERROR("Can't get system D-Bus connection");
         exit(1);
     }
+
+    /* cached address -> pid mappings are invalid once the owner changes */
+    if (!dbus_connection_add_filter(sys_conn, name_owner_changed, NULL,NULL))
+        OHM_ERROR("auth: failed to add D-Bus filter");
+    else {
+        dbus_bus_add_match(sys_conn, NAME_OWNER_MATCH, &err);
+
+        if (dbus_error_is_set(&err)) {
+            OHM_ERROR("auth: can't add match \"%s\": %s", NAME_OWNER_MATCH,
+                      err.message);
+            dbus_error_free(&err);
+        }
+    }
 }
     
 static void session_bus_init(const char *addr)
@@ -325,6 +352,34 @@ static void pid_queried(DBusPendingCall *pend, void *data)
 }
 
 
+static DBusHandlerResult name_owner_changed(DBusConnection *conn,
+                                            DBusMessage    *msg,
+                                            void           *data)
+{
+    char *name, *before, *after;
+
+    (void)conn;
+    (void)data;
+
+    if (dbus_message_is_signal(msg, DBUS_ADMIN_INTERFACE,
+                               DBUS_NAME_OWNER_CHANGED_SIGNAL) &&
+        dbus_message_get_args(msg, NULL,
+                              DBUS_TYPE_STRING, &name,
+                              DBUS_TYPE_STRING, &before,
+                              DBUS_TYPE_STRING, &after,
+                              DBUS_TYPE_INVALID)                &&
+        before[0] != '\0')
+    {
+        OHM_DEBUG(DBG_DBUS, "owner of %s changed ('%s' -> '%s')",
+                  name, before, after);
+
+        auth_cache_invalidate_addr(name);
+    }
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+
 /* 
  * Local Variables:
  * c-basic-offset: 4
@@ -39,6 +39,7 @@ typedef struct _OhmPlugin OhmPlugin;
 
 /* D-Bus signal & method names */
 #define DBUS_QUERY_PID_METHOD          "GetConnectionUnixProcessID"
+#define DBUS_NAME_OWNER_CHANGED_SIGNAL "NameOwnerChanged"
 
 
 void  dbusif_init(OhmPlugin *);
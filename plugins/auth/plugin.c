@@ -28,19 +28,23 @@ USA.
 #include "plugin.h"
 #include "auth-request.h"
 #include "auth-creds.h"
+#include "auth-cache.h"
 #include "dbusif.h"
 
 /* these is the manually equivalent of OHM_EXPORTABLE */
 static const char *OHM_VAR(auth_request,_SIGNATURE) =
     "int(char *id_type,void *id, char *req_type,void *req, "
          "auth_request_cb_t callback, void *data)";
+static const char *OHM_VAR(auth_cache_stats,_SIGNATURE) =
+    "char *(char *buf, int len)";
 
-int DBG_REQ, DBG_DBUS, DBG_CREDS;
+int DBG_REQ, DBG_DBUS, DBG_CREDS, DBG_CACHE;
 
 OHM_DEBUG_PLUGIN(auth,
     OHM_DEBUG_FLAG("request" , "authorization requests", &DBG_REQ   ),
     OHM_DEBUG_FLAG("dbus"    , "D-Bus queries"         , &DBG_DBUS  ),
-    OHM_DEBUG_FLAG("creds"   , "creds cheks"           , &DBG_CREDS )
+    OHM_DEBUG_FLAG("creds"   , "creds cheks"           , &DBG_CREDS ),
+    OHM_DEBUG_FLAG("cache"   , "decision cache"        , &DBG_CACHE )
 );
 
 
@@ -50,16 +54,18 @@ static void plugin_init(OhmPlugin *plugin)
 
     auth_request_init(plugin);
     auth_creds_init(plugin);
+    auth_cache_init(plugin);
     dbusif_init(plugin);
 
 #if 0
-    DBG_REQ = DBG_DBUS = DBG_CREDS = TRUE;
+    DBG_REQ = DBG_DBUS = DBG_CREDS = DBG_CACHE = TRUE;
 #endif
 }
 
 static void plugin_destroy(OhmPlugin *plugin)
 {
     dbusif_exit(plugin);
+    auth_cache_exit(plugin);
     auth_creds_exit(plugin);
     auth_request_exit(plugin);
 }
@@ -80,8 +86,9 @@ OHM_PLUGIN_PROVIDES(
     "maemo.auth"
 );
 
-OHM_PLUGIN_PROVIDES_METHODS(auth, 1,
-    OHM_EXPORT(auth_request, "request")
+OHM_PLUGIN_PROVIDES_METHODS(auth, 2,
+    OHM_EXPORT(auth_request    , "request"    ),
+    OHM_EXPORT(auth_cache_stats, "cache_stats")
 );
 
 /* 
@@ -36,7 +36,7 @@ USA.
 #define G_MODULE_EXPORT EXPORT
 #endif
 
-extern int DBG_REQ, DBG_DBUS, DBG_CREDS;
+extern int DBG_REQ, DBG_DBUS, DBG_CREDS, DBG_CACHE;
 
 
 /*
@@ -0,0 +1,557 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_auth_cache.c
+ * @brief authorization decision cache against mock creds and D-Bus
+ */
+
+#include <check.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <ohm/ohm-plugin.h>
+
+static const char *fake_get_param(OhmPlugin *, const char *);
+
+#define ohm_plugin_get_param(p,k) fake_get_param(p, k)
+
+#include "../auth-cache.c"
+#include "../auth-request.c"
+
+#define NCLIENT     8           /* clients in the benchmark */
+#define NREQUEST    20000       /* requests in the benchmark */
+
+int DBG_REQ, DBG_DBUS, DBG_CREDS, DBG_CACHE;
+
+static int          ncheck;     /* auth_creds_check calls */
+static int          nquery;     /* dbusif_pid_query calls */
+static int          ndone;      /* completed requests */
+static int          ngranted;
+static proc_start_t fake_start; /* start time of the fake process */
+static guint        fake_creds; /* credentials of the fake process */
+static ino_t        fake_exe;   /* executable of the fake process */
+static int          plugin;     /* stub plugin */
+static const char  *params[][2] = {
+    { "cache"             , "yes" },
+    { "cache-ttl"         , "30"  },
+    { "cache-negative-ttl", "2"   },
+    { NULL                , NULL  }
+};
+static int          bus[2];     /* socket pair to the fake bus daemon */
+static pid_t        daemon_pid;
+
+typedef struct {
+    dbusif_pid_query_cb_t  func;
+    void                  *data;
+} query_t;
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * mock credentials and D-Bus
+ */
+
+int auth_creds_check(pid_t pid, void *request, char *err, int len)
+{
+    char   path[64], buf[4096];
+    char **pattern = (char **)request;
+    FILE  *fp;
+    int    i;
+
+    ncheck++;
+
+    /* roughly what creds_gettask does: read the task status */
+    snprintf(path, sizeof(path), "/proc/%u/status", pid);
+    if ((fp = fopen(path, "r")) == NULL) {
+        snprintf(err, len, "Failed to read credentials for task (pid %u)",
+                 pid);
+        return FALSE;
+    }
+    while (fgets(buf, sizeof(buf), fp) != NULL)
+        ;
+    fclose(fp);
+
+    for (i = 0; pattern[i]; i++) {
+        if (!strcmp(pattern[i], "denied")) {
+            snprintf(err, len, "No matching credential for %s", pattern[i]);
+            return FALSE;
+        }
+    }
+
+    snprintf(err, len, "OK");
+    return TRUE;
+}
+
+char *auth_creds_request_dump(void *request, char *buf, int len)
+{
+    (void)request;
+
+    snprintf(buf, len, "...");
+
+    return buf;
+}
+
+static gboolean query_reply(gpointer data)
+{
+    query_t *query = (query_t *)data;
+
+    /* every client connection belongs to this process */
+    query->func(getpid(), "OK", query->data);
+    free(query);
+
+    return FALSE;
+}
+
+int dbusif_pid_query(char *bustype, char *addr, dbusif_pid_query_cb_t func,
+                     void *data)
+{
+    query_t *query = malloc(sizeof(*query));
+    pid_t    pid;
+
+    (void)bustype;
+    (void)addr;
+
+    nquery++;
+
+    /* a method call costs at least a round-trip to the bus daemon */
+    pid = getpid();
+    if (write(bus[0], &pid, sizeof(pid)) != sizeof(pid) ||
+        read(bus[0], &pid, sizeof(pid)) != sizeof(pid))
+        return EIO;
+
+    query->func = func;
+    query->data = data;
+    g_idle_add(query_reply, query);
+
+    return 0;
+}
+
+static proc_start_t fake_start_time(pid_t pid)
+{
+    (void)pid;
+
+    return fake_start;
+}
+
+static guint fake_creds_hash(pid_t pid)
+{
+    (void)pid;
+
+    return fake_creds;
+}
+
+static proc_exe_t fake_exe_id(pid_t pid)
+{
+    proc_exe_t exe = { 1, fake_exe };
+
+    (void)pid;
+
+    return exe;
+}
+
+static const char *fake_get_param(OhmPlugin *p, const char *key)
+{
+    int i;
+
+    fail_unless(p == (OhmPlugin *)&plugin, "parameter of unknown plugin");
+
+    for (i = 0; params[i][0] != NULL; i++)
+        if (!strcmp(params[i][0], key))
+            return params[i][1];
+
+    return NULL;
+}
+
+
+/*
+ * helpers
+ */
+
+static int request_done(int success, char *err, void *data)
+{
+    (void)err;
+    (void)data;
+
+    ndone++;
+    if (success)
+        ngranted++;
+
+    return TRUE;
+}
+
+static void start_bus_daemon(void)
+{
+    pid_t pid;
+
+    fail_if(socketpair(AF_UNIX, SOCK_STREAM, 0, bus) < 0, "socketpair failed");
+
+    if ((daemon_pid = fork()) == 0) {
+        close(bus[0]);
+        while (read(bus[1], &pid, sizeof(pid)) == sizeof(pid))
+            if (write(bus[1], &pid, sizeof(pid)) != sizeof(pid))
+                break;
+        _exit(0);
+    }
+
+    close(bus[1]);
+}
+
+static void stop_bus_daemon(void)
+{
+    close(bus[0]);
+    waitpid(daemon_pid, NULL, 0);
+}
+
+static void run_mainloop(void)
+{
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+}
+
+static double benchmark(int cache, int *granted)
+{
+    static char *creds[][3] = {
+        { "GRP::pulse-access", NULL         , NULL },
+        { "GRP::video"       , "GRP::audio" , NULL },
+        { "denied"           , NULL         , NULL },
+        { "tcb"              , NULL         , NULL },
+    };
+
+#define NCREDS (sizeof(creds) / sizeof(creds[0]))
+
+    struct timeval start, end;
+    char           addr[NCLIENT][16];
+    int            i;
+    double         s;
+
+    enabled = cache;
+    ncheck = nquery = ndone = ngranted = 0;
+
+    for (i = 0; i < NCLIENT; i++)
+        snprintf(addr[i], sizeof(addr[i]), ":1.%d", 100 + i);
+
+    gettimeofday(&start, NULL);
+
+    for (i = 0; i < NREQUEST; i++) {
+        auth_request("dbus", addr[i % NCLIENT], "creds",
+                     creds[(i / NCLIENT) % NCREDS], request_done, NULL);
+        run_mainloop();
+    }
+
+    gettimeofday(&end, NULL);
+
+    s = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+
+    fail_unless(ndone == NREQUEST, "%d requests of %d completed",
+                ndone, NREQUEST);
+
+    *granted = ngranted;
+
+    return NREQUEST / s;
+
+#undef NCREDS
+}
+
+static void setup(void)
+{
+    auth_cache_init((OhmPlugin *)&plugin);
+
+    memset(&stats, 0, sizeof(stats));
+    enabled    = TRUE;
+    ttl        = CACHE_TTL;
+    neg_ttl    = CACHE_NEGATIVE_TTL;
+    start_time = fake_start_time;
+    creds_hash = fake_creds_hash;
+    exe_id     = fake_exe_id;
+    fake_start = 1000;
+    fake_creds = 1;
+    fake_exe   = 100;
+}
+
+static void teardown(void)
+{
+    auth_cache_exit((OhmPlugin *)&plugin);
+    start_time = read_start_time;
+    creds_hash = read_creds_hash;
+    exe_id     = read_exe_id;
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_auth_cache_pid_reuse)
+{
+    char err[128];
+    int  success;
+    pid_t pid;
+
+    auth_cache_add_decision(1234, "GRP::video", TRUE, "OK");
+    auth_cache_add_pid(":1.42", 1234);
+
+    fail_unless(auth_cache_lookup_decision(1234, "GRP::video", &success,
+                                           err, sizeof(err)) && success,
+                "cached decision not found");
+    fail_unless(auth_cache_lookup_pid(":1.42", &pid) && pid == 1234,
+                "cached pid not found");
+
+    /* the process exits and a new one gets the same pid */
+    fake_start = 2000;
+
+    fail_if(auth_cache_lookup_decision(1234, "GRP::video", &success,
+                                       err, sizeof(err)),
+            "decision of a dead process used for its pid successor");
+    fail_if(auth_cache_lookup_pid(":1.42", &pid),
+            "pid of a dead process returned");
+    fail_unless(stats.reused == 1, "%u pid reuses detected", stats.reused);
+
+    /* the process is gone without a successor */
+    auth_cache_add_decision(1234, "GRP::video", TRUE, "OK");
+    fake_start = 0;
+
+    fail_if(auth_cache_lookup_decision(1234, "GRP::video", &success,
+                                       err, sizeof(err)),
+            "decision of a dead process used");
+}
+END_TEST
+
+START_TEST (test_auth_cache_creds_change)
+{
+    char err[128];
+    int  success;
+
+    auth_cache_add_decision(1234, "GRP::video", TRUE, "OK");
+
+    fail_unless(auth_cache_lookup_decision(1234, "GRP::video", &success,
+                                           err, sizeof(err)) && success,
+                "cached decision not found");
+
+    /* the process drops its privileges */
+    fake_creds = 2;
+
+    fail_if(auth_cache_lookup_decision(1234, "GRP::video", &success,
+                                       err, sizeof(err)),
+            "decision used after a credential change");
+    fail_unless(stats.changed == 1 && stats.reused == 0,
+                "%u credential changes, %u pid reuses",
+                stats.changed, stats.reused);
+
+    /* decisions made with the new credentials are cached again */
+    auth_cache_add_decision(1234, "GRP::video", FALSE,
+                            "No matching credential");
+
+    fail_unless(auth_cache_lookup_decision(1234, "GRP::video", &success,
+                                           err, sizeof(err)) && !success,
+                "decision for the new credentials not cached");
+}
+END_TEST
+
+START_TEST (test_auth_cache_exec)
+{
+    char err[128];
+    int  success;
+
+    auth_cache_add_decision(1234, "GRP::video", TRUE, "OK");
+
+    fail_unless(auth_cache_lookup_decision(1234, "GRP::video", &success,
+                                           err, sizeof(err)) && success,
+                "cached decision not found");
+
+    /* same pid, start time and ids, but another binary */
+    fake_exe = 200;
+
+    fail_if(auth_cache_lookup_decision(1234, "GRP::video", &success,
+                                       err, sizeof(err)),
+            "decision used after an exec");
+    fail_unless(stats.execs == 1 && stats.changed == 0 && stats.reused == 0,
+                "%u execs, %u credential changes, %u pid reuses",
+                stats.execs, stats.changed, stats.reused);
+
+    /* decisions made for the new binary are cached again */
+    auth_cache_add_decision(1234, "GRP::video", FALSE,
+                            "No matching credential");
+
+    fail_unless(auth_cache_lookup_decision(1234, "GRP::video", &success,
+                                           err, sizeof(err)) && !success,
+                "decision for the new binary not cached");
+}
+END_TEST
+
+START_TEST (test_auth_cache_params)
+{
+    /* setup overrides these, parse them again */
+    auth_cache_exit((OhmPlugin *)&plugin);
+    auth_cache_init((OhmPlugin *)&plugin);
+
+    fail_unless(enabled && ttl == 30 && neg_ttl == 2,
+                "cache %d, ttl %d, negative ttl %d", enabled, ttl, neg_ttl);
+
+    params[1][1] = "bogus";
+    auth_cache_exit((OhmPlugin *)&plugin);
+    auth_cache_init((OhmPlugin *)&plugin);
+    params[1][1] = "30";
+
+    fail_unless(ttl == CACHE_TTL, "invalid ttl accepted: %d", ttl);
+}
+END_TEST
+
+START_TEST (test_auth_cache_negative_ttl)
+{
+    char err[128];
+    int  success;
+
+    neg_ttl = 0;
+
+    auth_cache_add_decision(1234, "GRP::video", TRUE, "OK");
+    auth_cache_add_decision(1234, "denied", FALSE, "No matching credential");
+
+    fail_unless(auth_cache_lookup_decision(1234, "GRP::video", &success,
+                                           err, sizeof(err)) && success,
+                "positive decision not cached");
+    fail_if(auth_cache_lookup_decision(1234, "denied", &success,
+                                       err, sizeof(err)),
+            "denial outlived its ttl");
+    fail_unless(stats.expired == 1, "%u expired", stats.expired);
+
+    neg_ttl = CACHE_NEGATIVE_TTL;
+    auth_cache_add_decision(1234, "denied", FALSE, "No matching credential");
+
+    fail_unless(auth_cache_lookup_decision(1234, "denied", &success,
+                                           err, sizeof(err)) && !success,
+                "denial not cached");
+    fail_if(strcmp(err, "No matching credential"), "error '%s'", err);
+}
+END_TEST
+
+START_TEST (test_auth_cache_name_owner_changed)
+{
+    char  err[128];
+    int   success;
+    pid_t pid;
+
+    auth_cache_add_pid(":1.42", 1234);
+    auth_cache_add_decision(1234, "GRP::video", TRUE, "OK");
+
+    auth_cache_invalidate_addr(":1.42");
+
+    fail_if(auth_cache_lookup_pid(":1.42", &pid), "stale address mapping");
+    fail_if(auth_cache_lookup_decision(1234, "GRP::video", &success,
+                                       err, sizeof(err)),
+            "stale decision");
+    fail_unless(stats.invalidated == 1, "%u invalidations",
+                stats.invalidated);
+}
+END_TEST
+
+START_TEST (test_auth_cache_benchmark)
+{
+    double uncached, cached;
+    int    granted_uncached, granted_cached;
+    char   buf[256];
+
+    start_time = read_start_time;
+    creds_hash = read_creds_hash;
+    exe_id     = read_exe_id;
+    start_bus_daemon();
+
+    uncached = benchmark(FALSE, &granted_uncached);
+    fail_unless(ncheck == NREQUEST && nquery == NREQUEST,
+                "%d creds checks, %d pid queries without cache",
+                ncheck, nquery);
+
+    cached = benchmark(TRUE, &granted_cached);
+    fail_unless(granted_cached == granted_uncached,
+                "%d requests granted with cache, %d without",
+                granted_cached, granted_uncached);
+    fail_unless(nquery == NCLIENT, "%d pid queries with cache", nquery);
+    fail_unless(ncheck < NREQUEST / 100, "%d creds checks with cache",
+                ncheck);
+
+    stop_bus_daemon();
+
+    printf("%d requests: %.0f/s without cache, %.0f/s with cache\n",
+           NREQUEST, uncached, cached);
+    printf("cache %s\n", auth_cache_stats(buf, sizeof(buf)));
+}
+END_TEST
+
+Suite *ohm_auth_cache_suite(void)
+{
+    Suite *suite = suite_create("ohm_auth_cache");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_auth_cache_pid_reuse);
+    tcase_add_test(tc_all, test_auth_cache_creds_change);
+    tcase_add_test(tc_all, test_auth_cache_exec);
+    tcase_add_test(tc_all, test_auth_cache_params);
+    tcase_add_test(tc_all, test_auth_cache_negative_ttl);
+    tcase_add_test(tc_all, test_auth_cache_name_owner_changed);
+    tcase_add_test(tc_all, test_auth_cache_benchmark);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_auth_cache_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
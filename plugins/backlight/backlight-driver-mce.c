@@ -32,6 +32,14 @@ static void  cache_destroy(void);
 static pid_t cache_lookup(const char *);
 static int   cache_insert(const char *, pid_t);
 static void  cache_delete(const char *);
+static void  decision_cache_init(OhmPlugin *);
+static void  decision_cache_exit(void);
+static int   decision_lookup(pid_t, const char *, const char *, const char *,
+                             int *);
+static void  decision_insert(pid_t, const char *, const char *, const char *,
+                             int);
+static int   resolve_request(backlight_context_t *, char *, char *, char *,
+                             int *);
 
 int  backlight_request(backlight_context_t *, pid_t, DBusMessage *);
 void continue_request(DBusPendingCall *, void *);
@@ -49,8 +57,6 @@ mce_init(backlight_context_t *ctx, OhmPlugin *plugin)
 {
     GSList *facts;
     
-    (void)plugin;
-    
     facts = ohm_fact_store_get_facts_by_name(ctx->store, "backlight");
     
     if (facts == NULL || g_slist_length(facts) != 1) {
@@ -61,6 +67,7 @@ mce_init(backlight_context_t *ctx, OhmPlugin *plugin)
         ctx->fact = (OhmFact *)facts->data;
 
     cache_create();
+    decision_cache_init(plugin);
     bus_init();
 }
 
@@ -74,6 +81,7 @@ mce_exit(backlight_context_t *ctx)
     ctx->fact = NULL;
     
     bus_exit();
+    decision_cache_exit();
     cache_destroy();
 }
 
@@ -253,10 +261,7 @@ backlight_request(backlight_context_t *ctx, pid_t pid, DBusMessage *req)
 {
     const char          *member;
     char                *request, *group, *binary;
-    char                *vars[3*2 + 1];
-    GValue              *field;
-    const char          *action;
-    int                  i, decision;
+    int                  decision;
 
     member = dbus_message_get_member(req);
     if      (!strcmp(member, MCE_DISPLAY_ON_REQ))    request = "on";
@@ -273,27 +278,11 @@ backlight_request(backlight_context_t *ctx, pid_t pid, DBusMessage *req)
     OHM_DEBUG(DBG_REQUEST, "%s request for {%u, %s:%s}", request,
               pid, group, binary);
     
-    vars[i=0] = "request";
-    vars[++i] = request;
-    vars[++i] = "group";
-    vars[++i] = group;
-    vars[++i] = "binary";
-    vars[++i] = binary;
-    vars[++i] = NULL;
-
     ep_disable();
-    
-    if (ctx->resolve("backlight_request", vars) <= 0)              /* failure */
-        decision = TRUE;
-    else {
-        field = ohm_fact_get(ctx->fact, "state");
-        
-        if (field == NULL || G_VALUE_TYPE(field) != G_TYPE_STRING)     /* ??? */
-            decision = TRUE;
-        else {
-            action   = g_value_get_string(field);
-            decision = !strcmp(action, request);
-        }
+
+    if (!decision_lookup(pid, request, group, binary, &decision)) {
+        if (resolve_request(ctx, request, group, binary, &decision))
+            decision_insert(pid, request, group, binary, decision);
     }
     
     mce_send_reply(req, decision);
@@ -572,6 +561,308 @@ cache_delete(const char *client)
 }
 
 
+/*****************************************************************************
+ *                   *** backlight request decision cache ***                *
+ *****************************************************************************/
+
+/*
+ * MCE clients tend to send bursts of identical requests. The outcome of
+ * backlight_request only depends on the request, the client and the state
+ * of the policy, so we remember the decision per client pid and request
+ * and reuse it until a fact changes in the factstore (or one of the facts
+ * listed in decision-cache-facts, if given). Our own resolves change the
+ * policy state too, so a decision is stamped with the version of the state
+ * its resolve left behind. It is reused only while the policy stays in that
+ * state; any later change, including one made by resolving another request,
+ * invalidates it.
+ */
+
+#define DECISION_CACHE_MAX 64                 /* flush everything beyond this */
+
+typedef struct {
+    char         *group;                      /* group of the client */
+    char         *binary;                     /* binary of the client */
+    unsigned int  version;                    /* policy version of decision */
+    int           decision;                   /* granted or denied */
+} decision_t;
+
+static struct {
+    GHashTable   *entries;                    /* pid:request -> decision_t */
+    GHashTable   *facts;                      /* facts to watch, or NULL */
+    unsigned int  version;                    /* policy state version */
+    OhmFactStore *fs;
+    gulong        inserted;
+    gulong        removed;
+    gulong        updated;
+    unsigned int  hit;
+    unsigned int  miss;
+    unsigned int  stale;
+} decisions;
+
+
+/********************
+ * free_decision
+ ********************/
+static void
+free_decision(gpointer data)
+{
+    decision_t *d = (decision_t *)data;
+
+    if (d != NULL) {
+        FREE(d->group);
+        FREE(d->binary);
+        FREE(d);
+    }
+}
+
+
+/********************
+ * policy_changed
+ ********************/
+static void
+policy_changed(OhmFact *fact)
+{
+    const char *name;
+
+    if (fact == NULL)
+        return;
+
+    name = ohm_structure_get_name(OHM_STRUCTURE(fact));
+
+    if (decisions.facts == NULL || g_hash_table_lookup(decisions.facts, name)) {
+        OHM_DEBUG(DBG_REQUEST, "%s changed, invalidating decisions", name);
+        decisions.version++;
+    }
+}
+
+
+/********************
+ * fact_inserted_cb
+ ********************/
+static void
+fact_inserted_cb(void *data, OhmFact *fact, gpointer user_data)
+{
+    (void)data;
+    (void)user_data;
+
+    policy_changed(fact);
+}
+
+
+/********************
+ * fact_removed_cb
+ ********************/
+static void
+fact_removed_cb(void *data, OhmFact *fact, gpointer user_data)
+{
+    (void)data;
+    (void)user_data;
+
+    policy_changed(fact);
+}
+
+
+/********************
+ * fact_updated_cb
+ ********************/
+static void
+fact_updated_cb(void *data, OhmFact *fact, GQuark field, gpointer value,
+                gpointer user_data)
+{
+    (void)data;
+    (void)field;
+    (void)value;
+    (void)user_data;
+
+    policy_changed(fact);
+}
+
+
+/********************
+ * decision_cache_init
+ ********************/
+static void
+decision_cache_init(OhmPlugin *plugin)
+{
+    const char *enabled, *facts;
+    char       *list, *name, *save;
+
+    enabled = ohm_plugin_get_param(plugin, "decision-cache");
+    facts   = ohm_plugin_get_param(plugin, "decision-cache-facts");
+
+    if (enabled != NULL && strcmp(enabled, "yes")) {
+        OHM_INFO("backlight: decision cache is disabled");
+        return;
+    }
+
+    decisions.entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              g_free, free_decision);
+
+    if (facts != NULL && (list = STRDUP(facts)) != NULL) {
+        decisions.facts = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                g_free, NULL);
+
+        for (name = strtok_r(list, " ,", &save);
+             name != NULL;
+             name = strtok_r(NULL, " ,", &save))
+        {
+            g_hash_table_insert(decisions.facts, g_strdup(name),
+                                GINT_TO_POINTER(TRUE));
+        }
+
+        FREE(list);
+    }
+
+    decisions.fs       = ohm_fact_store_get_fact_store();
+    decisions.inserted = g_signal_connect(G_OBJECT(decisions.fs), "inserted",
+                                          G_CALLBACK(fact_inserted_cb), NULL);
+    decisions.removed  = g_signal_connect(G_OBJECT(decisions.fs), "removed",
+                                          G_CALLBACK(fact_removed_cb), NULL);
+    decisions.updated  = g_signal_connect(G_OBJECT(decisions.fs), "updated",
+                                          G_CALLBACK(fact_updated_cb), NULL);
+
+    OHM_INFO("backlight: decisions are cached until %s changes",
+             decisions.facts ? facts : "the factstore");
+}
+
+
+/********************
+ * decision_cache_exit
+ ********************/
+static void
+decision_cache_exit(void)
+{
+    if (decisions.entries == NULL)
+        return;
+
+    g_signal_handler_disconnect(G_OBJECT(decisions.fs), decisions.inserted);
+    g_signal_handler_disconnect(G_OBJECT(decisions.fs), decisions.removed);
+    g_signal_handler_disconnect(G_OBJECT(decisions.fs), decisions.updated);
+
+    OHM_INFO("backlight: decision cache: %u hits, %u misses (%u stale)",
+             decisions.hit, decisions.miss, decisions.stale);
+
+    g_hash_table_destroy(decisions.entries);
+
+    if (decisions.facts != NULL)
+        g_hash_table_destroy(decisions.facts);
+
+    memset(&decisions, 0, sizeof(decisions));
+}
+
+
+/********************
+ * decision_lookup
+ ********************/
+static int
+decision_lookup(pid_t pid, const char *request, const char *group,
+                const char *binary, int *decision)
+{
+    decision_t *d;
+    char        key[64];
+
+    if (decisions.entries == NULL)
+        return FALSE;
+
+    snprintf(key, sizeof(key), "%u:%s", pid, request);
+
+    if ((d = g_hash_table_lookup(decisions.entries, key)) != NULL) {
+        if (d->version == decisions.version &&
+            !strcmp(d->group , group  ? group  : "") &&
+            !strcmp(d->binary, binary ? binary : "")) {
+            OHM_DEBUG(DBG_REQUEST, "%s request of %u %s (cached)", request,
+                      pid, d->decision ? "granted" : "denied");
+
+            *decision = d->decision;
+            decisions.hit++;
+
+            return TRUE;
+        }
+
+        decisions.stale++;
+    }
+
+    decisions.miss++;
+
+    return FALSE;
+}
+
+
+/********************
+ * decision_insert
+ ********************/
+static void
+decision_insert(pid_t pid, const char *request, const char *group,
+                const char *binary, int decision)
+{
+    decision_t *d;
+    char        key[64];
+
+    if (decisions.entries == NULL)
+        return;
+
+    if (g_hash_table_size(decisions.entries) >= DECISION_CACHE_MAX)
+        g_hash_table_remove_all(decisions.entries);
+
+    if (ALLOC_OBJ(d) == NULL)
+        return;
+
+    d->group    = STRDUP(group);
+    d->binary   = STRDUP(binary);
+    d->version  = decisions.version;          /* after the resolve */
+    d->decision = decision;
+
+    if (d->group == NULL || d->binary == NULL) {
+        free_decision(d);
+        return;
+    }
+
+    snprintf(key, sizeof(key), "%u:%s", pid, request);
+    g_hash_table_replace(decisions.entries, g_strdup(key), d);
+}
+
+
+/********************
+ * resolve_request
+ ********************/
+static int
+resolve_request(backlight_context_t *ctx, char *request, char *group,
+                char *binary, int *decision)
+{
+    char       *vars[3*2 + 1];
+    GValue     *field;
+    const char *action;
+    int         i, status;
+
+    vars[i=0] = "request";
+    vars[++i] = request;
+    vars[++i] = "group";
+    vars[++i] = group;
+    vars[++i] = "binary";
+    vars[++i] = binary;
+    vars[++i] = NULL;
+
+    status = ctx->resolve("backlight_request", vars);
+
+    if (status <= 0) {                                            /* failure */
+        *decision = TRUE;
+        return FALSE;
+    }
+
+    field = ohm_fact_get(ctx->fact, "state");
+
+    if (field == NULL || G_VALUE_TYPE(field) != G_TYPE_STRING) {     /* ??? */
+        *decision = TRUE;
+        return FALSE;
+    }
+
+    action    = g_value_get_string(field);
+    *decision = !strcmp(action, request);
+
+    return TRUE;
+}
+
+
 /*
  * Local Variables:
  * c-basic-offset: 4
@@ -0,0 +1,403 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_backlight_cache.c
+ * @brief MCE display request decision cache against a fake MCE client
+ */
+
+#include <check.h>
+
+#include <dbus/dbus.h>
+
+/* capture the replies instead of sending them */
+static dbus_bool_t fake_send(DBusConnection *, DBusMessage *, dbus_uint32_t *);
+#define dbus_connection_send fake_send
+
+#include "../backlight-driver-mce.c"
+
+#undef dbus_connection_send
+
+#define NREQUEST  3000                  /* requests in the burst test */
+#define BURST     50                    /* identical requests in a row */
+#define NCLIENT   (sizeof(clients) / sizeof(clients[0]))
+#define CALL_FACT "com.nokia.policy.call"
+
+int DBG_ACTION, DBG_REQUEST;
+
+static struct {
+    const char *address;                /* D-Bus address */
+    pid_t       pid;
+    char       *group;
+    char       *binary;
+} clients[] = {
+    { ":1.10", 1010, "player" , "mediaplayer" },
+    { ":1.11", 1011, "browser", "browser"     },
+    { ":1.12", 1012, "camera" , "camera-ui"   },
+};
+
+static const char *members[] = {
+    MCE_DISPLAY_ON_REQ,
+    MCE_DISPLAY_DIM_REQ,
+    MCE_PREVENT_BLANK_REQ,
+    MCE_DISPLAY_OFF_REQ,
+};
+
+static backlight_context_t  ctx;
+static OhmFactStore        *fs;
+static OhmFact             *call_fact;
+static int                  nresolve;  /* resolves by the fake policy */
+static int                  nreply;    /* replies sent to the client */
+static int                  reply;     /* last decision sent */
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * mock policy, cgroups, EP and D-Bus
+ */
+
+void ep_disable(void) {}
+void ep_enable(void)  {}
+
+static dbus_bool_t fake_send(DBusConnection *conn, DBusMessage *msg,
+                             dbus_uint32_t *serial)
+{
+    dbus_bool_t allow;
+
+    (void)conn;
+    (void)serial;
+
+    fail_unless(dbus_message_get_args(msg, NULL,
+                                      DBUS_TYPE_BOOLEAN, &allow,
+                                      DBUS_TYPE_INVALID),
+                "malformed reply");
+    reply = allow;
+    nreply++;
+
+    return TRUE;
+}
+
+static int fake_process_info(pid_t pid, char **group, char **binary)
+{
+    unsigned int i;
+
+    for (i = 0; i < NCLIENT; i++) {
+        if (clients[i].pid == pid) {
+            *group  = clients[i].group;
+            *binary = clients[i].binary;
+            return TRUE;
+        }
+    }
+
+    *group = *binary = "<unknown>";
+    return FALSE;
+}
+
+static int call_active(void)
+{
+    GValue *value = ohm_fact_get(call_fact, "state");
+
+    return value != NULL && g_value_get_int(value);
+}
+
+static const char *backlight_state(void)
+{
+    GValue *value = ohm_fact_get(ctx.fact, "state");
+
+    return value != NULL ? g_value_get_string(value) : "";
+}
+
+/*
+ * The player may do anything, the browser may not keep the display on
+ * and nobody but the camera may turn it off during a call. A blanked
+ * display cannot be dimmed. Like the real rule the decision ends up in
+ * the state field of the backlight fact, which is the state the next
+ * decision depends on.
+ */
+static int fake_resolve(char *goal, char **vars)
+{
+    const char *request = NULL, *group = NULL, *current, *state;
+    int         i;
+
+    fail_if(strcmp(goal, "backlight_request"), "unexpected goal %s", goal);
+
+    for (i = 0; vars[i] != NULL; i += 2) {
+        if (!strcmp(vars[i], "request"))
+            request = vars[i + 1];
+        else if (!strcmp(vars[i], "group"))
+            group = vars[i + 1];
+    }
+
+    nresolve++;
+    current = backlight_state();
+
+    if (!strcmp(group, "browser") && !strcmp(request, "keepon"))
+        state = "on";
+    else if (call_active() && !strcmp(request, "off") &&
+             strcmp(group, "camera"))
+        state = "dim";
+    else if (!strcmp(current, "off") && !strcmp(request, "dim"))
+        state = "off";
+    else
+        state = request;
+
+    ohm_fact_set(ctx.fact, "state", ohm_value_from_string(state));
+
+    return 1;
+}
+
+
+/*
+ * fake MCE client
+ */
+
+static int display_request(int client, const char *member)
+{
+    static dbus_uint32_t serial;
+
+    DBusMessage *msg;
+    const char  *address = clients[client].address;
+    int          n;
+
+    msg = dbus_message_new_method_call(POLICY_INTERFACE, POLICY_PATH,
+                                       POLICY_INTERFACE, member);
+    fail_if(msg == NULL, "failed to create request");
+    dbus_message_set_serial(msg, ++serial);
+    fail_unless(dbus_message_append_args(msg,
+                                         DBUS_TYPE_STRING, &address,
+                                         DBUS_TYPE_INVALID),
+                "failed to create request");
+
+    n = nreply;
+    mce_display_req(NULL, msg, &ctx);
+    dbus_message_unref(msg);
+
+    fail_unless(nreply == n + 1, "request not replied");
+
+    return reply;
+}
+
+static void set_call(int active)
+{
+    ohm_fact_set(call_fact, "state", ohm_value_from_int(active));
+}
+
+static int run(int cache, int *decisions)
+{
+    int i, client, member;
+
+    decision_cache_exit();
+    if (cache)
+        decision_cache_init(NULL);
+
+    set_call(FALSE);
+    ohm_fact_set(ctx.fact, "state", ohm_value_from_string("on"));
+    nresolve = 0;
+
+    for (i = 0; i < NREQUEST; i++) {
+        /* the policy changes every now and then */
+        if (i % 700 == 0)
+            set_call((i / 700) & 1);
+
+        client = (i / BURST) % NCLIENT;
+        member = (i / (BURST * NCLIENT)) % 4;
+
+        decisions[i] = display_request(client, members[member]);
+    }
+
+    return nresolve;
+}
+
+static void setup(void)
+{
+    unsigned int i;
+
+    g_type_init();
+
+    fs = ohm_fact_store_get_fact_store();
+
+    ctx.fact  = ohm_fact_new("backlight");
+    call_fact = ohm_fact_new(CALL_FACT);
+    ohm_fact_store_insert(fs, ctx.fact);
+    ohm_fact_store_insert(fs, call_fact);
+
+    nresolve = 0;
+
+    ctx.resolve      = fake_resolve;
+    ctx.process_info = fake_process_info;
+
+    cache_create();
+    for (i = 0; i < NCLIENT; i++)
+        cache_insert(clients[i].address, clients[i].pid);
+
+    decision_cache_init(NULL);
+}
+
+static void teardown(void)
+{
+    decision_cache_exit();
+    cache_destroy();
+
+    ohm_fact_store_remove(fs, ctx.fact);
+    ohm_fact_store_remove(fs, call_fact);
+    g_object_unref(ctx.fact);
+    g_object_unref(call_fact);
+
+    FREE(ctx.state);
+    memset(&ctx, 0, sizeof(ctx));
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_backlight_cache_burst)
+{
+    static int uncached[NREQUEST], cached[NREQUEST];
+
+    int nuncached, ncached, i;
+
+    nuncached = run(FALSE, uncached);
+    ncached   = run(TRUE , cached);
+
+    for (i = 0; i < NREQUEST; i++)
+        fail_unless(cached[i] == uncached[i],
+                    "request #%d: %s with cache, %s without", i,
+                    cached[i] ? "granted" : "denied",
+                    uncached[i] ? "granted" : "denied");
+
+    printf("%d requests: %d resolves without cache (%.2f/request), "
+           "%d with cache (%.3f/request), %u hits, %u misses\n",
+           NREQUEST, nuncached, (double)nuncached / NREQUEST,
+           ncached, (double)ncached / NREQUEST,
+           decisions.hit, decisions.miss);
+
+    fail_unless(nuncached == NREQUEST, "%d resolves without cache",
+                nuncached);
+    fail_unless(ncached <= NREQUEST / BURST + NREQUEST / 700 + 1,
+                "%d resolves with cache", ncached);
+}
+END_TEST
+
+START_TEST (test_backlight_cache_own_resolve)
+{
+    /* the player dims the display and the decision is cached */
+    fail_unless(display_request(0, MCE_DISPLAY_ON_REQ), "on denied");
+    fail_unless(display_request(0, MCE_DISPLAY_DIM_REQ), "dim denied");
+    fail_unless(display_request(0, MCE_DISPLAY_DIM_REQ), "dim denied");
+    fail_unless(nresolve == 2, "%d resolves", nresolve);
+
+    /* a resolve of ours blanks the display... */
+    fail_unless(display_request(0, MCE_DISPLAY_OFF_REQ), "off denied");
+    fail_unless(nresolve == 3, "%d resolves", nresolve);
+
+    /* ...which the cached dim decision did not take into account */
+    fail_if(display_request(0, MCE_DISPLAY_DIM_REQ),
+            "stale decision used after our own resolve changed the state");
+    fail_unless(nresolve == 4, "%d resolves", nresolve);
+
+    /* the outcome of the last resolve is cached again */
+    fail_if(display_request(0, MCE_DISPLAY_DIM_REQ), "dim granted");
+    fail_unless(nresolve == 4, "%d resolves", nresolve);
+}
+END_TEST
+
+START_TEST (test_backlight_cache_invalidation)
+{
+    /* the browser may not turn the display off during a call */
+    set_call(FALSE);
+    fail_unless(display_request(1, MCE_DISPLAY_OFF_REQ), "off denied");
+    fail_unless(display_request(1, MCE_DISPLAY_OFF_REQ), "off denied");
+    fail_unless(nresolve == 1, "%d resolves", nresolve);
+
+    set_call(TRUE);
+    fail_if(display_request(1, MCE_DISPLAY_OFF_REQ),
+            "stale decision used after a policy change");
+    fail_unless(nresolve == 2, "%d resolves", nresolve);
+
+    /* the state left by our own resolve does not invalidate the decision */
+    fail_if(display_request(1, MCE_DISPLAY_OFF_REQ), "off granted");
+    fail_unless(nresolve == 2, "%d resolves", nresolve);
+
+    /* the pid now belongs to another group */
+    clients[1].group = "camera";
+    fail_unless(display_request(1, MCE_DISPLAY_OFF_REQ),
+                "decision of the old group used");
+    fail_unless(nresolve == 3, "%d resolves", nresolve);
+    clients[1].group = "browser";
+}
+END_TEST
+
+Suite *ohm_backlight_cache_suite(void)
+{
+    Suite *suite = suite_create("ohm_backlight_cache");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_backlight_cache_burst);
+    tcase_add_test(tc_all, test_backlight_cache_invalidation);
+    tcase_add_test(tc_all, test_backlight_cache_own_resolve);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_backlight_cache_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -20,14 +20,21 @@ USA.
 
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 
 #include "cgrp-plugin.h"
+#include "cgrp-apptrack.h"
+
+#define APPTRACK_BURST_TIMEOUT 100              /* msec */
 
 
 static gboolean socket_cb(GIOChannel *, GIOCondition, gpointer);
+static void     burst_end(cgrp_context_t *);
 
 static void schedule_update(void *, OhmFact *, GQuark, gpointer, gpointer);
 static gboolean apptrack_update(gpointer);
@@ -175,6 +182,17 @@ apptrack_exit(cgrp_context_t *ctx)
         close(ctx->apptrack_sock);
         ctx->apptrack_sock = -1;
 
+        if (ctx->apptrack_timer) {
+            g_source_remove(ctx->apptrack_timer);
+            ctx->apptrack_timer = 0;
+        }
+
+        FREE(ctx->apptrack_buf);
+        ctx->apptrack_buf     = NULL;
+        ctx->apptrack_size    = 0;
+        ctx->apptrack_pending = 0;
+        ctx->apptrack_more    = FALSE;
+
         if (ctx->apptrack_src) {
             g_source_remove(ctx->apptrack_src);
             ctx->apptrack_src = 0;
@@ -386,6 +404,220 @@ schedule_update(void *whatever,
 }
 
 
+/********************
+ * burst_apply
+ ********************/
+static void
+burst_apply(cgrp_context_t *ctx, pid_t pid, char *state)
+{
+    if (ctx->apptrack_pending++ == 0)
+        ctx->apptrack_group = ctx->active_group;
+
+    process_update_state(ctx, proc_hash_lookup(ctx, pid), state);
+}
+
+
+/********************
+ * burst_end
+ ********************/
+static void
+burst_end(cgrp_context_t *ctx)
+{
+    if (ctx->apptrack_timer != 0) {
+        g_source_remove(ctx->apptrack_timer);
+        ctx->apptrack_timer = 0;
+    }
+
+    ctx->apptrack_more = FALSE;
+
+    if (ctx->apptrack_pending == 0)
+        return;
+
+    OHM_DEBUG(DBG_NOTIFY, "applied %d active/standby notifications",
+              ctx->apptrack_pending);
+
+    ctx->apptrack_pending = 0;
+
+    apptrack_notify(ctx, ctx->active_process);
+
+    if (ctx->apptrack_group != ctx->active_group)
+        apptrack_cgroup_notify(ctx, ctx->active_group, NULL);
+
+    ctx->apptrack_group = NULL;
+}
+
+
+/********************
+ * burst_timeout
+ ********************/
+static gboolean
+burst_timeout(gpointer data)
+{
+    cgrp_context_t *ctx = (cgrp_context_t *)data;
+
+    OHM_WARNING("cgrp: incomplete application notification burst");
+
+    ctx->apptrack_timer = 0;
+    burst_end(ctx);
+
+    return FALSE;
+}
+
+
+/********************
+ * parse_text
+ ********************/
+static int
+parse_text(cgrp_context_t *ctx, char *buf)
+{
+    char          *p, *state;
+    unsigned long  pid;
+
+    OHM_DEBUG(DBG_NOTIFY, "got active/standby notification: '%s'", buf);
+
+    p = buf;
+    while (*p) {
+        errno = 0;
+        pid   = strtoul(p, &state, 10);
+
+        if (state == p || *state != ' ' || errno != 0 ||
+            pid == 0 || pid > INT_MAX) {
+            OHM_ERROR("cgrp: received malformed notification '%s'", buf);
+            return FALSE;
+        }
+
+        state++;
+
+        if ((p = strpbrk(state, "\r\n ")) != NULL) {
+            *p++ = '\0';
+            p += strspn(p, "\r\n ");
+        }
+        else
+            p = state + strlen(state);
+
+        burst_apply(ctx, (pid_t)pid, state);
+    }
+
+    return TRUE;
+}
+
+
+/********************
+ * parse_frames
+ ********************/
+static int
+parse_frames(cgrp_context_t *ctx, char *buf, int size)
+{
+    apptrack_hdr_t  hdr;
+    apptrack_rec_t  rec;
+    char           *p, *end, *state;
+    uint32_t        length, pid;
+
+    p   = buf;
+    end = buf + size;
+
+    while (p < end) {
+        if (end - p < (int)sizeof(hdr)) {
+            OHM_ERROR("cgrp: truncated application notification");
+            return FALSE;
+        }
+
+        memcpy(&hdr, p, sizeof(hdr));
+        p += sizeof(hdr);
+
+        if (ntohs(hdr.magic) != APPTRACK_MAGIC) {
+            OHM_ERROR("cgrp: invalid application notification");
+            return FALSE;
+        }
+
+        if (hdr.version != APPTRACK_VERSION) {
+            OHM_ERROR("cgrp: unsupported application notification "
+                      "version %u", hdr.version);
+            return FALSE;
+        }
+
+        length = ntohl(hdr.length);
+
+        if (length % sizeof(rec) || length > (uint32_t)(end - p)) {
+            OHM_ERROR("cgrp: invalid application notification length %u",
+                      length);
+            return FALSE;
+        }
+
+        OHM_DEBUG(DBG_NOTIFY, "got %u active/standby notifications%s",
+                  length / (uint32_t)sizeof(rec),
+                  hdr.flags & APPTRACK_MORE ? ", more to follow" : "");
+
+        for (; length > 0; length -= sizeof(rec), p += sizeof(rec)) {
+            memcpy(&rec, p, sizeof(rec));
+            pid = ntohl(rec.pid);
+
+            switch (rec.state) {
+            case APPTRACK_ACTIVE:  state = APP_ACTIVE;   break;
+            case APPTRACK_STANDBY: state = APP_INACTIVE; break;
+            default:
+                OHM_ERROR("cgrp: invalid state %u for process %u",
+                          rec.state, pid);
+                continue;
+            }
+
+            if (pid == 0 || pid > INT_MAX) {
+                OHM_ERROR("cgrp: invalid process id %u in notification", pid);
+                continue;
+            }
+
+            burst_apply(ctx, (pid_t)pid, state);
+        }
+
+        ctx->apptrack_more = (hdr.flags & APPTRACK_MORE) != 0;
+    }
+
+    return TRUE;
+}
+
+
+/********************
+ * socket_recv
+ ********************/
+static int
+socket_recv(cgrp_context_t *ctx)
+{
+    int size, len;
+
+    /* find out the real size of the next datagram */
+    size = recv(ctx->apptrack_sock, NULL, 0,
+                MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+
+    if (size < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            OHM_ERROR("cgrp: failed to receive application notification "
+                      "(%d: %s)", errno, strerror(errno));
+        return -1;
+    }
+
+    if (size + 1 > ctx->apptrack_size) {
+        len = size + 1;
+        if (REALLOC_ARR(ctx->apptrack_buf, ctx->apptrack_size, len) == NULL) {
+            OHM_ERROR("cgrp: failed to allocate notification buffer");
+            recv(ctx->apptrack_sock, NULL, 0, MSG_DONTWAIT);
+            return 0;
+        }
+        ctx->apptrack_size = len;
+    }
+
+    size = recv(ctx->apptrack_sock, ctx->apptrack_buf, size, MSG_DONTWAIT);
+
+    if (size < 0) {
+        OHM_ERROR("cgrp: failed to receive application notification");
+        return -1;
+    }
+
+    ctx->apptrack_buf[size] = '\0';
+
+    return size;
+}
+
+
 /********************
  * socket_cb
  ********************/
@@ -393,56 +625,39 @@ static gboolean
 socket_cb(GIOChannel *chnl, GIOCondition mask, gpointer data)
 {
     cgrp_context_t *ctx = (cgrp_context_t *)data;
-    cgrp_group_t   *prev_active, *curr_active;
-    cgrp_process_t *process;
-    
-    char            buf[256], *pidp, *state;
-    pid_t           pid;
+    char           *buf;
     int             size;
     
     (void)chnl;
-    (void)data;
 
     if (!(mask & G_IO_IN))
         return TRUE;
-    
-    size = sizeof(buf) - 1;
-    if ((size = recv(ctx->apptrack_sock, buf, size, MSG_DONTWAIT)) < 0) {
-        OHM_ERROR("cgrp: failed to receive application notification");
-        goto out;
-    }
-    
-    buf[size] = '\0';
-    OHM_DEBUG(DBG_NOTIFY, "got active/standby notification: '%s'", buf);
 
-    process     = NULL;
-    prev_active = ctx->active_group;
-    pidp = buf;
-    while (pidp && *pidp) {
-        pid = (unsigned short)strtoul(pidp, &state, 10);
-            
-        if (*state == ' ')
-            state++;
-        else {
-            OHM_ERROR("cgrp: received malformed notification '%s'", buf);
-            goto out;
-        }
-
-        if ((pidp = strpbrk(state, "\r\n ")) != NULL)
-            *pidp++ = '\0';
+    /*
+     * Apply all queued notifications, then fan out once. If the last burst
+     * is to be continued, wait a while for the rest of it.
+     */
 
-        process = proc_hash_lookup(ctx, pid);
+    while ((size = socket_recv(ctx)) >= 0) {
+        buf = ctx->apptrack_buf;
 
-        process_update_state(ctx, process, state);
+        if (size == 0)
+            continue;
 
-        apptrack_notify(ctx, ctx->active_process);
+        if (isdigit((unsigned char)buf[0])) {
+            parse_text(ctx, buf);
+            ctx->apptrack_more = FALSE;
+        }
+        else
+            parse_frames(ctx, buf, size);
     }
 
-    curr_active = ctx->active_group;
-    if (prev_active != curr_active)
-        apptrack_cgroup_notify(ctx, curr_active, NULL);
+    if (!ctx->apptrack_more)
+        burst_end(ctx);
+    else if (ctx->apptrack_timer == 0)
+        ctx->apptrack_timer = g_timeout_add(APPTRACK_BURST_TIMEOUT,
+                                            burst_timeout, ctx);
 
- out:
     return TRUE;
 }
 
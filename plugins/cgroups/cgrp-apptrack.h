@@ -0,0 +1,71 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#ifndef __OHM_PLUGIN_CGRP_APPTRACK_H__
+#define __OHM_PLUGIN_CGRP_APPTRACK_H__
+
+#include <stdint.h>
+
+/*
+ * Application activity notification protocol.
+ *
+ * A notification datagram carries one or more frames. Each frame is a
+ * header followed by length bytes of records. All fields are in network
+ * byte order. The records of consecutive frames up to and including the
+ * first one without APPTRACK_MORE form a burst, which is applied as a
+ * single state transition. A burst may span several datagrams.
+ *
+ * Datagrams starting with a digit are taken to be in the legacy text
+ * format, a whitespace-separated list of '<pid> <active|standby>' pairs.
+ */
+
+#define APPTRACK_MAGIC   0x4154                 /* 'AT' */
+#define APPTRACK_VERSION 1
+
+#define APPTRACK_MORE    0x01                   /* burst continues */
+
+enum {
+    APPTRACK_STANDBY = 0,
+    APPTRACK_ACTIVE  = 1,
+};
+
+typedef struct {
+    uint16_t magic;                             /* APPTRACK_MAGIC */
+    uint8_t  version;                           /* APPTRACK_VERSION */
+    uint8_t  flags;                             /* APPTRACK_* flags */
+    uint32_t length;                            /* bytes of records */
+} apptrack_hdr_t;
+
+typedef struct {
+    uint32_t pid;                               /* process id */
+    uint8_t  state;                             /* APPTRACK_ACTIVE/STANDBY */
+    uint8_t  reserved[3];                       /* must be zero */
+} apptrack_rec_t;
+
+#endif /* __OHM_PLUGIN_CGRP_APPTRACK_H__ */
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -309,6 +309,8 @@ iowait_notify_option: TOKEN_IDENT TOKEN_UINT TOKEN_UINT {
     | TOKEN_IDENT TOKEN_UINT {
           if (!strcmp($1.value, "startup-delay"))
               ctx->iow.startup_delay = $2.value;
+          else if (!strcmp($1.value, "pressure-window"))
+              ctx->iow.window = $2.value;
           else {
               ctx->iow.nsample = $2.value;
               ctx->iow.estim   = estim_alloc($1.value, $2.value);
@@ -319,6 +321,8 @@ iowait_notify_option: TOKEN_IDENT TOKEN_UINT TOKEN_UINT {
     | TOKEN_IDENT string {
           if (!strcmp($1.value, "hook"))
               ctx->iow.hook = STRDUP($2.value);
+          else if (!strcmp($1.value, "pressure"))
+              ctx->iow.pressure = STRDUP($2.value);
           else {
               OHM_ERROR("cgrp: invalid iowait-notify parameter %s", $1.value);
 	      YYABORT;
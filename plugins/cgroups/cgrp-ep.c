@@ -19,6 +19,7 @@ USA.
 
 
 #include "cgrp-plugin.h"
+#include "ep-args.h"
 
 
 /*
@@ -86,6 +87,7 @@ typedef void (*ep_cb_t) (GObject *, GObject *, gboolean);
 static void     policy_decision (GObject *, GObject *, ep_cb_t, gpointer);
 static void     policy_keychange(GObject *, GObject *, gpointer);
 static gboolean txparser        (GObject *, GObject *, gpointer);
+static int      action_check    (void);
 
 
 /********************
@@ -103,6 +105,9 @@ ep_init(cgrp_context_t *ctx, GObject *(*signaling_register)(gchar *, gchar **))
         OHM_ERROR("cgrp: failed to initalize factstore");
         return FALSE;
     }
+
+    if (!action_check())
+        return FALSE;
     
     if (signaling_register == NULL) {
         OHM_ERROR("cgrp: signaling interface not available");
@@ -192,10 +197,7 @@ reparent_action(cgrp_context_t *ctx, void *data)
         return FALSE;
     }
 
-    if (group->partition == partition)
-        return TRUE;
-
-    success = partition_add_group(partition, group, action->pid);
+    success = partition_txn_add_group(ctx, partition, group, action->pid);
 
     OHM_DEBUG(DBG_ACTION, "reparenting group %d/'%s' to partition '%s' %s",
               action->pid, action->group, action->partition, success ? "OK" : "FAILED");
@@ -221,7 +223,7 @@ freeze_action(cgrp_context_t *ctx, void *data)
         return TRUE;
     }
     
-    success = partition_freeze(ctx, partition, frozen);
+    success = partition_txn_freeze(ctx, partition, frozen);
 
     OHM_DEBUG(DBG_ACTION, "%sfreeze partition '%s': %s", frozen ? "" : "un",
               action->partition, success ? "OK" : "FAILED");
@@ -246,7 +248,7 @@ schedule_action(cgrp_context_t *ctx, void *data)
         return TRUE;
     }
     
-    success = partition_limit_cpu(partition, action->share);
+    success = partition_txn_limit_cpu(ctx, partition, action->share);
     
     OHM_DEBUG(DBG_ACTION, "setting CPU share %d of partition %s: %s",
               action->share, action->partition, success ? "OK" : "FAILED");
@@ -556,23 +558,8 @@ group_oom_action(cgrp_context_t *ctx, void *data)
 #define GRP_PRIO  PREFIX"group_priority"
 #define GRP_OOM   PREFIX"group_oom"
 
-#define STRUCT_OFFSET(s,m) ((char *)&(((s *)0)->m) - (char *)0)
-
 typedef int (*action_t)(cgrp_context_t *, void *);
 
-typedef enum {
-    argtype_invalid = 0,
-    argtype_string,
-    argtype_integer,
-    argtype_unsigned
-} argtype_t;
-
-typedef struct {		/* argument descriptor for actions */
-    argtype_t   type;
-    const char *name;
-    int         offs;
-} argdsc_t; 
-
 typedef struct {		/* action descriptor */
     const char *name;
     action_t    handler;
@@ -661,7 +648,6 @@ static actdsc_t actions[] = {
 };
 
 static int action_parser  (actdsc_t *, cgrp_context_t *);
-static int get_args       (OhmFact *, argdsc_t *, void *);
 
 
 static gboolean
@@ -684,6 +670,9 @@ txparser(GObject *conn, GObject *transaction, gpointer data)
     success = TRUE;
 
     if (!strcmp(signal, "cgroup_actions")) {
+        /* collect partition changes of the whole decision, then apply them */
+        partition_txn_begin(ctx);
+
         for (entry = list; entry != NULL; entry = g_slist_next(entry)) {
             name = (char *)entry->data;
             for (action = actions; action->name != NULL; action++) {
@@ -691,6 +680,8 @@ txparser(GObject *conn, GObject *transaction, gpointer data)
                     success &= action_parser(action, ctx);
             }
         }
+
+        success &= partition_txn_commit(ctx);
     }
 
     g_free(signal);
@@ -698,12 +689,28 @@ txparser(GObject *conn, GObject *transaction, gpointer data)
     return success;
 }
 
+static int action_check(void)
+{
+    actdsc_t   *action;
+    ep_error_t  err;
+
+    for (action = actions; action->name != NULL; action++) {
+        if (!ep_args_check(action->argdsc, action->datalen, &err)) {
+            OHM_ERROR("cgrp: action %s: %s", action->name, err.msg);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
 static int action_parser(actdsc_t *action, cgrp_context_t *ctx)
 {
-    OhmFact *fact;
-    GSList  *list;
-    char    *data;
-    int      success;
+    OhmFact    *fact;
+    GSList     *list;
+    char       *data;
+    int         success;
+    ep_error_t  err;
 
     if ((data = malloc(action->datalen)) == NULL) {
         OHM_ERROR("Can't allocate %d byte memory", action->datalen);
@@ -721,11 +728,10 @@ static int action_parser(actdsc_t *action, cgrp_context_t *ctx)
 
         memset(data, 0, action->datalen);
 
-        if (get_args(fact, action->argdsc, data))
+        if (ep_args_parse(fact, action->argdsc, data, &err))
             success &= action->handler(ctx, data);
         else {
-            OHM_DEBUG(DBG_ACTION, "argument parsing error for action '%s'",
-                      action->name);
+            OHM_ERROR("cgrp: invalid action: %s", err.msg);
             success &= FALSE;
         }
     }
@@ -735,46 +741,6 @@ static int action_parser(actdsc_t *action, cgrp_context_t *ctx)
     return success;
 }
 
-static int get_args(OhmFact *fact, argdsc_t *argdsc, void *args)
-{
-    argdsc_t *ad;
-    GValue   *gv;
-    void     *vptr;
-
-    if (fact == NULL)
-        return FALSE;
-
-    for (ad = argdsc;    ad->type != argtype_invalid;   ad++) {
-        vptr = args + ad->offs;
-
-        if ((gv = ohm_fact_get(fact, ad->name)) == NULL)
-            continue;
-
-        switch (ad->type) {
-
-        case argtype_string:
-            if (G_VALUE_TYPE(gv) == G_TYPE_STRING)
-                *(const char **)vptr = g_value_get_string(gv);
-            break;
-
-        case argtype_integer:
-            if (G_VALUE_TYPE(gv) == G_TYPE_INT)
-                *(int *)vptr = g_value_get_int(gv);
-            break;
-
-        case argtype_unsigned:
-            if (G_VALUE_TYPE(gv) == G_TYPE_UINT)
-                *(unsigned int *)vptr = g_value_get_uint(gv);
-            break;
-
-        default:
-            break;
-        }
-    }
-
-    return TRUE;
-}
-
 /*
  * Local Variables:
  * c-basic-offset: 4
@@ -90,8 +90,10 @@ group_add(cgrp_context_t *ctx, cgrp_group_t *g)
         return NULL;
     }
 
-    for (i = 0; i < ctx->ngroup; i++)
+    for (i = 0; i < ctx->ngroup; i++) {
         list_init(&ctx->groups[i].processes);
+        list_init(&ctx->groups[i].reassign_hook);
+    }
 
     group = ctx->groups + ctx->ngroup++;
     group->name        = STRDUP(g->name);
@@ -99,6 +101,7 @@ group_add(cgrp_context_t *ctx, cgrp_group_t *g)
     group->partition   = g->partition;
     group->flags       = g->flags;
     list_init(&group->processes);
+    list_init(&group->reassign_hook);
 
     if (group->name == NULL || group->description == NULL) {
         OHM_ERROR("cgrp: failed to add group");
@@ -132,6 +135,7 @@ group_purge(cgrp_context_t *ctx, cgrp_group_t *group)
         group->name        = NULL;
         group->description = NULL;
         list_init(&group->processes);
+        list_delete(&group->reassign_hook);
 
         if (group->fact != NULL)
             fact_delete(ctx, group->fact);
@@ -56,6 +56,10 @@ static void close_control(int *);
 static int  write_control(int, char *, ...)     \
     __attribute__ ((format(printf, 2, 3)));
 
+static int  write_freezer(cgrp_partition_t *, int);
+static int  write_cpu    (cgrp_partition_t *, unsigned int);
+static void txn_reset    (cgrp_context_t *);
+
 static void foreach_print(gpointer, gpointer, gpointer);
 static void foreach_del  (gpointer, gpointer, gpointer);
 
@@ -68,6 +72,13 @@ typedef struct {
     int         flag;
 } mount_option_t;
 
+typedef struct {                                 /* a pending group move */
+    list_hook_t       hook;                      /* to transaction moves */
+    cgrp_group_t     *group;                     /* group to move */
+    cgrp_partition_t *partition;                 /* target partition */
+    pid_t             pid;                       /* single process, or 0 */
+} txn_move_t;
+
 static mount_option_t mntopts[] = {
     { CGROUP_FREEZER, CGRP_FLAG_MOUNT_FREEZER },
     { CGROUP_CPU    , CGRP_FLAG_MOUNT_CPU     },
@@ -162,8 +173,16 @@ partition_add(cgrp_context_t *ctx, cgrp_partition_t *p)
     
     path = remap_path(ctx, p->path, pathbuf);
     
-    if (ALLOC_OBJ(partition)                == NULL ||
-        (partition->name = STRDUP(p->name)) == NULL ||
+    if (ALLOC_OBJ(partition) == NULL) {
+        OHM_ERROR("cgrp: failed to allocate partition '%s'", p->name);
+        return NULL;
+    }
+
+    partition->state.frozen = -1;
+    list_init(&partition->txn.hook);
+    list_init(&partition->reassign);
+
+    if ((partition->name = STRDUP(p->name)) == NULL ||
         (partition->path = STRDUP(path))    == NULL) {
         OHM_ERROR("cgrp: failed to allocate partition '%s'", p->name);
         goto fail;
@@ -221,10 +240,19 @@ partition_add(cgrp_context_t *ctx, cgrp_partition_t *p)
 void
 partition_del(cgrp_context_t *ctx, cgrp_partition_t *partition)
 {
+    cgrp_group_t *group;
+    list_hook_t  *p, *n;
+
     if (partition == NULL)
         return;
     
     part_hash_delete(ctx, partition->name);
+
+    list_delete(&partition->txn.hook);
+    list_foreach(&partition->reassign, p, n) {
+        group = list_entry(p, cgrp_group_t, reassign_hook);
+        list_delete(&group->reassign_hook);
+    }
     
     close_control(&partition->control.tasks);
     close_control(&partition->control.freeze);
@@ -349,8 +377,19 @@ partition_add_group(cgrp_partition_t *partition, cgrp_group_t *group, pid_t pid)
 
     group->partition = partition;
 
+    /*
+     * Keep groups that failed to move on the reassignment list of their
+     * new partition, so thawing it does not need to look at every group.
+     */
+
     if (!success)
         CGRP_SET_FLAG(group->flags, CGRP_GROUPFLAG_REASSIGN);
+    else if (!pid)
+        CGRP_CLR_FLAG(group->flags, CGRP_GROUPFLAG_REASSIGN);
+
+    list_delete(&group->reassign_hook);
+    if (CGRP_TST_FLAG(group->flags, CGRP_GROUPFLAG_REASSIGN))
+        list_append(&partition->reassign, &group->reassign_hook);
 
     return success;
 }
@@ -363,18 +402,25 @@ void
 unfreeze_fixup(cgrp_context_t *ctx, cgrp_partition_t *partition)
 {
     cgrp_group_t *group;
-    int           i;
+    list_hook_t   pending, *p, *n;
 
-    for (i = 0; i < ctx->ngroup; i++) {
-        group = &ctx->groups[i];
+    (void)ctx;
 
-        if (group->partition == partition &&
-            CGRP_TST_FLAG(group->flags, CGRP_GROUPFLAG_REASSIGN)) {
-            OHM_DEBUG(DBG_ACTION, "reassigning group '%s' to partition '%s'",
-                      group->name, partition->name);
-            partition_add_group(partition, group, 0);
-            CGRP_CLR_FLAG(group->flags, CGRP_GROUPFLAG_REASSIGN);
-        }
+    /* groups failing again get relinked, so detach the current ones first */
+    list_init(&pending);
+    list_foreach(&partition->reassign, p, n) {
+        list_delete(p);
+        list_append(&pending, p);
+    }
+
+    list_foreach(&pending, p, n) {
+        group = list_entry(p, cgrp_group_t, reassign_hook);
+        list_delete(&group->reassign_hook);
+        CGRP_CLR_FLAG(group->flags, CGRP_GROUPFLAG_REASSIGN);
+
+        OHM_DEBUG(DBG_ACTION, "reassigning group '%s' to partition '%s'",
+                  group->name, partition->name);
+        partition_add_group(partition, group, 0);
     }
 }
 
@@ -385,20 +431,10 @@ unfreeze_fixup(cgrp_context_t *ctx, cgrp_partition_t *partition)
 int
 partition_freeze(cgrp_context_t *ctx, cgrp_partition_t *partition, int freeze)
 {
-    char *cmd;
-    int   len, success;
+    int success;
 
     if (partition->control.freeze >= 0) {
-        if (freeze) {
-            cmd = FROZEN;
-            len = sizeof(FROZEN) - 1;
-        }
-        else {
-            cmd = THAWED;
-            len = sizeof(THAWED) - 1;
-        }
-
-        success = (write(partition->control.freeze, cmd, len) == len);
+        success = write_freezer(partition, freeze);
 
         if (!freeze && success)
             unfreeze_fixup(ctx, partition);
@@ -416,16 +452,10 @@ partition_freeze(cgrp_context_t *ctx, cgrp_partition_t *partition, int freeze)
 int
 partition_limit_cpu(cgrp_partition_t *partition, unsigned int share)
 {
-    char val[64];
-    int  len, chk;    
-
     partition->limit.cpu = share;
     
-    if (partition->control.cpu >= 0 && share > 0) {
-        len = snprintf(val, sizeof(val), "%u", share);
-        chk = write(partition->control.cpu, val, len);
-        return chk == len;
-    }
+    if (partition->control.cpu >= 0 && share > 0)
+        return write_cpu(partition, share);
     else
         return TRUE;
 }
@@ -538,6 +568,218 @@ partition_apply_setting(cgrp_context_t *ctx, cgrp_partition_t *partition,
 }
 
 
+/*****************************************************************************
+ *                         *** partition transactions ***                    *
+ *****************************************************************************/
+
+/*
+ * A policy decision typically carries freezer, CPU share and reparenting
+ * actions for several partitions, most of them repeating the current state.
+ * Collecting them in a transaction lets us coalesce them per partition and
+ * per group, drop the ones that would not change anything, and apply the
+ * rest in an order the freezer accepts: tasks cannot be moved to or from a
+ * frozen cgroup, so we thaw first, move groups next, and freeze last.
+ * Outside transactions the freezer is always written, so that a cgroup
+ * the kernel left FREEZING gets another try.
+ */
+
+/********************
+ * partition_txn_begin
+ ********************/
+void
+partition_txn_begin(cgrp_context_t *ctx)
+{
+    cgrp_part_txn_t *txn = &ctx->txn;
+
+    if (txn->active)
+        txn_reset(ctx);
+
+    list_init(&txn->partitions);
+    list_init(&txn->moves);
+    txn->active = TRUE;
+}
+
+
+/********************
+ * txn_touch
+ ********************/
+static void
+txn_touch(cgrp_context_t *ctx, cgrp_partition_t *partition)
+{
+    if (list_empty(&partition->txn.hook))
+        list_append(&ctx->txn.partitions, &partition->txn.hook);
+}
+
+
+/********************
+ * partition_txn_add_group
+ ********************/
+int
+partition_txn_add_group(cgrp_context_t *ctx, cgrp_partition_t *partition,
+                        cgrp_group_t *group, pid_t pid)
+{
+    cgrp_part_txn_t *txn = &ctx->txn;
+    txn_move_t      *move;
+    list_hook_t     *p, *n;
+
+    if (!txn->active)
+        return partition_add_group(partition, group, pid);
+
+    /* a later move of the same group (or process) overrides earlier ones */
+    list_foreach(&txn->moves, p, n) {
+        move = list_entry(p, txn_move_t, hook);
+        if (move->group == group && move->pid == pid) {
+            move->partition = partition;
+            return TRUE;
+        }
+    }
+
+    if (ALLOC_OBJ(move) == NULL) {
+        OHM_ERROR("cgrp: failed to allocate group move");
+        return FALSE;
+    }
+
+    move->group     = group;
+    move->partition = partition;
+    move->pid       = pid;
+    list_append(&txn->moves, &move->hook);
+
+    return TRUE;
+}
+
+
+/********************
+ * partition_txn_freeze
+ ********************/
+int
+partition_txn_freeze(cgrp_context_t *ctx, cgrp_partition_t *partition,
+                     int freeze)
+{
+    if (!ctx->txn.active)
+        return partition_freeze(ctx, partition, freeze);
+
+    partition->txn.freeze = freeze ? CGRP_TXN_FREEZE : CGRP_TXN_THAW;
+    txn_touch(ctx, partition);
+
+    return TRUE;
+}
+
+
+/********************
+ * partition_txn_limit_cpu
+ ********************/
+int
+partition_txn_limit_cpu(cgrp_context_t *ctx, cgrp_partition_t *partition,
+                        unsigned int share)
+{
+    if (!ctx->txn.active)
+        return partition_limit_cpu(partition, share);
+
+    partition->limit.cpu = share;
+    partition->txn.cpu   = share;
+    txn_touch(ctx, partition);
+
+    return TRUE;
+}
+
+
+/********************
+ * partition_txn_commit
+ ********************/
+int
+partition_txn_commit(cgrp_context_t *ctx)
+{
+    cgrp_part_txn_t  *txn = &ctx->txn;
+    cgrp_partition_t *partition;
+    txn_move_t       *move;
+    list_hook_t      *p, *n;
+    int               success;
+
+    if (!txn->active)
+        return TRUE;
+
+    success = TRUE;
+
+    /* thaw partitions so tasks can be moved in and out of them */
+    list_foreach(&txn->partitions, p, n) {
+        partition = list_entry(p, cgrp_partition_t, txn.hook);
+        if (partition->txn.freeze == CGRP_TXN_THAW &&
+            partition->control.freeze >= 0 &&
+            partition->state.frozen != FALSE)
+            success &= write_freezer(partition, FALSE);
+    }
+
+    /* move groups */
+    list_foreach(&txn->moves, p, n) {
+        move      = list_entry(p, txn_move_t, hook);
+        partition = move->partition;
+
+        if (move->group->partition != partition) {
+            success &= partition_add_group(partition, move->group, move->pid);
+
+            OHM_DEBUG(DBG_ACTION, "reparenting group %d/'%s' to '%s'",
+                      move->pid, move->group->name, partition->name);
+        }
+    }
+
+    /* retry groups that failed to move while their partition was frozen */
+    list_foreach(&txn->partitions, p, n) {
+        partition = list_entry(p, cgrp_partition_t, txn.hook);
+        if (partition->txn.freeze == CGRP_TXN_THAW &&
+            partition->state.frozen == FALSE)
+            unfreeze_fixup(ctx, partition);
+    }
+
+    /* adjust CPU shares */
+    list_foreach(&txn->partitions, p, n) {
+        partition = list_entry(p, cgrp_partition_t, txn.hook);
+        if (partition->txn.cpu > 0 && partition->control.cpu >= 0)
+            success &= write_cpu(partition, partition->txn.cpu);
+    }
+
+    /* freeze partitions, including whatever was just moved into them */
+    list_foreach(&txn->partitions, p, n) {
+        partition = list_entry(p, cgrp_partition_t, txn.hook);
+        if (partition->txn.freeze == CGRP_TXN_FREEZE &&
+            partition->control.freeze >= 0 &&
+            partition->state.frozen != TRUE)
+            success &= write_freezer(partition, TRUE);
+    }
+
+    txn_reset(ctx);
+
+    return success;
+}
+
+
+/********************
+ * txn_reset
+ ********************/
+static void
+txn_reset(cgrp_context_t *ctx)
+{
+    cgrp_part_txn_t  *txn = &ctx->txn;
+    cgrp_partition_t *partition;
+    txn_move_t       *move;
+    list_hook_t      *p, *n;
+
+    list_foreach(&txn->partitions, p, n) {
+        partition = list_entry(p, cgrp_partition_t, txn.hook);
+        partition->txn.freeze = CGRP_TXN_NONE;
+        partition->txn.cpu    = 0;
+        list_delete(&partition->txn.hook);
+    }
+
+    list_foreach(&txn->moves, p, n) {
+        move = list_entry(p, txn_move_t, hook);
+        list_delete(&move->hook);
+        FREE(move);
+    }
+
+    txn->active = FALSE;
+}
+
+
 /********************
  * ctrl_dump
  ********************/
@@ -722,6 +964,51 @@ write_control(int fd, char *format, ...)
 }
 
 
+/********************
+ * write_freezer
+ ********************/
+static int
+write_freezer(cgrp_partition_t *partition, int freeze)
+{
+    char *cmd;
+    int   len, success;
+
+    freeze = !!freeze;
+
+    if (freeze) {
+        cmd = FROZEN;
+        len = sizeof(FROZEN) - 1;
+    }
+    else {
+        cmd = THAWED;
+        len = sizeof(THAWED) - 1;
+    }
+    
+    success = (write(partition->control.freeze, cmd, len) == len);
+    partition->state.frozen = success ? freeze : -1;
+
+    return success;
+}
+
+
+/********************
+ * write_cpu
+ ********************/
+static int
+write_cpu(cgrp_partition_t *partition, unsigned int share)
+{
+    int success;
+
+    if (partition->state.cpu == share)
+        return TRUE;
+
+    success = write_control(partition->control.cpu, "%u", share);
+    partition->state.cpu = success ? share : 0;
+
+    return success;
+}
+
+
 /********************
  * foreach_print
  ********************/
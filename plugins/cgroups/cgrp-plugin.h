@@ -125,6 +125,18 @@ typedef enum {
 #define CGRP_NO_CONTROL (-1)
 #define CGRP_NO_LIMIT     0
 
+enum {
+    CGRP_TXN_NONE = 0,                      /* no freezer change */
+    CGRP_TXN_FREEZE,                        /* freeze partition */
+    CGRP_TXN_THAW,                          /* thaw partition */
+};
+
+typedef struct {                            /* a partition transaction */
+    int               active;               /* being collected */
+    list_hook_t       partitions;           /* touched partitions */
+    list_hook_t       moves;                /* pending group moves */
+} cgrp_part_txn_t;
+
 typedef struct {
     char             *name;                 /* name of this partition */
     char             *path;                 /* path to this partition */
@@ -141,6 +153,16 @@ typedef struct {
         int           rt_period;              /* total CPU period */
         int           rt_runtime;             /* allowed realtime period */
     } limit;
+    struct {                                /* last written control state */
+        int           frozen;                 /* frozen, thawed, or -1 */
+        unsigned int  cpu;                    /* CPU shares, 0 if unknown */
+    } state;
+    struct {                                /* pending transaction */
+        list_hook_t   hook;                   /* to touched partitions */
+        int           freeze;                 /* CGRP_TXN_FREEZE/THAW/NONE */
+        unsigned int  cpu;                    /* CPU shares, 0 if unchanged */
+    } txn;
+    list_hook_t       reassign;             /* groups pending reassignment */
 
 #if 0    
     list_hook_t       hash_bucket;          /* hook to hash bucket chain */
@@ -172,6 +194,7 @@ typedef struct {
     cgrp_partition_t *partition;            /* current partititon */
     OhmFact          *fact;                 /* fact for this group */
     int               priority;             /* priority if given */
+    list_hook_t       reassign_hook;        /* to partition reassign list */
 } cgrp_group_t;
 
 typedef struct cgrp_follower_s {
@@ -598,6 +621,16 @@ typedef union {
 
 typedef struct timespec timestamp_t;
 
+#define CGRP_PSI_MAX 3                      /* io, memory and cpu */
+
+typedef struct {
+    const char         *resource;           /* io, memory or cpu */
+    int                 fd;                 /* pressure trigger fd */
+    GIOChannel         *gioc;               /*   associated GIO channel */
+    guint               gsrc;               /*   and event source */
+    unsigned long long  total;              /* last total stall (usec) */
+} cgrp_psi_t;
+
 typedef struct {
     unsigned int     thres_low;             /* low threshold */
     unsigned int     thres_high;            /* high threshold */
@@ -608,11 +641,15 @@ typedef struct {
     estim_t         *estim;                 /* estimator */
     char            *hook;                  /* resolver notification hook */
     unsigned int     startup_delay;         /* initial delay before sampling */
+    char            *pressure;              /* PSI resources to monitor */
+    unsigned int     window;                /* PSI trigger window (msec) */
     
     unsigned long    sample;                /* last sample */
     timestamp_t      stamp;                 /*   and its timestamp */
     guint            timer;                 /* next sampling timer */
     int              alert;                 /* whether above high threshold */
+    cgrp_psi_t       psi[CGRP_PSI_MAX];     /* pressure stall triggers */
+    int              npsi;                  /*   and their number */
 } cgrp_iowait_t;
 
 
@@ -651,6 +688,7 @@ typedef struct {
     cgrp_ctrl_t      *controls;             /* cgroup extra controls */
 
     cgrp_partition_t *root;                 /* root partition */
+    cgrp_part_txn_t   txn;                  /* partition transaction */
     cgrp_group_t     *groups;               /* classification groups */
     int               ngroup;               /* number of groups */
     cgrp_procdef_t   *procdefs;             /* process definitions */
@@ -687,6 +725,12 @@ typedef struct {
     list_hook_t       apptrack_subscribers; /* list of subscribers */
     OhmFact          *apptrack_changes;     /* $application_changes */
     guint             apptrack_update;      /* scheduled change update */
+    char             *apptrack_buf;         /* notification buffer */
+    int               apptrack_size;        /*   and its size */
+    int               apptrack_pending;     /* records since last fan-out */
+    int               apptrack_more;        /* burst continues */
+    cgrp_group_t     *apptrack_group;       /* active group before burst */
+    guint             apptrack_timer;       /* burst completion timeout */
     
     int             (*resolve)(char *, char **);
     int             (*register_method)(char *, dres_handler_t);
@@ -774,6 +818,7 @@ void partition_print(cgrp_partition_t *, FILE *);
 int partition_add_process(cgrp_partition_t *, cgrp_process_t *);
 int partition_add_group(cgrp_partition_t *, cgrp_group_t *, pid_t);
 int partition_freeze(cgrp_context_t *, cgrp_partition_t *, int);
+void unfreeze_fixup(cgrp_context_t *, cgrp_partition_t *);
 int partition_limit_cpu(cgrp_partition_t *, unsigned int);
 int partition_limit_mem(cgrp_partition_t *, unsigned int);
 int partition_limit_rt(cgrp_partition_t *, int, int);
@@ -781,6 +826,14 @@ int partition_apply_settings(cgrp_context_t *, cgrp_partition_t *);
 int partition_apply_setting(cgrp_context_t *, cgrp_partition_t *,
                             char *, char *);
 
+void partition_txn_begin    (cgrp_context_t *);
+int  partition_txn_add_group(cgrp_context_t *, cgrp_partition_t *,
+                             cgrp_group_t *, pid_t);
+int  partition_txn_freeze   (cgrp_context_t *, cgrp_partition_t *, int);
+int  partition_txn_limit_cpu(cgrp_context_t *, cgrp_partition_t *,
+                             unsigned int);
+int  partition_txn_commit   (cgrp_context_t *);
+
 void ctrl_dump(cgrp_context_t *, FILE *);
 void ctrl_del(cgrp_ctrl_t *);
 void ctrl_setting_del(cgrp_ctrl_setting_t *);
@@ -113,6 +113,12 @@ sysmon_exit(cgrp_context_t *ctx)
 static gboolean iow_calculate(gpointer ptr);
 static gboolean iow_sample(int fd, unsigned long *sample, timestamp_t *stamp);
 
+static int           psi_open(cgrp_context_t *ctx);
+static void          psi_close(cgrp_context_t *ctx);
+static gboolean      psi_start(gpointer ptr);
+static unsigned long psi_rate(cgrp_context_t *ctx);
+static void          psi_schedule(cgrp_context_t *ctx, unsigned long avg);
+
 
 /********************
  * iow_init
@@ -150,8 +156,16 @@ iow_init(cgrp_context_t *ctx)
              iow->nsample, iow->hook,
              iow->startup_delay);
 
-    iow_sample(ctx->proc_stat, &iow->sample, &iow->stamp);
-    iow->timer = g_timeout_add(1000 * iow->startup_delay, iow_calculate, ctx);
+    if (psi_open(ctx)) {
+        OHM_INFO("cgrp: using pressure stall triggers, window %u msec",
+                 iow->window);
+        iow->timer = g_timeout_add(1000 * iow->startup_delay, psi_start, ctx);
+    }
+    else {
+        iow_sample(ctx->proc_stat, &iow->sample, &iow->stamp);
+        iow->timer = g_timeout_add(1000 * iow->startup_delay,
+                                   iow_calculate, ctx);
+    }
     
     return TRUE;
 }
@@ -168,10 +182,14 @@ iow_exit(cgrp_context_t *ctx)
         ctx->iow.timer = 0;
     }
 
+    psi_close(ctx);
+
     estim_free(ctx->iow.estim);
     ctx->iow.estim = NULL;
     FREE(ctx->iow.hook);
     ctx->iow.hook = NULL;
+    FREE(ctx->iow.pressure);
+    ctx->iow.pressure = NULL;
 }
 
 
@@ -292,13 +310,17 @@ iow_calculate(gpointer ptr)
     unsigned long   prevs, ds, dt, rate, avg;
     timestamp_t     prevt;
     
-    prevs = iow->sample;
-    prevt = iow->stamp;
-    iow_sample(ctx->proc_stat, &iow->sample, &iow->stamp);
+    if (iow->npsi > 0)
+        rate = psi_rate(ctx);
+    else {
+        prevs = iow->sample;
+        prevt = iow->stamp;
+        iow_sample(ctx->proc_stat, &iow->sample, &iow->stamp);
 
-    dt   = msec_diff(&iow->stamp, &prevt);          /* sample period */
-    ds   = (iow->sample - prevs) * 1000 / clkhz;    /* sample diff   */
-    rate = ds * 1000 / dt;                    /* normalized to 1 sec */
+        dt   = msec_diff(&iow->stamp, &prevt);          /* sample period */
+        ds   = (iow->sample - prevs) * 1000 / clkhz;    /* sample diff   */
+        rate = ds * 1000 / (dt ? dt : 1);         /* normalized to 1 sec */
+    }
         
     avg = estim_update(iow->estim, rate);
     
@@ -320,11 +342,325 @@ iow_calculate(gpointer ptr)
         }
     }
     
-    iow_schedule(ctx, avg);
+    if (iow->npsi > 0)
+        psi_schedule(ctx, avg);
+    else
+        iow_schedule(ctx, avg);
+
+    return FALSE;
+}
+
+
+/*****************************************************************************
+ *               *** pressure stall (PSI) I/O-wait monitoring ***            *
+ *****************************************************************************/
+
+/*
+ * Instead of polling /proc/stat we ask the kernel to wake us up when tasks
+ * have been stalled on the monitored resources for at least the low
+ * threshold percentage of a trigger window. We then sample the stall totals
+ * once per window, feeding the same estimator and alert logic as the poller,
+ * until the average drops back below the low threshold and the alert is
+ * off. On an idle system there are no wakeups at all. If no trigger can be
+ * set up (no PSI support in the kernel), or a trigger fails later, we fall
+ * back to polling /proc/stat.
+ */
+
+#define DEFAULT_PSI_RESOURCES "io"
+#define DEFAULT_PSI_WINDOW    1000                  /* msec */
+#define MIN_PSI_WINDOW        500                   /* kernel limits */
+#define MAX_PSI_WINDOW        10000
+
+static const char *psi_dir = "/proc/pressure";
+
+
+/********************
+ * psi_read
+ ********************/
+static int
+psi_read(cgrp_psi_t *psi, unsigned long long *total)
+{
+    char  buf[256], *p, *e;
+    int   n;
+
+    lseek(psi->fd, 0, SEEK_SET);
+    n = read(psi->fd, buf, sizeof(buf) - 1);
+
+    if (n <= 0) {
+        OHM_ERROR("cgrp: failed to read %s pressure", psi->resource);
+        return FALSE;
+    }
+
+    buf[n] = '\0';
+
+    /* some avg10=0.00 avg60=0.00 avg300=0.00 total=0 */
+    if (strncmp(buf, "some ", 5) || (p = strstr(buf, "total=")) == NULL) {
+        OHM_ERROR("cgrp: invalid %s pressure data", psi->resource);
+        return FALSE;
+    }
+
+    *total = strtoull(p + 6, &e, 10);
+
+    return (e != p + 6);
+}
+
+
+/********************
+ * psi_trigger
+ ********************/
+static int
+psi_trigger(cgrp_context_t *ctx, const char *resource)
+{
+    cgrp_iowait_t *iow = &ctx->iow;
+    cgrp_psi_t    *psi;
+    char           path[PATH_MAX], trigger[64];
+    unsigned long  window, stall;
+    int            fd, len;
+
+    if (strcmp(resource, "io") && strcmp(resource, "memory") &&
+        strcmp(resource, "cpu")) {
+        OHM_ERROR("cgrp: unknown pressure resource '%s'", resource);
+        return FALSE;
+    }
+
+    if (iow->npsi >= CGRP_PSI_MAX)
+        return FALSE;
+
+    snprintf(path, sizeof(path), "%s/%s", psi_dir, resource);
+    if ((fd = open(path, O_RDWR | O_NONBLOCK)) < 0)
+        return FALSE;
+
+    psi = iow->psi + iow->npsi;
+    psi->resource = resource;
+    psi->fd       = fd;
+    psi->gioc     = NULL;
+    psi->gsrc     = 0;
+
+    if (!psi_read(psi, &psi->total)) {
+        close(fd);
+        return FALSE;
+    }
+
+    window = 1000UL * iow->window;                            /* usec */
+    stall  = window / 100 * iow->thres_low;
+    if (stall == 0)
+        stall = 1;
+
+    /* the kernel expects the terminating '\0' too */
+    len = snprintf(trigger, sizeof(trigger), "some %lu %lu", stall, window);
+    if (write(fd, trigger, len + 1) != len + 1) {
+        OHM_WARNING("cgrp: failed to set %s pressure trigger", resource);
+        close(fd);
+        return FALSE;
+    }
+
+    iow->npsi++;
+
+    OHM_INFO("cgrp: %s pressure trigger %s", resource, trigger);
+
+    return TRUE;
+}
+
+
+/********************
+ * psi_open
+ ********************/
+static int
+psi_open(cgrp_context_t *ctx)
+{
+    static const char *names[] = { "io", "memory", "cpu", NULL };
+
+    cgrp_iowait_t  *iow = &ctx->iow;
+    const char     *resources, **n;
+    char            buf[64], *r, *save;
+
+    resources = iow->pressure ? iow->pressure : DEFAULT_PSI_RESOURCES;
+
+    if (!strcmp(resources, "off") || !strcmp(resources, "none"))
+        return FALSE;
+
+    if (!iow->window)
+        iow->window = DEFAULT_PSI_WINDOW;
+    if (iow->window < MIN_PSI_WINDOW)
+        iow->window = MIN_PSI_WINDOW;
+    if (iow->window > MAX_PSI_WINDOW)
+        iow->window = MAX_PSI_WINDOW;
+
+    snprintf(buf, sizeof(buf), "%s", resources);
+
+    for (r = strtok_r(buf, " ,", &save); r; r = strtok_r(NULL, " ,", &save)) {
+        for (n = names; *n != NULL && strcmp(*n, r); n++)
+            ;
+        psi_trigger(ctx, *n ? *n : r);
+    }
+
+    if (iow->npsi == 0) {
+        OHM_INFO("cgrp: no pressure stall information, polling %s",
+                 "/proc/stat");
+        return FALSE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &iow->stamp);
+
+    return TRUE;
+}
+
+
+/********************
+ * psi_close
+ ********************/
+static void
+psi_close(cgrp_context_t *ctx)
+{
+    cgrp_psi_t *psi;
+    int         i;
+
+    for (i = 0, psi = ctx->iow.psi; i < ctx->iow.npsi; i++, psi++) {
+        if (psi->gsrc != 0)
+            g_source_remove(psi->gsrc);
+        if (psi->gioc != NULL)
+            g_io_channel_unref(psi->gioc);
+        close(psi->fd);
+
+        psi->gsrc = 0;
+        psi->gioc = NULL;
+        psi->fd   = -1;
+    }
+
+    ctx->iow.npsi = 0;
+}
+
+
+/********************
+ * psi_fallback
+ ********************/
+static void
+psi_fallback(cgrp_context_t *ctx)
+{
+    OHM_WARNING("cgrp: pressure stall trigger failed, polling %s instead",
+                "/proc/stat");
+
+    psi_close(ctx);
+
+    iow_sample(ctx->proc_stat, &ctx->iow.sample, &ctx->iow.stamp);
+    if (ctx->iow.timer == 0)
+        iow_schedule(ctx, 0);
+}
+
+
+/********************
+ * psi_event
+ ********************/
+static gboolean
+psi_event(GIOChannel *chnl, GIOCondition mask, gpointer data)
+{
+    cgrp_context_t *ctx = (cgrp_context_t *)data;
+    cgrp_iowait_t  *iow = &ctx->iow;
+    int             i;
+
+    (void)chnl;
+
+    if (mask & G_IO_ERR) {
+        psi_fallback(ctx);
+        return FALSE;
+    }
+
+    if (iow->timer != 0)                          /* already sampling */
+        return TRUE;
+
+    OHM_DEBUG(DBG_SYSMON, "pressure stall triggered, start sampling");
+
+    for (i = 0; i < iow->npsi; i++)
+        psi_read(iow->psi + i, &iow->psi[i].total);
+    clock_gettime(CLOCK_MONOTONIC, &iow->stamp);
+
+    iow->timer = g_timeout_add(iow->window, iow_calculate, ctx);
+
+    return TRUE;
+}
+
+
+/********************
+ * psi_start
+ ********************/
+static gboolean
+psi_start(gpointer ptr)
+{
+    cgrp_context_t *ctx = (cgrp_context_t *)ptr;
+    cgrp_psi_t     *psi;
+    GIOCondition    mask;
+    int             i;
+
+    ctx->iow.timer = 0;
+
+    /* PSI fds always poll readable, triggers are signalled by POLLPRI */
+    mask = G_IO_PRI | G_IO_ERR;
+
+    for (i = 0, psi = ctx->iow.psi; i < ctx->iow.npsi; i++, psi++) {
+        if ((psi->gioc = g_io_channel_unix_new(psi->fd)) == NULL ||
+            (psi->gsrc = g_io_add_watch(psi->gioc, mask, psi_event, ctx)) == 0) {
+            psi_fallback(ctx);
+            break;
+        }
+    }
+
     return FALSE;
 }
 
 
+/********************
+ * psi_rate
+ ********************/
+static unsigned long
+psi_rate(cgrp_context_t *ctx)
+{
+    cgrp_iowait_t      *iow = &ctx->iow;
+    cgrp_psi_t         *psi;
+    unsigned long long  prev;
+    unsigned long       dt, rate, max;
+    timestamp_t         prevt;
+    int                 i;
+
+    prevt = iow->stamp;
+    clock_gettime(CLOCK_MONOTONIC, &iow->stamp);
+
+    if ((dt = msec_diff(&iow->stamp, &prevt)) == 0)
+        dt = 1;
+
+    /* stall usecs per msec is the stalled share of time in 1/1000 */
+    max = 0;
+    for (i = 0, psi = iow->psi; i < iow->npsi; i++, psi++) {
+        prev = psi->total;
+
+        if (!psi_read(psi, &psi->total) || psi->total < prev)
+            continue;
+
+        rate = (unsigned long)((psi->total - prev) / dt);
+        if (rate > max)
+            max = rate;
+    }
+
+    return max > 1000 ? 1000 : max;
+}
+
+
+/********************
+ * psi_schedule
+ ********************/
+static void
+psi_schedule(cgrp_context_t *ctx, unsigned long avg)
+{
+    cgrp_iowait_t *iow = &ctx->iow;
+
+    if (!iow->alert && avg <= iow->thres_low) {
+        OHM_DEBUG(DBG_SYSMON, "pressure stall over, waiting for trigger");
+        iow->timer = 0;
+    }
+    else
+        iow->timer = g_timeout_add(iow->window, iow_calculate, ctx);
+}
+
+
 /*****************************************************************************
  *                      *** I/O queue length monitoring ***                  *
  *****************************************************************************/
@@ -0,0 +1,397 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_apptrack.c
+ * @brief application notification protocol over a socketpair
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include "../cgrp-apptrack.c"
+
+#define NPROC   4
+#define NBURST  1000                    /* records in an oversized burst */
+
+int DBG_NOTIFY, DBG_ACTION;
+
+static cgrp_group_t    groups[2] = {
+    { .name = "player"     },
+    { .name = "background" },
+};
+
+/* 70000 and 4464 collide if the pid is truncated to 16 bits */
+static cgrp_process_t  procs[NPROC] = {
+    { .pid = 70000  , .binary = "/usr/bin/player" , .argv0 = "player",
+      .name = "player" , .group = groups + 0 },
+    { .pid = 4464   , .binary = "/usr/bin/daemon" , .argv0 = "daemon",
+      .name = "daemon" , .group = groups + 1 },
+    { .pid = 4194303, .binary = "/usr/bin/browser", .argv0 = "browser",
+      .name = "browser", .group = groups + 1 },
+    { .pid = 1234   , .binary = "/usr/bin/camera" , .argv0 = "camera",
+      .name = "camera" , .group = groups + 0 },
+};
+
+static cgrp_context_t  ctx;
+static int             sock;            /* sending end of the socketpair */
+static int             nfanout;         /* subscriber notifications */
+static pid_t           fanout_pid;      /*   and the last notified pid */
+static int             ngroup;          /* cgroup_notify resolves */
+static int             ntransition;     /* process state updates */
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * mock process tracking and resolver
+ */
+
+cgrp_process_t *proc_hash_lookup(cgrp_context_t *c, pid_t pid)
+{
+    int i;
+
+    (void)c;
+
+    for (i = 0; i < NPROC; i++)
+        if (procs[i].pid == pid)
+            return procs + i;
+
+    return NULL;
+}
+
+int process_update_state(cgrp_context_t *c, cgrp_process_t *process,
+                         char *state)
+{
+    if (process == NULL)
+        return TRUE;
+
+    ntransition++;
+
+    if (!strcmp(state, APP_ACTIVE)) {
+        c->active_process = process;
+        c->active_group   = process->group;
+    }
+    else if (process == c->active_process) {
+        c->active_process = NULL;
+        c->active_group   = NULL;
+    }
+
+    return TRUE;
+}
+
+char **process_get_argv(cgrp_proc_attr_t *attr, int n)
+{
+    (void)attr;
+    (void)n;
+
+    return NULL;
+}
+
+static int fake_resolve(char *goal, char **vars)
+{
+    (void)vars;
+
+    fail_if(strcmp(goal, "cgroup_notify"), "unexpected goal %s", goal);
+    ngroup++;
+
+    return 0;
+}
+
+static void subscriber(pid_t pid, const char *binary, const char *argv0,
+                       const char *group, void *user_data)
+{
+    (void)binary;
+    (void)argv0;
+    (void)group;
+    (void)user_data;
+
+    nfanout++;
+    fanout_pid = pid;
+}
+
+
+/*
+ * helpers
+ */
+
+static int put_frame(char *buf, int flags, const pid_t *pids,
+                     const int *states, int n)
+{
+    apptrack_hdr_t hdr;
+    apptrack_rec_t rec;
+    int            i;
+
+    hdr.magic   = htons(APPTRACK_MAGIC);
+    hdr.version = APPTRACK_VERSION;
+    hdr.flags   = flags;
+    hdr.length  = htonl(n * sizeof(rec));
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    for (i = 0; i < n; i++) {
+        memset(&rec, 0, sizeof(rec));
+        rec.pid   = htonl(pids[i]);
+        rec.state = states[i];
+        memcpy(buf + sizeof(hdr) + i * sizeof(rec), &rec, sizeof(rec));
+    }
+
+    return sizeof(hdr) + n * sizeof(rec);
+}
+
+static void send_msg(const void *buf, int size)
+{
+    fail_unless(send(sock, buf, size, 0) == size, "failed to send %d bytes",
+                size);
+}
+
+static void deliver(void)
+{
+    socket_cb(NULL, G_IO_IN, &ctx);
+}
+
+static void setup(void)
+{
+    int sv[2];
+
+    fail_if(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) < 0, "socketpair failed");
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.apptrack_sock = sv[0];
+    ctx.resolve       = fake_resolve;
+    sock              = sv[1];
+
+    list_init(&ctx.apptrack_subscribers);
+    context = &ctx;
+    apptrack_subscribe(subscriber, NULL);
+
+    nfanout = ngroup = ntransition = 0;
+    fanout_pid = -1;
+}
+
+static void teardown(void)
+{
+    apptrack_exit(&ctx);
+    close(sock);
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_apptrack_large_pids)
+{
+    char  buf[256];
+    pid_t pids[]   = { 4464, 70000 };
+    int   states[] = { APPTRACK_STANDBY, APPTRACK_ACTIVE };
+
+    send_msg(buf, put_frame(buf, 0, pids, states, 2));
+    deliver();
+
+    fail_unless(ctx.active_process == procs + 0, "wrong active process %d",
+                ctx.active_process ? ctx.active_process->pid : 0);
+    fail_unless(nfanout == 1 && fanout_pid == 70000, "fan-out %d/%d",
+                nfanout, fanout_pid);
+
+    /* the legacy text format must not truncate pids either */
+    snprintf(buf, sizeof(buf), "70000 standby 4194303 active\n");
+    send_msg(buf, strlen(buf));
+    deliver();
+
+    fail_unless(ctx.active_process == procs + 2, "wrong active process %d",
+                ctx.active_process ? ctx.active_process->pid : 0);
+    fail_unless(nfanout == 2 && fanout_pid == 4194303, "fan-out %d/%d",
+                nfanout, fanout_pid);
+
+    /* out of range pids are rejected, not wrapped */
+    snprintf(buf, sizeof(buf), "4294971760 active\n");
+    send_msg(buf, strlen(buf));
+    deliver();
+
+    fail_unless(ctx.active_process == procs + 2, "wrapped pid accepted");
+}
+END_TEST
+
+START_TEST (test_apptrack_oversized_burst)
+{
+    static pid_t pids[NBURST];
+    static int   states[NBURST];
+    static char  buf[sizeof(apptrack_hdr_t) + NBURST * sizeof(apptrack_rec_t)];
+    char         text[NBURST * 24], *p;
+    int          i;
+
+    for (i = 0; i < NBURST; i++) {
+        pids[i]   = procs[i % NPROC].pid;
+        states[i] = (i & 1) ? APPTRACK_ACTIVE : APPTRACK_STANDBY;
+    }
+
+    send_msg(buf, put_frame(buf, 0, pids, states, NBURST));
+    deliver();
+
+    fail_unless(ntransition == NBURST, "%d of %d records applied",
+                ntransition, NBURST);
+    fail_unless(nfanout == 1, "%d subscriber notifications", nfanout);
+    fail_unless(ngroup == 1, "%d cgroup notifications", ngroup);
+    fail_unless(ctx.active_process == procs + (NBURST - 1) % NPROC,
+                "wrong active process after burst");
+
+    /* the same in the legacy format, way beyond the old 256 bytes */
+    for (i = 0, p = text; i < NBURST; i++)
+        p += sprintf(p, "%u %s ", pids[(i + 1) % NBURST],
+                     (i & 1) ? APP_ACTIVE : APP_INACTIVE);
+
+    send_msg(text, p - text);
+    deliver();
+
+    fail_unless(ntransition == 2 * NBURST, "%d of %d records applied",
+                ntransition - NBURST, NBURST);
+    fail_unless(nfanout == 2, "%d subscriber notifications", nfanout);
+    fail_unless(ctx.active_process == procs + NBURST % NPROC,
+                "wrong active process after text burst");
+}
+END_TEST
+
+START_TEST (test_apptrack_split_burst)
+{
+    char  buf[256];
+    pid_t pids[]   = { 70000, 1234, 4194303 };
+    int   states[] = { APPTRACK_STANDBY, APPTRACK_ACTIVE, APPTRACK_STANDBY };
+    int   n;
+
+    /* one datagram may carry several frames */
+    n  = put_frame(buf, APPTRACK_MORE, pids, states, 1);
+    n += put_frame(buf + n, APPTRACK_MORE, pids + 1, states + 1, 1);
+    send_msg(buf, n);
+    deliver();
+
+    fail_unless(nfanout == 0, "fan-out before the burst is complete");
+    fail_unless(ctx.apptrack_timer != 0, "no burst timeout");
+
+    send_msg(buf, put_frame(buf, 0, pids + 2, states + 2, 1));
+    deliver();
+
+    fail_unless(nfanout == 1 && fanout_pid == 1234, "fan-out %d/%d",
+                nfanout, fanout_pid);
+    fail_unless(ctx.apptrack_timer == 0, "burst timeout left behind");
+
+    /* the rest of a burst never arrives */
+    send_msg(buf, put_frame(buf, APPTRACK_MORE, pids, states, 1));
+    deliver();
+
+    fail_unless(nfanout == 1, "fan-out before the burst is complete");
+
+    while (ctx.apptrack_timer != 0)
+        g_main_context_iteration(NULL, TRUE);
+
+    fail_unless(nfanout == 2, "incomplete burst never applied");
+}
+END_TEST
+
+START_TEST (test_apptrack_malformed)
+{
+    char            buf[256];
+    apptrack_hdr_t *hdr = (apptrack_hdr_t *)buf;
+    pid_t           pids[]   = { 70000 };
+    int             states[] = { APPTRACK_ACTIVE };
+    int             n;
+
+    n = put_frame(buf, 0, pids, states, 1);
+    hdr->version = APPTRACK_VERSION + 1;
+    send_msg(buf, n);
+
+    n = put_frame(buf, 0, pids, states, 1);
+    hdr->length = htonl(1024);
+    send_msg(buf, n);
+
+    n = put_frame(buf, 0, pids, states, 1);
+    send_msg(buf, n - 1);
+
+    send_msg(buf, 0);
+    send_msg("garbage", 7);
+
+    deliver();
+
+    fail_unless(ntransition == 0, "%d records of malformed notifications "
+                "applied", ntransition);
+
+    send_msg(buf, put_frame(buf, 0, pids, states, 1));
+    deliver();
+
+    fail_unless(ctx.active_process == procs + 0 && nfanout == 1,
+                "valid notification not applied");
+}
+END_TEST
+
+Suite *ohm_apptrack_suite(void)
+{
+    Suite *suite = suite_create("ohm_apptrack");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_apptrack_large_pids);
+    tcase_add_test(tc_all, test_apptrack_oversized_burst);
+    tcase_add_test(tc_all, test_apptrack_split_burst);
+    tcase_add_test(tc_all, test_apptrack_malformed);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_apptrack_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
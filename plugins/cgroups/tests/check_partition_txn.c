@@ -0,0 +1,520 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_partition_txn.c
+ * @brief partition transactions against a fake cgroupfs directory tree
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* count and police control writes like a cgroup v1 freezer would */
+static ssize_t fake_write(int, const void *, size_t);
+#define write fake_write
+
+#include "../cgrp-partition.c"
+
+#undef write
+
+#define NPART      3
+#define NGROUP     8
+#define NPROC      4                    /* processes per group */
+#define NDECISION  20
+
+enum { FG = 0, BG, IDLE };
+
+int DBG_ACTION;
+
+static const char     *names[NPART] = { "foreground", "background", "idle" };
+static char            root[PATH_MAX];
+static cgrp_context_t  ctx;
+static cgrp_partition_t *parts[NPART];
+static int             frozen[NPART];       /* kernel side freezer state */
+static cgrp_group_t    groups[NGROUP];
+static cgrp_process_t  procs[NGROUP * NPROC];
+
+static struct {
+    int freeze;                             /* freezer.state writes */
+    int cpu;                                /* cpu.shares writes */
+    int tasks;                              /* successful tasks writes */
+    int busy;                               /* tasks writes refused */
+} nwrite;
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * mock partition table, leaders and the freezer
+ */
+
+int part_hash_init(cgrp_context_t *c) { (void)c; return TRUE; }
+void part_hash_exit(cgrp_context_t *c) { (void)c; }
+int part_hash_insert(cgrp_context_t *c, cgrp_partition_t *p)
+{
+    (void)c;
+    (void)p;
+
+    return TRUE;
+}
+int part_hash_delete(cgrp_context_t *c, const char *name)
+{
+    (void)c;
+    (void)name;
+
+    return TRUE;
+}
+cgrp_partition_t *part_hash_lookup(cgrp_context_t *c, const char *name)
+{
+    (void)c;
+    (void)name;
+
+    return NULL;
+}
+cgrp_partition_t *part_hash_find_by_path(cgrp_context_t *c, const char *path)
+{
+    (void)c;
+    (void)path;
+
+    return NULL;
+}
+void part_hash_foreach(cgrp_context_t *c, GHFunc func, void *data)
+{
+    (void)c;
+    (void)func;
+    (void)data;
+}
+
+void leader_acts(cgrp_process_t *process) { (void)process; }
+
+static int part_index(cgrp_partition_t *partition)
+{
+    int i;
+
+    for (i = 0; i < NPART; i++)
+        if (parts[i] == partition)
+            return i;
+
+    return -1;
+}
+
+static ssize_t fake_write(int fd, const void *buf, size_t size)
+{
+    cgrp_partition_t *partition;
+    pid_t             pid;
+    int               i, j;
+
+    for (i = 0; i < NPART; i++) {
+        partition = parts[i];
+
+        if (fd == partition->control.freeze) {
+            frozen[i] = !strncmp(buf, FROZEN, size);
+            nwrite.freeze++;
+            return size;
+        }
+
+        if (fd == partition->control.cpu) {
+            nwrite.cpu++;
+            return size;
+        }
+
+        if (fd == partition->control.tasks) {
+            pid = strtoul(buf, NULL, 10);
+            for (j = 0; j < NGROUP * NPROC; j++)
+                if (procs[j].pid == pid)
+                    break;
+
+            fail_if(j == NGROUP * NPROC, "write of unknown pid %u", pid);
+
+            /* anything frozen can't move or be moved to/from */
+            if (frozen[i] ||
+                (procs[j].partition && frozen[part_index(procs[j].partition)])) {
+                nwrite.busy++;
+                errno = EBUSY;
+                return -1;
+            }
+
+            nwrite.tasks++;
+            return size;
+        }
+    }
+
+    fail_if(TRUE, "write to unexpected fd %d", fd);
+    return -1;
+}
+
+
+/*
+ * helpers
+ */
+
+static void make_control(const char *dir, const char *name)
+{
+    char path[PATH_MAX];
+    int  fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fd = open(path, O_CREAT | O_WRONLY, 0644);
+    fail_if(fd < 0, "failed to create %s", path);
+    close(fd);
+}
+
+static void make_partition(int idx)
+{
+    cgrp_partition_t p;
+    char             path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%s", root, names[idx]);
+    fail_if(mkdir(path, 0755) < 0, "failed to create %s", path);
+
+    make_control(path, TASKS);
+    make_control(path, FREEZER);
+    make_control(path, CPU);
+    make_control(path, MEMORY);
+
+    memset(&p, 0, sizeof(p));
+    p.name = (char *)names[idx];
+    p.path = path;
+
+    parts[idx] = partition_add(&ctx, &p);
+    fail_if(parts[idx] == NULL, "failed to add partition %s", names[idx]);
+}
+
+static void remove_partition(int idx)
+{
+    const char *controls[] = { TASKS, FREEZER, CPU, MEMORY, NULL };
+    char        path[PATH_MAX];
+    int         i;
+
+    partition_del(&ctx, parts[idx]);
+    parts[idx] = NULL;
+
+    for (i = 0; controls[i] != NULL; i++) {
+        snprintf(path, sizeof(path), "%s/%s/%s", root, names[idx], controls[i]);
+        unlink(path);
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", root, names[idx]);
+    rmdir(path);
+}
+
+static int group_in(cgrp_group_t *group, int idx)
+{
+    cgrp_process_t *process;
+    list_hook_t    *p, *n;
+
+    if (group->partition != parts[idx])
+        return FALSE;
+
+    list_foreach(&group->processes, p, n) {
+        process = list_entry(p, cgrp_process_t, group_hook);
+        if (process->partition != parts[idx])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * A decision as the policy sends it: the full freezer and CPU state of
+ * every partition plus a single group moving between fore- and background.
+ * Without a transaction this is what the enforcement point used to do:
+ * reparent first, then freeze, then schedule, with no idea of the state
+ * the controls are already in.
+ */
+static int decide(int txn, int i)
+{
+    cgrp_group_t *group  = groups + i % NGROUP;
+    int           target = (i / NGROUP) & 1 ? FG : BG;
+    int           j, success;
+
+    if (txn) {
+        partition_txn_begin(&ctx);
+        partition_txn_add_group(&ctx, parts[target], group, 0);
+        partition_txn_freeze(&ctx, parts[FG]  , FALSE);
+        partition_txn_freeze(&ctx, parts[BG]  , FALSE);
+        partition_txn_freeze(&ctx, parts[IDLE], TRUE);
+        partition_txn_limit_cpu(&ctx, parts[FG]  , 1024);
+        partition_txn_limit_cpu(&ctx, parts[BG]  , 256);
+        partition_txn_limit_cpu(&ctx, parts[IDLE], 2);
+        success = partition_txn_commit(&ctx);
+    }
+    else {
+        for (j = 0; j < NPART; j++)
+            parts[j]->state.cpu = 0;
+
+        success = TRUE;
+        if (group->partition != parts[target])
+            success &= partition_add_group(parts[target], group, 0);
+        success &= partition_freeze(&ctx, parts[FG]  , FALSE);
+        success &= partition_freeze(&ctx, parts[BG]  , FALSE);
+        success &= partition_freeze(&ctx, parts[IDLE], TRUE);
+        success &= partition_limit_cpu(parts[FG]  , 1024);
+        success &= partition_limit_cpu(parts[BG]  , 256);
+        success &= partition_limit_cpu(parts[IDLE], 2);
+    }
+
+    return success;
+}
+
+static int total_writes(void)
+{
+    return nwrite.freeze + nwrite.cpu + nwrite.tasks + nwrite.busy;
+}
+
+static void setup(void)
+{
+    cgrp_process_t *process;
+    int             i, j;
+
+    snprintf(root, sizeof(root), "/tmp/cgrp-txn-XXXXXX");
+    fail_if(mkdtemp(root) == NULL, "failed to create fake cgroupfs");
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.desired_mount = STRDUP(root);
+    ctx.actual_mount  = STRDUP(root);
+
+    memset(frozen, 0, sizeof(frozen));
+    for (i = 0; i < NPART; i++)
+        make_partition(i);
+
+    for (i = 0; i < NGROUP; i++) {
+        memset(groups + i, 0, sizeof(groups[i]));
+        groups[i].name = "group";
+        list_init(&groups[i].processes);
+        list_init(&groups[i].reassign_hook);
+
+        for (j = 0; j < NPROC; j++) {
+            process = procs + i * NPROC + j;
+            memset(process, 0, sizeof(*process));
+            process->pid   = 1000 + i * NPROC + j;
+            process->name  = "process";
+            process->group = groups + i;
+            list_append(&groups[i].processes, &process->group_hook);
+        }
+
+        fail_unless(partition_add_group(parts[FG], groups + i, 0),
+                    "failed to place group #%d", i);
+    }
+
+    memset(&nwrite, 0, sizeof(nwrite));
+}
+
+static void teardown(void)
+{
+    int i;
+
+    for (i = 0; i < NPART; i++)
+        remove_partition(i);
+    rmdir(root);
+
+    FREE(ctx.desired_mount);
+    FREE(ctx.actual_mount);
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_partition_txn_writes)
+{
+    int legacy, batched, i;
+
+    for (i = 0; i < NDECISION; i++)
+        fail_unless(decide(FALSE, i), "decision #%d failed", i);
+    legacy = total_writes();
+
+    /* put everything back and replay the same decisions as transactions */
+    for (i = 0; i < NGROUP; i++)
+        partition_add_group(parts[FG], groups + i, 0);
+    for (i = 0; i < NPART; i++) {
+        parts[i]->state.frozen = -1;
+        parts[i]->state.cpu    = 0;
+    }
+    memset(&nwrite, 0, sizeof(nwrite));
+
+    for (i = 0; i < NDECISION; i++)
+        fail_unless(decide(TRUE, i), "decision #%d failed", i);
+    batched = total_writes();
+
+    printf("%d decisions: %d control writes without transactions, "
+           "%d with (%d freezer, %d cpu, %d tasks)\n", NDECISION,
+           legacy, batched, nwrite.freeze, nwrite.cpu, nwrite.tasks);
+
+    fail_unless(legacy == NDECISION * (2 * NPART + NPROC),
+                "%d writes without transactions", legacy);
+    fail_unless(nwrite.freeze == NPART && nwrite.cpu == NPART,
+                "%d freezer and %d cpu writes for an unchanged state",
+                nwrite.freeze, nwrite.cpu);
+    fail_unless(nwrite.tasks == NDECISION * NPROC && nwrite.busy == 0,
+                "%d tasks writes, %d refused", nwrite.tasks, nwrite.busy);
+}
+END_TEST
+
+START_TEST (test_partition_txn_ordering)
+{
+    partition_freeze(&ctx, parts[BG], TRUE);
+    memset(&nwrite, 0, sizeof(nwrite));
+
+    /* a group moving to a partition thawed by the same decision */
+    partition_txn_begin(&ctx);
+    partition_txn_add_group(&ctx, parts[BG], groups + 0, 0);
+    partition_txn_freeze(&ctx, parts[BG], FALSE);
+    fail_unless(partition_txn_commit(&ctx), "transaction failed");
+
+    fail_unless(group_in(groups + 0, BG), "group not moved");
+    fail_unless(nwrite.busy == 0 && nwrite.tasks == NPROC,
+                "%d tasks writes, %d refused", nwrite.tasks, nwrite.busy);
+
+    /* a group moving to a partition frozen by the same decision */
+    partition_txn_begin(&ctx);
+    partition_txn_freeze(&ctx, parts[BG], TRUE);
+    partition_txn_add_group(&ctx, parts[BG], groups + 1, 0);
+    fail_unless(partition_txn_commit(&ctx), "transaction failed");
+
+    fail_unless(group_in(groups + 1, BG) && frozen[BG],
+                "group not moved before freezing");
+    fail_unless(nwrite.busy == 0, "%d tasks writes refused", nwrite.busy);
+
+    /* moves cancelling each other out */
+    memset(&nwrite, 0, sizeof(nwrite));
+    partition_txn_begin(&ctx);
+    partition_txn_add_group(&ctx, parts[IDLE], groups + 2, 0);
+    partition_txn_add_group(&ctx, parts[FG]  , groups + 2, 0);
+    fail_unless(partition_txn_commit(&ctx), "transaction failed");
+
+    fail_unless(total_writes() == 0, "%d writes for a no-op", total_writes());
+}
+END_TEST
+
+START_TEST (test_partition_txn_refreeze)
+{
+    partition_freeze(&ctx, parts[BG], TRUE);
+    memset(&nwrite, 0, sizeof(nwrite));
+
+    /* a direct freeze is always retried, the cgroup may be FREEZING */
+    fail_unless(partition_freeze(&ctx, parts[BG], TRUE), "freeze failed");
+    fail_unless(nwrite.freeze == 1, "%d freezer writes", nwrite.freeze);
+
+    /* a transaction restating the frozen state does not write */
+    memset(&nwrite, 0, sizeof(nwrite));
+    partition_txn_begin(&ctx);
+    partition_txn_freeze(&ctx, parts[BG], TRUE);
+    fail_unless(partition_txn_commit(&ctx), "transaction failed");
+
+    fail_unless(nwrite.freeze == 0, "%d freezer writes", nwrite.freeze);
+}
+END_TEST
+
+START_TEST (test_partition_txn_reassign)
+{
+    cgrp_group_t *group;
+    list_hook_t  *p, *n;
+    int           npending;
+
+    partition_freeze(&ctx, parts[BG], TRUE);
+    memset(&nwrite, 0, sizeof(nwrite));
+
+    /* moving into a partition that stays frozen has to wait */
+    partition_txn_begin(&ctx);
+    partition_txn_add_group(&ctx, parts[BG], groups + 3, 0);
+    fail_if(partition_txn_commit(&ctx), "move into a frozen partition");
+
+    npending = 0;
+    list_foreach(&parts[BG]->reassign, p, n) {
+        group = list_entry(p, cgrp_group_t, reassign_hook);
+        fail_unless(group == groups + 3, "unexpected pending group");
+        npending++;
+    }
+    fail_unless(npending == 1, "%d pending groups", npending);
+    fail_unless(list_empty(&parts[FG]->reassign), "stray pending group");
+
+    /* thawing moves only the pending group */
+    memset(&nwrite, 0, sizeof(nwrite));
+    partition_txn_begin(&ctx);
+    partition_txn_freeze(&ctx, parts[BG], FALSE);
+    fail_unless(partition_txn_commit(&ctx), "transaction failed");
+
+    fail_unless(group_in(groups + 3, BG), "pending group not reassigned");
+    fail_unless(list_empty(&parts[BG]->reassign), "group left pending");
+    fail_if(CGRP_TST_FLAG(groups[3].flags, CGRP_GROUPFLAG_REASSIGN),
+            "reassign flag left set");
+    fail_unless(nwrite.freeze == 1 && nwrite.tasks == NPROC,
+                "%d freezer and %d tasks writes", nwrite.freeze, nwrite.tasks);
+}
+END_TEST
+
+Suite *ohm_partition_txn_suite(void)
+{
+    Suite *suite = suite_create("ohm_partition_txn");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_partition_txn_writes);
+    tcase_add_test(tc_all, test_partition_txn_ordering);
+    tcase_add_test(tc_all, test_partition_txn_refreeze);
+    tcase_add_test(tc_all, test_partition_txn_reassign);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_partition_txn_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,496 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_sysmon_psi.c
+ * @brief pressure stall and polling I/O-wait monitoring in simulated time
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <time.h>
+#include <glib.h>
+
+/* run the monitor against a simulated clock and main loop */
+static int   fake_clock_gettime(clockid_t, struct timespec *);
+static guint fake_timeout_add(guint, GSourceFunc, gpointer);
+static guint fake_io_add_watch(GIOChannel *, GIOCondition, GIOFunc, gpointer);
+static gboolean fake_source_remove(guint);
+
+#define clock_gettime   fake_clock_gettime
+#define g_timeout_add   fake_timeout_add
+#define g_io_add_watch  fake_io_add_watch
+#define g_source_remove fake_source_remove
+
+#include "../cgrp-sysmon.c"
+
+#undef clock_gettime
+#undef g_timeout_add
+#undef g_io_add_watch
+#undef g_source_remove
+
+#define MAX_SOURCE  16
+#define STALL       600                 /* stall under load (1/1000) */
+#define IDLE_START  (2 * 1000)          /* msec */
+#define IDLE_END    (62 * 1000)
+#define LOAD_START  (90 * 1000)
+#define LOAD_END    (150 * 1000)
+#define RUN_END     (180 * 1000)
+
+int DBG_SYSMON;
+
+typedef struct {
+    guint        id;
+    int          timer;                 /* timer or I/O watch */
+    unsigned int interval;              /* timer interval (msec) */
+    unsigned int due;                   /*   and expiry */
+    GSourceFunc  tmr_cb;
+    GIOFunc      io_cb;
+    gpointer     data;
+} source_t;
+
+static source_t        sources[MAX_SOURCE];
+static guint           nextid;
+static unsigned int    now;             /* simulated time (msec) */
+static unsigned int    wakeups;         /* callbacks dispatched */
+static unsigned int    alert_high;      /* time of last high notification */
+static unsigned int    alert_low;       /*   and last low notification */
+static char            dir[] = "/tmp/check_sysmon_psi.XXXXXX";
+static char            io_path[PATH_MAX], stat_path[PATH_MAX];
+static unsigned long   stall_total;     /* total stall (usec) */
+static unsigned int    trigger_stall;   /* trigger set by the monitor */
+static unsigned int    trigger_window;
+static unsigned int    trigger_last;    /* last trigger event */
+static unsigned int   *history;         /* per msec stall in the window */
+static cgrp_context_t  ctx;
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * simulated clock and main loop
+ */
+
+static int fake_clock_gettime(clockid_t id, struct timespec *ts)
+{
+    (void)id;
+
+    ts->tv_sec  = now / 1000;
+    ts->tv_nsec = (now % 1000) * 1000 * 1000;
+
+    return 0;
+}
+
+static source_t *new_source(gpointer data)
+{
+    int i;
+
+    for (i = 0; i < MAX_SOURCE; i++) {
+        if (sources[i].id == 0) {
+            sources[i].id   = ++nextid;
+            sources[i].data = data;
+            return sources + i;
+        }
+    }
+
+    fail_if(TRUE, "too many event sources");
+    return NULL;
+}
+
+static guint fake_timeout_add(guint msecs, GSourceFunc cb, gpointer data)
+{
+    source_t *src = new_source(data);
+
+    src->timer    = TRUE;
+    src->interval = msecs;
+    src->due      = now + msecs;
+    src->tmr_cb   = cb;
+
+    return src->id;
+}
+
+static guint fake_io_add_watch(GIOChannel *chnl, GIOCondition mask,
+                               GIOFunc cb, gpointer data)
+{
+    source_t *src = new_source(data);
+
+    (void)chnl;
+
+    fail_unless(mask & G_IO_PRI, "trigger watch without G_IO_PRI");
+    fail_if(mask & G_IO_IN, "trigger fds are always readable");
+
+    src->timer = FALSE;
+    src->io_cb = cb;
+
+    return src->id;
+}
+
+static gboolean fake_source_remove(guint id)
+{
+    int i;
+
+    for (i = 0; i < MAX_SOURCE; i++) {
+        if (sources[i].id == id) {
+            memset(sources + i, 0, sizeof(sources[i]));
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static int nsource(int timer)
+{
+    int i, n;
+
+    for (i = n = 0; i < MAX_SOURCE; i++)
+        if (sources[i].id != 0 && sources[i].timer == timer)
+            n++;
+
+    return n;
+}
+
+
+/*
+ * fake pressure and stat files
+ */
+
+static void write_file(const char *path, const char *fmt, ...)
+{
+    va_list ap;
+    FILE   *fp;
+
+    fail_if((fp = fopen(path, "w")) == NULL, "failed to open %s", path);
+
+    va_start(ap, fmt);
+    vfprintf(fp, fmt, ap);
+    va_end(ap);
+
+    fclose(fp);
+}
+
+static void update_files(void)
+{
+    write_file(io_path, "some avg10=0.00 avg60=0.00 avg300=0.00 total=%lu\n"
+               "full avg10=0.00 avg60=0.00 avg300=0.00 total=%lu\n",
+               stall_total, stall_total / 2);
+
+    /* clkhz is 100, so a tick is 10 msecs */
+    write_file(stat_path, "cpu  1000 0 1000 100000 %lu 0 0 0 0 0\n",
+               stall_total / 10000);
+}
+
+static void read_trigger(void)
+{
+    char  buf[1024], *p, *t;
+    FILE *fp;
+    int   n;
+
+    fail_if((fp = fopen(io_path, "r")) == NULL, "failed to open %s", io_path);
+    n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+
+    /* the trigger was written after the initial statistics */
+    for (p = buf, t = NULL; (p = memchr(p, 's', buf + n - p)) != NULL; p++)
+        if (!strncmp(p, "some ", 5) && strstr(p, "avg10") != p + 5)
+            t = p;
+
+    fail_if(t == NULL, "no trigger in %s", io_path);
+    fail_unless(sscanf(t, "some %u %u", &trigger_stall, &trigger_window) == 2,
+                "invalid trigger '%s'", t);
+
+    trigger_window /= 1000;
+    history = calloc(trigger_window, sizeof(*history));
+}
+
+
+/*
+ * Advance the simulated time until end, accumulating stall according to
+ * the load, firing the pressure trigger like the kernel would and expiring
+ * timers. Returns the number of wakeups in the given period.
+ */
+static unsigned int run(unsigned int end, unsigned int load_start,
+                        unsigned int load_end)
+{
+    unsigned int start = wakeups, stall, sum, i;
+    source_t    *src;
+    guint        id;
+
+    for (; now < end; now++) {
+        stall = (now >= load_start && now < load_end) ? STALL : 0;
+        stall_total += stall;
+
+        if (history != NULL) {
+            history[now % trigger_window] = stall;
+
+            for (i = sum = 0; i < trigger_window; i++)
+                sum += history[i];
+
+            if (sum >= trigger_stall &&
+                (trigger_last == 0 || now - trigger_last >= trigger_window)) {
+                for (i = 0; i < MAX_SOURCE; i++) {
+                    src = sources + i;
+                    if (src->id != 0 && !src->timer) {
+                        update_files();
+                        trigger_last = now;
+                        wakeups++;
+                        id = src->id;
+                        if (!src->io_cb(NULL, G_IO_PRI, src->data))
+                            fake_source_remove(id);
+                    }
+                }
+            }
+        }
+
+        for (i = 0; i < MAX_SOURCE; i++) {
+            src = sources + i;
+            if (src->id != 0 && src->timer && src->due <= now) {
+                update_files();
+                wakeups++;
+                id = src->id;
+                if (src->tmr_cb(src->data))
+                    src->due = now + src->interval;
+                else
+                    fake_source_remove(id);
+            }
+        }
+    }
+
+    return wakeups - start;
+}
+
+
+/*
+ * mock resolver
+ */
+
+static int fake_resolve(char *hook, char **vars)
+{
+    fail_if(strcmp(hook, "iowait_notify"), "unexpected hook %s", hook);
+    fail_if(strcmp(vars[0], "iowait"), "unexpected variable %s", vars[0]);
+
+    if (!strcmp(vars[1], "high"))
+        alert_high = now;
+    else
+        alert_low = now;
+
+    return 0;
+}
+
+static void setup(void)
+{
+    fail_if(mkdtemp(dir) == NULL, "failed to create %s", dir);
+
+    snprintf(io_path  , sizeof(io_path)  , "%s/io"  , dir);
+    snprintf(stat_path, sizeof(stat_path), "%s/stat", dir);
+
+    memset(sources, 0, sizeof(sources));
+    now = 1;
+    wakeups = alert_high = alert_low = 0;
+    stall_total = 0;
+    trigger_stall = trigger_window = trigger_last = 0;
+    history = NULL;
+
+    update_files();
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.resolve           = fake_resolve;
+    ctx.proc_stat         = open(stat_path, O_RDONLY);
+    ctx.iow.thres_low     = 10;
+    ctx.iow.thres_high    = 35;
+    ctx.iow.poll_high     = 10;
+    ctx.iow.poll_low      = 2;
+    ctx.iow.nsample       = 3;
+    ctx.iow.estim         = estim_alloc("window", 3);
+    ctx.iow.hook          = STRDUP("iowait_notify");
+    ctx.iow.startup_delay = 1;
+    ctx.iow.window        = 1000;
+
+    clkhz  = 100;
+    psi_dir = dir;
+}
+
+static void teardown(void)
+{
+    iow_exit(&ctx);
+    close(ctx.proc_stat);
+
+    fail_unless(nsource(TRUE) == 0 && nsource(FALSE) == 0,
+                "event sources left behind");
+
+    free(history);
+    unlink(io_path);
+    unlink(stat_path);
+    rmdir(dir);
+    strcpy(dir + strlen(dir) - 6, "XXXXXX");
+}
+
+static void measure(int psi, unsigned int *idle, unsigned int *high,
+                    unsigned int *low)
+{
+    ctx.iow.pressure = STRDUP(psi ? "io memory" : "off");
+    iow_init(&ctx);
+
+    fail_unless(ctx.iow.npsi == (psi ? 1 : 0), "%d pressure triggers",
+                ctx.iow.npsi);
+
+    if (psi)
+        read_trigger();
+
+    /* an idle minute after the startup delay, then a minute of load */
+    run(IDLE_START, LOAD_START, LOAD_END);
+    *idle = run(IDLE_END, LOAD_START, LOAD_END);
+    run(RUN_END, LOAD_START, LOAD_END);
+
+    fail_unless(alert_high > LOAD_START, "no high alert");
+    fail_unless(alert_low > LOAD_END, "no low alert");
+
+    *high = alert_high - LOAD_START;
+    *low  = alert_low  - LOAD_END;
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_sysmon_psi_trigger)
+{
+    unsigned int idle, high, low;
+
+    measure(TRUE, &idle, &high, &low);
+
+    fail_unless(trigger_window == 1000, "trigger window %u msec",
+                trigger_window);
+    fail_unless(trigger_stall == 100 * 1000, "trigger stall %u usec",
+                trigger_stall);
+
+    fail_unless(idle == 0, "%u wakeups in an idle minute", idle);
+    fail_unless(high <= 2 * 1000, "high alert after %u msec", high);
+    fail_unless(low <= 5 * 1000, "low alert after %u msec", low);
+    fail_unless(nsource(TRUE) == 0, "sampling after the load is gone");
+
+    printf("pressure triggers: %u wakeups per idle minute, "
+           "high alert after %.1f s, low alert after %.1f s\n",
+           idle, high / 1000.0, low / 1000.0);
+}
+END_TEST
+
+START_TEST (test_sysmon_poll_fallback)
+{
+    unsigned int idle, high, low;
+
+    psi_dir = "/nonexistent";
+    measure(FALSE, &idle, &high, &low);
+
+    fail_unless(idle >= 60 / ctx.iow.poll_high - 1, "%u wakeups in an idle "
+                "minute", idle);
+
+    printf("/proc/stat polling: %u wakeups per idle minute, "
+           "high alert after %.1f s, low alert after %.1f s\n",
+           idle, high / 1000.0, low / 1000.0);
+}
+END_TEST
+
+START_TEST (test_sysmon_psi_trigger_error)
+{
+    guint id;
+    int   i;
+
+    ctx.iow.pressure = STRDUP("io");
+    iow_init(&ctx);
+    run(IDLE_START, LOAD_START, LOAD_END);
+
+    fail_unless(ctx.iow.npsi == 1 && nsource(FALSE) == 1, "no trigger watch");
+
+    for (i = 0; i < MAX_SOURCE; i++)
+        if (sources[i].id != 0 && !sources[i].timer)
+            break;
+
+    /* the trigger goes away, polling has to take over */
+    id = sources[i].id;
+    fail_if(sources[i].io_cb(NULL, G_IO_ERR, sources[i].data),
+            "failed trigger kept");
+    fake_source_remove(id);
+
+    fail_unless(ctx.iow.npsi == 0, "failed trigger not closed");
+    fail_unless(nsource(FALSE) == 0 && nsource(TRUE) == 1,
+                "polling not scheduled");
+
+    run(LOAD_END, LOAD_START, LOAD_END);
+    fail_unless(alert_high > LOAD_START, "no high alert after fallback");
+}
+END_TEST
+
+Suite *ohm_sysmon_psi_suite(void)
+{
+    Suite *suite = suite_create("ohm_sysmon_psi");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_sysmon_psi_trigger);
+    tcase_add_test(tc_all, test_sysmon_poll_fallback);
+    tcase_add_test(tc_all, test_sysmon_psi_trigger_error);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_sysmon_psi_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
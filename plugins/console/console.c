@@ -26,7 +26,10 @@ USA.
 #include <fcntl.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
@@ -34,22 +37,33 @@ USA.
 #include <gmodule.h>
 
 #include <ohm/ohm-plugin.h>
+#include <ohm/ohm-plugin-log.h>
 
-#define BUSY_MESSAGE "Only a single console allowed and is already active.\n"
+#define BUSY_MESSAGE "Too many active consoles, try again later.\n"
+#define LONG_MESSAGE "Input line too long, discarded.\n"
+#define TRUNC_MESSAGE "\n[output truncated]\n"
 
 #define INVALID_ID   -1
-#define BUFFER_CHUNK 128
+
+#define DEFAULT_CLIENTS 16               /* client limit of multi-consoles */
+#define DEFAULT_INPUT   4096             /* input buffer, longest line */
+#define DEFAULT_OUTPUT  16384            /* output buffer */
+#define OUTPUT_GROWTH   16               /* max. growth for callback output */
+#define LINE_BUDGET     8                /* lines per client per dispatch */
 
 #define CALLBACK(c, cb, args...) do {               \
         if ((c)->cb != NULL) {                      \
             (c)->active++;                          \
-            (c)->cb((c)->gid, ## args);             \
+            (c)->cb((c)->id, ## args);              \
             (c)->active--;                          \
         }                                           \
     } while (0)
 
 #define CLOSED(c) (!(c)->active && (c)->flags & CONSOLE_CLOSED)
 
+/* the client is not reading its output, stop processing its input */
+#define THROTTLED(c) ((c)->out.used >= output_size / 2)
+
 
 #ifndef ALLOC
 #undef ALLOC
@@ -112,24 +126,43 @@ enum {
     CONSOLE_SINGLE   = 0x00,
     CONSOLE_MULTIPLE = 0x01,
     CONSOLE_CLOSED   = 0x02,
+    CONSOLE_LISTENER = 0x04,             /* listening console */
+    CONSOLE_UNIX     = 0x08,             /* Unix-domain socket */
+    CONSOLE_EOF      = 0x10,             /* end of input seen */
+    CONSOLE_CR       = 0x20,             /* last line ended in '\r' */
+    CONSOLE_DISCARD  = 0x40,             /* discarding an overlong line */
+    CONSOLE_TRUNCATE = 0x80,             /* dropping output until drained */
 };
 
 typedef struct console_s console_t;
 
+typedef struct {                         /* a fixed size ring buffer */
+    char   *data;                        /* buffer */
+    size_t  size;                        /* buffer size */
+    size_t  head;                        /* offset of the first byte */
+    size_t  used;                        /* bytes in the buffer */
+} ring_t;
+
+#define RING_SPACE(r) ((r)->size - (r)->used)
+#define RING_AT(r, i) ((r)->data[((r)->head + (i)) % (r)->size])
+
 
 #define MAX_GRABS 4                      /* 4 is enough for everybody... */
 
 struct console_s {
     console_t *parent;                   /* where we got accept(2)ed */
     int        nchild;                   /* number of children */
+    int        limit;                    /* max. number of children */
     int        flags;                    /* misc. flags */
     int        active;
+    int        id;                       /* console id */
 
     char      *endpoint;                 /* address:port to listen(2) on */
     int        sock;                     /* socket */
-    char      *buf;                      /* input buffer */
-    size_t     size;                     /* buffer size */
-    size_t     used;                     /* buffer used */
+    ring_t     in;                       /* input buffer */
+    ring_t     out;                      /* pending output */
+    size_t     scan;                     /* input scanned for a newline */
+    char      *line;                     /* current input line */
     
     void (*opened)(int, struct sockaddr *, int); /* open callback */
     void (*closed)(int);                         /* close callback */
@@ -138,6 +171,8 @@ struct console_s {
 
     GIOChannel *gio;                     /* associated I/O channel */
     guint       gid;                     /* glib source id */
+    GIOCondition cond;                   /*   and its conditions */
+    guint       pending;                 /* buffered input processing */
 
     int         grabs[MAX_GRABS];        /* grabbed file descriptors */
 };
@@ -148,12 +183,37 @@ struct console_s {
 
 static console_t    **consoles;
 static unsigned int   nconsole;
+static int            next_id = 1;
+
+static int    max_clients = DEFAULT_CLIENTS;
+static size_t input_size  = DEFAULT_INPUT;
+static size_t output_size = DEFAULT_OUTPUT;
 
 static gboolean console_accept (GIOChannel *, GIOCondition, gpointer);
 static gboolean console_handler(GIOChannel *, GIOCondition, gpointer);
+static gboolean console_pending(gpointer);
+static void     console_watch  (console_t *);
+static int      console_flush  (console_t *);
+static int      console_send   (console_t *, const char *, size_t);
+static int      console_drain  (console_t *);
+static int      console_queue  (console_t *, const char *, size_t);
+static console_t *console_attach(console_t *, int, struct sockaddr *, int);
 
 static int grab_fd  (int fd, int sock);
 static int ungrab_fd(int grab);
+static int grabbed  (console_t *c);
+
+static int    ring_init(ring_t *, size_t);
+static void   ring_free(ring_t *);
+static int    ring_resize(ring_t *, size_t);
+static size_t ring_put (ring_t *, const char *, size_t);
+static size_t ring_get (ring_t *, char *, size_t);
+static void   ring_drop(ring_t *, size_t);
+static char  *ring_head(ring_t *, size_t *);
+static char  *ring_tail(ring_t *, size_t *);
+
+static char *unix_path(char *);
+static int   parse_address(char *, struct sockaddr *, socklen_t *);
 
 
 /*****************************************************************************
@@ -166,8 +226,35 @@ static int ungrab_fd(int grab);
 static void
 plugin_init(OhmPlugin *plugin)
 {
-    (void)plugin;
-    return;
+    const char *clients = ohm_plugin_get_param(plugin, "max-clients");
+    const char *input   = ohm_plugin_get_param(plugin, "input-buffer");
+    const char *output  = ohm_plugin_get_param(plugin, "output-buffer");
+    char       *end;
+    long        n;
+
+    if (clients != NULL) {
+        n = strtol(clients, &end, 10);
+        if (*end || n < 1)
+            OHM_WARNING("console: invalid max-clients '%s'", clients);
+        else
+            max_clients = (int)n;
+    }
+
+    if (input != NULL) {
+        n = strtol(input, &end, 10);
+        if (*end || n < 128)
+            OHM_WARNING("console: invalid input-buffer '%s'", input);
+        else
+            input_size = (size_t)n;
+    }
+
+    if (output != NULL) {
+        n = strtol(output, &end, 10);
+        if (*end || n < 128)
+            OHM_WARNING("console: invalid output-buffer '%s'", output);
+        else
+            output_size = (size_t)n;
+    }
 }
 
 
@@ -221,13 +308,20 @@ del_console(console_t *c)
         }
     }
 
+    if ((c->flags & (CONSOLE_LISTENER | CONSOLE_UNIX)) ==
+        (CONSOLE_LISTENER | CONSOLE_UNIX))
+        unlink(unix_path(c->endpoint));
+
     FREE(c->endpoint);
     close(c->sock);
     
     c->endpoint = NULL;
     c->sock     = -1;
-    c->used     = 0;
-    memset(c->buf, 0, c->size);
+    c->scan     = 0;
+    ring_free(&c->in);
+    ring_free(&c->out);
+    FREE(c->line);
+    c->line = NULL;
 
     if (c->nchild > 0) {
         for (i = 0; i < nconsole; i++) {
@@ -253,7 +347,8 @@ lookup_console(int id)
     unsigned int i;
 
     for (i = 0; i < nconsole; i++)
-        if (consoles[i] != NULL && consoles[i]->gid == (guint)id)
+        if (consoles[i] != NULL && consoles[i]->sock >= 0 &&
+            consoles[i]->id == id)
             return consoles[i];
     
     return NULL;
@@ -266,6 +361,11 @@ lookup_console(int id)
 
 /********************
  * console_open
+ *
+ * Open a console listening on address, which is either ip:port or a
+ * Unix-domain socket given as unix:path or an absolute path. multiple
+ * limits the number of simultaneous clients: 0 allows a single one, 1
+ * (TRUE) the configured default, anything larger that many clients.
  ********************/
 OHM_EXPORTABLE(int, console_open, (char *address,
                                    void (*opened)(int, struct sockaddr *, int),
@@ -273,64 +373,62 @@ OHM_EXPORTABLE(int, console_open, (char *address,
                                    void (*input)(int, char *, void *),
                                    void  *data, int multiple))
 {
-    console_t          *c = NULL;
-    struct sockaddr_in  sin;
-    char                addr[64], *portp, *end;
-    int                 len, reuse, flags;
-    GIOCondition        events;
-
-    if ((portp = strchr(address, ':')) == NULL)
-        return -1;
-    
-    len = (int)portp - (int)address;
-    strncpy(addr, address, len);
-    addr[len] = '\0';
-    portp++;
-
-    memset(&sin, 0, sizeof(sin));
-
-    sin.sin_family = AF_INET;
-    if (!inet_aton(addr, &sin.sin_addr))
-        return -1;
-    
-    sin.sin_port = strtoul(portp, &end, 10);
-    sin.sin_port = htons(sin.sin_port);
-    if (*end != '\0')
+    console_t               *c = NULL;
+    struct sockaddr_storage  ss;
+    struct sockaddr         *sa = (struct sockaddr *)&ss;
+    socklen_t                salen;
+    struct stat              st;
+    int                      reuse, flags;
+    GIOCondition             events;
+
+    if (parse_address(address, sa, &salen) < 0)
         return -1;
     
     if ((c = new_console()) == NULL)
         return -1;
 
-    if ((c->sock = socket(sin.sin_family, SOCK_STREAM, 0)) < 0)
+    if ((c->sock = socket(sa->sa_family, SOCK_STREAM, 0)) < 0)
         return -1;
 
+    c->id       = next_id++;
     c->endpoint = STRDUP(address);
     c->opened   = opened;
     c->closed   = closed;
     c->input    = input;
     c->data     = data;
     c->flags    = multiple ? CONSOLE_MULTIPLE : CONSOLE_SINGLE;
+    c->flags   |= CONSOLE_LISTENER;
+    c->limit    = multiple > 1 ? multiple : (multiple ? max_clients : 1);
     
-    reuse = 1;
-    setsockopt(c->sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-
-    if ((flags = fcntl(c->sock, F_GETFD, 0)) == 0) {
+    if (c->endpoint == NULL || c->sock < 0)
+        goto fail;
+    
+    if ((flags = fcntl(c->sock, F_GETFD, 0)) >= 0) {
         flags |= FD_CLOEXEC;
         fcntl(c->sock, F_SETFD, flags);
     }
     
-    if (c->endpoint == NULL || c->sock < 0)
-        goto fail;
-    
-    if (bind(c->sock, (struct sockaddr *)&sin, sizeof(sin)) != 0 ||
-        listen(c->sock, 2) != 0)
+    if (sa->sa_family == AF_UNIX) {
+        c->flags |= CONSOLE_UNIX;
+        /* remove a stale socket left behind by a previous instance */
+        if (lstat(unix_path(address), &st) == 0 && S_ISSOCK(st.st_mode))
+            unlink(unix_path(address));
+    }
+    else {
+        reuse = 1;
+        setsockopt(c->sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+
+    if (bind(c->sock, sa, salen) != 0 || listen(c->sock, 8) != 0)
         goto fail;
     
     if ((c->gio = g_io_channel_unix_new(c->sock)) == NULL)
         goto fail;
     
     events = G_IO_IN | G_IO_HUP;
-    return (c->gid = g_io_add_watch(c->gio, events, console_accept, c));
+    c->gid = g_io_add_watch(c->gio, events, console_accept, c);
+
+    return c->id;
     
  fail:
     if (c != NULL) {
@@ -344,13 +442,40 @@ OHM_EXPORTABLE(int, console_open, (char *address,
 }
 
 
+/********************
+ * console_limit
+ ********************/
+OHM_EXPORTABLE(int, console_limit, (int id, int max))
+{
+    console_t *c = lookup_console(id);
+
+    if (c == NULL || !(c->flags & CONSOLE_LISTENER) || max < 1)
+        return EINVAL;
+
+    c->limit = max;
+
+    if (max > 1)
+        c->flags |= CONSOLE_MULTIPLE;
+    else
+        c->flags &= ~CONSOLE_MULTIPLE;
+
+    return 0;
+}
+
+
 /********************
  * shutdown_console
  ********************/
 static void
 shutdown_console(console_t *c)
 {
-    g_source_remove(c->gid);
+    if (c->gid != 0)
+        g_source_remove(c->gid);
+    if (c->pending != 0)
+        g_source_remove(c->pending);
+    c->gid     = 0;
+    c->pending = 0;
+
     g_io_channel_unref(c->gio);
     del_console(c);
 }
@@ -387,7 +512,7 @@ OHM_EXPORTABLE(int, console_write, (int id, char *buf, size_t size))
     if (size == 0)
         size = strlen(buf);
 
-    return write(c->sock, buf, size);
+    return console_queue(c, buf, size);
 }
 
 
@@ -397,8 +522,8 @@ OHM_EXPORTABLE(int, console_write, (int id, char *buf, size_t size))
 OHM_EXPORTABLE(int, console_printf, (int id, char *fmt, ...))
 {
     console_t *c = lookup_console(id);
-    int        fd, len;
-    FILE      *fp;
+    char       buf[1024], *p;
+    int        len;
     va_list    ap;
 
     if (c == NULL) {
@@ -406,19 +531,25 @@ OHM_EXPORTABLE(int, console_printf, (int id, char *fmt, ...))
         return -1;
     }
     
-    if ((fd = dup(c->sock)) < 0)
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (len < 0)
         return -1;
-    
-    if ((fp = fdopen(fd, "w")) == NULL) {
-        close(fd);
+
+    if ((size_t)len < sizeof(buf))
+        return console_queue(c, buf, len);
+
+    if ((p = ALLOC_ARR(char, len + 1)) == NULL)
         return -1;
-    }
-    
+
     va_start(ap, fmt);
-    len = vfprintf(fp, fmt, ap);
+    vsnprintf(p, len + 1, fmt, ap);
     va_end(ap);
-    fflush(fp);
-    fclose(fp);
+
+    len = console_queue(c, p, len);
+    FREE(p);
 
     return len;
 }
@@ -476,6 +607,22 @@ ungrab_fd(int grab)
 }
 
 
+/********************
+ * grabbed
+ ********************/
+static int
+grabbed(console_t *c)
+{
+    int i;
+
+    for (i = 0; i < MAX_GRABS; i++)
+        if (c->grabs[i] != 0)
+            return TRUE;
+
+    return FALSE;
+}
+
+
 /********************
  * console_grab
  ********************/
@@ -499,6 +646,16 @@ OHM_EXPORTABLE(int, console_grab, (int id, int fd))
 
     if (empty < 0)
         return ENOSPC;
+
+    /*
+     * Writes to a grabbed fd go to the socket directly, bypassing our
+     * output buffer. Flush what is pending so they do not overtake it.
+     */
+    if (console_drain(c) < 0)
+        return errno;
+
+    if (!c->active)
+        console_watch(c);
     
     if ((c->grabs[empty] = grab_fd(fd, c->sock)) == 0)
         return errno;
@@ -608,11 +765,10 @@ OHM_EXPORTABLE(int, console_ungrab, (int id))
 static gboolean
 console_accept(GIOChannel *source, GIOCondition condition, gpointer data)
 {
-    console_t          *lc = (console_t *)data;
-    console_t          *c;
-    struct sockaddr_in  addr;
-    socklen_t           addrlen = sizeof(addr);
-    int                 sock, flags;
+    console_t               *lc = (console_t *)data;
+    struct sockaddr_storage  addr;
+    socklen_t                addrlen = sizeof(addr);
+    int                      sock, flags;
 
     (void)source;
 
@@ -622,31 +778,46 @@ console_accept(GIOChannel *source, GIOCondition condition, gpointer data)
     if ((sock = accept(lc->sock, (struct sockaddr *)&addr, &addrlen)) < 0)
         return TRUE;
     
-    if ((flags = fcntl(lc->sock, F_GETFD, 0)) == 0) {
+    if ((flags = fcntl(sock, F_GETFD, 0)) >= 0) {
         flags |= FD_CLOEXEC;
-        fcntl(lc->sock, F_SETFD, flags);
+        fcntl(sock, F_SETFD, flags);
     }
     
-    if (lc->nchild > 1 && !(lc->flags & CONSOLE_MULTIPLE)) {
-        write(sock, BUSY_MESSAGE, sizeof(BUSY_MESSAGE) - 1);
+    if (lc->nchild >= lc->limit) {
+        send(sock, BUSY_MESSAGE, sizeof(BUSY_MESSAGE) - 1,
+             MSG_DONTWAIT | MSG_NOSIGNAL);
         close(sock);
         return TRUE;
     }
     
+    console_attach(lc, sock, (struct sockaddr *)&addr, (int)addrlen);
+
+    return TRUE;
+}
+
+
+/********************
+ * console_attach
+ ********************/
+static console_t *
+console_attach(console_t *lc, int sock, struct sockaddr *addr, int addrlen)
+{
+    console_t *c;
+
     if ((c = new_console()) == NULL)
         goto fail;
 
+    c->id       = next_id++;
     c->endpoint = STRDUP(lc->endpoint);
-    c->size     = BUFFER_CHUNK;
-    c->used     = 0;
-    c->buf      = ALLOC_ARR(char, c->size);
     c->sock     = sock;
     c->opened   = lc->opened;
     c->closed   = lc->closed;
     c->input    = lc->input;
     c->data     = lc->data;
+    c->line     = ALLOC_ARR(char, input_size + 1);
 
-    if (c->endpoint == NULL || c->buf == NULL)
+    if (c->endpoint == NULL || c->line == NULL ||
+        !ring_init(&c->in, input_size) || !ring_init(&c->out, output_size))
         goto fail;
 
     if ((c->gio = g_io_channel_unix_new(c->sock)) == NULL)
@@ -655,24 +826,30 @@ console_accept(GIOChannel *source, GIOCondition condition, gpointer data)
     c->parent = lc;
     lc->nchild++;
 
-    c->gid = g_io_add_watch(c->gio, G_IO_IN | G_IO_HUP, console_handler, c);
+    console_watch(c);
     
-    CALLBACK(c, opened, (struct sockaddr *)&addr, (int)addrlen);
-    if (CLOSED(c))
+    CALLBACK(c, opened, addr, addrlen);
+    if (CLOSED(c)) {
         shutdown_console(c);
+        return NULL;
+    }
 
-    return TRUE;
+    return c;
 
  fail:
     if (sock >= 0)
         close(sock);
     if (c) {
         FREE(c->endpoint);
+        ring_free(&c->in);
+        ring_free(&c->out);
+        FREE(c->line);
         c->endpoint = NULL;
+        c->line     = NULL;
         c->sock     = -1;
     }
 
-    return TRUE;
+    return NULL;
 }
 
 
@@ -682,22 +859,385 @@ console_accept(GIOChannel *source, GIOCondition condition, gpointer data)
 static int
 console_read(console_t *c)
 {
-    int n, left = c->size - c->used - 1;
-    
-    if (left < BUFFER_CHUNK) {
-        if (REALLOC_ARR(c->buf, c->size, c->size + BUFFER_CHUNK) == NULL)
-            return -ENOMEM;
-        c->size += BUFFER_CHUNK;
+    char   *buf;
+    size_t  left;
+    int     n, total;
+
+    /*
+     * Read at most what fits in the input buffer. Anything beyond that is
+     * left in the socket until we have consumed some of the buffered lines.
+     */
+
+    total = 0;
+    while ((buf = ring_tail(&c->in, &left)) != NULL) {
+        n = recv(c->sock, buf, left, MSG_DONTWAIT);
+
+        if (n > 0) {
+            c->in.used += n;
+            total      += n;
+            if ((size_t)n < left)
+                break;
+        }
+        else if (n == 0) {
+            c->flags |= CONSOLE_EOF;
+            break;
+        }
+        else if (errno == EINTR)
+            continue;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else
+            return -1;
+    }
+
+    return total;
+}
+
+
+/********************
+ * console_line
+ ********************/
+static int
+console_line(console_t *c)
+{
+    size_t i;
+    char   ch;
+
+    /*
+     * Extract the next line terminated by '\n', '\r\n' or '\r'. A '\r'
+     * might be followed by a '\n' we have not received yet, so remember
+     * it and swallow the '\n' once it turns up.
+     */
+
+    while (c->in.used > 0) {
+        if (c->flags & CONSOLE_CR) {
+            c->flags &= ~CONSOLE_CR;
+            if (RING_AT(&c->in, 0) == '\n') {
+                ring_drop(&c->in, 1);
+                continue;
+            }
+        }
+
+        for (i = c->scan; i < c->in.used; i++) {
+            ch = RING_AT(&c->in, i);
+            if (ch == '\n' || ch == '\r')
+                break;
+        }
+
+        if (i == c->in.used) {
+            if (c->in.used < c->in.size) {
+                c->scan = i;
+                return FALSE;
+            }
+
+            /* a full buffer without a newline, drop it up to the next one */
+            if (!(c->flags & CONSOLE_DISCARD))
+                console_queue(c, LONG_MESSAGE, sizeof(LONG_MESSAGE) - 1);
+            c->flags |= CONSOLE_DISCARD;
+            ring_drop(&c->in, c->in.used);
+            c->scan = 0;
+            return FALSE;
+        }
+
+        c->scan = 0;
+        if (ch == '\r')
+            c->flags |= CONSOLE_CR;
+
+        if (c->flags & CONSOLE_DISCARD) {
+            c->flags &= ~CONSOLE_DISCARD;
+            ring_drop(&c->in, i + 1);
+            continue;
+        }
+
+        ring_get(&c->in, c->line, i);
+        ring_drop(&c->in, 1);
+        c->line[i] = '\0';
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+/********************
+ * console_input
+ ********************/
+static int
+console_input(console_t *c, int budget)
+{
+    int n;
+
+    /*
+     * Hand at most budget lines to the input callback, so a client
+     * pipelining lots of input cannot starve the others. Returns 1 if
+     * there might be more lines buffered, 0 if not or if we need to wait
+     * for the client to read its output first, and -1 if the console got
+     * closed by the callback.
+     */
+
+    for (n = 0; budget < 0 || n < budget; n++) {
+        if (THROTTLED(c) || !console_line(c))
+            return 0;
+
+        CALLBACK(c, input, c->line, c->data);
+
+        if (CLOSED(c))
+            return -1;
     }
 
-    switch ((n = read(c->sock, c->buf + c->used, left))) {
-    case  0:
+    return 1;
+}
+
+
+/********************
+ * console_process
+ ********************/
+static int
+console_process(console_t *c)
+{
+    int more;
+
+    if (c->flags & CONSOLE_EOF) {
+        if (console_input(c, -1) >= 0)
+            CALLBACK(c, closed);
+        return -1;
+    }
+
+    if ((more = console_input(c, LINE_BUDGET)) < 0)
+        return -1;
+
+    console_watch(c);
+
+    return more;
+}
+
+
+/********************
+ * console_pending
+ ********************/
+static gboolean
+console_pending(gpointer data)
+{
+    console_t *c = (console_t *)data;
+
+    switch (console_process(c)) {
     case -1:
-        return n;
+        c->pending = 0;
+        shutdown_console(c);
+        return FALSE;
+    case 0:
+        c->pending = 0;
+        return FALSE;
     default:
-        c->used += n;
-        return c->used;
+        return TRUE;
+    }
+}
+
+
+/********************
+ * console_watch
+ ********************/
+static void
+console_watch(console_t *c)
+{
+    GIOCondition cond = 0;
+
+    /*
+     * Stop reading input while the buffer is full or the client is not
+     * reading its output. Unread input then stays in the socket, which
+     * eventually pushes back on the client.
+     */
+
+    if (!(c->flags & CONSOLE_EOF) && RING_SPACE(&c->in) > 0 && !THROTTLED(c))
+        cond |= G_IO_IN | G_IO_HUP;
+
+    if (c->out.used > 0)
+        cond |= G_IO_OUT;
+
+    if (cond == c->cond && (c->gid != 0 || cond == 0))
+        return;
+
+    if (c->gid != 0)
+        g_source_remove(c->gid);
+
+    c->cond = cond;
+    c->gid  = 0;
+
+    if (cond != 0)
+        c->gid = g_io_add_watch(c->gio, cond | G_IO_ERR, console_handler, c);
+}
+
+
+/********************
+ * console_flush
+ ********************/
+static int
+console_flush(console_t *c)
+{
+    char   *buf;
+    size_t  len;
+    int     n;
+
+    while ((buf = ring_head(&c->out, &len)) != NULL) {
+        n = send(c->sock, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (n > 0)
+            ring_drop(&c->out, n);
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        else
+            return -1;
+    }
+
+    if (c->out.used == 0) {
+        c->flags &= ~CONSOLE_TRUNCATE;
+        if (c->out.size > output_size)
+            ring_resize(&c->out, output_size);
+    }
+
+    return 0;
+}
+
+
+/********************
+ * console_send
+ ********************/
+static int
+console_send(console_t *c, const char *buf, size_t size)
+{
+    struct pollfd pfd;
+    size_t        sent;
+    int           n;
+
+    /*
+     * Write out all of buf, waiting for the client to read it if
+     * necessary. Only used while writes to grabbed fds block anyway.
+     */
+
+    pfd.fd     = c->sock;
+    pfd.events = POLLOUT;
+
+    for (sent = 0; sent < size; ) {
+        n = send(c->sock, buf + sent, size - sent,
+                 MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (n > 0)
+            sent += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+                return -1;
+        }
+        else
+            return -1;
     }
+
+    return 0;
+}
+
+
+/********************
+ * console_drain
+ ********************/
+static int
+console_drain(console_t *c)
+{
+    char   *buf;
+    size_t  len;
+
+    while ((buf = ring_head(&c->out, &len)) != NULL) {
+        if (console_send(c, buf, len) < 0)
+            return -1;
+        ring_drop(&c->out, len);
+    }
+
+    return console_flush(c);
+}
+
+
+/********************
+ * console_queue
+ ********************/
+static int
+console_queue(console_t *c, const char *buf, size_t size)
+{
+    size_t sent, queued, left, space, mark, grow, limit;
+    int    n;
+
+    if (c->flags & CONSOLE_LISTENER) {
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    /* keep the order of our output and that written to grabbed fds */
+    if (grabbed(c)) {
+        if (console_drain(c) < 0 || console_send(c, buf, size) < 0)
+            return -1;
+        return (int)size;
+    }
+
+    /* write directly if nothing is pending, queue whatever is left */
+    sent = 0;
+    if (c->out.used == 0) {
+        n = send(c->sock, buf, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (n >= 0)
+            sent = n;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            return -1;
+
+        if (sent == size)
+            return (int)size;
+    }
+
+    /*
+     * Output produced by a callback has nowhere else to go, so let the
+     * buffer grow for it (up to a limit). If it still does not fit, drop
+     * the rest until the client catches up and tell it so.
+     */
+    left = size - sent;
+
+    if (RING_SPACE(&c->out) < left && c->active) {
+        limit = output_size * OUTPUT_GROWTH;
+        for (grow = c->out.size * 2; grow < c->out.used + left; grow *= 2)
+            ;
+        ring_resize(&c->out, grow < limit ? grow : limit);
+    }
+
+    if (c->flags & CONSOLE_TRUNCATE)
+        queued = 0;
+    else if (RING_SPACE(&c->out) >= left)
+        queued = ring_put(&c->out, buf + sent, left);
+    else {
+        mark  = sizeof(TRUNC_MESSAGE) - 1;
+        space = RING_SPACE(&c->out);
+
+        if (space >= mark)
+            queued = ring_put(&c->out, buf + sent, space - mark);
+        else {
+            c->out.used -= mark - space;         /* not sent yet, make room */
+            queued = 0;
+        }
+
+        ring_put(&c->out, TRUNC_MESSAGE, mark);
+        c->flags |= CONSOLE_TRUNCATE;
+
+        OHM_WARNING("console: output of console #%d truncated", c->id);
+    }
+
+    if (!c->active)
+        console_watch(c);
+
+    if (sent + queued == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return (int)(sent + queued);
 }
 
 
@@ -707,44 +1247,36 @@ console_read(console_t *c)
 static gboolean
 console_handler(GIOChannel *source, GIOCondition condition, gpointer data)
 {
-    console_t    *c = (console_t *)data;
-    int           left = c->size - c->used - 1;
-    unsigned int  i;
+    console_t *c = (console_t *)data;
 
     (void)source;
 
+    if (condition & G_IO_OUT) {
+        if (console_flush(c) < 0) {
+            CALLBACK(c, closed);
+            goto closed;
+        }
+    }
+
     if (condition & G_IO_IN) {
-        switch (console_read(c)) {
-        case -1:
-            break;
-        case 0:
+        if (console_read(c) < 0) {
+            CALLBACK(c, closed);
             goto closed;
-        default:
-            for (i = 0; i < c->used; i++)
-                if (c->buf[i] == '\r') {
-                    c->buf[i] = '\0';
-                    if (i < c->used && c->buf[i+1] == '\n') {
-                        i++;
-                        c->buf[++i] = '\0';
-                    }
-                    CALLBACK(c, input, c->buf, c->data);
-                    if (CLOSED(c))
-                        goto closed;
-                    if ((left = c->used - i - 1) > 0) {
-                        memmove(c->buf, c->buf + i + 1, left);
-                        c->used         -= i + 1;
-                        c->buf[c->used]  = '\0';
-                        i                = 0;
-                    }
-                    else
-                        c->used = 0;
-                }
         }
     }
-    
-    if (condition & G_IO_HUP) {
-        CALLBACK(c, closed);
+    else if (condition & (G_IO_HUP | G_IO_ERR))
+        c->flags |= CONSOLE_EOF;
+
+    switch (console_process(c)) {
+    case -1:
         goto closed;
+    case 0:
+        break;
+    default:
+        /* more lines buffered, continue once the others had their turn */
+        if (!c->pending)
+            c->pending = g_idle_add_full(G_PRIORITY_DEFAULT,
+                                         console_pending, c, NULL);
     }
 
     return TRUE;
@@ -755,6 +1287,235 @@ console_handler(GIOChannel *source, GIOCondition condition, gpointer data)
 }
 
 
+/*****************************************************************************
+ *                            *** ring buffers ***                           *
+ *****************************************************************************/
+
+/********************
+ * ring_init
+ ********************/
+static int
+ring_init(ring_t *r, size_t size)
+{
+    r->data = ALLOC_ARR(char, size);
+    r->size = r->data ? size : 0;
+    r->head = 0;
+    r->used = 0;
+
+    return r->data != NULL;
+}
+
+
+/********************
+ * ring_free
+ ********************/
+static void
+ring_free(ring_t *r)
+{
+    FREE(r->data);
+    memset(r, 0, sizeof(*r));
+}
+
+
+/********************
+ * ring_resize
+ ********************/
+static int
+ring_resize(ring_t *r, size_t size)
+{
+    char   *data;
+    size_t  used;
+
+    if (size < r->used)
+        return FALSE;
+
+    if (size == r->size)
+        return TRUE;
+
+    if ((data = ALLOC_ARR(char, size)) == NULL)
+        return FALSE;
+
+    used = ring_get(r, data, r->used);
+
+    FREE(r->data);
+    r->data = data;
+    r->size = size;
+    r->head = 0;
+    r->used = used;
+
+    return TRUE;
+}
+
+
+/********************
+ * ring_put
+ ********************/
+static size_t
+ring_put(ring_t *r, const char *buf, size_t size)
+{
+    size_t n, len, total;
+    char  *p;
+
+    total = 0;
+    while (total < size && (p = ring_tail(r, &len)) != NULL) {
+        n = size - total < len ? size - total : len;
+        memcpy(p, buf + total, n);
+        r->used += n;
+        total   += n;
+    }
+
+    return total;
+}
+
+
+/********************
+ * ring_get
+ ********************/
+static size_t
+ring_get(ring_t *r, char *buf, size_t size)
+{
+    size_t n, len, total;
+    char  *p;
+
+    total = 0;
+    while (total < size && (p = ring_head(r, &len)) != NULL) {
+        n = size - total < len ? size - total : len;
+        memcpy(buf + total, p, n);
+        ring_drop(r, n);
+        total += n;
+    }
+
+    return total;
+}
+
+
+/********************
+ * ring_drop
+ ********************/
+static void
+ring_drop(ring_t *r, size_t size)
+{
+    if (size >= r->used) {
+        r->head = 0;
+        r->used = 0;
+    }
+    else {
+        r->head  = (r->head + size) % r->size;
+        r->used -= size;
+    }
+}
+
+
+/********************
+ * ring_head
+ ********************/
+static char *
+ring_head(ring_t *r, size_t *len)
+{
+    if (r->used == 0)
+        return NULL;
+
+    if (r->head + r->used <= r->size)
+        *len = r->used;
+    else
+        *len = r->size - r->head;
+
+    return r->data + r->head;
+}
+
+
+/********************
+ * ring_tail
+ ********************/
+static char *
+ring_tail(ring_t *r, size_t *len)
+{
+    size_t tail;
+
+    if (r->used == r->size)
+        return NULL;
+
+    tail = (r->head + r->used) % r->size;
+
+    if (tail >= r->head)
+        *len = r->size - tail;
+    else
+        *len = r->head - tail;
+
+    return r->data + tail;
+}
+
+
+/*****************************************************************************
+ *                             *** addresses ***                             *
+ *****************************************************************************/
+
+/********************
+ * unix_path
+ ********************/
+static char *
+unix_path(char *address)
+{
+    if (!strncmp(address, "unix:", 5))
+        return address + 5;
+    else
+        return address;
+}
+
+
+/********************
+ * parse_address
+ ********************/
+static int
+parse_address(char *address, struct sockaddr *sa, socklen_t *salen)
+{
+    struct sockaddr_in *sin = (struct sockaddr_in *)sa;
+    struct sockaddr_un *sun = (struct sockaddr_un *)sa;
+    char                addr[64], *portp, *path, *end;
+    size_t              len;
+    unsigned long       port;
+
+    if (!strncmp(address, "unix:", 5) || address[0] == '/') {
+        path = unix_path(address);
+
+        if (!*path || strlen(path) >= sizeof(sun->sun_path))
+            return -1;
+
+        memset(sun, 0, sizeof(*sun));
+        sun->sun_family = AF_UNIX;
+        strcpy(sun->sun_path, path);
+        *salen = sizeof(*sun);
+
+        return AF_UNIX;
+    }
+
+    if ((portp = strchr(address, ':')) == NULL)
+        return -1;
+    
+    if ((len = portp - address) >= sizeof(addr))
+        return -1;
+
+    strncpy(addr, address, len);
+    addr[len] = '\0';
+    portp++;
+
+    memset(sin, 0, sizeof(*sin));
+
+    sin->sin_family = AF_INET;
+    if (!inet_aton(addr, &sin->sin_addr))
+        return -1;
+    
+    port = strtoul(portp, &end, 10);
+    if (*end != '\0' || port > 0xffff)
+        return -1;
+
+    sin->sin_port = htons(port);
+    *salen = sizeof(*sin);
+
+    return AF_INET;
+}
+
+
 OHM_PLUGIN_DESCRIPTION("console",
                        "0.0.0",
                        "krisztian.litkey@nokia.com",
@@ -763,8 +1524,9 @@ OHM_PLUGIN_DESCRIPTION("console",
                        plugin_exit,
                        NULL);
 
-OHM_PLUGIN_PROVIDES_METHODS(console, 6,
+OHM_PLUGIN_PROVIDES_METHODS(console, 7,
     OHM_EXPORT(console_open  , "open"  ),
+    OHM_EXPORT(console_limit , "limit" ),
     OHM_EXPORT(console_close , "close" ),
     OHM_EXPORT(console_write , "write" ),
     OHM_EXPORT(console_printf, "printf"),
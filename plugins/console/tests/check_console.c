@@ -0,0 +1,614 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_console.c
+ * @brief console clients driven over socketpairs and Unix-domain sockets
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#include "../console.c"
+
+#define NCLIENT    32                   /* concurrent clients */
+#define NLINE      200                  /* pipelined lines per client */
+#define NECHO      2000                 /* lines in the back-pressure test */
+#define ECHO_SIZE  512                  /* reply to each of them */
+#define MAX_LOG    (NCLIENT * NLINE)
+
+static char       dir[PATH_MAX];
+static char       address[PATH_MAX];
+static int        lid;                  /* listening console */
+static console_t *lc;
+
+static struct {
+    int id;                             /* console the line came from */
+    int seq;                            /* sequence number in the line */
+} lines[MAX_LOG];
+static char       text[16][32];         /* first lines received */
+static char       last[256];            /* last line received */
+static int        nline;
+static int        nopen, nclose;
+static int        echo;                 /* reply ECHO_SIZE bytes per line */
+static size_t     burst;                /* reply this many bytes per line */
+static int        written;              /*   of which this many were taken */
+static int        grabfd;               /* write to this fd grabbed */
+static char       output[(OUTPUT_GROWTH + 2) * DEFAULT_OUTPUT];
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * console callbacks
+ */
+
+static void opened(int id, struct sockaddr *addr, int addrlen)
+{
+    (void)id;
+    (void)addr;
+    (void)addrlen;
+
+    nopen++;
+}
+
+static void closed(int id)
+{
+    (void)id;
+
+    nclose++;
+}
+
+static void input(int id, char *line, void *data)
+{
+    static char reply[ECHO_SIZE];
+
+    (void)data;
+
+    fail_unless(strlen(line) < sizeof(last), "line of %zd bytes",
+                strlen(line));
+    strcpy(last, line);
+    if (nline < 16)
+        snprintf(text[nline], sizeof(text[nline]), "%s", line);
+
+    if (nline < MAX_LOG) {
+        lines[nline].id  = id;
+        lines[nline].seq = strtol(line, NULL, 10);
+    }
+    nline++;
+
+    if (echo) {
+        memset(reply, 'r', sizeof(reply) - 1);
+        reply[sizeof(reply) - 1] = '\n';
+        fail_unless(console_write(id, reply, sizeof(reply)) == sizeof(reply),
+                    "reply to line %d truncated", nline);
+    }
+
+    if (burst > 0) {
+        memset(output, 'b', burst);
+        written = console_write(id, output, burst);
+    }
+
+    if (grabfd >= 0) {
+        fail_unless(console_grab(id, grabfd) == 0, "failed to grab fd");
+        fail_unless(write(grabfd, "grabbed\n", 8) == 8, "grabbed write");
+        console_printf(id, "after\n");
+        fail_unless(console_ungrab(id, grabfd) == 0, "failed to ungrab fd");
+    }
+}
+
+
+/*
+ * helpers
+ */
+
+static void run(void)
+{
+    int idle = 0;
+
+    while (idle < 3)
+        if (!g_main_context_iteration(NULL, FALSE))
+            idle++;
+        else
+            idle = 0;
+}
+
+static console_t *client(int *fd)
+{
+    console_t *c;
+    int        sv[2];
+
+    fail_if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0, "socketpair failed");
+
+    c = console_attach(lc, sv[0], NULL, 0);
+    fail_if(c == NULL, "failed to attach client");
+    *fd = sv[1];
+
+    return c;
+}
+
+static void send_str(int fd, const char *str)
+{
+    int len = strlen(str);
+
+    fail_unless(send(fd, str, len, 0) == len, "failed to send '%s'", str);
+}
+
+static void small_buffers(console_t *c, int fd)
+{
+    int size = 4096, flags;
+
+    setsockopt(c->sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* read everything the console has for the client */
+static int receive(console_t *c, int fd, char *buf, int size)
+{
+    int nread, n, i;
+
+    nread = 0;
+    for (i = 0; i < 100000; i++) {
+        while ((n = recv(fd, buf + nread, size - nread, MSG_DONTWAIT)) > 0)
+            nread += n;
+        if (!g_main_context_iteration(NULL, FALSE) && c->out.used == 0)
+            break;
+    }
+
+    return nread;
+}
+
+static int connect_unix(void)
+{
+    struct sockaddr_un sun;
+    int                fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    fail_if(fd < 0, "failed to create socket");
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, unix_path(address));
+    fail_if(connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0,
+            "failed to connect to %s", address);
+
+    return fd;
+}
+
+static void setup(void)
+{
+    snprintf(dir, sizeof(dir), "/tmp/ohm-console-XXXXXX");
+    fail_if(mkdtemp(dir) == NULL, "failed to create %s", dir);
+    snprintf(address, sizeof(address), "unix:%s/console", dir);
+
+    lid = console_open(address, opened, closed, input, NULL, NCLIENT + 1);
+    fail_if(lid < 0, "failed to open console %s", address);
+    lc = lookup_console(lid);
+
+    nline = nopen = nclose = echo = 0;
+    burst  = 0;
+    grabfd = -1;
+    last[0] = '\0';
+}
+
+static void teardown(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < nconsole; i++)
+        if (consoles[i] != NULL && consoles[i]->sock >= 0 &&
+            consoles[i]->id != lid)
+            console_close(consoles[i]->id);
+
+    console_close(lid);
+    fail_if(access(unix_path(address), F_OK) == 0, "socket left behind");
+    rmdir(dir);
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_console_framing)
+{
+    const char *expected[] = { "alpha", "beta", "gamma", "delta", "epsilon",
+                               "", "zeta", "eta", "last" };
+    int         fd, i;
+
+    client(&fd);
+
+    send_str(fd, "alpha\nbeta\r\ngamma\rdelta\r");
+    run();
+    fail_unless(nline == 4, "%d lines", nline);
+
+    /* the '\n' of a '\r\n' split across reads is not an empty line */
+    send_str(fd, "\nepsilon\n\nzeta\r");
+    run();
+    send_str(fd, "\n");
+    run();
+    send_str(fd, "eta\nlast");
+    run();
+    fail_unless(nline == 8, "%d lines", nline);
+
+    /* input is flushed and the close reported when the client goes away */
+    send_str(fd, "\n");
+    close(fd);
+    run();
+
+    fail_unless(nline == 9, "%d lines", nline);
+    fail_unless(nclose == 1, "%d closes reported", nclose);
+
+    for (i = 0; i < nline; i++)
+        fail_unless(!strcmp(text[i], expected[i]), "line #%d: '%s', "
+                    "expected '%s'", i, text[i], expected[i]);
+}
+END_TEST
+
+START_TEST (test_console_fairness)
+{
+    console_t *c[NCLIENT];
+    int        fd[NCLIENT], next[NCLIENT];
+    char       buf[NLINE * 16], *p;
+    int        i, j, run_len, max_run, seen;
+
+    for (i = 0; i < NCLIENT; i++) {
+        c[i] = client(fd + i);
+        next[i] = 0;
+
+        /* everything pipelined at once, with a mix of line endings */
+        for (j = 0, p = buf; j < NLINE; j++)
+            p += sprintf(p, "%d%s", j, j % 3 == 0 ? "\r\n" :
+                         j % 3 == 1 ? "\n" : "\r");
+        send_str(fd[i], buf);
+    }
+
+    run();
+
+    fail_unless(nline == NCLIENT * NLINE, "%d of %d lines", nline,
+                NCLIENT * NLINE);
+
+    max_run = run_len = 0;
+    for (i = 0; i < nline; i++) {
+        for (j = 0; j < NCLIENT; j++)
+            if (c[j]->id == lines[i].id)
+                break;
+
+        fail_if(j == NCLIENT, "line from unknown console %d", lines[i].id);
+        fail_unless(lines[i].seq == next[j], "client #%d: line %d, "
+                    "expected %d", j, lines[i].seq, next[j]);
+        next[j]++;
+
+        if (i > 0 && lines[i].id == lines[i - 1].id)
+            run_len++;
+        else
+            run_len = 1;
+        if (run_len > max_run)
+            max_run = run_len;
+    }
+
+    /* nobody gets more than a budget in a row, everybody gets a turn */
+    for (i = 0, seen = 0; i < NCLIENT * LINE_BUDGET; i++)
+        for (j = 0; j < NCLIENT; j++)
+            if (c[j]->id == lines[i].id && next[j] >= 0) {
+                next[j] = -1;
+                seen++;
+            }
+
+    printf("%d clients, %d lines: longest run from one client %d, "
+           "%d clients served within the first %d lines\n", NCLIENT, nline,
+           max_run, seen, NCLIENT * LINE_BUDGET);
+
+    fail_unless(max_run <= LINE_BUDGET, "%d lines in a row", max_run);
+    fail_unless(seen == NCLIENT, "%d of %d clients served", seen, NCLIENT);
+
+    for (i = 0; i < NCLIENT; i++) {
+        fail_unless(c[i]->in.size == input_size &&
+                    c[i]->out.size == output_size, "buffers resized");
+        close(fd[i]);
+    }
+    run();
+}
+END_TEST
+
+START_TEST (test_console_backpressure)
+{
+    console_t *c;
+    char       buf[4096];
+    int        fd, size, flags, nsent, nread, n, i, stalled;
+
+    echo = TRUE;
+    c    = client(&fd);
+
+    size = 4096;
+    setsockopt(c->sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    /* keep pushing input without ever reading the replies */
+    nsent = stalled = 0;
+    for (i = 0; i < 1000 && nsent < NECHO; i++) {
+        while (nsent < NECHO && send(fd, "x\n", 2, MSG_DONTWAIT) == 2)
+            nsent++;
+        g_main_context_iteration(NULL, FALSE);
+
+        fail_unless(c->in.used <= input_size && c->out.used <= output_size,
+                    "buffer overrun");
+    }
+
+    stalled = nline;
+    printf("client not reading: %d of %d lines sent, %d processed, "
+           "%zd bytes of output pending\n", nsent, NECHO, stalled,
+           c->out.used);
+
+    fail_unless(nsent < NECHO, "input never pushed back");
+    fail_unless(stalled < nsent, "input processed without output space");
+
+    /* once the client reads, everything goes through */
+    nread = 0;
+    for (i = 0; i < 100000 && (nsent < NECHO || nread < NECHO * ECHO_SIZE);
+         i++) {
+        while (nsent < NECHO && send(fd, "x\n", 2, MSG_DONTWAIT) == 2)
+            nsent++;
+        while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+            nread += n;
+        g_main_context_iteration(NULL, FALSE);
+
+        fail_unless(c->in.used <= input_size && c->out.used <= output_size,
+                    "buffer overrun");
+    }
+
+    fail_unless(nline == NECHO, "%d of %d lines processed", nline, NECHO);
+    fail_unless(nread == NECHO * ECHO_SIZE, "%d of %d bytes of output",
+                nread, NECHO * ECHO_SIZE);
+    fail_unless(c->in.size == input_size && c->out.size == output_size,
+                "buffers resized");
+
+    close(fd);
+    run();
+}
+END_TEST
+
+START_TEST (test_console_limit)
+{
+    char buf[256];
+    int  fd[3], n;
+
+    fail_unless(console_limit(lid, 2) == 0, "failed to set client limit");
+
+    fd[0] = connect_unix();
+    fd[1] = connect_unix();
+    run();
+    fd[2] = connect_unix();
+    run();
+
+    fail_unless(nopen == 2, "%d clients accepted", nopen);
+
+    n = recv(fd[2], buf, sizeof(buf) - 1, 0);
+    fail_unless(n == sizeof(BUSY_MESSAGE) - 1, "no busy message");
+    fail_unless(recv(fd[2], buf, sizeof(buf), 0) == 0, "refused client open");
+    close(fd[2]);
+
+    /* a slot frees up when a client leaves */
+    close(fd[0]);
+    run();
+    fd[0] = connect_unix();
+    run();
+
+    fail_unless(nopen == 3 && nclose == 1, "%d opened, %d closed", nopen,
+                nclose);
+
+    send_str(fd[0], "hello\r\n");
+    run();
+    fail_unless(!strcmp(last, "hello"), "got '%s'", last);
+
+    close(fd[0]);
+    close(fd[1]);
+    run();
+}
+END_TEST
+
+START_TEST (test_console_overlong)
+{
+    char buf[8192];
+    int  fd, n;
+
+    client(&fd);
+
+    memset(buf, 'a', 5000);
+    strcpy(buf + 5000, "\nok\n");
+    send_str(fd, buf);
+    run();
+
+    fail_unless(nline == 1 && !strcmp(last, "ok"), "%d lines, last '%s'",
+                nline, last);
+
+    n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    fail_unless(n == sizeof(LONG_MESSAGE) - 1, "no notice of the long line");
+
+    close(fd);
+    run();
+}
+END_TEST
+
+START_TEST (test_console_truncate)
+{
+    console_t *c;
+    size_t     mark = sizeof(TRUNC_MESSAGE) - 1;
+    int        fd, nread;
+
+    c = client(&fd);
+    small_buffers(c, fd);
+
+    /* a reply of a few buffers' worth is delivered in full */
+    burst = 4 * output_size;
+    send_str(fd, "x\n");
+    run();
+
+    fail_unless(written == (int)burst, "%d of %zd bytes taken", written, burst);
+    fail_unless(c->out.size > output_size, "output buffer did not grow");
+
+    nread = receive(c, fd, output, sizeof(output));
+    fail_unless(nread == (int)burst, "%d of %zd bytes received", nread, burst);
+    fail_unless(c->out.size == output_size, "output buffer did not shrink");
+
+    /* beyond the limit the rest is dropped, and the client is told so */
+    burst = sizeof(output);
+    send_str(fd, "x\n");
+    run();
+
+    fail_unless(written > 0 && written < (int)burst, "%d of %zd bytes taken",
+                written, burst);
+
+    nread = receive(c, fd, output, sizeof(output));
+    fail_unless(nread == written + (int)mark, "%d bytes received for %d",
+                nread, written);
+    fail_if(memcmp(output + written, TRUNC_MESSAGE, mark),
+            "no notice of the truncated output");
+
+    /* once the client caught up, output flows normally again */
+    burst = 100;
+    send_str(fd, "x\n");
+    run();
+
+    nread = receive(c, fd, output, sizeof(output));
+    fail_unless(written == 100 && nread == 100, "%d bytes taken, %d received",
+                written, nread);
+
+    close(fd);
+    run();
+}
+END_TEST
+
+START_TEST (test_console_grab)
+{
+    console_t *c;
+    char       path[PATH_MAX], buf[4096], *p;
+    int        fd, out, n, nread, i;
+    pid_t      pid;
+
+    c = client(&fd);
+    small_buffers(c, fd);
+
+    /* a slow client that collects its output in a file */
+    snprintf(path, sizeof(path), "%s/output", dir);
+    if ((pid = fork()) == 0) {
+        close(c->sock);
+        out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        send(fd, "x\n", 2, 0);
+        usleep(100000);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+            if (write(out, buf, n) != n)
+                _exit(1);
+        _exit(0);
+    }
+    close(fd);
+
+    /* the reply is pending in our buffer when the callback grabs an fd */
+    burst  = 4 * output_size;
+    grabfd = open("/dev/null", O_WRONLY);
+
+    while (nline == 0)
+        g_main_context_iteration(NULL, TRUE);
+
+    console_close(c->id);
+    waitpid(pid, NULL, 0);
+    close(grabfd);
+    grabfd = -1;
+
+    fail_unless((out = open(path, O_RDONLY)) >= 0, "no output");
+    for (nread = 0; (n = read(out, output + nread, sizeof(output) - nread)) > 0;
+         nread += n)
+        ;
+    close(out);
+    unlink(path);
+
+    fail_unless(nread == (int)burst + 14, "%d bytes received", nread);
+    for (i = 0, p = output; i < (int)burst; i++)
+        fail_unless(p[i] == 'b', "grabbed output overtook byte #%d", i);
+    fail_if(memcmp(output + burst, "grabbed\nafter\n", 14),
+            "output out of order");
+}
+END_TEST
+
+Suite *ohm_console_suite(void)
+{
+    Suite *suite = suite_create("ohm_console");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_console_framing);
+    tcase_add_test(tc_all, test_console_fairness);
+    tcase_add_test(tc_all, test_console_backpressure);
+    tcase_add_test(tc_all, test_console_limit);
+    tcase_add_test(tc_all, test_console_overlong);
+    tcase_add_test(tc_all, test_console_truncate);
+    tcase_add_test(tc_all, test_console_grab);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_console_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
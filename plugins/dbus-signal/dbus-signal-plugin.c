@@ -35,6 +35,18 @@ USA.
  * target = dres_signal_handler
  * arguments = foo,bar
  *
+ * The signature may contain any basic D-Bus type. They are passed to the
+ * resolver as follows:
+ *
+ *   s, o, g              strings ('s')
+ *   i, b, y, n, q, u     integers ('i'), u above INT_MAX wraps around
+ *   d, x, t              doubles ('d')
+ *
+ * Each signal is compiled at load time into a fixed argument layout with
+ * preallocated storage, so dispatching a signal does not allocate memory.
+ * Signals with the same name, interface, path and sender share a single
+ * dispatcher, which filters the messages before looking at the arguments
+ * and picks the matching hooks by their signature id.
  */
 
 #include "dbus-signal-plugin.h"
@@ -77,115 +89,313 @@ static void free_dbus_signal_parameters(struct dbus_signal_parameters_s *params)
     g_free(params->target);
     g_strfreev(params->arguments);
 
+    free(params->types);
+    free(params->dres_args);
+    free(params->doubles);
+
     g_free(params);
 
     return;
 }
 
+static void free_dbus_signal_dispatcher(struct dbus_signal_dispatcher_s *dispatcher)
+{
+    g_free(dispatcher->name);
+    g_free(dispatcher->path);
+    g_free(dispatcher->interface);
+    g_free(dispatcher->sender);
+    g_slist_free(dispatcher->hooks);
+
+    g_free(dispatcher);
+
+    return;
+}
+
 #define DRES_VARTYPE(t)  (char *)(t)
 #define DRES_VARVALUE(s) (char *)(s)
 
-static DBusHandlerResult handler(DBusConnection *c, DBusMessage *msg, void *data)
+static guint32 signature_id(const char *sig)
 {
-    struct dbus_signal_parameters_s *params = data;
-    /* i is the dres array iterator, j is the parameter iterator and k
-     * is the double storage iterator */
-    int status, len, i = 0, j = 0, k = 0;
-    const char *sig;
-    DBusMessageIter msg_it;
-    char **dres_args = NULL;
-    double double_storage[32];
+    /*
+     * FNV-1a. Different signatures can hash to the same id; that only
+     * costs a marshal_signal call, which rejects the message when its
+     * argument types do not match the expected ones.
+     */
+    guint32 id = 2166136261U;
+
+    while (*sig) {
+        id ^= (unsigned char) *sig++;
+        id *= 16777619U;
+    }
 
-    (void) c;
-    (void) msg;
+    return id;
+}
 
-    if (params == NULL || msg == NULL || dbus_plugin == NULL) {
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+static char dres_type(int type)
+{
+    switch (type) {
+        case DBUS_TYPE_STRING:
+        case DBUS_TYPE_OBJECT_PATH:
+        case DBUS_TYPE_SIGNATURE:
+            return 's';
+        case DBUS_TYPE_INT32:
+        case DBUS_TYPE_BOOLEAN:
+        case DBUS_TYPE_BYTE:
+        case DBUS_TYPE_INT16:
+        case DBUS_TYPE_UINT16:
+        case DBUS_TYPE_UINT32:
+            return 'i';
+        case DBUS_TYPE_DOUBLE:
+        case DBUS_TYPE_INT64:
+        case DBUS_TYPE_UINT64:
+            return 'd';
+        default:
+            return 0;
     }
+}
 
-    OHM_DEBUG(DBG_DBUS_SIGNAL, "handling signal '%s.%s' on path '%s', calling target '%s'",
-            params->interface, params->name, params->path, params->target);
+static int compile_signal(struct dbus_signal_parameters_s *params)
+{
+    int len, i, ndouble = 0;
+    char type;
 
-    /* get the signal parameters */
+    len = strlen(params->signature);
 
-    sig = dbus_message_get_signature(msg);
+    for (i = 0; i < len; i++) {
+        if ((type = dres_type(params->signature[i])) == 0)
+            return FALSE;
+        if (type == 'd')
+            ndouble++;
+    }
 
-    if (strcmp(sig, params->signature) != 0) {
-        OHM_DEBUG(DBG_DBUS_SIGNAL, "wrong signal signature ('%s': expected '%s'", sig, params->signature);
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    params->types = calloc(len + 1, sizeof(int));
+    params->dres_args = calloc(len * 3 + 1, sizeof(char *));
+    params->doubles = calloc(ndouble + 1, sizeof(double));
+
+    if (params->types == NULL || params->dres_args == NULL || params->doubles == NULL)
+        return FALSE;
+
+    /* the names and the types never change, only the values do */
+
+    for (i = 0; i < len; i++) {
+        params->types[i] = params->signature[i];
+        params->dres_args[i*3] = params->arguments[i];
+        params->dres_args[i*3 + 1] = DRES_VARTYPE((long) dres_type(params->signature[i]));
     }
 
-    len = strlen(sig) * 3 + 1;
+    params->nargs = len;
+    params->sigid = signature_id(params->signature);
+
+    return TRUE;
+}
+
+static int marshal_signal(struct dbus_signal_parameters_s *params, DBusMessage *msg)
+{
+    /* i is the parameter iterator and k is the double storage iterator */
+    int i, k = 0;
+    DBusMessageIter msg_it;
+    char **value;
+
+    if (!dbus_message_iter_init(msg, &msg_it))
+        return params->nargs == 0;
+
+    if (params->nargs == 0)
+        return FALSE;
 
-    if (len > 1) {
+    for (i = 0; i < params->nargs; i++) {
 
-        dres_args = calloc(len, sizeof(char *));
+        if (i > 0 && !dbus_message_iter_next(&msg_it))
+            return FALSE;
 
-        if (dres_args == NULL) {
-            OHM_DEBUG(DBG_DBUS_SIGNAL, "error allocating memory");
-            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        if (dbus_message_iter_get_arg_type(&msg_it) != params->types[i])
+            return FALSE;
+
+        value = &params->dres_args[i*3 + 2];
+
+        switch (params->types[i]) {
+            case DBUS_TYPE_STRING:
+            case DBUS_TYPE_OBJECT_PATH:
+            case DBUS_TYPE_SIGNATURE:
+                {
+                    char *strvalue;
+                    dbus_message_iter_get_basic(&msg_it, &strvalue);
+                    *value = DRES_VARVALUE(strvalue);
+                    break;
+                }
+            case DBUS_TYPE_BOOLEAN:
+                {
+                    dbus_bool_t boolvalue;
+                    dbus_message_iter_get_basic(&msg_it, &boolvalue);
+                    *value = DRES_VARVALUE((long) (boolvalue ? 1 : 0));
+                    break;
+                }
+            case DBUS_TYPE_BYTE:
+                {
+                    unsigned char bytevalue;
+                    dbus_message_iter_get_basic(&msg_it, &bytevalue);
+                    *value = DRES_VARVALUE((long) bytevalue);
+                    break;
+                }
+            case DBUS_TYPE_INT16:
+                {
+                    dbus_int16_t shortvalue;
+                    dbus_message_iter_get_basic(&msg_it, &shortvalue);
+                    *value = DRES_VARVALUE((long) shortvalue);
+                    break;
+                }
+            case DBUS_TYPE_UINT16:
+                {
+                    dbus_uint16_t ushortvalue;
+                    dbus_message_iter_get_basic(&msg_it, &ushortvalue);
+                    *value = DRES_VARVALUE((long) ushortvalue);
+                    break;
+                }
+            case DBUS_TYPE_INT32:
+                {
+                    dbus_int32_t intvalue;
+                    dbus_message_iter_get_basic(&msg_it, &intvalue);
+                    *value = DRES_VARVALUE((long) intvalue);
+                    break;
+                }
+            case DBUS_TYPE_UINT32:
+                {
+                    dbus_uint32_t uintvalue;
+                    dbus_message_iter_get_basic(&msg_it, &uintvalue);
+                    *value = DRES_VARVALUE((long) (int) uintvalue);
+                    break;
+                }
+            case DBUS_TYPE_DOUBLE:
+                {
+                    dbus_message_iter_get_basic(&msg_it, &params->doubles[k]);
+                    *value = DRES_VARVALUE(&params->doubles[k++]);
+                    break;
+                }
+            case DBUS_TYPE_INT64:
+                {
+                    dbus_int64_t longvalue;
+                    dbus_message_iter_get_basic(&msg_it, &longvalue);
+                    params->doubles[k] = (double) longvalue;
+                    *value = DRES_VARVALUE(&params->doubles[k++]);
+                    break;
+                }
+            case DBUS_TYPE_UINT64:
+                {
+                    dbus_uint64_t ulongvalue;
+                    dbus_message_iter_get_basic(&msg_it, &ulongvalue);
+                    params->doubles[k] = (double) ulongvalue;
+                    *value = DRES_VARVALUE(&params->doubles[k++]);
+                    break;
+                }
+            default:
+                OHM_DEBUG(DBG_DBUS_SIGNAL, "impossible signal parameter error");
+                return FALSE;
         }
+    }
 
-        dbus_message_iter_init(msg, &msg_it);
-        do {
-            switch (dbus_message_iter_get_arg_type(&msg_it)) {
-                case DBUS_TYPE_STRING:
-                    {
-                        char *strvalue;
-                        dbus_message_iter_get_basic(&msg_it, &strvalue);
-                        dres_args[i++] = params->arguments[j++];
-                        dres_args[i++] = DRES_VARTYPE('s');
-                        dres_args[i++] = DRES_VARVALUE(strvalue);
-                        break;
-                    }
-                case DBUS_TYPE_INT32:
-                    {
-                        int intvalue;
-                        dbus_message_iter_get_basic(&msg_it, &intvalue);
-                        dres_args[i++] = params->arguments[j++];
-                        dres_args[i++] = DRES_VARTYPE('i');
-                        dres_args[i++] = DRES_VARVALUE(intvalue);
-                        break;
-                    }
-                case DBUS_TYPE_DOUBLE:
-                    {
-                        if (k == 32) {
-                            OHM_DEBUG(DBG_DBUS_SIGNAL, "too many double arguments");
-                            free(dres_args);
-                            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-                        }
-                        dbus_message_iter_get_basic(&msg_it, &double_storage[k]);
-                        dres_args[i++] = params->arguments[j++];
-                        dres_args[i++] = DRES_VARTYPE('d');
-                        dres_args[i++] = (char *) DRES_VARVALUE(&double_storage[k]);
-                        k++;
-                        break;
-                    }
-                default:
-                    OHM_DEBUG(DBG_DBUS_SIGNAL, "impossible signal parameter error");
-                    free(dres_args);
-                    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-            }
+    /* trailing arguments mean a different signature */
+    return !dbus_message_iter_next(&msg_it);
+}
+
+#undef DRES_VARVALUE
+#undef DRES_VARTYPE
+
+static int field_matches(const char *expected, const char *actual)
+{
+    return expected == NULL || (actual != NULL && strcmp(expected, actual) == 0);
+}
 
-        } while (dbus_message_iter_next(&msg_it) && i < len-1);
+static DBusHandlerResult dispatch(DBusConnection *c, DBusMessage *msg, void *data)
+{
+    struct dbus_signal_dispatcher_s *dispatcher = data;
+    struct dbus_signal_parameters_s *params;
+    guint32 sigid;
+    GSList *e;
+    int status;
+
+    (void) c;
 
-        dres_args[len-1] = NULL;
+    if (dispatcher == NULL || msg == NULL || dbus_plugin == NULL) {
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
 
-    status = resolve(params->target, dres_args);
+    /* filter out anything not meant for us before touching the arguments */
+
+    if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL
+            || !field_matches(dispatcher->name, dbus_message_get_member(msg))
+            || !field_matches(dispatcher->interface, dbus_message_get_interface(msg))
+            || !field_matches(dispatcher->path, dbus_message_get_path(msg))
+            || !field_matches(dispatcher->sender, dbus_message_get_sender(msg))) {
+        OHM_DEBUG(DBG_DBUS_SIGNAL, "ignoring signal '%s.%s' from '%s' on path '%s'",
+                dbus_message_get_interface(msg), dbus_message_get_member(msg),
+                dbus_message_get_sender(msg), dbus_message_get_path(msg));
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+    sigid = signature_id(dbus_message_get_signature(msg));
+
+    for (e = dispatcher->hooks; e != NULL; e = g_slist_next(e)) {
+
+        params = e->data;
+
+        if (params->sigid != sigid || !marshal_signal(params, msg)) {
+            OHM_DEBUG(DBG_DBUS_SIGNAL, "wrong signal signature ('%s': expected '%s')",
+                    dbus_message_get_signature(msg), params->signature);
+            continue;
+        }
+
+        OHM_DEBUG(DBG_DBUS_SIGNAL, "handling signal '%s.%s' on path '%s', calling target '%s'",
+                params->interface, params->name, params->path, params->target);
 
-    free(dres_args);
+        status = resolve(params->target, params->nargs ? params->dres_args : NULL);
 
-    if (status < 0) {
-        OHM_DEBUG(DBG_DBUS_SIGNAL, "ran policy hook '%s' with status %d",
-                params->target ? params->target : "NULL", status);
+        if (status < 0) {
+            OHM_DEBUG(DBG_DBUS_SIGNAL, "ran policy hook '%s' with status %d",
+                    params->target ? params->target : "NULL", status);
+        }
     }
 
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
-#undef DRES_VARVALUE
-#undef DRES_VARTYPE
+static struct dbus_signal_dispatcher_s *get_dispatcher(struct dbus_signal_parameters_s *params)
+{
+    struct dbus_signal_dispatcher_s *dispatcher;
+    GSList *e;
+    int success;
+
+    for (e = dbus_plugin->dispatchers; e != NULL; e = g_slist_next(e)) {
+
+        dispatcher = e->data;
+
+        if (g_strcmp0(dispatcher->name, params->name) == 0
+                && g_strcmp0(dispatcher->interface, params->interface) == 0
+                && g_strcmp0(dispatcher->path, params->path) == 0
+                && g_strcmp0(dispatcher->sender, params->sender) == 0) {
+            return dispatcher;
+        }
+    }
+
+    dispatcher = g_new0(struct dbus_signal_dispatcher_s, 1);
+
+    dispatcher->name = g_strdup(params->name);
+    dispatcher->path = g_strdup(params->path);
+    dispatcher->interface = g_strdup(params->interface);
+    dispatcher->sender = g_strdup(params->sender);
+
+    /* the signature is matched by the dispatcher */
+
+    success = add_signal(DBUS_BUS_SYSTEM, dispatcher->path, dispatcher->interface,
+            dispatcher->name, NULL, dispatcher->sender, dispatch, dispatcher);
+
+    if (!success) {
+        free_dbus_signal_dispatcher(dispatcher);
+        return NULL;
+    }
+
+    dbus_plugin->dispatchers = g_slist_prepend(dbus_plugin->dispatchers, dispatcher);
+
+    return dispatcher;
+}
 
 static void plugin_init(OhmPlugin *plugin)
 {
@@ -230,11 +440,11 @@ static void plugin_init(OhmPlugin *plugin)
 
         for (i = 0; i < signals_len; i++) {
             struct dbus_signal_parameters_s *params;
-            int success;
-            int len, arg_len, j, error = 0;
+            struct dbus_signal_dispatcher_s *dispatcher;
+            int len, arg_len;
             gchar *arg_string, **iter;
 
-            params = calloc(1, sizeof(struct dbus_signal_parameters_s));
+            params = g_new0(struct dbus_signal_parameters_s, 1);
 
             params->name = g_key_file_get_value(keyfile, signals[i], "name", NULL);
             params->path = g_key_file_get_value(keyfile, signals[i], "path", NULL);
@@ -255,29 +465,11 @@ static void plugin_init(OhmPlugin *plugin)
                 continue;
             }
 
-            /* check that the signature contains only allowed types and
-             * that its length matches the argument length */
+            /* check that the signature length matches the argument length */
 
-            params->signature = params->signature ? params->signature : strdup("");
+            params->signature = params->signature ? params->signature : g_strdup("");
 
             len = strlen(params->signature); /* 0 uf not present in the file */
-            for (j = 0; j < len; j++) {
-                switch(params->signature[j]) {
-                    case 'i':
-                    case 's':
-                    case 'd':
-                        break;
-                    default:
-                        error = 1;
-                        break;
-                }
-            }
-
-            if (error) {
-                OHM_ERROR("dbus-signal: illegal signal signature: '%s'", params->signature);
-                free_dbus_signal_parameters(params);
-                continue;
-            }
 
             /* count the number of arguments */
 
@@ -297,10 +489,19 @@ static void plugin_init(OhmPlugin *plugin)
                 continue;
             }
 
-            success = add_signal(DBUS_BUS_SYSTEM, params->path, params->interface,
-                    params->name, params->signature, params->sender, handler, params);
+            /* compile the argument layout, this checks that the signature
+             * contains only allowed types */
 
-            if (success) {
+            if (!compile_signal(params)) {
+                OHM_ERROR("dbus-signal: illegal signal signature: '%s'", params->signature);
+                free_dbus_signal_parameters(params);
+                continue;
+            }
+
+            dispatcher = get_dispatcher(params);
+
+            if (dispatcher != NULL) {
+                dispatcher->hooks = g_slist_append(dispatcher->hooks, params);
                 dbus_plugin->signals = g_slist_prepend(dbus_plugin->signals, params);
                 OHM_INFO("dbus-signal: added watcher for signal '%s' (%s) on interface '%s'",
                         params->name, params->signature, params->interface);
@@ -334,13 +535,21 @@ plugin_exit(OhmPlugin *plugin)
     if (dbus_plugin != NULL) {
         GSList *e = NULL;
 
+        for (e = dbus_plugin->dispatchers; e != NULL; e = g_slist_next(e)) {
+
+            struct dbus_signal_dispatcher_s *dispatcher = e->data;
+
+            del_signal(DBUS_BUS_SYSTEM, dispatcher->path, dispatcher->interface,
+                    dispatcher->name, NULL, dispatcher->sender, dispatch, dispatcher);
+
+            free_dbus_signal_dispatcher(dispatcher);
+        }
+        g_slist_free(dbus_plugin->dispatchers);
+
         for (e = dbus_plugin->signals; e != NULL; e = g_slist_next(e)) {
 
             struct dbus_signal_parameters_s *params = e->data;
 
-            del_signal(DBUS_BUS_SYSTEM, params->path, params->interface,
-                    params->name, params->signature, params->sender, handler, params);
-
             free_dbus_signal_parameters(params);
         }
         g_slist_free(dbus_plugin->signals);
@@ -35,6 +35,7 @@ USA.
 struct dbus_plugin_s {
     OhmPlugin *ohm_plugin;
     GSList *signals;
+    GSList *dispatchers;
 };
 
 struct dbus_signal_parameters_s {
@@ -45,6 +46,22 @@ struct dbus_signal_parameters_s {
     gchar *sender;
     gchar *target;
     gchar **arguments;
+
+    /* argument layout compiled from the signature at load time */
+    guint32 sigid;              /* signature id */
+    int nargs;                  /* number of arguments */
+    int *types;                 /* D-Bus type of each argument */
+    char **dres_args;           /* resolver arguments, names and types set */
+    double *doubles;            /* value storage for the 'd' arguments */
+};
+
+/* hooks for the same signal from the same sender on the same path */
+struct dbus_signal_dispatcher_s {
+    gchar *name;
+    gchar *path;
+    gchar *interface;
+    gchar *sender;
+    GSList *hooks;
 };
 
 #endif
@@ -0,0 +1,507 @@
+/*************************************************************************
+Copyright (C) 2011 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_dbus_signal.c
+ * @brief compiled signal hooks and the dispatcher fed with recorded
+ *        signals, with a benchmark of the dispatch path
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <check.h>
+#include <ohm/ohm-plugin.h>
+
+#define NROUND   20000          /* rounds of recorded signals in the bench */
+#define MAX_REG  16             /* registrations with the dbus plugin */
+
+static void *counted_calloc(size_t, size_t);
+static const char *fake_get_param(OhmPlugin *, const char *);
+
+static int nalloc;              /* allocations by the plugin */
+
+#define calloc(n, size)           counted_calloc(n, size)
+#define ohm_plugin_get_param(p,k) fake_get_param(p, k)
+
+#include "../dbus-signal-plugin.c"
+
+#undef calloc
+
+static char config[] = "/tmp/check_dbus_signal.XXXXXX";
+
+static const char *config_data =
+    "[battery]\n"
+    "path = /com/nokia/bme/signal\n"
+    "interface = com.nokia.bme.signal\n"
+    "name = battery_state_changed\n"
+    "sender = :1.7\n"
+    "signature = sib\n"
+    "target = battery\n"
+    "arguments = state;level;charging\n"
+    "\n"
+    "[battery_short]\n"
+    "path = /com/nokia/bme/signal\n"
+    "interface = com.nokia.bme.signal\n"
+    "name = battery_state_changed\n"
+    "sender = :1.7\n"
+    "signature = s\n"
+    "target = battery_short\n"
+    "arguments = state\n"
+    "\n"
+    "[counters]\n"
+    "path = /com/nokia/stats\n"
+    "interface = com.nokia.stats\n"
+    "name = counters\n"
+    "signature = uxtdo\n"
+    "target = counters\n"
+    "arguments = count;delta;total;rate;object\n"
+    "\n"
+    "[idle]\n"
+    "path = /com/nokia/stats\n"
+    "interface = com.nokia.stats\n"
+    "name = idle\n"
+    "target = idle\n"
+    "\n"
+    "[broken_type]\n"
+    "path = /com/nokia/broken\n"
+    "interface = com.nokia.broken\n"
+    "name = broken\n"
+    "signature = v\n"
+    "target = broken\n"
+    "arguments = list\n"
+    "\n"
+    "[broken_count]\n"
+    "path = /com/nokia/broken\n"
+    "interface = com.nokia.broken\n"
+    "name = broken\n"
+    "signature = ss\n"
+    "target = broken\n"
+    "arguments = one\n";
+
+static struct {
+    const char                    *name;
+    const char                    *signature;
+    DBusObjectPathMessageFunction  handler;
+    void                          *data;
+} reg[MAX_REG];                 /* registrations with the dbus plugin */
+static int nreg;
+
+static char  goal[64];          /* the last resolved goal */
+static char *args[16 * 3];      /*   and its arguments */
+static int   nresolve;
+
+static struct {
+    const char  *name;
+    DBusMessage *msg;
+    int          nhook;         /* hooks it should trigger */
+} recorded[8];                  /* recorded signals */
+static int nrecorded;
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * allocation counting, plugin parameters, mock resolver and dbus plugin
+ */
+
+static void *counted_calloc(size_t n, size_t size)
+{
+    nalloc++;
+    return calloc(n, size);
+}
+
+static const char *fake_get_param(OhmPlugin *plugin, const char *key)
+{
+    (void)plugin;
+
+    return strcmp(key, "filename") ? NULL : config;
+}
+
+static int fake_resolve(char *g, char **locals)
+{
+    int i;
+
+    strncpy(goal, g, sizeof(goal) - 1);
+    memset(args, 0, sizeof(args));
+
+    for (i = 0; locals != NULL && locals[i] != NULL && i < 16 * 3 - 1; i++)
+        args[i] = locals[i];
+
+    nresolve++;
+
+    return 0;
+}
+
+static int fake_add_signal(DBusBusType type, const char *path,
+                           const char *interface, const char *member,
+                           const char *signature, const char *sender,
+                           DBusObjectPathMessageFunction h, void *data)
+{
+    (void)type;
+    (void)path;
+    (void)interface;
+    (void)sender;
+
+    fail_unless(nreg < MAX_REG, "too many signal registrations");
+
+    reg[nreg].name      = member;
+    reg[nreg].signature = signature;
+    reg[nreg].handler   = h;
+    reg[nreg].data      = data;
+    nreg++;
+
+    return TRUE;
+}
+
+static int fake_del_signal(DBusBusType type, const char *path,
+                           const char *interface, const char *member,
+                           const char *signature, const char *sender,
+                           DBusObjectPathMessageFunction h, void *data)
+{
+    int i;
+
+    (void)type;
+    (void)path;
+    (void)interface;
+    (void)member;
+    (void)signature;
+    (void)sender;
+
+    for (i = 0; i < nreg; i++) {
+        if (reg[i].handler == h && reg[i].data == data) {
+            reg[i] = reg[--nreg];
+            return TRUE;
+        }
+    }
+
+    fail("deleting unknown signal registration");
+    return FALSE;
+}
+
+
+/*
+ * helpers
+ */
+
+static DBusMessage *signal_new(const char *path, const char *interface,
+                               const char *name, const char *sender)
+{
+    DBusMessage *msg = dbus_message_new_signal(path, interface, name);
+
+    dbus_message_set_sender(msg, sender);
+
+    return msg;
+}
+
+static void record(const char *name, DBusMessage *msg, int nhook)
+{
+    recorded[nrecorded].name  = name;
+    recorded[nrecorded].msg   = msg;
+    recorded[nrecorded].nhook = nhook;
+    nrecorded++;
+}
+
+static int deliver(DBusMessage *msg)
+{
+    const char *member = dbus_message_get_member(msg);
+    int         i, n;
+
+    /* route like the dbus plugin does, by the signal name */
+    for (i = n = 0; i < nreg; i++) {
+        if (!strcmp(reg[i].name, member)) {
+            reg[i].handler(NULL, msg, reg[i].data);
+            n++;
+        }
+    }
+
+    return n;
+}
+
+static const char *arg(const char *name, char *type)
+{
+    int i;
+
+    for (i = 0; args[i] != NULL; i += 3) {
+        if (!strcmp(args[i], name)) {
+            *type = (char)(long)args[i + 1];
+            return args[i + 2];
+        }
+    }
+
+    fail("no argument %s for %s", name, goal);
+    return NULL;
+}
+
+static void setup(void)
+{
+    static int   plugin;
+    const char  *state = "charging", *object = "/com/nokia/stats/cpu0";
+    dbus_int32_t level = 87;
+    dbus_bool_t  charging = TRUE;
+    dbus_uint32_t count = 4000000000U;
+    dbus_int64_t  delta = -5000000000LL;
+    dbus_uint64_t total = 1ULL << 40;
+    double        rate  = 0.25;
+    DBusMessage  *msg;
+    int           fd;
+
+    fd = mkstemp(config);
+    fail_if(fd < 0, "failed to create configuration");
+    fail_unless(write(fd, config_data, strlen(config_data)) ==
+                (ssize_t)strlen(config_data), "failed to write configuration");
+    close(fd);
+
+    resolve    = fake_resolve;
+    add_signal = fake_add_signal;
+    del_signal = fake_del_signal;
+    nreg = nresolve = nrecorded = 0;
+
+    plugin_init((OhmPlugin *)&plugin);
+
+    fail_unless(dbus_plugin != NULL, "plugin failed to initialize");
+
+    /* recorded traffic, including signals the hooks must not act on */
+    msg = signal_new("/com/nokia/bme/signal", "com.nokia.bme.signal",
+                     "battery_state_changed", ":1.7");
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &state,
+                             DBUS_TYPE_INT32, &level,
+                             DBUS_TYPE_BOOLEAN, &charging, DBUS_TYPE_INVALID);
+    record("battery", msg, 1);
+
+    msg = signal_new("/com/nokia/bme/signal", "com.nokia.bme.signal",
+                     "battery_state_changed", ":1.7");
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &state,
+                             DBUS_TYPE_INVALID);
+    record("battery_short", msg, 1);
+
+    msg = signal_new("/com/nokia/stats", "com.nokia.stats", "counters",
+                     ":1.9");
+    dbus_message_append_args(msg, DBUS_TYPE_UINT32, &count,
+                             DBUS_TYPE_INT64, &delta,
+                             DBUS_TYPE_UINT64, &total,
+                             DBUS_TYPE_DOUBLE, &rate,
+                             DBUS_TYPE_OBJECT_PATH, &object,
+                             DBUS_TYPE_INVALID);
+    record("counters", msg, 1);
+
+    msg = signal_new("/com/nokia/stats", "com.nokia.stats", "idle", ":1.9");
+    record("idle", msg, 1);
+
+    msg = signal_new("/com/nokia/bme/signal", "com.nokia.bme.signal",
+                     "battery_state_changed", ":1.8");
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &state,
+                             DBUS_TYPE_INVALID);
+    record("wrong sender", msg, 0);
+
+    msg = signal_new("/com/nokia/bme/other", "com.nokia.bme.signal",
+                     "battery_state_changed", ":1.7");
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &state,
+                             DBUS_TYPE_INVALID);
+    record("wrong path", msg, 0);
+
+    msg = signal_new("/com/nokia/bme/signal", "com.nokia.bme.signal",
+                     "battery_state_changed", ":1.7");
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &state,
+                             DBUS_TYPE_STRING, &state, DBUS_TYPE_INVALID);
+    record("wrong signature", msg, 0);
+
+    msg = signal_new("/com/nokia/stats", "com.nokia.stats", "idle", ":1.9");
+    dbus_message_append_args(msg, DBUS_TYPE_INT32, &level,
+                             DBUS_TYPE_INVALID);
+    record("unexpected arguments", msg, 0);
+}
+
+static void teardown(void)
+{
+    int i;
+
+    plugin_exit(NULL);
+
+    fail_unless(nreg == 0, "%d signal registrations left behind", nreg);
+
+    for (i = 0; i < nrecorded; i++)
+        dbus_message_unref(recorded[i].msg);
+
+    unlink(config);
+    strcpy(config, "/tmp/check_dbus_signal.XXXXXX");
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_dbus_signal_compile)
+{
+    int i;
+
+    /* the two broken hooks are rejected, the battery ones share a match */
+    fail_unless(g_slist_length(dbus_plugin->signals) == 4, "%d hooks loaded",
+                g_slist_length(dbus_plugin->signals));
+    fail_unless(nreg == 3, "%d signal registrations", nreg);
+
+    for (i = 0; i < nreg; i++)
+        fail_unless(reg[i].signature == NULL, "signature matched by the "
+                    "dbus plugin");
+}
+END_TEST
+
+START_TEST (test_dbus_signal_marshal)
+{
+    char type;
+
+    fail_unless(deliver(recorded[0].msg) == 1 && nresolve == 1 &&
+                !strcmp(goal, "battery"), "battery hook not run");
+    fail_unless(!strcmp(arg("state", &type), "charging") && type == 's',
+                "wrong state");
+    fail_unless((long)arg("level", &type) == 87 && type == 'i',
+                "wrong level");
+    fail_unless((long)arg("charging", &type) == 1 && type == 'i',
+                "wrong boolean");
+
+    deliver(recorded[2].msg);
+
+    fail_unless(nresolve == 2 && !strcmp(goal, "counters"),
+                "counters hook not run");
+    fail_unless((int)(long)arg("count", &type) == (int)4000000000U &&
+                type == 'i', "wrong uint32");
+    fail_unless(*(double *)arg("delta", &type) == -5000000000.0 &&
+                type == 'd', "wrong int64");
+    fail_unless(*(double *)arg("total", &type) == (double)(1ULL << 40) &&
+                type == 'd', "wrong uint64");
+    fail_unless(*(double *)arg("rate", &type) == 0.25 && type == 'd',
+                "wrong double");
+    fail_unless(!strcmp(arg("object", &type), "/com/nokia/stats/cpu0") &&
+                type == 's', "wrong object path");
+
+    deliver(recorded[3].msg);
+
+    fail_unless(nresolve == 3 && !strcmp(goal, "idle") && args[0] == NULL,
+                "idle hook not run without arguments");
+}
+END_TEST
+
+START_TEST (test_dbus_signal_filter)
+{
+    int i, n;
+
+    for (i = 0; i < nrecorded; i++) {
+        n = nresolve;
+        deliver(recorded[i].msg);
+
+        fail_unless(nresolve - n == recorded[i].nhook,
+                    "%s: %d hooks run instead of %d", recorded[i].name,
+                    nresolve - n, recorded[i].nhook);
+    }
+}
+END_TEST
+
+START_TEST (test_dbus_signal_bench)
+{
+    struct timespec start, end;
+    double          ns;
+    int             i, j, nhook;
+
+    nalloc = nresolve = nhook = 0;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+
+    for (i = 0; i < NROUND; i++) {
+        for (j = 0; j < nrecorded; j++) {
+            deliver(recorded[j].msg);
+            nhook += recorded[j].nhook;
+        }
+    }
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+
+    ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    printf("dbus-signal: %d signals, %d hooks run, %.2f allocations and "
+           "%.0f ns of CPU time per dispatched hook\n",
+           NROUND * nrecorded, nresolve, (double)nalloc / nresolve,
+           ns / nresolve);
+
+    fail_unless(nresolve == nhook, "%d hooks run instead of %d", nresolve,
+                nhook);
+    fail_unless(nalloc == 0, "%d allocations while dispatching", nalloc);
+}
+END_TEST
+
+Suite *ohm_dbus_signal_suite(void)
+{
+    Suite *suite = suite_create("ohm_dbus_signal");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_dbus_signal_compile);
+    tcase_add_test(tc_all, test_dbus_signal_marshal);
+    tcase_add_test(tc_all, test_dbus_signal_filter);
+    tcase_add_test(tc_all, test_dbus_signal_bench);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_dbus_signal_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
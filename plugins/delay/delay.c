@@ -69,6 +69,7 @@ static void plugin_exit(OhmPlugin *plugin)
 {
     OHM_INFO("delay: exit ...");
 
+    timer_exit(plugin);
     fsif_exit(plugin);
 }
 
@@ -0,0 +1,552 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_timer_wheel.c
+ * @brief delay timer wheel against a fake monotonic clock, a fake main
+ *        loop and a mock factstore
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <glib.h>
+#include <check.h>
+#include <ohm/ohm-plugin.h>
+
+#include "delay.h"
+#include "fsif.h"
+#include "timer.h"
+
+#define NTIMER   5000           /* simultaneously armed timers */
+#define HOUR     (3600ULL * 1000ULL)
+
+static int DBG_REQUEST, DBG_TIMER, DBG_EVENT, DBG_FS;
+
+static int fake_clock_gettime(clockid_t, struct timespec *);
+static int fake_gettimeofday(struct timeval *, void *);
+static guint fake_timeout_add_full(gint, guint, GSourceFunc, gpointer,
+                                   GDestroyNotify);
+static guint fake_idle_add_full(gint, GSourceFunc, gpointer, GDestroyNotify);
+static gboolean fake_source_remove(guint);
+
+#define clock_gettime       fake_clock_gettime
+#define gettimeofday        fake_gettimeofday
+#define g_timeout_add_full  fake_timeout_add_full
+#define g_idle_add_full     fake_idle_add_full
+#define g_source_remove     fake_source_remove
+
+#include "../timer.c"
+
+struct _OhmFact {
+    char                id[32];
+    char               *state;
+    unsigned long       delay;
+    unsigned long long  expire;
+    unsigned long       address;
+    unsigned long       argc;
+    int                 arg;
+};
+
+static GHashTable *facts;       /* mock factstore, timer facts by id */
+
+static uint64_t    mono;        /* fake monotonic clock in ms */
+static uint64_t    wall;        /* fake wall clock in ms */
+
+static struct {
+    guint          id;          /* the armed source, if any */
+    uint64_t       due;         /*   when it is due */
+    GSourceFunc    cb;
+} source;
+static guint       lastid;
+
+static uint64_t    expected[NTIMER];  /* expected firing times */
+static int         nfired[NTIMER];    /* number of callbacks per timer */
+static int         nlate;             /* callbacks after their deadline */
+static int         nearly;            /* callbacks before their deadline */
+static uint64_t    last;              /* time of the last callback */
+static int         disorder;          /* callbacks out of time order */
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * fake clocks and main loop
+ */
+
+static int fake_clock_gettime(clockid_t id, struct timespec *ts)
+{
+    fail_unless(id == CLOCK_MONOTONIC, "timer read a non-monotonic clock");
+
+    ts->tv_sec  = mono / 1000ULL;
+    ts->tv_nsec = (mono % 1000ULL) * 1000000ULL;
+
+    return 0;
+}
+
+static int fake_gettimeofday(struct timeval *tv, void *tz)
+{
+    (void)tz;
+
+    tv->tv_sec  = wall / 1000ULL;
+    tv->tv_usec = (wall % 1000ULL) * 1000ULL;
+
+    return 0;
+}
+
+static guint fake_timeout_add_full(gint prio, guint interval, GSourceFunc cb,
+                                   gpointer data, GDestroyNotify destroy)
+{
+    (void)prio;
+    (void)data;
+    (void)destroy;
+
+    fail_unless(source.id == 0, "more than one main loop source armed");
+
+    source.id  = ++lastid;
+    source.due = mono + interval;
+    source.cb  = cb;
+
+    return source.id;
+}
+
+static guint fake_idle_add_full(gint prio, GSourceFunc cb, gpointer data,
+                                GDestroyNotify destroy)
+{
+    return fake_timeout_add_full(prio, 0, cb, data, destroy);
+}
+
+static gboolean fake_source_remove(guint id)
+{
+    fail_unless(id != 0 && id == source.id, "removing unknown source %u", id);
+
+    source.id = 0;
+
+    return TRUE;
+}
+
+
+/*
+ * mock factstore
+ */
+
+static int fsif_add_factstore_entry(char *name, fsif_field_t *fldlist)
+{
+    fsif_entry_t *fact;
+    fsif_field_t *fld;
+
+    fail_unless(!strcmp(name, FACTSTORE_TIMER), "unexpected fact %s", name);
+
+    fact = calloc(1, sizeof(*fact));
+
+    for (fld = fldlist;  fld->type != fldtype_invalid;  fld++) {
+        if (!strcmp(fld->name, TIMER_ID))
+            strncpy(fact->id, fld->value.string, sizeof(fact->id) - 1);
+        else if (!strcmp(fld->name, TIMER_STATE))
+            fact->state = fld->value.string;
+        else if (!strcmp(fld->name, TIMER_DELAY))
+            fact->delay = fld->value.unsignd;
+        else if (!strcmp(fld->name, TIMER_EXPIRE)) {
+            fail_unless(fld->type == fldtype_time, "expire is not a time");
+            fact->expire = fld->value.time;
+        }
+        else if (!strcmp(fld->name, TIMER_ADDRESS))
+            fact->address = fld->value.unsignd;
+        else if (!strcmp(fld->name, TIMER_ARGC))
+            fact->argc = fld->value.unsignd;
+        else if (!strcmp(fld->name, "argv0"))
+            fact->arg = fld->value.integer;
+    }
+
+    fail_if(g_hash_table_lookup(facts, fact->id), "duplicate timer %s",
+            fact->id);
+    g_hash_table_insert(facts, fact->id, fact);
+
+    return TRUE;
+}
+
+static int fsif_destroy_factstore_entry(fsif_entry_t *fact)
+{
+    g_hash_table_remove(facts, fact->id);
+    free(fact);
+
+    return TRUE;
+}
+
+static fsif_entry_t *fsif_get_entry(char *name, fsif_field_t *selist)
+{
+    (void)name;
+
+    return g_hash_table_lookup(facts, selist[0].value.string);
+}
+
+static void fsif_get_field_by_entry(fsif_entry_t *fact, fsif_fldtype_t type,
+                                    char *name, void *vptr)
+{
+    (void)type;
+
+    if (!strcmp(name, TIMER_ID))
+        *(char **)vptr = fact->id;
+    else if (!strcmp(name, TIMER_STATE))
+        *(char **)vptr = fact->state;
+    else if (!strcmp(name, TIMER_ADDRESS))
+        *(unsigned long *)vptr = fact->address;
+    else if (!strcmp(name, TIMER_ARGC))
+        *(unsigned long *)vptr = fact->argc;
+    else if (type == fldtype_string)
+        *(char **)vptr = NULL;
+    else
+        *(int *)vptr = fact->arg;
+}
+
+static void fsif_set_field_by_entry(fsif_entry_t *fact, fsif_fldtype_t type,
+                                    char *name, void *vptr)
+{
+    fail_unless(type == fldtype_string && !strcmp(name, TIMER_STATE),
+                "unexpected field %s", name);
+
+    fact->state = *(char **)vptr;
+}
+
+
+/*
+ * helpers
+ */
+
+static void callback(char *id, char *argt, void **argv)
+{
+    int i;
+
+    fail_unless(!strcmp(argt, "i"), "wrong signature '%s'", argt);
+
+    i = *(int *)argv[0];
+
+    fail_unless(i >= 0 && i < NTIMER, "wrong argument %d", i);
+    fail_unless(atoi(id + 1) == i, "argument %d for timer %s", i, id);
+
+    nfired[i]++;
+
+    if (mono > expected[i])
+        nlate++;
+    if (mono < expected[i])
+        nearly++;
+
+    if (mono < last)
+        disorder++;
+
+    last = mono;
+}
+
+static int arm(int i, unsigned int delay, int restart)
+{
+    char  id[32];
+    int   arg = i;
+    void *argv[1] = { &arg };
+
+    snprintf(id, sizeof(id), "t%d", i);
+    expected[i] = mono + delay;
+
+    if (restart && timer_lookup(id) != NULL)
+        return timer_restart(timer_lookup(id), delay, "callback", callback,
+                             "i", argv);
+    else
+        return timer_add(id, delay, "callback", callback, "i", argv);
+}
+
+static void cancel(int i)
+{
+    char id[32];
+
+    snprintf(id, sizeof(id), "t%d", i);
+
+    fail_unless(timer_stop(timer_lookup(id)), "failed to stop %s", id);
+}
+
+static fsif_entry_t *fact(int i)
+{
+    char id[32];
+
+    snprintf(id, sizeof(id), "t%d", i);
+
+    return g_hash_table_lookup(facts, id);
+}
+
+static void run_until(uint64_t t)
+{
+    GSourceFunc cb;
+
+    while (source.id != 0 && source.due <= t) {
+        if (mono < source.due)
+            mono = source.due;
+
+        cb = source.cb;
+        source.id = 0;
+        cb(NULL);
+    }
+
+    if (mono < t)
+        mono = t;
+}
+
+static int total_fired(void)
+{
+    int i, n;
+
+    for (i = n = 0;  i < NTIMER;  i++)
+        n += nfired[i];
+
+    return n;
+}
+
+static void setup(void)
+{
+    mono   = 123456789ULL;
+    wall   = 1262304000000ULL;
+    lastid = 0;
+    last   = 0;
+    nlate  = nearly = disorder = 0;
+
+    memset(&source, 0, sizeof(source));
+    memset(nfired, 0, sizeof(nfired));
+
+    facts = g_hash_table_new(g_str_hash, g_str_equal);
+
+    timer_init(NULL);
+}
+
+static void teardown(void)
+{
+    GHashTableIter  it;
+    gpointer        key, value;
+
+    timer_exit(NULL);
+
+    g_hash_table_iter_init(&it, facts);
+    while (g_hash_table_iter_next(&it, &key, &value))
+        free(value);
+
+    g_hash_table_destroy(facts);
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_wheel_many)
+{
+    uint64_t start = mono;
+    int      i;
+
+    /* spread over every level of the wheel, with plenty of collisions */
+    for (i = 0;  i < NTIMER;  i++) {
+        switch (i % 4) {
+        case 0:  arm(i, random() % 64, FALSE);                  break;
+        case 1:  arm(i, random() % 5000, FALSE);                break;
+        case 2:  arm(i, random() % (600 * 1000), FALSE);        break;
+        default: arm(i, random() % (48 * HOUR), FALSE);         break;
+        }
+    }
+
+    fail_unless(g_hash_table_size(wheel.nodes) == NTIMER, "%u timers armed",
+                g_hash_table_size(wheel.nodes));
+    fail_unless(fact(7)->expire == expected[7], "expire %llu != %llu",
+                fact(7)->expire, expected[7]);
+
+    run_until(start + 48 * HOUR);
+
+    fail_unless(total_fired() == NTIMER, "%d of %d timers fired",
+                total_fired(), NTIMER);
+
+    for (i = 0;  i < NTIMER;  i++)
+        fail_unless(nfired[i] == 1, "timer %d fired %d times", i, nfired[i]);
+
+    fail_unless(nlate == 0 && nearly == 0, "%d late and %d early timers",
+                nlate, nearly);
+    fail_unless(disorder == 0, "%d timers fired out of order", disorder);
+    fail_unless(!strcmp(fact(0)->state, "rundown"), "state %s",
+                fact(0)->state);
+    fail_unless(source.id == 0, "main loop source left armed");
+}
+END_TEST
+
+START_TEST (test_wheel_restart)
+{
+    uint64_t      start = mono;
+    timer_node_t *node;
+    int           i;
+
+    for (i = 0;  i < NTIMER;  i++)
+        arm(i, 1000 + i, FALSE);
+
+    node = g_hash_table_lookup(wheel.nodes, "t42");
+
+    run_until(start + 500);
+
+    /* restart every timer, cancel every third one */
+    for (i = 0;  i < NTIMER;  i++)
+        fail_unless(arm(i, 10000 + (i % 100) * 1000, TRUE),
+                    "failed to restart timer %d", i);
+
+    fail_unless(g_hash_table_lookup(wheel.nodes, "t42") == node,
+                "restart did not reuse the armed timer");
+    fail_unless(fact(42)->expire == start + 500 + 10000 + 42000,
+                "expire %llu after restart", fact(42)->expire);
+
+    for (i = 0;  i < NTIMER;  i += 3)
+        cancel(i);
+
+    fail_unless(!strcmp(fact(0)->state, "stopped"), "state %s",
+                fact(0)->state);
+
+    run_until(start + 1000 + NTIMER);
+
+    fail_unless(total_fired() == 0, "%d timers fired at their old deadline",
+                total_fired());
+
+    run_until(start + 500 + 10000 + 100 * 1000);
+
+    for (i = 0;  i < NTIMER;  i++)
+        fail_unless(nfired[i] == (i % 3 ? 1 : 0), "timer %d fired %d times",
+                    i, nfired[i]);
+
+    fail_unless(nlate == 0 && nearly == 0, "%d late and %d early timers",
+                nlate, nearly);
+
+    /* a timer can be restarted once it has run down */
+    fail_unless(arm(1, 10, TRUE), "failed to restart a fired timer");
+    run_until(mono + 10);
+    fail_unless(nfired[1] == 2, "restarted timer fired %d times", nfired[1]);
+}
+END_TEST
+
+START_TEST (test_wheel_clock_jump)
+{
+    uint64_t start = mono;
+    int      i;
+
+    for (i = 0;  i < NTIMER;  i++)
+        arm(i, (i + 1) * 1000, FALSE);
+
+    /* setting the wall clock has no effect whatsoever */
+    wall -= 24 * HOUR;
+    run_until(start + 10 * 1000);
+    wall += 48 * HOUR;
+    run_until(start + 20 * 1000);
+
+    fail_unless(total_fired() == 20, "%d timers fired", total_fired());
+    fail_unless(fact(0)->expire == start + 1000,
+                "expire %llu follows the wall clock", fact(0)->expire);
+    fail_unless(nlate == 0 && nearly == 0, "%d late and %d early timers",
+                nlate, nearly);
+
+    /*
+     * The monotonic clock jumps ahead (eg. the main loop got stuck). All
+     * the overdue timers fire at once, in order, and only once.
+     */
+    mono = start + 3600 * 1000;
+    run_until(mono);
+
+    fail_unless(total_fired() == 3600, "%d timers fired after the jump",
+                total_fired());
+    fail_unless(disorder == 0, "%d timers fired out of order", disorder);
+
+    for (i = 0;  i < 3600;  i++)
+        fail_unless(nfired[i] == 1, "timer %d fired %d times", i, nfired[i]);
+
+    /* the rest is still on time */
+    nlate = 0;
+    run_until(start + (NTIMER + 1) * 1000);
+
+    fail_unless(total_fired() == NTIMER, "%d timers fired", total_fired());
+    fail_unless(nlate == 0 && nearly == 0, "%d late and %d early timers",
+                nlate, nearly);
+
+    /* a new timer armed after the jump is measured from the new time */
+    fail_unless(arm(0, 100, TRUE), "failed to rearm timer");
+    fail_unless(source.due <= mono + 100, "wheel armed %llu ms ahead",
+                source.due - mono);
+
+    run_until(mono + 100);
+
+    fail_unless(nfired[0] == 2 && nlate == 0, "rearmed timer fired %d times, "
+                "%d late", nfired[0], nlate);
+}
+END_TEST
+
+Suite *ohm_timer_wheel_suite(void)
+{
+    Suite *suite = suite_create("ohm_timer_wheel");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_wheel_many);
+    tcase_add_test(tc_all, test_wheel_restart);
+    tcase_add_test(tc_all, test_wheel_clock_jump);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_timer_wheel_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
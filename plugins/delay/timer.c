@@ -19,18 +19,40 @@ USA.
 
 
 static int build_fldlist(fsif_field_t *, char *, char *, unsigned int,
-                         unsigned int, char *, void *, char *, void **);
-static void calculate_expiration_time(unsigned int, char *,int);
+                         uint64_t, char *, void *, char *, void **);
+static uint64_t monotonic_ms(void);
 
-static unsigned int schedule_timer_event(char *, unsigned int);
-static void cancel_timer_event_by_srcid(unsigned int);
+static timer_node_t *schedule_timer_event(char *, unsigned int);
+static void cancel_timer_event_by_id(char *);
 static void cancel_timer_event_by_entry(fsif_entry_t *);
 static int  timer_event_cb(void *);
 
+static void     wheel_init(void);
+static void     wheel_exit(void);
+static void     wheel_link(timer_node_t *, uint64_t);
+static void     wheel_unlink(timer_node_t *);
+static void     wheel_splice(int, int, timer_link_t *);
+static uint64_t wheel_next(void);
+static void     wheel_sync(uint64_t);
+static void     wheel_advance(uint64_t);
+static void     wheel_arm(void);
+static gboolean wheel_dispatch(gpointer);
+
+static timer_wheel_t wheel;
+
 
 static void timer_init(OhmPlugin *plugin)
 {
     (void)plugin;
+
+    wheel_init();
+}
+
+static void timer_exit(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    wheel_exit();
 }
 
 static int timer_add(char *id, unsigned int delay, char *cb_name,
@@ -41,21 +63,23 @@ static int timer_add(char *id, unsigned int delay, char *cb_name,
 #define FLDLIST_DIM  MAX_ARG + 10
 
     fsif_field_t  fldlist[FLDLIST_DIM];
-    unsigned int  srcid;
+    timer_node_t *node;
+    uint64_t      expire;
     int           success;
     char         *state;
 
     if (!id || !cb_name || !cb || !argt || strlen(argt) > MAX_ARG)
         success = FALSE;
     else {
-        srcid   =  schedule_timer_event(id, delay);
-        success = srcid;
-        state   = srcid ? "active" : "failed";
+        node    = schedule_timer_event(id, delay);
+        success = node ? TRUE : FALSE;
+        state   = node ? "active" : "failed";
+        expire  = node ? node->expire : monotonic_ms() + delay;
 
-        if (!build_fldlist(fldlist,id,state,delay,srcid,cb_name,cb,argt,argv)||
-            !fsif_add_factstore_entry(FACTSTORE_TIMER, fldlist)               )
+        if (!build_fldlist(fldlist,id,state,delay,expire,cb_name,cb,argt,argv)||
+            !fsif_add_factstore_entry(FACTSTORE_TIMER, fldlist)                )
         {
-            cancel_timer_event_by_srcid(srcid);
+            cancel_timer_event_by_id(id);
             success = FALSE;            
         }
     }
@@ -71,22 +95,27 @@ static int timer_restart(fsif_entry_t *entry, unsigned int delay,
                          char *cb_name, delay_cb_t cb, char *argt, void **argv)
 {
     char *id = 0;
+    int   success;
     
     if (!entry || !cb_name || !cb || !argt)
         goto fail;
 
     fsif_get_field_by_entry(entry, fldtype_string, TIMER_ID, &id);
 
-    if (id == NULL)
+    /* the id is owned by the entry we are about to destroy */
+    if (id == NULL || (id = strdup(id)) == NULL)
         goto fail;
 
-    cancel_timer_event_by_entry(entry);
+    /*
+     * If the timer is still armed timer_add will just move it to its new
+     * place on the wheel.
+     */
+    success = fsif_destroy_factstore_entry(entry) &&
+              timer_add(id, delay, cb_name, cb, argt, argv);
 
-    if (!fsif_destroy_factstore_entry(entry) ||
-        !timer_add(id, delay, cb_name, cb, argt, argv))
-        goto fail;
+    free(id);
         
-    return TRUE;
+    return success;
 
  fail:
     return FALSE;
@@ -142,18 +171,16 @@ static int timer_active(fsif_entry_t *entry)
 }
 
 static int build_fldlist(fsif_field_t *fldlist, char *id, char *state,
-                         unsigned int delay, unsigned int srcid, 
+                         unsigned int delay, uint64_t expire, 
                          char *cbname, void *addr, char *argt, void **argv)
 {
+    static char buf[2048];      /* the argument names outlive this call */
+
     char  t;
     int   i, j;
     char *argname;
-    char  buf[2048];
     char *bufend;
     int   len;
-    char  expire[64];
-
-    calculate_expiration_time(delay, expire, sizeof(expire));
 
     j = 0;
 
@@ -176,9 +203,9 @@ static int build_fldlist(fsif_field_t *fldlist, char *id, char *state,
     fldlist[j].value.unsignd = delay;
     j++;
 
-    fldlist[j].type = fldtype_string;
+    fldlist[j].type = fldtype_time;
     fldlist[j].name = TIMER_EXPIRE;
-    fldlist[j].value.string = expire;
+    fldlist[j].value.time = expire;
     j++;
 
     fldlist[j].type = fldtype_string;
@@ -191,11 +218,6 @@ static int build_fldlist(fsif_field_t *fldlist, char *id, char *state,
     fldlist[j].value.unsignd = addr;
     j++;
 
-    fldlist[j].type = fldtype_unsignd;
-    fldlist[j].name = TIMER_SRCID;
-    fldlist[j].value.unsignd = srcid;
-    j++;
-
     fldlist[j].type = fldtype_unsignd;
     fldlist[j].name = TIMER_ARGC;
     fldlist[j].value.unsignd = strlen(argt);
@@ -240,67 +262,75 @@ static int build_fldlist(fsif_field_t *fldlist, char *id, char *state,
     return TRUE;
 }
 
-static void calculate_expiration_time(unsigned int delay, char *buf, int len)
+static uint64_t monotonic_ms(void)
 {
-    struct timeval  tv;
-    struct tm      *tm;
-    uint64_t        now;
-    uint64_t        exp;
-    time_t          exp_sec;
-    int             exp_ms;
+    struct timespec ts;
 
-    gettimeofday(&tv, NULL);
-    now = (uint64_t)tv.tv_sec * 1000ULL  + (uint64_t)(tv.tv_usec / 1000);
-    exp = now + (uint64_t)delay;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
 
-    exp_sec = exp / 1000ULL;
-    exp_ms  = exp % 1000ULL;
-
-    tm = gmtime(&exp_sec);
-
-    snprintf(buf, len, "%2d:%02d:%02d.%03d",
-             tm->tm_hour, tm->tm_min, tm->tm_sec, exp_ms);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)(ts.tv_nsec / 1000000);
 }
 
 
-static unsigned int schedule_timer_event(char *id, unsigned int delay)
+static timer_node_t *schedule_timer_event(char *id, unsigned int delay)
 {
-    gpointer      data;
-    unsigned int  srcid;
+    timer_node_t *node;
+    uint64_t      now;
 
-    if (id == NULL) 
-        srcid = 0;
+    if (id == NULL || wheel.nodes == NULL)
+        node = NULL;
     else {
-        data = strdup(id);
+        if ((node = g_hash_table_lookup(wheel.nodes, id)) != NULL)
+            wheel_unlink(node);
+        else if ((node = malloc(sizeof(*node))) != NULL) {
+            memset(node, 0, sizeof(*node));
+
+            if ((node->id = strdup(id)) == NULL) {
+                free(node);
+                node = NULL;
+            }
+            else
+                g_hash_table_insert(wheel.nodes, node->id, node);
+        }
 
-        if (!delay)
-            srcid = g_idle_add_full(G_PRIORITY_HIGH, timer_event_cb,data,free);
-        else {
-            srcid = g_timeout_add_full(G_PRIORITY_HIGH, delay,
-                                       timer_event_cb, data, free);
+        if (node != NULL) {
+            now = monotonic_ms();
+
+            wheel_sync(now - 1);
+
+            node->expire = now + (uint64_t)delay;
+            wheel_link(node, wheel.now + 1);
+            wheel_arm();
         }
     }
 
-    if (srcid) {
-        OHM_DEBUG(DBG_EVENT, "sheduled event with %s=%u (id=%s)",
-                  TIMER_SRCID, srcid, id);
+    if (node != NULL) {
+        OHM_DEBUG(DBG_EVENT, "sheduled event at %llu (id=%s)",
+                  (unsigned long long)node->expire, id);
     }
     else {
         OHM_DEBUG(DBG_EVENT, "failed to schedule event (id=%s)", id);
     }
 
-    return srcid;
+    return node;
 }
 
-static void cancel_timer_event_by_srcid(unsigned int srcid)
+static void cancel_timer_event_by_id(char *id)
 {
-    if (srcid != 0) {
-        if (g_source_remove(srcid))
-            OHM_DEBUG(DBG_EVENT, "event with %s=%u removed",
-                      TIMER_SRCID, srcid);
-        else
-            OHM_DEBUG(DBG_EVENT, "Failed to remove event with %s=%u",
-                      TIMER_SRCID, srcid);
+    timer_node_t *node;
+
+    if (id != NULL && wheel.nodes != NULL) {
+        if ((node = g_hash_table_lookup(wheel.nodes, id)) == NULL)
+            OHM_DEBUG(DBG_EVENT, "Failed to remove event (id=%s)", id);
+        else {
+            wheel_unlink(node);
+            g_hash_table_remove(wheel.nodes, node->id);
+
+            free(node->id);
+            free(node);
+
+            OHM_DEBUG(DBG_EVENT, "event removed (id=%s)", id);
+        }
     }
 }
 
@@ -308,11 +338,11 @@ static void cancel_timer_event_by_entry(fsif_entry_t *entry)
 {
     static char  *stopped = "stopped";
 
-    unsigned int  srcid;
+    char         *id = NULL;
 
     if (timer_active(entry)) {
-        fsif_get_field_by_entry(entry, fldtype_unsignd, TIMER_SRCID, &srcid);
-        cancel_timer_event_by_srcid(srcid);
+        fsif_get_field_by_entry(entry, fldtype_string, TIMER_ID, &id);
+        cancel_timer_event_by_id(id);
         fsif_set_field_by_entry(entry, fldtype_string, TIMER_STATE, &stopped);
     }
 }
@@ -327,7 +357,7 @@ static int timer_event_cb(void *data)
     char         *id    = (char *)data;
     fsif_entry_t *entry = NULL;
     delay_cb_t    cb;
-    int           argc;
+    unsigned long argc;
     char          argt[MAX_ARG + 1];
     void         *argv[MAX_ARG];
     char          name[64];
@@ -379,6 +409,310 @@ static int timer_event_cb(void *data)
 #undef MAX_ARG
 }
 
+
+/********************
+ * wheel_init
+ ********************/
+static void wheel_init(void)
+{
+    timer_link_t *head;
+    int           l, s;
+
+    memset(&wheel, 0, sizeof(wheel));
+
+    for (l = 0;  l < WHEEL_LEVELS;  l++) {
+        for (s = 0;  s < WHEEL_SLOTS;  s++) {
+            head = &wheel.slots[l][s];
+            head->next = head->prev = head;
+        }
+    }
+
+    wheel.now   = monotonic_ms() - 1;
+    wheel.nodes = g_hash_table_new(g_str_hash, g_str_equal);
+}
+
+
+/********************
+ * wheel_exit
+ ********************/
+static void wheel_exit(void)
+{
+    GHashTableIter  it;
+    gpointer        key, value;
+    timer_node_t   *node;
+
+    if (wheel.srcid != 0) {
+        g_source_remove(wheel.srcid);
+        wheel.srcid = 0;
+    }
+
+    if (wheel.nodes != NULL) {
+        g_hash_table_iter_init(&it, wheel.nodes);
+
+        while (g_hash_table_iter_next(&it, &key, &value)) {
+            node = (timer_node_t *)value;
+            free(node->id);
+            free(node);
+        }
+
+        g_hash_table_destroy(wheel.nodes);
+        wheel.nodes = NULL;
+    }
+}
+
+
+/********************
+ * wheel_link
+ ********************/
+static void wheel_link(timer_node_t *node, uint64_t base)
+{
+    timer_link_t *head;
+    uint64_t      tick;
+    uint64_t      delta;
+    int           level;
+    int           slot;
+
+    /*
+     * base is the first tick that is still to be processed. Anything
+     * overdue goes to the slot of base. Otherwise the node goes to the
+     * lowest level that has its slot within one turn of the wheel.
+     */
+    tick  = node->expire < base ? base : node->expire;
+    delta = tick - base;
+
+    for (level = 0;  level < WHEEL_LEVELS - 1;  level++) {
+        if (delta < (1ULL << (WHEEL_BITS * (level + 1))))
+            break;
+    }
+
+    slot = (tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    head = &wheel.slots[level][slot];
+
+    node->level = level;
+    node->slot  = slot;
+
+    node->link.next = head;
+    node->link.prev = head->prev;
+    head->prev->next = &node->link;
+    head->prev = &node->link;
+
+    wheel.used[level] |= 1ULL << slot;
+}
+
+
+/********************
+ * wheel_unlink
+ ********************/
+static void wheel_unlink(timer_node_t *node)
+{
+    timer_link_t *head = &wheel.slots[node->level][node->slot];
+
+    node->link.prev->next = node->link.next;
+    node->link.next->prev = node->link.prev;
+    node->link.next = node->link.prev = &node->link;
+
+    if (head->next == head)
+        wheel.used[node->level] &= ~(1ULL << node->slot);
+}
+
+
+/********************
+ * wheel_splice
+ ********************/
+static void wheel_splice(int level, int slot, timer_link_t *list)
+{
+    timer_link_t *head = &wheel.slots[level][slot];
+
+    if (head->next == head)
+        list->next = list->prev = list;
+    else {
+        list->next = head->next;
+        list->prev = head->prev;
+        list->next->prev = list;
+        list->prev->next = list;
+
+        head->next = head->prev = head;
+    }
+
+    wheel.used[level] &= ~(1ULL << slot);
+}
+
+
+/********************
+ * wheel_next
+ ********************/
+static uint64_t wheel_next(void)
+{
+    uint64_t next, used, block, tick;
+    int      level, shift, slot;
+
+    /*
+     * The first tick after now that needs processing: the first nonempty
+     * slot on level 0 or the start of the first nonempty slot on any of
+     * the higher levels, where its timers get cascaded.
+     */
+    next = 0;
+
+    for (level = 0;  level < WHEEL_LEVELS;  level++) {
+        if ((used = wheel.used[level]) == 0)
+            continue;
+
+        shift = WHEEL_BITS * level;
+        block = (wheel.now >> shift) + 1;
+        slot  = block & WHEEL_MASK;
+
+        if (slot != 0)
+            used = (used >> slot) | (used << (WHEEL_SLOTS - slot));
+
+        tick = (block + __builtin_ctzll(used)) << shift;
+
+        if (next == 0 || tick < next)
+            next = tick;
+    }
+
+    return next;
+}
+
+
+/********************
+ * wheel_sync
+ ********************/
+static void wheel_sync(uint64_t now)
+{
+    uint64_t next;
+
+    /*
+     * Catch up with the clock if there is nothing to process on the way.
+     * Timers due in a tick that has already been processed would only
+     * fire in the next one.
+     */
+    if (wheel.now < now) {
+        next = wheel_next();
+
+        if (next == 0 || next > now)
+            wheel.now = now;
+    }
+}
+
+
+/********************
+ * wheel_advance
+ ********************/
+static void wheel_advance(uint64_t now)
+{
+    timer_link_t  list;
+    timer_node_t *node;
+    uint64_t      next;
+    int           level, shift;
+
+    while (wheel.now < now) {
+        next = wheel_next();
+
+        if (next == 0 || next > now) {
+            wheel.now = now;
+            break;
+        }
+
+        wheel.now = next;
+
+        /* cascade from the top so every node ends up on its final slot */
+        for (level = WHEEL_LEVELS - 1;  level > 0;  level--) {
+            shift = WHEEL_BITS * level;
+
+            if (next & ((1ULL << shift) - 1))
+                continue;
+
+            wheel_splice(level, (next >> shift) & WHEEL_MASK, &list);
+
+            while (list.next != &list) {
+                node = (timer_node_t *)list.next;
+
+                list.next = node->link.next;
+                list.next->prev = &list;
+
+                wheel_link(node, next);
+            }
+        }
+
+        /*
+         * Fire the slot. The callbacks are free to add, restart or cancel
+         * any timer, including the ones still waiting on the list.
+         */
+        wheel_splice(0, next & WHEEL_MASK, &list);
+
+        while (list.next != &list) {
+            node = (timer_node_t *)list.next;
+
+            node->link.prev->next = node->link.next;
+            node->link.next->prev = node->link.prev;
+
+            g_hash_table_remove(wheel.nodes, node->id);
+
+            timer_event_cb(node->id);
+
+            free(node->id);
+            free(node);
+        }
+    }
+}
+
+
+/********************
+ * wheel_arm
+ ********************/
+static void wheel_arm(void)
+{
+    uint64_t next, now;
+
+    next = wheel_next();
+
+    if (next == 0) {
+        if (wheel.srcid != 0) {
+            g_source_remove(wheel.srcid);
+            wheel.srcid = 0;
+        }
+        return;
+    }
+
+    /* an early wakeup is harmless, the dispatcher rearms */
+    if (wheel.srcid != 0 && wheel.wakeup <= next)
+        return;
+
+    if (wheel.srcid != 0)
+        g_source_remove(wheel.srcid);
+
+    now = monotonic_ms();
+
+    if (next <= now) {
+        wheel.srcid = g_idle_add_full(G_PRIORITY_HIGH, wheel_dispatch,
+                                      NULL, NULL);
+    }
+    else {
+        wheel.srcid = g_timeout_add_full(G_PRIORITY_HIGH, next - now,
+                                         wheel_dispatch, NULL, NULL);
+    }
+
+    wheel.wakeup = next;
+
+    OHM_DEBUG(DBG_EVENT, "wheel armed for %llu", (unsigned long long)next);
+}
+
+
+/********************
+ * wheel_dispatch
+ ********************/
+static gboolean wheel_dispatch(gpointer data)
+{
+    (void)data;
+
+    wheel.srcid = 0;
+
+    wheel_advance(monotonic_ms());
+    wheel_arm();
+
+    return FALSE;
+}
+
 /* 
  * Local Variables:
  * c-basic-offset: 4
@@ -31,11 +31,44 @@ USA.
 #define TIMER_EXPIRE    "expire"
 #define TIMER_CALLBACK  "callback"
 #define TIMER_ADDRESS   "address"
-#define TIMER_SRCID     "g_source_id"
 #define TIMER_ARGC      "argc"
 #define TIMER_ARGV      "argv%d"
 
+/*
+ * Timers are kept on a hierarchical wheel ticking in milliseconds of
+ * CLOCK_MONOTONIC. Each level has 64 slots, a slot spanning one full turn
+ * of the level below. Timers are cascaded to lower levels as the wheel
+ * turns and fired from level 0. Six levels cover any unsigned delay.
+ */
+#define WHEEL_BITS      6
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS    6
+
+typedef struct timer_link_s {
+    struct timer_link_s *next;
+    struct timer_link_s *prev;
+} timer_link_t;
+
+typedef struct {
+    timer_link_t  link;         /* slot hook, must be the first */
+    char         *id;           /* timer id, the key in the node hash */
+    uint64_t      expire;       /* monotonic expiration time in ms */
+    int           level;        /* wheel level and */
+    int           slot;         /*   slot the node is hooked to */
+} timer_node_t;
+
+typedef struct {
+    timer_link_t  slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t      used[WHEEL_LEVELS];   /* bitmaps of nonempty slots */
+    uint64_t      now;          /* last tick processed */
+    GHashTable   *nodes;        /* armed timers by id */
+    guint         srcid;        /* the main loop source of the wheel */
+    uint64_t      wakeup;       /* the tick srcid is due at */
+} timer_wheel_t;
+
 static void          timer_init(OhmPlugin *);
+static void          timer_exit(OhmPlugin *);
 static int           timer_add(char *, unsigned int, char *,
                                delay_cb_t, char *, void **);
 static int           timer_restart(fsif_entry_t *, unsigned int, char *,
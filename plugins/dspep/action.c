@@ -32,11 +32,10 @@ USA.
 #include "plugin.h"
 #include "action.h"
 #include "dsp.h"
+#include "ep-args.h"
 
 #define MAX_DSP_USERS 64
 
-#define STRUCT_OFFSET(s,m) ((char *)&(((s *)0)->m) - (char *)0)
-
 OHM_IMPORTABLE(gboolean , unregister_ep, (GObject *ep));
 OHM_IMPORTABLE(GObject *, register_ep  , (gchar *uri, gchar **interested));
 
@@ -45,19 +44,6 @@ typedef void (*internal_ep_cb_t) (GObject *ep,
                                   gboolean success);
 typedef int (*action_t)(void *);
 
-typedef enum {
-    argtype_invalid = 0,
-    argtype_string,
-    argtype_integer,
-    argtype_unsigned
-} argtype_t;
-
-typedef struct {		/* argument descriptor for actions */
-    argtype_t     type;
-    const char   *name;
-    int           offs;
-} argdsc_t; 
-
 typedef struct {		/* action descriptor */
     const char   *name;
     action_t      handler;
@@ -82,7 +68,6 @@ static void key_change_signal_cb(GObject *, GObject *, gpointer);
 static gboolean transaction_parser(GObject *, GObject *, gpointer);
 static int dspuser_action(void *);
 static int action_parser(actdsc_t *);
-static int get_args(OhmFact *, argdsc_t *, void *);
 
 
 /*! \addtogroup pubif
@@ -260,10 +245,11 @@ static int dspuser_action(void *data)
 
 static int action_parser(actdsc_t *action)
 {
-    OhmFact *fact;
-    GSList  *list;
-    char    *data;
-    int      success;
+    OhmFact    *fact;
+    GSList     *list;
+    char       *data;
+    int         success;
+    ep_error_t  err;
 
     if ((data = malloc(action->datalen)) == NULL) {
         OHM_ERROR("dspep: Can't allocate %d byte memory", action->datalen);
@@ -281,8 +267,10 @@ static int action_parser(actdsc_t *action)
 
         memset(data, 0, action->datalen);
 
-        if (!get_args(fact, action->argdsc, data))
+        if (!ep_args_parse(fact, action->argdsc, data, &err)) {
+            OHM_ERROR("dspep: invalid action: %s", err.msg);
             success &= FALSE;
+        }
         else
             success &= action->handler(data);
     }
@@ -292,50 +280,6 @@ static int action_parser(actdsc_t *action)
     return success;
 }
 
-static int get_args(OhmFact *fact, argdsc_t *argdsc, void *args)
-{
-    argdsc_t *ad;
-    GValue   *gv;
-    void     *vptr;
-
-    if (fact == NULL)
-        return FALSE;
-
-    for (ad = argdsc;    ad->type != argtype_invalid;   ad++) {
-        vptr = args + ad->offs;
-
-        if ((gv = ohm_fact_get(fact, ad->name)) == NULL)
-            continue;
-
-#if 0
-        OHM_DEBUG(DBG_ACTION, "Got value type %d", G_VALUE_TYPE(gv));
-#endif
-
-        switch (ad->type) {
-
-        case argtype_string:
-            if (G_VALUE_TYPE(gv) == G_TYPE_STRING)
-                *(const char **)vptr = g_value_get_string(gv);
-            break;
-
-        case argtype_integer:
-            if (G_VALUE_TYPE(gv) == G_TYPE_INT)
-                *(int *)vptr = g_value_get_int(gv);
-            break;
-
-        case argtype_unsigned:
-            if (G_VALUE_TYPE(gv) == G_TYPE_ULONG)
-                *(unsigned long *)vptr = g_value_get_ulong(gv);
-            break;
-
-        default:
-            break;
-        }
-    }
-
-    return TRUE;
-}
-
 /*
  * Local Variables:
  * c-basic-offset: 4
@@ -31,6 +31,10 @@ USA.
 
 int DBG_INIT, DBG_ACTION, DBG_DSP;
 
+OHM_IMPORTABLE(void, timestamp_trace, (const char *id,
+                                       uint32_t arg0, uint32_t arg1));
+OHM_IMPORTABLE(int, timestamp_tracing, (void));
+
 OHM_DEBUG_PLUGIN(dsp,
     OHM_DEBUG_FLAG( "init"    , "init sequence"        , &DBG_INIT   ),
     OHM_DEBUG_FLAG( "action"  , "Video policy actions" , &DBG_ACTION ),
@@ -44,6 +48,10 @@ void plugin_print_timestamp(const char *function, const char *phase)
     struct tm      tm;
     char           tstamp[64];
 
+    /* function and phase are static strings; leave is traced as 1 */
+    if (timestamp_tracing != NULL && timestamp_tracing())
+        timestamp_trace(function, phase[0] == 'l', 0);
+
     if (DBG_INIT) {
         gettimeofday(&tv, NULL);
         localtime_r(&tv.tv_sec, &tm);
@@ -54,12 +62,30 @@ void plugin_print_timestamp(const char *function, const char *phase)
     }
 }
 
+static void timestamp_init(void)
+{
+    char *signature = (char *)timestamp_trace_SIGNATURE;
+
+    /* ENTER/LEAVE are only traced into the ring buffer, never to sp */
+    if (!ohm_module_find_method("timestamp_trace", &signature,
+                                (void *)&timestamp_trace))
+        return;
+
+    signature = (char *)timestamp_tracing_SIGNATURE;
+
+    if (!ohm_module_find_method("timestamp_tracing", &signature,
+                                (void *)&timestamp_tracing))
+        timestamp_tracing = NULL;
+}
+
 static void plugin_init(OhmPlugin *plugin)
 {
     OHM_DEBUG_INIT(dsp);
 
     DBG_INIT = FALSE;
 
+    timestamp_init();
+
     ENTER;
 
 #if 0
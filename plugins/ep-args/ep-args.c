@@ -0,0 +1,282 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "ep-args.h"
+
+typedef struct {
+    const char *name;
+    int         size;
+    int         align;
+} typedsc_t;
+
+#define TYPEDSC(n, t) { n, sizeof(t), __alignof__(t) }
+
+static typedsc_t types[] = {
+    [argtype_invalid ] = { "invalid", 0, 1 },
+    [argtype_string  ] = TYPEDSC("string"       , const char *),
+    [argtype_integer ] = TYPEDSC("integer"      , int),
+    [argtype_unsigned] = TYPEDSC("unsigned"     , unsigned int),
+    [argtype_long    ] = TYPEDSC("long"         , long),
+    [argtype_ulong   ] = TYPEDSC("unsigned long", unsigned long),
+};
+
+#define NTYPE ((int)(sizeof(types) / sizeof(types[0])))
+
+static ep_argerr_t get_number(GValue *, argtype_t, void *);
+static int         set_error(ep_error_t *, ep_argerr_t, OhmFact *,
+                         const char *, const char *, ...);
+
+
+/*! \addtogroup pubif
+ *  Functions
+ *  @{
+ */
+
+int ep_args_parse(OhmFact *fact, const argdsc_t *argdsc, void *args,
+                  ep_error_t *err)
+{
+    const argdsc_t *ad;
+    GValue         *gv;
+    void           *vptr;
+    ep_argerr_t     status;
+
+    if (fact == NULL)
+        return set_error(err, ep_args_nofact, NULL, NULL, "no fact");
+
+    for (ad = argdsc;    ad->type != argtype_invalid;    ad++) {
+        vptr = (char *)args + ad->offs;
+
+        if ((gv = ohm_fact_get(fact, ad->name)) == NULL) {
+            if (ad->flags & ARGFLAG_MANDATORY)
+                return set_error(err, ep_args_missing, fact, ad->name,
+                              "missing");
+            continue;
+        }
+
+        if (ad->type == argtype_string) {
+            if (G_VALUE_TYPE(gv) != G_TYPE_STRING)
+                return set_error(err, ep_args_type, fact, ad->name,
+                              "expected string, got %s",
+                              g_type_name(G_VALUE_TYPE(gv)));
+
+            /* no copy, the string is owned by the fact */
+            *(const char **)vptr = g_value_get_string(gv);
+        }
+        else if ((status = get_number(gv, ad->type, vptr)) != ep_args_ok) {
+            if (status == ep_args_range)
+                return set_error(err, status, fact, ad->name,
+                              "value does not fit in %s",
+                              types[ad->type].name);
+            else
+                return set_error(err, status, fact, ad->name,
+                              "expected %s, got %s", types[ad->type].name,
+                              g_type_name(G_VALUE_TYPE(gv)));
+        }
+    }
+
+    if (err != NULL) {
+        err->code   = ep_args_ok;
+        err->field  = NULL;
+        err->msg[0] = '\0';
+    }
+
+    return TRUE;
+}
+
+
+int ep_args_check(const argdsc_t *argdsc, int datalen, ep_error_t *err)
+{
+    const argdsc_t *ad, *prev;
+    typedsc_t      *td;
+
+    if (argdsc == NULL)
+        return set_error(err, ep_args_schema, NULL, NULL, "no field table");
+
+    for (ad = argdsc;    ad->type != argtype_invalid;    ad++) {
+        if (ad->type < 0 || ad->type >= NTYPE)
+            return set_error(err, ep_args_schema, NULL, ad->name,
+                          "invalid type %d", ad->type);
+
+        if (ad->name == NULL)
+            return set_error(err, ep_args_schema, NULL, NULL,
+                          "field #%d has no name", (int)(ad - argdsc));
+
+        td = types + ad->type;
+
+        if (ad->offs < 0 || ad->offs + td->size > datalen)
+            return set_error(err, ep_args_schema, NULL, ad->name,
+                          "offset %d outside of the %d byte record",
+                          ad->offs, datalen);
+
+        if (ad->offs % td->align)
+            return set_error(err, ep_args_schema, NULL, ad->name,
+                          "misaligned %s at offset %d", td->name, ad->offs);
+
+        for (prev = argdsc;    prev < ad;    prev++) {
+            if (!strcmp(prev->name, ad->name))
+                return set_error(err, ep_args_schema, NULL, ad->name,
+                              "duplicate field");
+
+            if (prev->offs < ad->offs + td->size &&
+                ad->offs < prev->offs + types[prev->type].size)
+                return set_error(err, ep_args_schema, NULL, ad->name,
+                              "overlaps field '%s'", prev->name);
+        }
+    }
+
+    if (err != NULL) {
+        err->code   = ep_args_ok;
+        err->field  = NULL;
+        err->msg[0] = '\0';
+    }
+
+    return TRUE;
+}
+
+
+const char *ep_args_strerror(ep_argerr_t code)
+{
+    switch (code) {
+    case ep_args_ok:      return "success";
+    case ep_args_nofact:  return "no fact";
+    case ep_args_missing: return "missing field";
+    case ep_args_type:    return "type mismatch";
+    case ep_args_range:   return "value out of range";
+    case ep_args_schema:  return "invalid field table";
+    default:              return "unknown error";
+    }
+}
+
+
+/*!
+ * @}
+ */
+
+static ep_argerr_t get_number(GValue *gv, argtype_t type, void *vptr)
+{
+    gint64  s = 0;
+    guint64 u = 0;
+    int     neg;
+
+    /*
+     * Accept any integer type in the fact and convert it to the storage
+     * type of the field if it fits. Negative values end up in s, all
+     * others in u.
+     */
+
+    switch (G_VALUE_TYPE(gv)) {
+    case G_TYPE_INT:    s = g_value_get_int(gv);    break;
+    case G_TYPE_LONG:   s = g_value_get_long(gv);   break;
+    case G_TYPE_INT64:  s = g_value_get_int64(gv);  break;
+    case G_TYPE_UINT:   u = g_value_get_uint(gv);   break;
+    case G_TYPE_ULONG:  u = g_value_get_ulong(gv);  break;
+    case G_TYPE_UINT64: u = g_value_get_uint64(gv); break;
+    default:                                        return ep_args_type;
+    }
+
+    if (s > 0)
+        u = (guint64)s;
+
+    neg = (s < 0);
+
+    switch (type) {
+    case argtype_integer:
+        if (neg ? s < INT_MIN : u > INT_MAX)
+            return ep_args_range;
+        *(int *)vptr = neg ? (int)s : (int)u;
+        break;
+
+    case argtype_unsigned:
+        if (neg || u > UINT_MAX)
+            return ep_args_range;
+        *(unsigned int *)vptr = (unsigned int)u;
+        break;
+
+    case argtype_long:
+        if (neg ? s < LONG_MIN : u > LONG_MAX)
+            return ep_args_range;
+        *(long *)vptr = neg ? (long)s : (long)u;
+        break;
+
+    case argtype_ulong:
+        if (neg || u > ULONG_MAX)
+            return ep_args_range;
+        *(unsigned long *)vptr = (unsigned long)u;
+        break;
+
+    default:
+        return ep_args_schema;
+    }
+
+    return ep_args_ok;
+}
+
+
+static int set_error(ep_error_t *err, ep_argerr_t code, OhmFact *fact,
+                     const char *field, const char *fmt, ...)
+{
+    va_list     ap;
+    const char *name;
+    int         n;
+
+    if (err == NULL)
+        return FALSE;
+
+    err->code  = code;
+    err->field = field;
+
+    if (fact != NULL)
+        name = ohm_structure_get_name(OHM_STRUCTURE(fact));
+    else
+        name = NULL;
+
+    if (field != NULL)
+        n = snprintf(err->msg, sizeof(err->msg), "%s%sfield '%s': ",
+                     name ? name : "", name ? ": " : "", field);
+    else
+        n = snprintf(err->msg, sizeof(err->msg), "%s%s",
+                     name ? name : "", name ? ": " : "");
+
+    if (n < 0 || n >= (int)sizeof(err->msg))
+        return FALSE;
+
+    va_start(ap, fmt);
+    vsnprintf(err->msg + n, sizeof(err->msg) - n, fmt, ap);
+    va_end(ap);
+
+    return FALSE;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
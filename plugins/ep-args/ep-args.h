@@ -0,0 +1,95 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#ifndef __OHM_EP_ARGS_H__
+#define __OHM_EP_ARGS_H__
+
+/*
+ * Unpacking of decision facts into action arguments for enforcement
+ * points. An enforcement point describes the arguments of each of its
+ * actions with a field table, eg.
+ *
+ *     static argdsc_t mute_args[] = {
+ *         { argtype_string , "group", STRUCT_OFFSET(mute_t, group) },
+ *         { argtype_integer, "value", STRUCT_OFFSET(mute_t, value),
+ *           ARGFLAG_MANDATORY                                        },
+ *         { argtype_invalid,  NULL  , 0                              }
+ *     };
+ *
+ * and ep_args_parse fills in a mute_t from a decision fact. Strings are
+ * not copied: they point to the value in the fact and stay valid only
+ * as long as the fact is not changed. Fields missing from the fact are
+ * left untouched unless they are mandatory.
+ */
+
+#include <stddef.h>
+#include <ohm/ohm-fact.h>
+
+#ifndef STRUCT_OFFSET
+#define STRUCT_OFFSET(s,m) ((int)offsetof(s, m))
+#endif
+
+typedef enum {
+    argtype_invalid = 0,
+    argtype_string,             /* const char *    */
+    argtype_integer,            /* int             */
+    argtype_unsigned,           /* unsigned int    */
+    argtype_long,               /* long            */
+    argtype_ulong,              /* unsigned long   */
+} argtype_t;
+
+#define ARGFLAG_MANDATORY 0x01  /* fail if the field is missing */
+
+typedef struct {		/* argument descriptor for actions */
+    argtype_t     type;
+    const char   *name;
+    int           offs;
+    int           flags;
+} argdsc_t; 
+
+typedef enum {
+    ep_args_ok = 0,
+    ep_args_nofact,             /* no fact to parse */
+    ep_args_missing,            /* mandatory field is missing */
+    ep_args_type,               /* field has an incompatible type */
+    ep_args_range,              /* numeric value does not fit */
+    ep_args_schema,             /* invalid field table */
+} ep_argerr_t;
+
+typedef struct {
+    ep_argerr_t   code;
+    const char   *field;        /* offending field, if any */
+    char          msg[128];     /* human readable description */
+} ep_error_t;
+
+int         ep_args_parse(OhmFact *, const argdsc_t *, void *, ep_error_t *);
+int         ep_args_check(const argdsc_t *, int, ep_error_t *);
+const char *ep_args_strerror(ep_argerr_t);
+
+
+#endif /* __OHM_EP_ARGS_H__ */
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,641 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_ep_args.c
+ * @brief parsing of decision facts into action arguments
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "../ep-args.c"
+
+#define NFUZZ       20000       /* random facts in the fuzz test */
+#define NPARSE      1000000     /* parses in the benchmark */
+#define GUARD       0x5a        /* filler around the parsed record */
+
+typedef struct {
+    const char    *s;
+    int            i;
+    unsigned int   u;
+    long           l;
+    unsigned long  ul;
+} record_t;
+
+typedef struct {
+    char      head[16];
+    record_t  rec;
+    char      tail[16];
+} guarded_t;
+
+typedef enum {                  /* what goes into a fact field */
+    value_missing = 0,
+    value_string,
+    value_double,
+    value_int,
+    value_uint,
+    value_long,
+    value_ulong,
+    value_int64,
+    value_uint64,
+    value_max
+} valtype_t;
+
+typedef struct {
+    valtype_t  type;
+    int        neg;
+    gint64     s;               /* value if negative */
+    guint64    u;               /* value otherwise */
+} value_t;
+
+static argdsc_t fields[] = {
+    { argtype_string  , "s" , STRUCT_OFFSET(record_t, s)  },
+    { argtype_integer , "i" , STRUCT_OFFSET(record_t, i)  },
+    { argtype_unsigned, "u" , STRUCT_OFFSET(record_t, u)  },
+    { argtype_long    , "l" , STRUCT_OFFSET(record_t, l)  },
+    { argtype_ulong   , "ul", STRUCT_OFFSET(record_t, ul) },
+    { argtype_invalid , NULL, 0                           }
+};
+
+#define NFIELD ((int)(sizeof(fields) / sizeof(fields[0])) - 1)
+
+static const char string_value[] = "foobar";
+
+
+/*
+ * helpers
+ */
+
+static void set_value(OhmFact *fact, const char *name, value_t *v)
+{
+    GValue *gv;
+
+    switch (v->type) {
+    case value_missing:
+        return;
+    case value_string:
+        gv = ohm_value_from_string(string_value);
+        break;
+    default:
+        gv = g_new0(GValue, 1);
+        break;
+    }
+
+    switch (v->type) {
+    case value_double:
+        g_value_init(gv, G_TYPE_DOUBLE);
+        break;
+    case value_int:
+        g_value_init(gv, G_TYPE_INT);
+        g_value_set_int(gv, v->neg ? (gint)v->s : (gint)v->u);
+        break;
+    case value_uint:
+        g_value_init(gv, G_TYPE_UINT);
+        g_value_set_uint(gv, (guint)v->u);
+        break;
+    case value_long:
+        g_value_init(gv, G_TYPE_LONG);
+        g_value_set_long(gv, v->neg ? (glong)v->s : (glong)v->u);
+        break;
+    case value_ulong:
+        g_value_init(gv, G_TYPE_ULONG);
+        g_value_set_ulong(gv, (gulong)v->u);
+        break;
+    case value_int64:
+        g_value_init(gv, G_TYPE_INT64);
+        g_value_set_int64(gv, v->neg ? v->s : (gint64)v->u);
+        break;
+    case value_uint64:
+        g_value_init(gv, G_TYPE_UINT64);
+        g_value_set_uint64(gv, v->u);
+        break;
+    default:
+        break;
+    }
+
+    ohm_fact_set(fact, name, gv);
+}
+
+static guint64 random64(void)
+{
+    return ((guint64)random() << 62) ^ ((guint64)random() << 31) ^ random();
+}
+
+static void random_value(value_t *v)
+{
+    static gint64 edges[] = {
+        0, 1, -1, 127, 128, 255, 256, 65535, 65536,
+        G_MININT, G_MAXINT, G_MAXUINT, (gint64)G_MAXUINT + 1,
+        G_MINLONG, G_MAXLONG, G_MAXINT64, G_MININT64,
+    };
+
+    gint64 x;
+
+    v->type = random() % value_max;
+
+    if (random() & 1)
+        x = edges[random() % (sizeof(edges) / sizeof(edges[0]))];
+    else
+        x = (gint64)random64();
+
+    /* truncate the value to what the type of the field can hold */
+    switch (v->type) {
+    case value_int:    x = (gint)x;                   break;
+    case value_uint:   x = (guint)x;                  break;
+    case value_long:   x = (glong)x;                  break;
+    case value_ulong:  x = (gint64)(gulong)x;         break;
+    default:                                          break;
+    }
+
+    v->neg = (x < 0 && v->type != value_ulong && v->type != value_uint &&
+              v->type != value_uint64);
+    v->s   = v->neg ? x : 0;
+    v->u   = v->neg ? 0 : (guint64)x;
+}
+
+/* the value that ends up in the record if the source value fits */
+static int fits(argtype_t type, value_t *v, record_t *r)
+{
+    switch (type) {
+    case argtype_integer:
+        r->i = v->neg ? (int)v->s : (int)v->u;
+        return v->neg ? (gint64)r->i == v->s : (r->i >= 0 &&
+                                                  (guint64)r->i == v->u);
+    case argtype_unsigned:
+        r->u = (unsigned int)v->u;
+        return !v->neg && (guint64)r->u == v->u;
+    case argtype_long:
+        r->l = v->neg ? (long)v->s : (long)v->u;
+        return v->neg ? (gint64)r->l == v->s : (r->l >= 0 &&
+                                                  (guint64)r->l == v->u);
+    case argtype_ulong:
+        r->ul = (unsigned long)v->u;
+        return !v->neg && (guint64)r->ul == v->u;
+    default:
+        return FALSE;
+    }
+}
+
+/* what ep_args_parse is expected to do with the field */
+static ep_argerr_t expect(argdsc_t *ad, value_t *v, record_t *r)
+{
+    if (v->type == value_missing)
+        return (ad->flags & ARGFLAG_MANDATORY) ? ep_args_missing : ep_args_ok;
+
+    if (ad->type == argtype_string) {
+        if (v->type != value_string)
+            return ep_args_type;
+        r->s = string_value;
+        return ep_args_ok;
+    }
+
+    if (v->type == value_string || v->type == value_double)
+        return ep_args_type;
+
+    return fits(ad->type, v, r) ? ep_args_ok : ep_args_range;
+}
+
+static int legacy_get_args(OhmFact *fact, argdsc_t *argdsc, void *args)
+{
+    argdsc_t *ad;
+    GValue   *gv;
+    void     *vptr;
+
+    if (fact == NULL)
+        return FALSE;
+
+    for (ad = argdsc;    ad->type != argtype_invalid;   ad++) {
+        vptr = args + ad->offs;
+
+        if ((gv = ohm_fact_get(fact, ad->name)) == NULL)
+            continue;
+
+        switch (ad->type) {
+
+        case argtype_string:
+            if (G_VALUE_TYPE(gv) == G_TYPE_STRING)
+                *(const char **)vptr = g_value_get_string(gv);
+            break;
+
+        case argtype_integer:
+            if (G_VALUE_TYPE(gv) == G_TYPE_INT)
+                *(int *)vptr = g_value_get_int(gv);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return TRUE;
+}
+
+static double elapsed_ns(struct timeval *start, int n)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return ((now.tv_sec - start->tv_sec) * 1e9 +
+            (now.tv_usec - start->tv_usec) * 1e3) / n;
+}
+
+static void setup(void)
+{
+    g_type_init();
+    srandom(1);
+}
+
+static void teardown(void)
+{
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_ep_args_basic)
+{
+    OhmFact    *fact = ohm_fact_new("com.nokia.policy.test");
+    GValue     *gv   = ohm_value_from_string("bar");
+    record_t    rec;
+    ep_error_t  err;
+    argdsc_t    table[NFIELD + 1];
+
+    ohm_fact_set(fact, "s", gv);
+    ohm_fact_set(fact, "i", ohm_value_from_int(-42));
+
+    /* strings are not copied, missing fields are not touched */
+    memset(&rec, 0, sizeof(rec));
+    rec.u = 7;
+
+    fail_unless(ep_args_parse(fact, fields, &rec, &err), "%s", err.msg);
+    fail_unless(err.code == ep_args_ok && err.msg[0] == '\0',
+                "error %d on success", err.code);
+    fail_unless(rec.s == g_value_get_string(gv), "string was copied");
+    fail_unless(rec.i == -42, "integer %d", rec.i);
+    fail_unless(rec.u == 7, "missing field overwritten");
+
+    /* mandatory fields */
+    memcpy(table, fields, sizeof(table));
+    table[2].flags = ARGFLAG_MANDATORY;
+
+    fail_if(ep_args_parse(fact, table, &rec, &err), "missing field accepted");
+    fail_unless(err.code == ep_args_missing && !strcmp(err.field, "u"),
+                "error %d for field %s", err.code, err.field);
+    fail_if(strcmp(err.msg, "com.nokia.policy.test: field 'u': missing"),
+            "message '%s'", err.msg);
+
+    /* type mismatch */
+    ohm_fact_set(fact, "s", ohm_value_from_int(1));
+    fail_if(ep_args_parse(fact, fields, &rec, &err), "integer as string");
+    fail_unless(err.code == ep_args_type, "error %d", err.code);
+
+    /* no fact, no error buffer */
+    fail_if(ep_args_parse(NULL, fields, &rec, &err), "NULL fact accepted");
+    fail_unless(err.code == ep_args_nofact, "error %d", err.code);
+    fail_if(ep_args_parse(fact, fields, &rec, NULL), "integer as string");
+
+    g_object_unref(fact);
+}
+END_TEST
+
+START_TEST (test_ep_args_range)
+{
+    static struct {
+        valtype_t    type;
+        gint64       value;
+        argtype_t    target;
+        ep_argerr_t  code;
+    } cases[] = {
+        { value_int   , -1                      , argtype_unsigned, ep_args_range },
+        { value_int   , -1                      , argtype_ulong   , ep_args_range },
+        { value_int   , G_MININT                , argtype_long    , ep_args_ok    },
+        { value_uint  , G_MAXUINT               , argtype_integer , ep_args_range },
+        { value_uint  , G_MAXUINT               , argtype_unsigned, ep_args_ok    },
+        { value_uint  , G_MAXINT                , argtype_integer , ep_args_ok    },
+        { value_int64 , (gint64)G_MAXINT + 1    , argtype_integer , ep_args_range },
+        { value_int64 , (gint64)G_MININT - 1    , argtype_integer , ep_args_range },
+        { value_int64 , (gint64)G_MAXUINT + 1   , argtype_unsigned, ep_args_range },
+        { value_uint64, -1                      , argtype_long    , ep_args_range },
+        { value_ulong , 1234                    , argtype_integer , ep_args_ok    },
+        { value_double, 0                       , argtype_integer , ep_args_type  },
+        { value_string, 0                       , argtype_long    , ep_args_type  },
+    };
+
+    OhmFact    *fact;
+    argdsc_t    table[2];
+    value_t     v;
+    record_t    rec, exp;
+    ep_error_t  err;
+    size_t      i;
+
+    memset(table, 0, sizeof(table));
+    table[0].name = "x";
+    table[0].offs = 0;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        fact = ohm_fact_new("com.nokia.policy.test");
+
+        v.type = cases[i].type;
+        v.neg  = cases[i].value < 0 && cases[i].type != value_uint64;
+        v.s    = v.neg ? cases[i].value : 0;
+        v.u    = v.neg ? 0 : (guint64)cases[i].value;
+        set_value(fact, "x", &v);
+
+        table[0].type = cases[i].target;
+        switch (cases[i].target) {
+        case argtype_integer:  table[0].offs = STRUCT_OFFSET(record_t, i);  break;
+        case argtype_unsigned: table[0].offs = STRUCT_OFFSET(record_t, u);  break;
+        case argtype_long:     table[0].offs = STRUCT_OFFSET(record_t, l);  break;
+        case argtype_ulong:    table[0].offs = STRUCT_OFFSET(record_t, ul); break;
+        default:                                                            break;
+        }
+
+        memset(&rec, 0, sizeof(rec));
+        memset(&exp, 0, sizeof(exp));
+
+        ep_args_parse(fact, table, &rec, &err);
+
+        fail_unless(err.code == cases[i].code, "case #%zu: error %d (%s)",
+                    i, err.code, err.msg);
+        fail_unless(err.code != ep_args_ok || expect(table, &v, &exp) ==
+                    ep_args_ok, "case #%zu: oracle disagrees", i);
+        fail_unless(err.code != ep_args_ok || !memcmp(&rec, &exp, sizeof(rec)),
+                    "case #%zu: wrong value", i);
+
+        g_object_unref(fact);
+    }
+}
+END_TEST
+
+START_TEST (test_ep_args_fuzz)
+{
+    OhmFact     *fact;
+    argdsc_t     table[NFIELD + 1];
+    value_t      values[NFIELD];
+    guarded_t    buf, exp;
+    ep_error_t   err;
+    ep_argerr_t  code;
+    const char  *field;
+    int          i, j, n, success, nok;
+
+    nok = 0;
+
+    for (i = 0; i < NFUZZ; i++) {
+        fact = ohm_fact_new("com.nokia.policy.fuzz");
+
+        /* a random subset of the fields in random order */
+        for (j = n = 0; j < NFIELD; j++) {
+            if (random() % 4 == 0)
+                continue;
+            table[n] = fields[j];
+            table[n].flags = (random() % 3 == 0) ? ARGFLAG_MANDATORY : 0;
+            n++;
+        }
+        for (j = n - 1; j > 0; j--) {
+            argdsc_t tmp;
+            int      k = random() % (j + 1);
+
+            tmp = table[j]; table[j] = table[k]; table[k] = tmp;
+        }
+        memset(table + n, 0, sizeof(table[n]));
+
+        for (j = 0; j < n; j++) {
+            random_value(values + j);
+            set_value(fact, table[j].name, values + j);
+        }
+
+        /* noise the parser has to ignore */
+        if (random() & 1)
+            ohm_fact_set(fact, "noise", ohm_value_from_int(random()));
+
+        memset(&buf, GUARD, sizeof(buf));
+        memset(&exp, GUARD, sizeof(exp));
+
+        for (j = 0, code = ep_args_ok, field = NULL; j < n; j++) {
+            if ((code = expect(table + j, values + j, &exp.rec)) != ep_args_ok) {
+                field = table[j].name;
+                break;
+            }
+        }
+
+        success = ep_args_parse(fact, table, &buf.rec, &err);
+
+        fail_unless(success == (code == ep_args_ok),
+                    "fuzz #%d: parse %s, expected error %d (%s)", i,
+                    success ? "succeeded" : "failed", code, err.msg);
+        fail_unless(err.code == code, "fuzz #%d: error %d, expected %d (%s)",
+                    i, err.code, code, err.msg);
+        fail_unless(field == err.field || !strcmp(field, err.field),
+                    "fuzz #%d: error in field %s, expected %s", i,
+                    err.field, field);
+        fail_unless(success || strstr(err.msg, err.field) != NULL,
+                    "fuzz #%d: message '%s' does not name the field", i,
+                    err.msg);
+
+        /* nothing outside the record may be touched */
+        fail_if(memcmp(buf.head, exp.head, sizeof(buf.head)) ||
+                memcmp(buf.tail, exp.tail, sizeof(buf.tail)),
+                "fuzz #%d: guard bytes overwritten", i);
+
+        if (success) {
+            if (exp.rec.s == string_value) {
+                fail_if(strcmp(buf.rec.s, string_value),
+                        "fuzz #%d: wrong string parsed", i);
+                exp.rec.s = buf.rec.s;
+            }
+            fail_if(memcmp(&buf, &exp, sizeof(buf)),
+                    "fuzz #%d: wrong values parsed", i);
+            nok++;
+        }
+
+        g_object_unref(fact);
+    }
+
+    printf("%d random facts: %d parsed, %d rejected\n", NFUZZ, nok,
+           NFUZZ - nok);
+
+    fail_unless(nok > NFUZZ / 100 && nok < NFUZZ - NFUZZ / 100,
+                "fuzz did not cover both outcomes");
+}
+END_TEST
+
+START_TEST (test_ep_args_schema)
+{
+    static argdsc_t bad_type[] = {
+        { (argtype_t)42   , "x" , 0                             },
+        { argtype_invalid , NULL, 0                             }
+    };
+    static argdsc_t no_name[] = {
+        { argtype_integer , NULL, STRUCT_OFFSET(record_t, i)    },
+        { argtype_invalid , NULL, 0                             }
+    };
+    static argdsc_t outside[] = {
+        { argtype_ulong   , "x" , sizeof(record_t) - 1          },
+        { argtype_invalid , NULL, 0                             }
+    };
+    static argdsc_t negative[] = {
+        { argtype_integer , "x" , -4                            },
+        { argtype_invalid , NULL, 0                             }
+    };
+    static argdsc_t misaligned[] = {
+        { argtype_string  , "x" , STRUCT_OFFSET(record_t, s) + 1 },
+        { argtype_invalid , NULL, 0                             }
+    };
+    static argdsc_t duplicate[] = {
+        { argtype_integer , "x" , STRUCT_OFFSET(record_t, i)    },
+        { argtype_unsigned, "x" , STRUCT_OFFSET(record_t, u)    },
+        { argtype_invalid , NULL, 0                             }
+    };
+    static argdsc_t overlap[] = {
+        { argtype_long    , "x" , STRUCT_OFFSET(record_t, l)    },
+        { argtype_integer , "y" , STRUCT_OFFSET(record_t, l)    },
+        { argtype_invalid , NULL, 0                             }
+    };
+    static struct {
+        argdsc_t   *table;
+        const char *what;
+    } bad[] = {
+        { bad_type  , "invalid type"      },
+        { no_name   , "unnamed field"     },
+        { outside   , "field past the end"},
+        { negative  , "negative offset"   },
+        { misaligned, "misaligned field"  },
+        { duplicate , "duplicate field"   },
+        { overlap   , "overlapping fields"},
+        { NULL      , "no table"          },
+    };
+
+    ep_error_t err;
+    size_t     i;
+
+    fail_unless(ep_args_check(fields, sizeof(record_t), &err), "%s", err.msg);
+    fail_if(ep_args_check(fields, sizeof(record_t) - 1, &err),
+            "record too small for the table accepted");
+
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        fail_if(ep_args_check(bad[i].table, sizeof(record_t), &err),
+                "%s accepted", bad[i].what);
+        fail_unless(err.code == ep_args_schema && err.msg[0] != '\0',
+                    "%s: error %d '%s'", bad[i].what, err.code, err.msg);
+    }
+}
+END_TEST
+
+START_TEST (test_ep_args_benchmark)
+{
+    typedef struct {
+        const char *group;
+        const char *partition;
+        int         pid;
+    } reparent_t;
+
+    static argdsc_t reparent_args[] = {
+        { argtype_string , "group"    , STRUCT_OFFSET(reparent_t, group)    },
+        { argtype_string , "partition", STRUCT_OFFSET(reparent_t, partition)},
+        { argtype_integer, "pid"      , STRUCT_OFFSET(reparent_t, pid),
+          ARGFLAG_MANDATORY                                                 },
+        { argtype_invalid,  NULL      , 0                                   },
+    };
+
+    OhmFact        *fact = ohm_fact_new("com.nokia.policy.cgroup_partition");
+    reparent_t      args;
+    ep_error_t      err;
+    struct timeval  start;
+    double          legacy, parse;
+    int             i;
+
+    ohm_fact_set(fact, "group"    , ohm_value_from_string("player"));
+    ohm_fact_set(fact, "partition", ohm_value_from_string("foreground"));
+    ohm_fact_set(fact, "pid"      , ohm_value_from_int(1234));
+
+    fail_unless(ep_args_check(reparent_args, sizeof(args), &err), "%s",
+                err.msg);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < NPARSE; i++) {
+        memset(&args, 0, sizeof(args));
+        legacy_get_args(fact, reparent_args, &args);
+    }
+    legacy = elapsed_ns(&start, NPARSE);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < NPARSE; i++) {
+        memset(&args, 0, sizeof(args));
+        if (!ep_args_parse(fact, reparent_args, &args, &err))
+            break;
+    }
+    parse = elapsed_ns(&start, NPARSE);
+
+    fail_unless(i == NPARSE, "parse failed: %s", err.msg);
+    fail_unless(args.pid == 1234 && !strcmp(args.partition, "foreground"),
+                "wrong arguments");
+
+    printf("%d decisions: %.1f ns/parse (unchecked get_args %.1f ns)\n",
+           NPARSE, parse, legacy);
+
+    g_object_unref(fact);
+}
+END_TEST
+
+Suite *ohm_ep_args_suite(void)
+{
+    Suite *suite = suite_create("ohm_ep_args");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_ep_args_basic);
+    tcase_add_test(tc_all, test_ep_args_range);
+    tcase_add_test(tc_all, test_ep_args_fuzz);
+    tcase_add_test(tc_all, test_ep_args_schema);
+    tcase_add_test(tc_all, test_ep_args_benchmark);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_ep_args_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -30,6 +30,18 @@ typedef union
    char *str;           
 } DBusBasicValue;
 
+/* a field:value filter selecting the facts of an operation */
+typedef struct {
+	const gchar	*field;
+	GValue		*value;
+} fact_selector_t;
+
+/* outcome of one tuple of a batch operation */
+typedef struct {
+	dbus_int32_t	status;		/* selected facts, or -errno */
+	const char	*error;
+} batch_result_t;
+
 
 static int DBG_FACTTOOL;
 static OhmFactStore *store;
@@ -125,6 +137,124 @@ static int is_handled_type(int dbus_type)
 }
 
 
+static void free_gvalue(gpointer data)
+
+{
+	GValue	*gval = (GValue *)data;
+
+	g_value_unset(gval);
+	g_free(gval);
+}
+
+/* Eat a variant holding one of the handled basic types */
+static int read_variant(DBusMessageIter * msg_it, DBusBasicValue * value, int * type)
+
+{
+	DBusMessageIter	variant_it;
+
+	if (dbus_message_iter_get_arg_type(msg_it) != DBUS_TYPE_VARIANT)
+		return FALSE;
+
+	dbus_message_iter_recurse(msg_it, &variant_it);
+	*type = dbus_message_iter_get_arg_type(&variant_it);
+	if (is_handled_type(*type) == FALSE)
+		return FALSE;
+
+	dbus_message_iter_get_basic(&variant_it, (void *)value);
+	dbus_message_iter_next(msg_it);
+
+	return TRUE;
+}
+
+static void free_selectors(fact_selector_t * selectors, int n)
+
+{
+	int	i;
+
+	for (i = 0; i < n; i++)
+		free_gvalue(selectors[i].value);
+	g_free(selectors);
+}
+
+/* Eat an a(sv) selection filter into a newly allocated array, to be freed
+ * with free_selectors. Any number of field:value pairs is accepted.
+ * Returns the number of pairs read, or -1 on invalid input.
+ */
+static int read_selectors(DBusMessageIter * msg_it, fact_selector_t ** selectors)
+
+{
+	DBusMessageIter	array_it;
+	DBusMessageIter	struct_it;
+	DBusBasicValue	dbus_value;
+	int		dbus_value_type;
+	fact_selector_t	*sel = NULL;
+	int		n = 0;
+	int		size = 0;
+
+	*selectors = NULL;
+
+	if (dbus_message_iter_get_arg_type(msg_it) != DBUS_TYPE_ARRAY)
+		return -1;
+
+	dbus_message_iter_recurse(msg_it, &array_it);
+	while (dbus_message_iter_get_arg_type(&array_it) != DBUS_TYPE_INVALID) {
+		if (dbus_message_iter_get_arg_type(&array_it) != DBUS_TYPE_STRUCT)
+			goto fail;
+
+		if (n == size) {
+			size = size ? 2 * size : 4;
+			sel = g_renew(fact_selector_t, sel, size);
+		}
+
+		dbus_message_iter_recurse(&array_it, &struct_it);
+		if (dbus_message_iter_get_arg_type(&struct_it) != DBUS_TYPE_STRING)
+			goto fail;
+		dbus_message_iter_get_basic(&struct_it, (void *)&sel[n].field);
+		dbus_message_iter_next(&struct_it);
+
+		if (!read_variant(&struct_it, &dbus_value, &dbus_value_type))
+			goto fail;
+		sel[n].value = dbus_value_to_gvalue(&dbus_value, dbus_value_type);
+		n++;
+
+		dbus_message_iter_next(&array_it);
+	}
+	dbus_message_iter_next(msg_it);
+
+	*selectors = sel;
+	return n;
+fail:
+	free_selectors(sel, n);
+	return -1;
+}
+
+/* Pick the facts matching all the selectors in a single pass over the
+ * facts of the given name, without copying the whole list first.
+ */
+static GSList * select_facts(const gchar * fact_name, fact_selector_t * selectors, int n)
+
+{
+	GSList	*fact_list_it;
+	GSList	*selected = NULL;
+	GValue	*fact_gval;
+	int	i;
+
+	for (fact_list_it = ohm_fact_store_get_facts_by_name(store, fact_name);
+	     fact_list_it != NULL;
+	     fact_list_it = g_slist_next(fact_list_it)) {
+		for (i = 0; i < n; i++) {
+			fact_gval = ohm_fact_get((OhmFact *)fact_list_it->data, selectors[i].field);
+			if (fact_gval == NULL || !gval_match(fact_gval, selectors[i].value))
+				break;
+		}
+		if (i == n)
+			selected = g_slist_prepend(selected, fact_list_it->data);
+	}
+
+	return g_slist_reverse(selected);
+}
+
+
 static int map_to_dbus_type(GValue *gval, gchar *sig, void **value)
 {
 	int retval;
@@ -216,14 +346,13 @@ static int setfact_single(DBusMessageIter * msg_it)
 	GSList		*fact_list;
 	GSList		*fact_list_it;
 	OhmFact		*fact;
+	fact_selector_t	*selectors = NULL;
+	int		nselector = 0;
 
 	/* Read name of the fact to set */
 	if (dbus_message_iter_get_arg_type(msg_it) == DBUS_TYPE_STRING) {
 		dbus_message_iter_get_basic(msg_it, (void *)&fact_name);
 		dbus_message_iter_next(msg_it);
-		fact_list = g_slist_copy(ohm_fact_store_get_facts_by_name(store, fact_name));
-		n = fact_list ? g_slist_length(fact_list) : 0;
-		OHM_DEBUG(DBG_FACTTOOL, "%s: %d facts found!", __FUNCTION__, n);
 	} else {
 		OHM_ERROR("%s:%d Invalid dbus request", __FUNCTION__, __LINE__);
 		goto end;
@@ -234,91 +363,27 @@ static int setfact_single(DBusMessageIter * msg_it)
 		dbus_message_iter_next(msg_it);
 	} else {
 		OHM_ERROR("%s:%d Invalid dbus request", __FUNCTION__, __LINE__);
-		goto free_list;
+		goto end;
 	}
 	/* Read the value to be set from a variant */
-	if (dbus_message_iter_get_arg_type(msg_it) == DBUS_TYPE_VARIANT) {
-		DBusMessageIter	variant_it;
-
-		dbus_message_iter_recurse(msg_it, &variant_it);
-		
-		dbus_value_type = dbus_message_iter_get_arg_type(&variant_it);
-		if (is_handled_type(dbus_value_type) == TRUE) {
-			dbus_message_iter_get_basic(&variant_it, (void *)&dbus_value);
-		} else {
-			OHM_ERROR("%s:%d Invalid dbus request", __FUNCTION__, __LINE__);
-			goto free_list;
-		}
-	} else {
+	if (!read_variant(msg_it, &dbus_value, &dbus_value_type)) {
 		OHM_ERROR("%s:%d Invalid dbus request", __FUNCTION__, __LINE__);
-		goto free_list;
+		goto end;
 	}
-	dbus_message_iter_next(msg_it);
 
 	/* Read optional array for fact selection: a(sv) */
 	if (dbus_message_iter_get_arg_type(msg_it) == DBUS_TYPE_ARRAY) {
-		DBusMessageIter	array_it;
-		DBusMessageIter struct_it;
-		DBusMessageIter variant_it;
-		const gchar     *select_field = NULL;
-		GValue          *select_gval;
-		GValue          *fact_gval;
-		DBusBasicValue  select_dbus_value;
-		int             select_dbus_value_type;
-		int             match;
-
-		dbus_message_iter_recurse(msg_it, &array_it);
-		while (dbus_message_iter_get_arg_type(&array_it) != DBUS_TYPE_INVALID) {
-			if (dbus_message_iter_get_arg_type(&array_it) != DBUS_TYPE_STRUCT) {
-				OHM_ERROR("%s:%d Invalid dbus request", __FUNCTION__, __LINE__);
-				goto free_list;
-			}
-			dbus_message_iter_recurse(&array_it, &struct_it);
-			if (dbus_message_iter_get_arg_type(&struct_it) == DBUS_TYPE_STRING) {
-				dbus_message_iter_get_basic(&struct_it, (void *)&select_field);
-				dbus_message_iter_next(&struct_it);
-			} else {
-				OHM_ERROR("%s:%d Invalid dbus request", __FUNCTION__, __LINE__);
-				goto free_list;
-			}
-			if (dbus_message_iter_get_arg_type(&struct_it) == DBUS_TYPE_VARIANT) {
-				dbus_message_iter_recurse(&struct_it, &variant_it);
-				select_gval = NULL;
-				select_dbus_value_type = dbus_message_iter_get_arg_type(&variant_it);
-				if (is_handled_type(select_dbus_value_type) == TRUE) {
-					dbus_message_iter_get_basic(&variant_it, (void *)&select_dbus_value);
-					select_gval = dbus_value_to_gvalue(&select_dbus_value, select_dbus_value_type);
-				}
-				if (select_gval == NULL) {
-					OHM_ERROR("%s:%d Invalid dbus request", __FUNCTION__, __LINE__);
-					goto free_list;
-				}
-			}
-			/* Filter the fact list using field:value */
-			fact_list_it = fact_list;
-			while (fact_list_it != NULL) {
-				fact = (OhmFact *)fact_list_it->data;
-				fact_gval = ohm_fact_get(fact, select_field);
-				if (fact_gval == NULL)
-					match = FALSE;
-				else
-					match = gval_match(fact_gval, select_gval);
-
-				if (match == FALSE) {
-					fact_list_it = fact_list = g_slist_remove(fact_list, fact);
-					/* n is used only for debug/info log messages */
-					n--;
-				} else {
-					fact_list_it = g_slist_next(fact_list_it);
-				}
-			}
-			g_value_unset(select_gval);
-			g_free(select_gval);
-
-			dbus_message_iter_next(&array_it);
+		if ((nselector = read_selectors(msg_it, &selectors)) < 0) {
+			OHM_ERROR("%s:%d Invalid dbus request", __FUNCTION__, __LINE__);
+			goto end;
 		}
-		dbus_message_iter_next(msg_it);
 	}
+	fact_list = select_facts(fact_name, selectors, nselector);
+	free_selectors(selectors, nselector);
+	/* n is used only for debug/info log messages */
+	n = g_slist_length(fact_list);
+	OHM_DEBUG(DBG_FACTTOOL, "%s: %d facts found!", __FUNCTION__, n);
+
 	/* Apply for all facts */
 	fact_list_it = fact_list;
 	while (fact_list_it != NULL) {
@@ -398,6 +463,290 @@ end:
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+/* Eat one (sa(sv)sv) tuple of a batch: fact name, selection filter, field
+ * name and value to set. The new value is recorded for each selected fact
+ * in the batch, nothing is applied yet. A later tuple setting the same field
+ * of the same fact overrides the earlier one.
+ * Returns the number of selected facts, or -errno with *error set.
+ */
+static int setfacts_tuple(DBusMessageIter * tuple_it, GHashTable * batch,
+	GSList ** facts, const char ** error)
+
+{
+	DBusMessageIter	struct_it;
+	const gchar 	*fact_name = NULL;
+	const gchar	*field_name = NULL;
+	DBusBasicValue	dbus_value;
+	int		dbus_value_type;
+	fact_selector_t	*selectors;
+	int		nselector;
+	GSList		*fact_list;
+	GSList		*fact_list_it;
+	GHashTable	*fields;
+	GQuark		field;
+	int		n = 0;
+
+	if (dbus_message_iter_get_arg_type(tuple_it) != DBUS_TYPE_STRUCT) {
+		*error = "not a (sa(sv)sv) tuple";
+		return -EINVAL;
+	}
+	dbus_message_iter_recurse(tuple_it, &struct_it);
+
+	if (dbus_message_iter_get_arg_type(&struct_it) != DBUS_TYPE_STRING) {
+		*error = "invalid fact name";
+		return -EINVAL;
+	}
+	dbus_message_iter_get_basic(&struct_it, (void *)&fact_name);
+	dbus_message_iter_next(&struct_it);
+
+	if ((nselector = read_selectors(&struct_it, &selectors)) < 0) {
+		*error = "invalid selection filter";
+		return -EINVAL;
+	}
+
+	if (dbus_message_iter_get_arg_type(&struct_it) != DBUS_TYPE_STRING) {
+		free_selectors(selectors, nselector);
+		*error = "invalid field name";
+		return -EINVAL;
+	}
+	dbus_message_iter_get_basic(&struct_it, (void *)&field_name);
+	dbus_message_iter_next(&struct_it);
+
+	if (!read_variant(&struct_it, &dbus_value, &dbus_value_type)) {
+		free_selectors(selectors, nselector);
+		*error = "unsupported value type";
+		return -EINVAL;
+	}
+
+	fact_list = select_facts(fact_name, selectors, nselector);
+	free_selectors(selectors, nselector);
+
+	field = g_quark_from_string(field_name);
+
+	for (fact_list_it = fact_list; fact_list_it != NULL; fact_list_it = g_slist_next(fact_list_it)) {
+		fields = g_hash_table_lookup(batch, fact_list_it->data);
+		if (fields == NULL) {
+			fields = g_hash_table_new_full(NULL, NULL, NULL, free_gvalue);
+			g_hash_table_insert(batch, fact_list_it->data, fields);
+			*facts = g_slist_prepend(*facts, fact_list_it->data);
+		}
+		g_hash_table_insert(fields, GUINT_TO_POINTER(field),
+			dbus_value_to_gvalue(&dbus_value, dbus_value_type));
+		n++;
+	}
+
+	OHM_DEBUG(DBG_FACTTOOL, "%s: %d facts %s selected for field %s", __FUNCTION__, n, fact_name, field_name);
+	g_slist_free(fact_list);
+
+	return n;
+}
+
+/* Apply the collected values fact by fact, skipping the fields which
+ * already have the requested value.
+ * Returns the number of fields changed.
+ */
+static int apply_batch(GHashTable * batch, GSList * facts)
+
+{
+	GHashTableIter	it;
+	GHashTable	*fields;
+	gpointer	key;
+	gpointer	value;
+	GValue		*fact_gval;
+	const gchar	*field_name;
+	OhmFact		*fact;
+	int		n = 0;
+
+	for (; facts != NULL; facts = g_slist_next(facts)) {
+		fact = (OhmFact *)facts->data;
+		fields = g_hash_table_lookup(batch, fact);
+
+		g_hash_table_iter_init(&it, fields);
+		while (g_hash_table_iter_next(&it, &key, &value)) {
+			field_name = g_quark_to_string(GPOINTER_TO_UINT(key));
+			fact_gval = ohm_fact_get(fact, field_name);
+			if (fact_gval != NULL && gval_match(fact_gval, (GValue *)value))
+				continue;
+
+			/* the fact takes over the value */
+			g_hash_table_iter_steal(&it);
+			ohm_fact_set(fact, field_name, (GValue *)value);
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/* Batch set of fact fields
+ *
+ * DBUS message format: a(sa(sv)sv), an array of tuples of fact name,
+ * selection filter (may be empty), field name and value to set.
+ *
+ * All tuples are checked and the facts they select are collected before
+ * anything is changed. If every tuple is valid, the changes are applied
+ * grouped per fact inside a single factstore transaction, with the last
+ * value set for a field winning and unchanged fields left alone. If any
+ * tuple is invalid, nothing is changed.
+ *
+ * Returns b a(is): whether the batch was committed, and for each tuple
+ * the number of facts it selected or a negative errno, with an error
+ * message.
+ */
+static DBusHandlerResult facttool_setfacts(DBusConnection * c, DBusMessage * msg,
+	void *user_data)
+
+{
+	DBusMessageIter	msg_it;
+	DBusMessageIter	array_it;
+	DBusMessageIter	rep_it;
+	DBusMessageIter	results_it;
+	DBusMessageIter	struct_it;
+	DBusMessage	*reply;
+	GHashTable	*batch;
+	GSList		*facts = NULL;
+	GArray		*results;
+	batch_result_t	*result;
+	batch_result_t	tuple;
+	dbus_bool_t	commit = TRUE;
+	guint		i;
+	int		n = 0;
+
+	(void)user_data;
+
+	batch = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_hash_table_destroy);
+	results = g_array_new(FALSE, FALSE, sizeof(batch_result_t));
+
+	dbus_message_iter_init(msg, &msg_it);
+	if (dbus_message_iter_get_arg_type(&msg_it) == DBUS_TYPE_ARRAY) {
+		dbus_message_iter_recurse(&msg_it, &array_it);
+		while (dbus_message_iter_get_arg_type(&array_it) != DBUS_TYPE_INVALID) {
+			tuple.error = "";
+			tuple.status = setfacts_tuple(&array_it, batch, &facts, &tuple.error);
+			if (tuple.status < 0) {
+				OHM_ERROR("%s: fact operation %u: %s", __FUNCTION__, results->len, tuple.error);
+				commit = FALSE;
+			}
+			g_array_append_val(results, tuple);
+			dbus_message_iter_next(&array_it);
+		}
+	} else {
+		OHM_ERROR("%s:%d Invalid dbus request", __FUNCTION__, __LINE__);
+		commit = FALSE;
+	}
+
+	if (commit == TRUE) {
+		facts = g_slist_reverse(facts);
+		ohm_fact_store_transaction_push(store);
+		n = apply_batch(batch, facts);
+		ohm_fact_store_transaction_pop(store, FALSE);
+		OHM_INFO("%s: Committed %u fact operations, %d fields changed in %u facts",
+			__FUNCTION__, results->len, n, g_slist_length(facts));
+	} else
+		OHM_INFO("%s: Discarding %u fact operations", __FUNCTION__, results->len);
+
+	if ((reply = dbus_message_new_method_return(msg)) == NULL) {
+		OHM_ERROR("%s: failed to allocate D-BUS reply", __FUNCTION__);
+		goto end;
+	}
+
+	dbus_message_iter_init_append(reply, &rep_it);
+	if (!dbus_message_iter_append_basic(&rep_it, DBUS_TYPE_BOOLEAN, &commit) ||
+	    !dbus_message_iter_open_container(&rep_it, DBUS_TYPE_ARRAY, "(is)", &results_it)) {
+		OHM_ERROR("%s: error opening container", __FUNCTION__);
+		goto free_reply;
+	}
+	for (i = 0; i < results->len; i++) {
+		result = &g_array_index(results, batch_result_t, i);
+		if (!dbus_message_iter_open_container(&results_it, DBUS_TYPE_STRUCT, NULL, &struct_it) ||
+		    !dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_INT32, &result->status) ||
+		    !dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &result->error)) {
+			OHM_ERROR("%s: error appending result", __FUNCTION__);
+			goto free_reply;
+		}
+		dbus_message_iter_close_container(&results_it, &struct_it);
+	}
+	dbus_message_iter_close_container(&rep_it, &results_it);
+
+	if (!dbus_connection_send(c, reply, NULL)) {
+		OHM_ERROR("%s: failed to send the reply", __FUNCTION__);
+	}
+free_reply:
+	dbus_message_unref(reply);
+end:
+	g_array_free(results, TRUE);
+	g_slist_free(facts);
+	g_hash_table_destroy(batch);
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+/* Append a fact to an aa(sv) container as an array of field name-value
+ * structs. Fields of unsupported types are left out.
+ */
+static int append_fact(DBusMessageIter * fact_it, OhmFact * fact)
+
+{
+	DBusMessageIter	fields_it;
+	GSList	*fields = NULL;
+
+	if (!dbus_message_iter_open_container(fact_it, DBUS_TYPE_ARRAY, "(sv)", &fields_it)) {
+		OHM_ERROR("%s: error opening container", __FUNCTION__);
+		return -1;
+	}
+	for (fields = ohm_fact_get_fields(fact); fields != NULL; fields = g_slist_next(fields)) {
+		DBusMessageIter	struct_it;
+		DBusMessageIter	variant_it;
+		GQuark	qfield = (GQuark)GPOINTER_TO_INT(fields->data);
+		const	gchar *field_name = g_quark_to_string(qfield);
+		gchar	sig_c = '?';
+		gchar	sig[2] = "?";
+		void	*value;
+		GValue	*gval = ohm_fact_get(fact, field_name);
+		int	dbus_type = map_to_dbus_type(gval, &sig_c, &value);
+
+		sig[0] = sig_c;
+		if (dbus_type == DBUS_TYPE_INVALID) {
+			OHM_WARNING("%s: ignoring invalid field %s", __FUNCTION__, field_name);
+			continue;
+		}
+		if (!dbus_message_iter_open_container(&fields_it, DBUS_TYPE_STRUCT, NULL, &struct_it)) {
+			OHM_ERROR("%s: error opening container", __FUNCTION__);
+			g_free(value);
+			return -1;
+		}
+		if (!dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &field_name)) {
+			OHM_ERROR("%s: error appending OhmFact field", __FUNCTION__);
+			g_free(value);
+			return -1;
+		}
+		if (!dbus_message_iter_open_container(&struct_it, DBUS_TYPE_VARIANT, sig, &variant_it)) {
+			OHM_ERROR("%s: error opening container", __FUNCTION__);
+			g_free(value);
+			return -1;
+		}
+		if (dbus_type == DBUS_TYPE_STRING) {
+			if (!dbus_message_iter_append_basic(&variant_it, dbus_type, &value)) {
+				OHM_ERROR("%s: error appending OhmFact value", __FUNCTION__);
+				g_free(value);
+				return -1;
+			}
+		} else {
+			if (!dbus_message_iter_append_basic(&variant_it, dbus_type, value)) {
+				OHM_ERROR("%s: error appending OhmFact value", __FUNCTION__);
+				g_free(value);
+				return -1;
+			}
+		}
+		g_free(value);
+		dbus_message_iter_close_container(&struct_it, &variant_it);
+		dbus_message_iter_close_container(&fields_it, &struct_it);
+	}
+
+	dbus_message_iter_close_container(fact_it, &fields_it);
+
+	return 0;
+}
+
 /* Get facts
  *
  * DBUS arguments:
@@ -416,7 +765,6 @@ static DBusHandlerResult facttool_getfact(DBusConnection * c, DBusMessage * msg,
 	const gchar 	*name = NULL;
 	DBusMessageIter	rep_it;
 	DBusMessageIter	fact_it;
-	DBusMessageIter	fields_it;
 	DBusMessage	*reply;
 	int		n;
 	GSList		*fact_list;
@@ -446,72 +794,111 @@ static DBusHandlerResult facttool_getfact(DBusConnection * c, DBusMessage * msg,
 		goto end;
 	}
 	while (fact_list != NULL) {
-		GSList	*fields = NULL;
-		OhmFact	*fact;
+		if (append_fact(&fact_it, (OhmFact *)fact_list->data) < 0)
+			goto end;
+		fact_list = g_slist_next(fact_list);
+	}
+	dbus_message_iter_close_container(&rep_it, &fact_it);
+
+	if (!dbus_connection_send(c, reply, NULL)) {
+		OHM_ERROR("%s: failed to send the reply", __FUNCTION__);
+	}
+
+end:
+	dbus_message_unref(reply);
+cancel:
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
 
-		if (!dbus_message_iter_open_container(&fact_it, DBUS_TYPE_ARRAY, "(sv)", &fields_it)) {
+/* Bulk get of facts
+ *
+ * DBUS message format: a(sa(sv)), an array of tuples of fact name and
+ * selection filter (may be empty).
+ *
+ * Returns aaa(sv): for each tuple the array of the selected facts, in the
+ * format of getfact. An invalid tuple fails the whole request.
+ */
+static DBusHandlerResult facttool_getfacts(DBusConnection * c, DBusMessage * msg,
+	void *user_data)
+
+{
+	DBusMessageIter	msg_it;
+	DBusMessageIter	array_it;
+	DBusMessageIter	struct_it;
+	DBusMessageIter	rep_it;
+	DBusMessageIter	tuples_it;
+	DBusMessageIter	fact_it;
+	DBusMessage	*reply;
+	const gchar 	*fact_name;
+	fact_selector_t	*selectors;
+	int		nselector;
+	GSList		*fact_list;
+	GSList		*fact_list_it;
+	int		status;
+
+	(void)user_data;
+
+	if ((reply = dbus_message_new_method_return(msg)) == NULL) {
+		OHM_ERROR("%s: failed to allocate D-BUS reply", __FUNCTION__);
+		goto cancel;
+	}
+	dbus_message_iter_init_append(reply, &rep_it);
+	if (!dbus_message_iter_open_container(&rep_it, DBUS_TYPE_ARRAY, "aa(sv)", &tuples_it)) {
+		OHM_ERROR("%s: error opening container", __FUNCTION__);
+		goto end;
+	}
+
+	dbus_message_iter_init(msg, &msg_it);
+	if (dbus_message_iter_get_arg_type(&msg_it) != DBUS_TYPE_ARRAY)
+		goto invalid;
+
+	dbus_message_iter_recurse(&msg_it, &array_it);
+	while (dbus_message_iter_get_arg_type(&array_it) != DBUS_TYPE_INVALID) {
+		if (dbus_message_iter_get_arg_type(&array_it) != DBUS_TYPE_STRUCT)
+			goto invalid;
+		dbus_message_iter_recurse(&array_it, &struct_it);
+		if (dbus_message_iter_get_arg_type(&struct_it) != DBUS_TYPE_STRING)
+			goto invalid;
+		dbus_message_iter_get_basic(&struct_it, (void *)&fact_name);
+		dbus_message_iter_next(&struct_it);
+		if ((nselector = read_selectors(&struct_it, &selectors)) < 0)
+			goto invalid;
+
+		fact_list = select_facts(fact_name, selectors, nselector);
+		free_selectors(selectors, nselector);
+
+		status = 0;
+		if (!dbus_message_iter_open_container(&tuples_it, DBUS_TYPE_ARRAY, "a(sv)", &fact_it)) {
 			OHM_ERROR("%s: error opening container", __FUNCTION__);
-			goto end;
-		}
-		fact = (OhmFact *)fact_list->data;
-		for (fields = ohm_fact_get_fields(fact); fields != NULL; fields = g_slist_next(fields)) {
-			DBusMessageIter	struct_it;
-			DBusMessageIter	variant_it;
-			GQuark	qfield = (GQuark)GPOINTER_TO_INT(fields->data);
-			const	gchar *field_name = g_quark_to_string(qfield);
-			gchar	sig_c = '?';
-			gchar	sig[2] = "?";
-			void	*value;
-			GValue	*gval = ohm_fact_get(fact, field_name);
-			int	dbus_type = map_to_dbus_type(gval, &sig_c, &value);
-
-			sig[0] = sig_c;
-			if (dbus_type == DBUS_TYPE_INVALID) {
-				OHM_WARNING("%s: ignoring invalid field %s", __FUNCTION__, field_name);
-				continue;
-			}
-			if (!dbus_message_iter_open_container(&fields_it, DBUS_TYPE_STRUCT, NULL, &struct_it)) {
-				OHM_ERROR("%s: error opening container", __FUNCTION__);
-				g_free(value);
-				goto end;
-			}
-			if (!dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &field_name)) {
-				OHM_ERROR("%s: error appending OhmFact field", __FUNCTION__);
-				g_free(value);
-				goto end;
-			}
-			if (!dbus_message_iter_open_container(&struct_it, DBUS_TYPE_VARIANT, sig, &variant_it)) {
-				OHM_ERROR("%s: error opening container", __FUNCTION__);
-				g_free(value);
-				goto end;
-			}
-			if (dbus_type == DBUS_TYPE_STRING) {
-				if (!dbus_message_iter_append_basic(&variant_it, dbus_type, &value)) {
-					OHM_ERROR("%s: error appending OhmFact value", __FUNCTION__);
-					g_free(value);
-					goto end;
-				}
-			} else {
-				if (!dbus_message_iter_append_basic(&variant_it, dbus_type, value)) {
-					OHM_ERROR("%s: error appending OhmFact value", __FUNCTION__);
-					g_free(value);
-					goto end;
-				}
-			}
-			g_free(value);
-			dbus_message_iter_close_container(&struct_it, &variant_it);
-			dbus_message_iter_close_container(&fields_it, &struct_it);
+			status = -1;
 		}
+		for (fact_list_it = fact_list; status == 0 && fact_list_it != NULL; fact_list_it = g_slist_next(fact_list_it))
+			status = append_fact(&fact_it, (OhmFact *)fact_list_it->data);
+		g_slist_free(fact_list);
+		if (status < 0)
+			goto end;
+		dbus_message_iter_close_container(&tuples_it, &fact_it);
 
-		dbus_message_iter_close_container(&fact_it, &fields_it);
-		fact_list = g_slist_next(fact_list);
+		dbus_message_iter_next(&array_it);
 	}
-	dbus_message_iter_close_container(&rep_it, &fact_it);
+	dbus_message_iter_close_container(&rep_it, &tuples_it);
 
 	if (!dbus_connection_send(c, reply, NULL)) {
 		OHM_ERROR("%s: failed to send the reply", __FUNCTION__);
 	}
+	goto end;
 
+invalid:
+	OHM_ERROR("%s:%d Invalid dbus request", __FUNCTION__, __LINE__);
+	dbus_message_unref(reply);
+	if ((reply = dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS,
+			"expecting a(sa(sv))")) == NULL) {
+		OHM_ERROR("%s: failed to allocate D-BUS reply", __FUNCTION__);
+		goto cancel;
+	}
+	if (!dbus_connection_send(c, reply, NULL)) {
+		OHM_ERROR("%s: failed to send the reply", __FUNCTION__);
+	}
 end:
 	dbus_message_unref(reply);
 cancel:
@@ -530,6 +917,10 @@ OHM_PLUGIN_DBUS_METHODS(
 	{NULL, DBUS_PATH_POLICY, METHOD_POLICY_FACTTOOL_SET_FACT,
 		facttool_setfact, NULL},
 	{NULL, DBUS_PATH_POLICY, METHOD_POLICY_FACTTOOL_GET_FACT,
-		facttool_getfact, NULL}
+		facttool_getfact, NULL},
+	{NULL, DBUS_PATH_POLICY, METHOD_POLICY_FACTTOOL_SET_FACTS,
+		facttool_setfacts, NULL},
+	{NULL, DBUS_PATH_POLICY, METHOD_POLICY_FACTTOOL_GET_FACTS,
+		facttool_getfacts, NULL}
 );
 
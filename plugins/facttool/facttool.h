@@ -41,6 +41,8 @@
 
 #define METHOD_POLICY_FACTTOOL_SET_FACT			"setfact"
 #define METHOD_POLICY_FACTTOOL_GET_FACT			"getfact"
+#define METHOD_POLICY_FACTTOOL_SET_FACTS		"setfacts"
+#define METHOD_POLICY_FACTTOOL_GET_FACTS		"getfacts"
 
 static void plugin_init(OhmPlugin *);
 static void plugin_exit(OhmPlugin *);
@@ -0,0 +1,572 @@
+/*************************************************************************
+ * Copyright (C) 2010 Intel Corporation.
+ *
+ * These OHM Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ * *************************************************************************/
+
+/* Batch set and bulk get of facttool against the factstore, counting the
+ * factstore updates and transactions
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+
+#include <check.h>
+#include <dbus/dbus.h>
+#include <ohm/ohm-fact.h>
+
+#define FACT_NAME	"com.nokia.policy.facttool_test"
+#define NFACT		3	/* facts of the test */
+#define NROUND		8	/* times each state is set, fits in a setfact signature */
+#define MAX_TUPLE	64
+
+static dbus_bool_t fake_connection_send(DBusConnection *, DBusMessage *,
+	dbus_uint32_t *);
+static void counted_transaction_push(OhmFactStore *);
+static void counted_transaction_pop(OhmFactStore *, gboolean);
+
+#define dbus_connection_send		fake_connection_send
+#define ohm_fact_store_transaction_push	counted_transaction_push
+#define ohm_fact_store_transaction_pop	counted_transaction_pop
+
+#include "../facttool.c"
+
+#undef ohm_fact_store_transaction_push
+#undef ohm_fact_store_transaction_pop
+
+static OhmFact		*facts[NFACT];
+static gulong		updated_id;
+static int		nupdated[NFACT];	/* factstore updates per fact */
+static int		ntransaction;
+static DBusMessage	*reply;			/* the last reply sent */
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+	va_list ap;
+
+	if (level != OHM_LOG_ERROR)
+		return;
+
+	va_start(ap, format);
+	fputs("E: ", stderr);
+	vfprintf(stderr, format, ap);
+	fputs("\n", stderr);
+	va_end(ap);
+}
+
+
+/*
+ * mock connection and counted factstore transactions
+ */
+
+static dbus_bool_t fake_connection_send(DBusConnection *c, DBusMessage *msg,
+	dbus_uint32_t *serial)
+{
+	(void)c;
+	(void)serial;
+
+	if (reply != NULL)
+		dbus_message_unref(reply);
+	reply = dbus_message_ref(msg);
+
+	return TRUE;
+}
+
+static void counted_transaction_push(OhmFactStore *fs)
+{
+	ntransaction++;
+	ohm_fact_store_transaction_push(fs);
+}
+
+static void counted_transaction_pop(OhmFactStore *fs, gboolean discard)
+{
+	ohm_fact_store_transaction_pop(fs, discard);
+}
+
+static void updated_cb(void *data, OhmFact *fact, GQuark field, gpointer value)
+{
+	GValue	*id = ohm_fact_get(fact, "id");
+
+	(void)data;
+	(void)field;
+	(void)value;
+
+	if (id != NULL)
+		nupdated[g_value_get_int(id)]++;
+}
+
+
+/*
+ * helpers
+ */
+
+static DBusMessage *new_request(const char *method, DBusMessageIter *it,
+	DBusMessageIter *tuples_it, const char *signature)
+{
+	DBusMessage	*msg;
+
+	msg = dbus_message_new_method_call("org.freedesktop.ohm", DBUS_PATH_POLICY,
+		DBUS_INTERFACE_POLICY, method);
+	dbus_message_iter_init_append(msg, it);
+	if (tuples_it != NULL)
+		dbus_message_iter_open_container(it, DBUS_TYPE_ARRAY, signature, tuples_it);
+
+	return msg;
+}
+
+static void call(DBusHandlerResult (*method)(DBusConnection *, DBusMessage *, void *),
+	DBusMessage *msg)
+{
+	dbus_message_set_serial(msg, 1);
+	method(NULL, msg, NULL);
+	dbus_message_unref(msg);
+}
+
+static void append_variant(DBusMessageIter *it, int type, const void *value)
+{
+	DBusMessageIter	variant_it;
+	char		sig[2] = { (char)type, '\0' };
+
+	dbus_message_iter_open_container(it, DBUS_TYPE_VARIANT, sig, &variant_it);
+	dbus_message_iter_append_basic(&variant_it, type, value);
+	dbus_message_iter_close_container(it, &variant_it);
+}
+
+/* a selection filter repeating the id:value pair n times */
+static void append_selectors(DBusMessageIter *it, int id, int n)
+{
+	DBusMessageIter	array_it;
+	DBusMessageIter	struct_it;
+	const char	*field = "id";
+	int		i;
+
+	dbus_message_iter_open_container(it, DBUS_TYPE_ARRAY, "(sv)", &array_it);
+	for (i = 0; id >= 0 && i < n; i++) {
+		dbus_message_iter_open_container(&array_it, DBUS_TYPE_STRUCT, NULL, &struct_it);
+		dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &field);
+		append_variant(&struct_it, DBUS_TYPE_INT32, &id);
+		dbus_message_iter_close_container(&array_it, &struct_it);
+	}
+	dbus_message_iter_close_container(it, &array_it);
+}
+
+static void append_selector(DBusMessageIter *it, int id)
+{
+	append_selectors(it, id, 1);
+}
+
+/* a (sa(sv)sv) tuple of setfacts, selecting the fact by id unless negative */
+static void append_set(DBusMessageIter *tuples_it, int id, const char *field,
+	int type, const void *value)
+{
+	DBusMessageIter	struct_it;
+	const char	*name = FACT_NAME;
+
+	dbus_message_iter_open_container(tuples_it, DBUS_TYPE_STRUCT, NULL, &struct_it);
+	dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &name);
+	append_selector(&struct_it, id);
+	dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &field);
+	append_variant(&struct_it, type, value);
+	dbus_message_iter_close_container(tuples_it, &struct_it);
+}
+
+/* the same operation as ssva(sv) of setfact */
+static void append_setfact(DBusMessageIter *it, int id, const char *field,
+	int type, const void *value)
+{
+	const char	*name = FACT_NAME;
+
+	dbus_message_iter_append_basic(it, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(it, DBUS_TYPE_STRING, &field);
+	append_variant(it, type, value);
+	append_selector(it, id);
+}
+
+/* the operations of the tests, states flipped back and forth */
+static int append_batch(DBusMessageIter *it,
+	void (*append)(DBusMessageIter *, int, const char *, int, const void *))
+{
+	const char	*on = "on", *off = "off", *mode = "test";
+	int		level = 5, unchanged = 0;
+	int		r, id, n = 0;
+
+	for (r = 0; r < NROUND; r++) {
+		for (id = 0; id < NFACT; id++, n++)
+			append(it, id, "state", DBUS_TYPE_STRING, (r & 1) ? &on : &off);
+	}
+	append(it, 0, "level", DBUS_TYPE_INT32, &level);
+	append(it, 1, "level", DBUS_TYPE_INT32, &level);
+	append(it, 2, "level", DBUS_TYPE_INT32, &unchanged);
+	append(it, -1, "mode", DBUS_TYPE_STRING, &mode);
+
+	return n + 4;
+}
+
+/* parse the b a(is) reply of setfacts */
+static int parse_results(int *status, const char **error, int *n)
+{
+	DBusMessageIter	it;
+	DBusMessageIter	array_it;
+	DBusMessageIter	struct_it;
+	dbus_bool_t	commit;
+	dbus_int32_t	s;
+
+	*n = 0;
+	dbus_message_iter_init(reply, &it);
+	dbus_message_iter_get_basic(&it, &commit);
+	dbus_message_iter_next(&it);
+	dbus_message_iter_recurse(&it, &array_it);
+
+	while (dbus_message_iter_get_arg_type(&array_it) == DBUS_TYPE_STRUCT && *n < MAX_TUPLE) {
+		dbus_message_iter_recurse(&array_it, &struct_it);
+		dbus_message_iter_get_basic(&struct_it, &s);
+		dbus_message_iter_next(&struct_it);
+		dbus_message_iter_get_basic(&struct_it, &error[*n]);
+		status[(*n)++] = s;
+		dbus_message_iter_next(&array_it);
+	}
+
+	return commit;
+}
+
+static const char *state(int id)
+{
+	return g_value_get_string(ohm_fact_get(facts[id], "state"));
+}
+
+static int level(int id)
+{
+	return g_value_get_int(ohm_fact_get(facts[id], "level"));
+}
+
+static void setup(void)
+{
+	int	i;
+
+	g_type_init();
+
+	plugin_init(NULL);
+
+	for (i = 0; i < NFACT; i++) {
+		facts[i] = ohm_fact_new(FACT_NAME);
+		ohm_fact_set(facts[i], "id", ohm_value_from_int(i));
+		ohm_fact_set(facts[i], "state", ohm_value_from_string("off"));
+		ohm_fact_set(facts[i], "level", ohm_value_from_int(0));
+		ohm_fact_store_insert(store, facts[i]);
+	}
+
+	updated_id = g_signal_connect(G_OBJECT(store), "updated",
+		G_CALLBACK(updated_cb), NULL);
+
+	memset(nupdated, 0, sizeof(nupdated));
+	ntransaction = 0;
+	reply = NULL;
+}
+
+static void teardown(void)
+{
+	int	i;
+
+	g_signal_handler_disconnect(G_OBJECT(store), updated_id);
+
+	for (i = 0; i < NFACT; i++) {
+		ohm_fact_store_remove(store, facts[i]);
+		g_object_unref(facts[i]);
+	}
+
+	if (reply != NULL)
+		dbus_message_unref(reply);
+
+	plugin_exit(NULL);
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_facttool_setfacts)
+{
+	DBusMessageIter	it;
+	DBusMessageIter	tuples_it;
+	DBusMessage	*msg;
+	const char	*error[MAX_TUPLE];
+	int		status[MAX_TUPLE];
+	int		i, n, ntuple;
+
+	msg = new_request(METHOD_POLICY_FACTTOOL_SET_FACTS, &it, &tuples_it, "(sa(sv)sv)");
+	ntuple = append_batch(&tuples_it, append_set);
+	dbus_message_iter_close_container(&it, &tuples_it);
+
+	call(facttool_setfacts, msg);
+
+	fail_unless(reply != NULL, "no reply");
+	fail_unless(parse_results(status, error, &n), "batch not committed");
+	fail_unless(n == ntuple, "%d results for %d tuples", n, ntuple);
+
+	for (i = 0; i < n - 1; i++)
+		fail_unless(status[i] == 1 && !strcmp(error[i], ""),
+			"tuple %d: status %d (%s)", i, status[i], error[i]);
+	fail_unless(status[n - 1] == NFACT, "unselected tuple matched %d facts",
+		status[n - 1]);
+
+	for (i = 0; i < NFACT; i++)
+		fail_unless(!strcmp(state(i), "on"), "fact %d is %s", i, state(i));
+	fail_unless(level(0) == 5 && level(1) == 5 && level(2) == 0, "wrong levels");
+
+	/* one update per changed field, none for the unchanged level */
+	fail_unless(nupdated[0] == 3 && nupdated[1] == 3 && nupdated[2] == 2,
+		"%d, %d and %d updates", nupdated[0], nupdated[1], nupdated[2]);
+	fail_unless(ntransaction == 1, "%d transactions", ntransaction);
+}
+END_TEST
+
+START_TEST (test_facttool_setfacts_atomic)
+{
+	DBusMessageIter	it;
+	DBusMessageIter	tuples_it;
+	DBusMessage	*msg;
+	const char	*error[MAX_TUPLE];
+	const char	*on = "on";
+	int		status[MAX_TUPLE];
+	dbus_uint32_t	u = 1;
+	dbus_bool_t	b = TRUE;
+	int		i, n;
+
+	msg = new_request(METHOD_POLICY_FACTTOOL_SET_FACTS, &it, &tuples_it, "(sa(sv)sv)");
+	append_set(&tuples_it, 0, "state", DBUS_TYPE_STRING, &on);
+	append_set(&tuples_it, 1, "state", DBUS_TYPE_STRING, &on);
+	append_set(&tuples_it, 2, "level", DBUS_TYPE_UINT32, &u);
+	append_set(&tuples_it, 2, "state", DBUS_TYPE_STRING, &on);
+	append_set(&tuples_it, -1, "mode", DBUS_TYPE_BOOLEAN, &b);
+	dbus_message_iter_close_container(&it, &tuples_it);
+
+	call(facttool_setfacts, msg);
+
+	fail_unless(reply != NULL, "no reply");
+	fail_if(parse_results(status, error, &n), "invalid batch committed");
+	fail_unless(n == 5, "%d results for 5 tuples", n);
+
+	fail_unless(status[0] == 1 && status[1] == 1 && status[3] == 1,
+		"valid tuples not checked");
+	fail_unless(status[2] == -EINVAL && strlen(error[2]) > 0,
+		"invalid value type not reported");
+	fail_unless(status[4] == -EINVAL && strlen(error[4]) > 0,
+		"invalid value type not reported");
+
+	/* nothing was touched */
+	for (i = 0; i < NFACT; i++) {
+		fail_unless(!strcmp(state(i), "off"), "fact %d changed", i);
+		fail_unless(nupdated[i] == 0, "fact %d updated", i);
+	}
+	fail_unless(ntransaction == 0, "%d transactions", ntransaction);
+}
+END_TEST
+
+START_TEST (test_facttool_setfacts_compare)
+{
+	DBusMessageIter	it;
+	DBusMessageIter	tuples_it;
+	DBusMessage	*msg;
+	int		i, n, nop, nsingle, nbatch;
+
+	/* the same operations through setfact first */
+	msg = new_request(METHOD_POLICY_FACTTOOL_SET_FACT, &it, NULL, NULL);
+	nop = append_batch(&it, append_setfact);
+	call(facttool_setfact, msg);
+
+	for (i = nsingle = 0; i < NFACT; i++)
+		nsingle += nupdated[i];
+
+	/* then back to the initial state and through setfacts */
+	for (i = 0; i < NFACT; i++) {
+		ohm_fact_set(facts[i], "state", ohm_value_from_string("off"));
+		ohm_fact_set(facts[i], "level", ohm_value_from_int(0));
+		ohm_fact_del(facts[i], "mode");
+	}
+	memset(nupdated, 0, sizeof(nupdated));
+
+	msg = new_request(METHOD_POLICY_FACTTOOL_SET_FACTS, &it, &tuples_it, "(sa(sv)sv)");
+	n = append_batch(&tuples_it, append_set);
+	dbus_message_iter_close_container(&it, &tuples_it);
+	call(facttool_setfacts, msg);
+
+	for (i = nbatch = 0; i < NFACT; i++)
+		nbatch += nupdated[i];
+
+	printf("facttool: %d operations on %d facts, %d factstore updates with "
+		"setfact, %d with setfacts\n", nop, NFACT, nsingle, nbatch);
+
+	fail_unless(n == nop, "different operations");
+	fail_unless(nsingle == NROUND * NFACT + NFACT + NFACT, "%d updates with "
+		"setfact", nsingle);
+	fail_unless(nbatch == 8, "%d updates with setfacts", nbatch);
+}
+END_TEST
+
+START_TEST (test_facttool_getfacts)
+{
+	DBusMessageIter	it;
+	DBusMessageIter	tuples_it;
+	DBusMessageIter	struct_it;
+	DBusMessageIter	facts_it;
+	DBusMessageIter	fact_it;
+	DBusMessageIter	field_it;
+	DBusMessageIter	value_it;
+	DBusMessage	*msg;
+	const char	*name = FACT_NAME, *none = "com.nokia.policy.none";
+	const char	*field, *value;
+	int		expected[3] = { 1, NFACT, 0 };
+	int		i, n, nfield;
+
+	msg = new_request(METHOD_POLICY_FACTTOOL_GET_FACTS, &it, &tuples_it, "(sa(sv))");
+	dbus_message_iter_open_container(&tuples_it, DBUS_TYPE_STRUCT, NULL, &struct_it);
+	dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &name);
+	append_selector(&struct_it, 1);
+	dbus_message_iter_close_container(&tuples_it, &struct_it);
+	dbus_message_iter_open_container(&tuples_it, DBUS_TYPE_STRUCT, NULL, &struct_it);
+	dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &name);
+	append_selector(&struct_it, -1);
+	dbus_message_iter_close_container(&tuples_it, &struct_it);
+	dbus_message_iter_open_container(&tuples_it, DBUS_TYPE_STRUCT, NULL, &struct_it);
+	dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &none);
+	append_selector(&struct_it, -1);
+	dbus_message_iter_close_container(&tuples_it, &struct_it);
+	dbus_message_iter_close_container(&it, &tuples_it);
+
+	call(facttool_getfacts, msg);
+
+	fail_unless(reply != NULL && !strcmp(dbus_message_get_signature(reply),
+		"aaa(sv)"), "wrong reply");
+
+	dbus_message_iter_init(reply, &it);
+	dbus_message_iter_recurse(&it, &tuples_it);
+
+	for (i = 0; i < 3; i++) {
+		dbus_message_iter_recurse(&tuples_it, &facts_it);
+
+		for (n = 0; dbus_message_iter_get_arg_type(&facts_it) == DBUS_TYPE_ARRAY; n++) {
+			dbus_message_iter_recurse(&facts_it, &fact_it);
+			for (nfield = 0; dbus_message_iter_get_arg_type(&fact_it) == DBUS_TYPE_STRUCT; nfield++) {
+				dbus_message_iter_recurse(&fact_it, &field_it);
+				dbus_message_iter_get_basic(&field_it, &field);
+				dbus_message_iter_next(&field_it);
+				dbus_message_iter_recurse(&field_it, &value_it);
+				if (!strcmp(field, "state")) {
+					dbus_message_iter_get_basic(&value_it, &value);
+					fail_unless(!strcmp(value, "off"), "wrong state");
+				}
+				dbus_message_iter_next(&fact_it);
+			}
+			fail_unless(nfield == 3, "%d fields in a fact", nfield);
+			dbus_message_iter_next(&facts_it);
+		}
+
+		fail_unless(n == expected[i], "tuple %d: %d facts instead of %d", i,
+			n, expected[i]);
+		dbus_message_iter_next(&tuples_it);
+	}
+
+	/* an invalid request gets an error */
+	msg = new_request(METHOD_POLICY_FACTTOOL_GET_FACTS, &it, NULL, NULL);
+	dbus_message_iter_append_basic(&it, DBUS_TYPE_STRING, &name);
+	call(facttool_getfacts, msg);
+
+	fail_unless(dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR,
+		"invalid request accepted");
+}
+END_TEST
+
+START_TEST (test_facttool_many_selectors)
+{
+	DBusMessageIter	it;
+	DBusMessageIter	tuples_it;
+	DBusMessageIter	struct_it;
+	DBusMessage	*msg;
+	const char	*name = FACT_NAME, *field = "state", *on = "on";
+	const char	*error[MAX_TUPLE];
+	int		status[MAX_TUPLE];
+	int		seven = 7, n;
+
+	/* setfact takes filters of any length, like it always did */
+	msg = new_request(METHOD_POLICY_FACTTOOL_SET_FACT, &it, NULL, NULL);
+	dbus_message_iter_append_basic(&it, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&it, DBUS_TYPE_STRING, &field);
+	append_variant(&it, DBUS_TYPE_STRING, &on);
+	append_selectors(&it, 1, 40);
+	call(facttool_setfact, msg);
+
+	fail_unless(!strcmp(state(1), "on"), "fact 1 is %s", state(1));
+	fail_unless(!strcmp(state(0), "off") && !strcmp(state(2), "off"),
+		"unselected facts changed");
+
+	/* and so do setfacts tuples */
+	msg = new_request(METHOD_POLICY_FACTTOOL_SET_FACTS, &it, &tuples_it, "(sa(sv)sv)");
+	field = "level";
+	dbus_message_iter_open_container(&tuples_it, DBUS_TYPE_STRUCT, NULL, &struct_it);
+	dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &name);
+	append_selectors(&struct_it, 2, 40);
+	dbus_message_iter_append_basic(&struct_it, DBUS_TYPE_STRING, &field);
+	append_variant(&struct_it, DBUS_TYPE_INT32, &seven);
+	dbus_message_iter_close_container(&tuples_it, &struct_it);
+	dbus_message_iter_close_container(&it, &tuples_it);
+	call(facttool_setfacts, msg);
+
+	fail_unless(parse_results(status, error, &n) && n == 1 && status[0] == 1,
+		"tuple with 40 selectors not applied");
+	fail_unless(level(2) == 7 && level(1) == 0, "wrong levels");
+}
+END_TEST
+
+Suite *ohm_facttool_suite(void)
+{
+	Suite *suite = suite_create("ohm_facttool");
+
+	TCase *tc_all = tcase_create("All");
+	tcase_set_timeout(tc_all, 60);
+	tcase_add_checked_fixture(tc_all, setup, teardown);
+
+	tcase_add_test(tc_all, test_facttool_setfacts);
+	tcase_add_test(tc_all, test_facttool_setfacts_atomic);
+	tcase_add_test(tc_all, test_facttool_setfacts_compare);
+	tcase_add_test(tc_all, test_facttool_getfacts);
+	tcase_add_test(tc_all, test_facttool_many_selectors);
+
+	suite_add_tcase(suite, tc_all);
+
+	return suite;
+}
+
+int main (void) {
+
+	int failed = 0;
+	Suite *suite;
+
+	suite = ohm_facttool_suite();
+	SRunner *runner = srunner_create(suite);
+	srunner_run_all(runner, CK_NORMAL);
+
+	failed = srunner_ntests_failed(runner);
+	srunner_free(runner);
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -19,6 +19,7 @@ USA.
 
 
 #include "fmradio-plugin.h"
+#include "ep-args.h"
 #include "mm.h"
 
 typedef void (*ep_cb_t) (GObject *, GObject *, gboolean);
@@ -221,23 +222,9 @@ fmradio_action(fmradio_context_t *ctx, void *data)
 
 #define PREFIX    "com.nokia.policy."
 #define BACKLIGHT PREFIX"backlight"
-#define STRUCT_OFFSET(s,m) ((char *)&(((s *)0)->m) - (char *)0)
 
 typedef int (*action_t)(backlight_context_t *, void *);
 
-typedef enum {
-    argtype_invalid = 0,
-    argtype_string,
-    argtype_integer,
-    argtype_unsigned
-} argtype_t;
-
-typedef struct {		/* argument descriptor for actions */
-    argtype_t   type;
-    const char *name;
-    int         offs;
-} argdsc_t; 
-
 typedef struct {		/* action descriptor */
     const char *name;
     action_t    handler;
@@ -256,7 +243,6 @@ static actdsc_t actions[] = {
 };
 
 static int action_parser(actdsc_t *, backlight_context_t *);
-static int get_args     (OhmFact  *, argdsc_t *, void *);
 
 
 static gboolean
@@ -295,10 +281,11 @@ txparser(GObject *conn, GObject *transaction, gpointer data)
 
 static int action_parser(actdsc_t *action, backlight_context_t *ctx)
 {
-    OhmFact *fact;
-    GSList  *list;
-    char    *data;
-    int      success;
+    OhmFact    *fact;
+    GSList     *list;
+    char       *data;
+    int         success;
+    ep_error_t  err;
 
     if ((data = malloc(action->datalen)) == NULL) {
         OHM_ERROR("Can't allocate %d byte memory", action->datalen);
@@ -316,11 +303,10 @@ static int action_parser(actdsc_t *action, backlight_context_t *ctx)
 
         memset(data, 0, action->datalen);
 
-        if (get_args(fact, action->argdsc, data))
+        if (ep_args_parse(fact, action->argdsc, data, &err))
             success &= action->handler(ctx, data);
         else {
-            OHM_DEBUG(DBG_ACTION, "argument parsing error for action '%s'",
-                      action->name);
+            OHM_ERROR("fmradio: invalid action: %s", err.msg);
             success &= FALSE;
         }
     }
@@ -330,46 +316,6 @@ static int action_parser(actdsc_t *action, backlight_context_t *ctx)
     return success;
 }
 
-static int get_args(OhmFact *fact, argdsc_t *argdsc, void *args)
-{
-    argdsc_t *ad;
-    GValue   *gv;
-    void     *vptr;
-
-    if (fact == NULL)
-        return FALSE;
-
-    for (ad = argdsc;    ad->type != argtype_invalid;   ad++) {
-        vptr = args + ad->offs;
-
-        if ((gv = ohm_fact_get(fact, ad->name)) == NULL)
-            continue;
-
-        switch (ad->type) {
-
-        case argtype_string:
-            if (G_VALUE_TYPE(gv) == G_TYPE_STRING)
-                *(const char **)vptr = g_value_get_string(gv);
-            break;
-
-        case argtype_integer:
-            if (G_VALUE_TYPE(gv) == G_TYPE_INT)
-                *(int *)vptr = g_value_get_int(gv);
-            break;
-
-        case argtype_unsigned:
-            if (G_VALUE_TYPE(gv) == G_TYPE_UINT)
-                *(unsigned int *)vptr = g_value_get_uint(gv);
-            break;
-
-        default:
-            break;
-        }
-    }
-
-    return TRUE;
-}
-
 #endif
 
 
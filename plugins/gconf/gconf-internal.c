@@ -38,6 +38,271 @@ typedef struct _observer {
     int refcount;
 } observer;
 
+/* The observed keys are kept in a trie with a node per path component.
+ * GConf is asked to listen to the topmost directories that directly
+ * contain observed keys, the other directories are covered by them. */
+
+typedef struct _dir_node {
+    gchar *name;                /* path component */
+    gchar *path;                /* full path of the node */
+    struct _dir_node *parent;
+    GHashTable *children;       /* path component -> node */
+    observer *obs;              /* set if the path is an observed key */
+    int nkeys;                  /* observed keys directly in the directory */
+    int refcount;               /* observed keys in the subtree */
+    gboolean watched;           /* directory added to the GConf client */
+} dir_node;
+
+static void free_observer(observer *obs)
+{
+    g_free(obs->key);
+    g_free(obs);
+
+    return;
+}
+
+static void free_node(gpointer data)
+{
+    dir_node *node = data;
+
+    if (node->children) {
+        g_hash_table_destroy(node->children);
+    }
+    g_free(node->name);
+    g_free(node->path);
+    g_free(node);
+
+    return;
+}
+
+static dir_node * new_node(dir_node *parent, const gchar *name)
+{
+    dir_node *node = g_new0(dir_node, 1);
+
+    node->name = g_strdup(name);
+    node->parent = parent;
+
+    if (parent == NULL) {
+        node->path = g_strdup("/");
+        return node;
+    }
+
+    if (parent->parent == NULL) {
+        node->path = g_strconcat("/", name, NULL);
+    }
+    else {
+        node->path = g_strconcat(parent->path, "/", name, NULL);
+    }
+
+    if (parent->children == NULL) {
+        parent->children = g_hash_table_new_full(g_str_hash, g_str_equal,
+                NULL, free_node);
+    }
+    g_hash_table_insert(parent->children, node->name, node);
+
+    return node;
+}
+
+static dir_node * find_node(dir_node *root, const gchar *key, gboolean create)
+{
+    /* walk the key a path component at a time, creating the missing
+     * nodes if requested */
+    dir_node *node = root, *child;
+    gchar *path, *name, *end;
+
+    path = g_alloca(strlen(key) + 1);
+    strcpy(path, key);
+
+    for (name = path; node != NULL && *name != '\0'; name = end) {
+
+        if ((end = strchr(name, '/')) != NULL) {
+            *end++ = '\0';
+        }
+        else {
+            end = name + strlen(name);
+        }
+
+        if (*name == '\0') {
+            /* leading or repeated slash */
+            continue;
+        }
+
+        child = node->children ? g_hash_table_lookup(node->children, name) : NULL;
+
+        if (child == NULL && create) {
+            child = new_node(node, name);
+        }
+
+        node = child;
+    }
+
+    return node;
+}
+
+static void ref_path(dir_node *node)
+{
+    for (; node != NULL; node = node->parent) {
+        node->refcount++;
+    }
+
+    return;
+}
+
+static void unref_path(dir_node *node)
+{
+    /* prune the branches that have no observed keys left */
+    dir_node *parent;
+
+    for (; node != NULL; node = parent) {
+        parent = node->parent;
+        node->refcount--;
+        if (node->refcount == 0 && parent != NULL) {
+            g_hash_table_remove(parent->children, node->name);
+        }
+    }
+
+    return;
+}
+
+static void watch_dir(gconf_plugin *plugin, dir_node *dir)
+{
+    gconf_client_add_dir(plugin->client, dir->path, GCONF_CLIENT_PRELOAD_NONE, NULL);
+    dir->watched = TRUE;
+    OHM_DEBUG(DBG_GCONF, "Add dir '%s' to be listened", dir->path);
+
+    return;
+}
+
+static void unwatch_dir(gconf_plugin *plugin, dir_node *dir)
+{
+    gconf_client_remove_dir(plugin->client, dir->path, NULL);
+    dir->watched = FALSE;
+    OHM_DEBUG(DBG_GCONF, "Remove dir '%s' from being listened", dir->path);
+
+    return;
+}
+
+static void watch_below(gconf_plugin *plugin, dir_node *node)
+{
+    /* listen to the topmost directories with observed keys below the
+     * node */
+    GHashTableIter iter;
+    gpointer child;
+
+    if (node->children == NULL) {
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, node->children);
+
+    while (g_hash_table_iter_next(&iter, NULL, &child)) {
+        dir_node *dir = child;
+        if (dir->nkeys > 0) {
+            watch_dir(plugin, dir);
+        }
+        else {
+            watch_below(plugin, dir);
+        }
+    }
+
+    return;
+}
+
+static void unwatch_below(gconf_plugin *plugin, dir_node *node)
+{
+    /* stop listening to the directories below the node */
+    GHashTableIter iter;
+    gpointer child;
+
+    if (node->children == NULL) {
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, node->children);
+
+    while (g_hash_table_iter_next(&iter, NULL, &child)) {
+        dir_node *dir = child;
+        if (dir->watched) {
+            unwatch_dir(plugin, dir);
+        }
+        else {
+            unwatch_below(plugin, dir);
+        }
+    }
+
+    return;
+}
+
+static gboolean is_covered(dir_node *dir)
+{
+    for (dir = dir->parent; dir != NULL; dir = dir->parent) {
+        if (dir->watched) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* By first subscribing to new directories and then unsubscribing from
+ * the old ones, we hope to remove the risk of a race condition when a
+ * key is changed before the new subscriptions. The API says that there
+ * can't be overlapping directories subscribed, though, but this appears
+ * to work. */
+
+static void add_key(gconf_plugin *plugin, dir_node *dir)
+{
+    dir->nkeys++;
+
+    if (dir->nkeys > 1 || is_covered(dir)) {
+        return;
+    }
+
+    watch_dir(plugin, dir);
+    unwatch_below(plugin, dir);
+
+    return;
+}
+
+static void remove_key(gconf_plugin *plugin, dir_node *dir)
+{
+    dir->nkeys--;
+
+    if (dir->nkeys > 0 || !dir->watched) {
+        return;
+    }
+
+    watch_below(plugin, dir);
+    unwatch_dir(plugin, dir);
+
+    return;
+}
+
+static void clear_node(gconf_plugin *plugin, dir_node *node)
+{
+    GHashTableIter iter;
+    gpointer child;
+
+    if (node->children != NULL) {
+        g_hash_table_iter_init(&iter, node->children);
+        while (g_hash_table_iter_next(&iter, NULL, &child)) {
+            clear_node(plugin, child);
+        }
+    }
+
+    if (node->obs) {
+        free_observer(node->obs);
+        node->obs = NULL;
+    }
+
+    if (node->watched) {
+        gconf_client_remove_dir(plugin->client, node->path, NULL);
+        node->watched = FALSE;
+    }
+
+    return;
+}
+
 
 static gboolean update_fact(gconf_plugin *plugin, GConfEntry *entry)
 {
@@ -130,25 +395,15 @@ static gboolean update_fact(gconf_plugin *plugin, GConfEntry *entry)
 
 void notify(GConfClient *client, guint id, GConfEntry *entry, gpointer user_data)
 {
-    GSList *e = NULL;
-    const gchar *key = NULL;
-    gboolean found = FALSE;
+    dir_node *node = NULL;
     gconf_plugin *plugin = user_data;
 
     (void) client;
     (void) id;
 
-    key = gconf_entry_get_key(entry);
-
-    for (e = plugin->observers; e != NULL; e = g_slist_next(e)) {
-        observer *obs = e->data;
-        if (!strcmp(key, obs->key)) {
-            found = TRUE;
-            break;
-        }
-    }
+    node = find_node(plugin->observed, gconf_entry_get_key(entry), FALSE);
 
-    if (!found)
+    if (node == NULL || node->obs == NULL)
         return;
 
     update_fact(plugin, entry);
@@ -173,6 +428,8 @@ gconf_plugin * init_gconf(int flag_gconf)
         goto error;
     }
 
+    plugin->observed = new_node(NULL, "");
+
     return plugin;
 
 error:
@@ -189,179 +446,9 @@ error:
     return NULL;
 }
 
-static void free_observer(observer *obs)
-{
-    g_free(obs->key);
-    g_free(obs);
-
-    return;
-}
-
-static char * get_directory_from_key(const char *key)
-{
-    int len;
-    char *last = strrchr(key, '/');
-    char *dir = NULL;
-
-    if (last == NULL) {
-        goto error;
-    }
-    len = last - key;
-
-    if (len == 0) {
-        return strdup("/");
-    }
-
-    dir = malloc(len+1);
-    if (dir == NULL) {
-        goto error;
-    }
-    strncpy(dir, key, len);
-    dir[len] = '\0';
-
-    return dir;
-
-error:
-    free(dir);
-    return NULL;
-}
-
-
-static int is_child_directory(const gchar *child, const gchar *parent)
-{
-    /* return true if the directory is a child or is exactly the same
-     * directory */
-    gchar *p_iter, *c_iter;
-    int is_child = TRUE;
-
-    p_iter = (gchar *) parent;
-    c_iter = (gchar *) child;
-
-    while (is_child) {
-        if (*p_iter == '\0') {
-            /* see if the parent directory is complete */
-            if (*c_iter == '\0' || *c_iter == '/') {
-                break;
-            }
-            else {
-                /* /foo/bar vs. /foo/barbar */
-                is_child = FALSE;
-            }
-        }
-        else if (*c_iter == '\0' || *p_iter != *c_iter) {
-            is_child = FALSE;
-        }
-        p_iter++;
-        c_iter++;
-    }
-
-    return is_child;
-}
-static GSList * listened_directories(GSList *observers)
-{
-    /* get a list of directories */
-    GSList *directories = NULL, *i, *j;
-    observer *obs = NULL;
-
-    for (i = observers; i != NULL; i = g_slist_next(i)) {
-        gchar *dir;
-        obs = (observer *) i->data;
-        dir = get_directory_from_key(obs->key);
-        if (dir) {
-            directories = g_slist_prepend(directories, dir);
-        }
-    }
-
-    for (i = directories; i != NULL; i = g_slist_next(i)) {
-        int is_child = FALSE;
-        for (j = directories; j != NULL; j = g_slist_next(j)) {
-            if (j != i) {
-                is_child = is_child_directory(i->data, j->data);
-                if (is_child) {
-                    break;
-                }
-            }
-        }
-        if (is_child) {
-
-            /* filter out the directories that are the direct descendents of
-             * other directories */
-            g_free(i->data);
-            directories = g_slist_delete_link(directories, i);
-
-            /* Start from the beginning: this appears to be a limitation
-             * of g_slist */
-            i = directories;
-        }
-    }
-
-    return directories;
-}
-
-static void recalculate_directories(gconf_plugin *plugin)
-{
-
-    GSList *new_dirs = NULL, *e = NULL, *f = NULL;
-
-    new_dirs = listened_directories(plugin->observers);
-
-    /* Calculate the difference between the original listened
-     * directories and the new ones. By first subscribing to new
-     * directories and then unsubscribing from old directories, we hope
-     * to remove the risk of a race condition when a key is changed
-     * before the new subscribtions. The API says that there can't be
-     * overlapping directories subscribed, though, but this appears to
-     * work. */
-
-    /* first subscribe to new ones */
-
-    for (e = new_dirs; e != NULL; e = g_slist_next(e)) {
-        gboolean found = FALSE;
-        for (f = plugin->watched_dirs; f != NULL; f = g_slist_next(f)) {
-            if (strcmp((gchar *) f->data, (gchar *) e->data) == 0) {
-                found = TRUE;
-                break;
-            }
-        }
-        if (!found) {
-            gconf_client_add_dir(plugin->client, e->data, GCONF_CLIENT_PRELOAD_NONE, NULL);
-            OHM_DEBUG(DBG_GCONF, "Add dir '%s' to be listened", (gchar *) e->data);
-        }
-    }
-
-    /* then unsubscribe from old ones */
-
-    for (e = plugin->watched_dirs; e != NULL; e = g_slist_next(e)) {
-        gboolean found = FALSE;
-        for (f = new_dirs; f != NULL; f = g_slist_next(f)) {
-            if (strcmp((gchar *) f->data, (gchar *) e->data) == 0) {
-                found = TRUE;
-                break;
-            }
-        }
-        if (!found) {
-            gconf_client_remove_dir(plugin->client, e->data, NULL);
-            OHM_DEBUG(DBG_GCONF, "Remove dir '%s' from being listened", (gchar *) e->data);
-        }
-        g_free(e->data);
-    }
-
-    g_slist_free(plugin->watched_dirs);
-    plugin->watched_dirs = new_dirs;
-
-    return;
-}
-
 void deinit_gconf(gconf_plugin *plugin)
 {
-    GSList *e = NULL, *list;
-    
-    /* free the observers */
-
-    for (e = plugin->observers; e != NULL; e = g_slist_next(e)) {
-        observer *obs = e->data;
-        free_observer(obs);
-    }
+    GSList *list;
 
     /* free the facts */
 
@@ -377,15 +464,12 @@ void deinit_gconf(gconf_plugin *plugin)
 
     }
 
-    g_slist_free(plugin->observers);
-    plugin->observers = NULL;
+    /* free the observers and stop watching all the directories that
+     * were being watched */
 
-    /* stop watching all the directories that were being watched */
-    for (e = plugin->watched_dirs; e != NULL; e = g_slist_next(e)) {
-        gconf_client_remove_dir(plugin->client, e->data, NULL);
-        g_free(e->data);
-    }
-    g_slist_free(plugin->watched_dirs);
+    clear_node(plugin, plugin->observed);
+    free_node(plugin->observed);
+    plugin->observed = NULL;
 
     g_object_unref(plugin->client);
     g_free(plugin);
@@ -396,19 +480,23 @@ void deinit_gconf(gconf_plugin *plugin)
 
 gboolean observe(gconf_plugin *plugin, const gchar *key)
 {
-    GSList *e = NULL;
+    dir_node *node = NULL;
     observer *obs = NULL;
     GConfEntry *entry = NULL;
 
     
     /* see if we are already observing the key */
 
-    for (e = plugin->observers; e != NULL; e = g_slist_next(e)) {
-        obs = e->data;
-        if (!strcmp(key, obs->key)) {
-            obs->refcount++;
-            return TRUE;
-        }
+    node = find_node(plugin->observed, key, FALSE);
+
+    if (node == plugin->observed) {
+        /* the root directory is not a key */
+        return FALSE;
+    }
+
+    if (node != NULL && node->obs != NULL) {
+        node->obs->refcount++;
+        return TRUE;
     }
     
     /* create the initial fact */
@@ -434,11 +522,13 @@ gboolean observe(gconf_plugin *plugin, const gchar *key)
     obs->key = g_strdup(key);
     obs->refcount = 1;
 
-    plugin->observers = g_slist_prepend(plugin->observers, obs);
+    node = find_node(plugin->observed, key, TRUE);
+    node->obs = obs;
+    ref_path(node);
 
-    /* recalculate the watched directory set: this enables the key
+    /* update the watched directory set: this enables the key
      * notification */
-    recalculate_directories(plugin);
+    add_key(plugin, node->parent);
 
     obs->notify = gconf_client_notify_add(plugin->client, key, notify, plugin, NULL, NULL);
     OHM_DEBUG(DBG_GCONF, "Requested notify for key '%s (id %u)'\n", key, obs->notify);
@@ -449,53 +539,53 @@ gboolean observe(gconf_plugin *plugin, const gchar *key)
 
 gboolean unobserve(gconf_plugin *plugin, const gchar *key)
 {
-    GSList *e = NULL, *f = NULL, *list = NULL;
+    GSList *f = NULL, *list = NULL;
+    dir_node *node = NULL;
     observer *obs = NULL;
-    gboolean ret = FALSE;
 
-    /* remove observers */
+    node = find_node(plugin->observed, key, FALSE);
 
-    for (e = plugin->observers; e != NULL; e = g_slist_next(e)) {
-        obs = e->data;
-        if (!strcmp(key, obs->key)) {
-            obs->refcount--;
-            if (obs->refcount == 0) {
-                
-                /* stop listening to the key */
+    if (node == NULL || node->obs == NULL) {
+        return FALSE;
+    }
 
-                gconf_client_notify_remove(plugin->client, obs->notify);
+    obs = node->obs;
+    obs->refcount--;
 
-                /* remove the observer */
-                
-                plugin->observers = g_slist_delete_link(plugin->observers, e);
+    if (obs->refcount > 0) {
+        return TRUE;
+    }
 
-                /* remove the fact from the FS that was observed */
+    /* stop listening to the key */
 
-                list = ohm_fact_store_get_facts_by_name(plugin->fs, GCONF_FACT);
-                
-                for (f = list; f != NULL; f = g_slist_next(f)) {
-                    OhmFact *fact = (OhmFact *) f->data;
-                    GValue *gval = ohm_fact_get(fact, "key");
+    gconf_client_notify_remove(plugin->client, obs->notify);
 
-                    if (gval && !strcmp(obs->key, g_value_get_string(gval))) {
-                        ohm_fact_store_remove(plugin->fs, fact);
-                        g_object_unref(fact);
-                        break;
-                    }
-                }
+    /* remove the observer */
 
-                /* recalculate the watched directory set */
-                recalculate_directories(plugin);
+    node->obs = NULL;
 
-                free_observer(obs);
-                obs = NULL;
-            }
-            ret = TRUE;
+    /* remove the fact from the FS that was observed */
+
+    list = ohm_fact_store_get_facts_by_name(plugin->fs, GCONF_FACT);
+
+    for (f = list; f != NULL; f = g_slist_next(f)) {
+        OhmFact *fact = (OhmFact *) f->data;
+        GValue *gval = ohm_fact_get(fact, "key");
+
+        if (gval && !strcmp(obs->key, g_value_get_string(gval))) {
+            ohm_fact_store_remove(plugin->fs, fact);
+            g_object_unref(fact);
             break;
         }
     }
-    
-    return ret;
+
+    /* update the watched directory set */
+    remove_key(plugin, node->parent);
+    unref_path(node);
+
+    free_observer(obs);
+
+    return TRUE;
 }
 
 /*
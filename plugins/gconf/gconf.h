@@ -59,8 +59,7 @@ typedef gboolean (*hal_cb) (OhmFact *hal_fact, gchar *capability, gboolean added
 
 typedef struct _gconf_plugin {
     guint notify;
-    GSList *observers;
-    GSList *watched_dirs;
+    struct _dir_node *observed;     /* trie of the observed keys */
     OhmFactStore *fs;
     GConfClient *client;
 } gconf_plugin;
@@ -0,0 +1,469 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_gconf_trie.c
+ * @brief observed key trie and the watched directory set of the GConf
+ *        plugin against a mock GConf client
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include <check.h>
+
+#include "../gconf.h"
+
+#define NAPP     20             /* application directories */
+#define NSUB     10             /* subdirectories per application */
+#define NLEAF    20             /* keys per subdirectory */
+#define NKEY     (NAPP * NSUB * NLEAF + NAPP + 1)
+
+static GConfClient *fake_client_get_default(void);
+static GConfEntry *fake_client_get_entry(GConfClient *, const gchar *,
+                                         const gchar *, gboolean, GError **);
+static const char *fake_entry_get_key(const GConfEntry *);
+static GConfValue *fake_entry_get_value(const GConfEntry *);
+static void fake_entry_unref(GConfEntry *);
+static void fake_client_add_dir(GConfClient *, const gchar *,
+                                GConfClientPreloadType, GError **);
+static void fake_client_remove_dir(GConfClient *, const gchar *, GError **);
+static guint fake_client_notify_add(GConfClient *, const gchar *,
+                                    GConfClientNotifyFunc, gpointer,
+                                    GFreeFunc, GError **);
+static void fake_client_notify_remove(GConfClient *, guint);
+
+#define gconf_client_get_default    fake_client_get_default
+#define gconf_client_get_entry      fake_client_get_entry
+#define gconf_entry_get_key         fake_entry_get_key
+#define gconf_entry_get_value       fake_entry_get_value
+#define gconf_entry_unref           fake_entry_unref
+#define gconf_client_add_dir        fake_client_add_dir
+#define gconf_client_remove_dir     fake_client_remove_dir
+#define gconf_client_notify_add     fake_client_notify_add
+#define gconf_client_notify_remove  fake_client_notify_remove
+
+#include "../gconf-internal.c"
+
+static gconf_plugin *plugin;
+
+static GHashTable *watched;     /* directories added to the mock client */
+static int         nadd;        /* gconf_client_add_dir calls */
+static int         nremove;     /* gconf_client_remove_dir calls */
+static int         nnotify;     /* notifications registered */
+static int         nupdate;     /* entries read into facts */
+
+static char       *keys[NKEY];  /* every key used in the tests */
+static char       *dirs[NKEY];  /*   and their directories */
+static int         observed[NKEY];
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * mock GConf client, the entries are just their keys with the value unset
+ */
+
+static GConfClient *fake_client_get_default(void)
+{
+    return (GConfClient *) g_object_new(G_TYPE_OBJECT, NULL);
+}
+
+static GConfEntry *fake_client_get_entry(GConfClient *client, const gchar *key,
+                                         const gchar *locale,
+                                         gboolean use_default, GError **err)
+{
+    (void)client;
+    (void)locale;
+    (void)use_default;
+    (void)err;
+
+    return (GConfEntry *) g_strdup(key);
+}
+
+static const char *fake_entry_get_key(const GConfEntry *entry)
+{
+    return (const char *) entry;
+}
+
+static GConfValue *fake_entry_get_value(const GConfEntry *entry)
+{
+    (void)entry;
+
+    nupdate++;
+
+    return NULL;
+}
+
+static void fake_entry_unref(GConfEntry *entry)
+{
+    g_free(entry);
+}
+
+static void fake_client_add_dir(GConfClient *client, const gchar *dir,
+                                GConfClientPreloadType preload, GError **err)
+{
+    (void)client;
+    (void)preload;
+    (void)err;
+
+    fail_if(g_hash_table_lookup(watched, dir) != NULL,
+            "directory %s added twice", dir);
+
+    g_hash_table_insert(watched, g_strdup(dir), GINT_TO_POINTER(TRUE));
+    nadd++;
+}
+
+static void fake_client_remove_dir(GConfClient *client, const gchar *dir,
+                                   GError **err)
+{
+    (void)client;
+    (void)err;
+
+    fail_unless(g_hash_table_remove(watched, dir),
+                "directory %s removed without being added", dir);
+    nremove++;
+}
+
+static guint fake_client_notify_add(GConfClient *client, const gchar *key,
+                                    GConfClientNotifyFunc func, gpointer data,
+                                    GFreeFunc destroy, GError **err)
+{
+    (void)client;
+    (void)key;
+    (void)func;
+    (void)data;
+    (void)destroy;
+    (void)err;
+
+    return ++nnotify;
+}
+
+static void fake_client_notify_remove(GConfClient *client, guint id)
+{
+    (void)client;
+    (void)id;
+
+    nnotify--;
+}
+
+
+/*
+ * helpers
+ */
+
+static int is_below(const char *dir, const char *parent)
+{
+    int len = strlen(parent);
+
+    return !strncmp(dir, parent, len) && dir[len] == '/';
+}
+
+static void check_watched(const char *when)
+{
+    /* the topmost directories of the observed keys, the hard way */
+    GHashTable *expected;
+    GHashTableIter it;
+    gpointer dir;
+    int i, j, covered;
+
+    expected = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (i = 0; i < NKEY; i++) {
+        if (!observed[i])
+            continue;
+
+        for (j = 0, covered = FALSE; j < NKEY && !covered; j++)
+            covered = observed[j] && is_below(dirs[i], dirs[j]);
+
+        if (!covered)
+            g_hash_table_insert(expected, dirs[i], dirs[i]);
+    }
+
+    fail_unless(g_hash_table_size(watched) == g_hash_table_size(expected),
+                "%s: %u directories watched instead of %u", when,
+                g_hash_table_size(watched), g_hash_table_size(expected));
+
+    g_hash_table_iter_init(&it, expected);
+    while (g_hash_table_iter_next(&it, &dir, NULL))
+        fail_unless(g_hash_table_lookup(watched, dir) != NULL,
+                    "%s: directory %s not watched", when, (char *)dir);
+
+    g_hash_table_destroy(expected);
+}
+
+static void observe_key(int i)
+{
+    fail_unless(observe(plugin, keys[i]), "failed to observe %s", keys[i]);
+    observed[i]++;
+}
+
+static void unobserve_key(int i)
+{
+    fail_unless(unobserve(plugin, keys[i]), "failed to unobserve %s", keys[i]);
+    observed[i]--;
+}
+
+static double cpu_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void setup(void)
+{
+    int a, s, k, n;
+
+    g_type_init();
+
+    /* leaf keys first, then the application keys, then the top key */
+    for (a = n = 0; a < NAPP; a++)
+        for (s = 0; s < NSUB; s++)
+            for (k = 0; k < NLEAF; k++)
+                keys[n++] = g_strdup_printf("/apps/app%02d/sub%02d/key%02d",
+                                            a, s, k);
+    for (a = 0; a < NAPP; a++)
+        keys[n++] = g_strdup_printf("/apps/app%02d/enabled", a);
+    keys[n++] = g_strdup("/apps/enabled");
+
+    for (n = 0; n < NKEY; n++)
+        dirs[n] = g_strndup(keys[n], strrchr(keys[n], '/') - keys[n]);
+
+    memset(observed, 0, sizeof(observed));
+    nadd = nremove = nnotify = nupdate = 0;
+
+    watched = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    plugin  = init_gconf(0);
+
+    fail_unless(plugin != NULL, "failed to initialize");
+}
+
+static void teardown(void)
+{
+    int i;
+
+    deinit_gconf(plugin);
+    plugin = NULL;
+
+    fail_unless(g_hash_table_size(watched) == 0, "%u directories left "
+                "watched", g_hash_table_size(watched));
+    g_hash_table_destroy(watched);
+
+    for (i = 0; i < NKEY; i++) {
+        g_free(keys[i]);
+        g_free(dirs[i]);
+    }
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_gconf_trie_cover)
+{
+    int app = NAPP * NSUB * NLEAF, top = NKEY - 1;
+    int i;
+
+    for (i = 0; i < NAPP * NSUB * NLEAF; i++)
+        observe_key(i);
+
+    check_watched("leaf keys");
+    fail_unless(nadd == NAPP * NSUB && nremove == 0, "%d add_dir and %d "
+                "remove_dir calls", nadd, nremove);
+
+    /* an application key takes over its subdirectories */
+    observe_key(app);
+    check_watched("application key");
+    fail_unless(nadd == NAPP * NSUB + 1 && nremove == NSUB,
+                "%d add_dir and %d remove_dir calls", nadd, nremove);
+
+    /* the top key takes over everything */
+    observe_key(top);
+    check_watched("top key");
+    fail_unless(g_hash_table_size(watched) == 1, "watched set not minimal");
+
+    /* and gives it back */
+    unobserve_key(top);
+    check_watched("top key removed");
+
+    unobserve_key(app);
+    check_watched("application key removed");
+    fail_unless(g_hash_table_size(watched) == NAPP * NSUB,
+                "%u directories watched", g_hash_table_size(watched));
+}
+END_TEST
+
+START_TEST (test_gconf_trie_refcount)
+{
+    observe_key(0);
+    observe_key(0);
+
+    fail_unless(nnotify == 1, "%d notifications for one key", nnotify);
+
+    unobserve_key(0);
+    check_watched("one reference left");
+    fail_unless(nnotify == 1, "notification dropped early");
+
+    unobserve_key(0);
+    check_watched("no references left");
+    fail_unless(nnotify == 0, "notification left behind");
+
+    fail_if(unobserve(plugin, keys[0]), "unobserved a key not observed");
+    fail_if(observe(plugin, "/"), "observed the root directory");
+
+    /* the branch is pruned with the last key */
+    fail_unless(plugin->observed->refcount == 0 &&
+                g_hash_table_size(plugin->observed->children) == 0,
+                "empty branches left in the trie");
+}
+END_TEST
+
+START_TEST (test_gconf_trie_notify)
+{
+    GConfEntry *entry;
+
+    observe_key(1);
+    nupdate = 0;
+
+    entry = (GConfEntry *) keys[1];
+    notify(NULL, 0, entry, plugin);
+    fail_unless(nupdate == 1, "observed key not routed");
+
+    /* a sibling in a watched directory, and a parent directory */
+    entry = (GConfEntry *) keys[2];
+    notify(NULL, 0, entry, plugin);
+    entry = (GConfEntry *) "/apps/app00/sub00";
+    notify(NULL, 0, entry, plugin);
+    entry = (GConfEntry *) "/apps/app00/sub00/key01/below";
+    notify(NULL, 0, entry, plugin);
+
+    fail_unless(nupdate == 1, "%d unobserved keys routed", nupdate - 1);
+}
+END_TEST
+
+START_TEST (test_gconf_trie_bench)
+{
+    int    order[NKEY];
+    double start, setup_ms, teardown_ms;
+    int    i, j, tmp, calls;
+
+    /* a shuffled order with the covering keys somewhere in the middle */
+    for (i = 0; i < NKEY; i++)
+        order[i] = i;
+
+    srand(48);
+    for (i = NKEY - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    start = cpu_ms();
+    for (i = 0; i < NKEY; i++)
+        observe_key(order[i]);
+    setup_ms = cpu_ms() - start;
+
+    check_watched("all keys observed");
+    calls = nadd + nremove;
+
+    printf("gconf: %d keys observed in %.2f ms with %d add_dir and %d "
+           "remove_dir calls\n", NKEY, setup_ms, nadd, nremove);
+
+    start = cpu_ms();
+    for (i = 0; i < NKEY; i++)
+        unobserve_key(order[NKEY - 1 - i]);
+    teardown_ms = cpu_ms() - start;
+
+    printf("gconf: %d keys unobserved in %.2f ms with %d add_dir and %d "
+           "remove_dir calls\n", NKEY, teardown_ms, nadd, nremove);
+
+    check_watched("all keys unobserved");
+
+    /* every directory change is caused by a key crossing a directory */
+    fail_unless(calls <= 2 * NKEY, "%d directory calls for %d keys", calls,
+                NKEY);
+    fail_unless(nadd == nremove, "%d add_dir and %d remove_dir calls", nadd,
+                nremove);
+}
+END_TEST
+
+Suite *ohm_gconf_trie_suite(void)
+{
+    Suite *suite = suite_create("ohm_gconf_trie");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_gconf_trie_cover);
+    tcase_add_test(tc_all, test_gconf_trie_refcount);
+    tcase_add_test(tc_all, test_gconf_trie_notify);
+    tcase_add_test(tc_all, test_gconf_trie_bench);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_gconf_trie_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -39,16 +39,19 @@ static int DBG_HAL, DBG_FACTS;
 
 /* this uses libhal (for now) */
 
-typedef struct _hal_modified_property {
+/* pending change of a property, the last change of a key wins */
+#define PROPERTY_CHANGED GINT_TO_POINTER(1)
+#define PROPERTY_REMOVED GINT_TO_POINTER(2)
+
+typedef struct _hal_modified_device {
     char *udi;
-    char *key;
-    dbus_bool_t is_removed;
-    dbus_bool_t is_added;
-} hal_modified_property;
+    GHashTable *keys;           /* key -> PROPERTY_CHANGED/REMOVED */
+} hal_modified_device;
 
 typedef struct _decorator {
     gchar *capability;
     GSList *devices;
+    GHashTable *facts;          /* udi -> last fact passed to cb */
     hal_cb cb;
     void *user_data;
 } decorator;
@@ -190,14 +193,89 @@ static gboolean has_udi(decorator *dec, const gchar *udi)
     return FALSE;
 }
 
+static GValue * property_value(hal_plugin *plugin, const char *udi,
+        const char *key, LibHalPropertyType type,
+        LibHalPropertySetIterator *iter, DBusError *error)
+{
+    /* Convert a HAL property to an OhmFact value. The property is read
+     * from the property set iterator if there is one and fetched from HAL
+     * otherwise. NULL if the fetch failed or the type is not supported. */
+
+    GValue *val = NULL;
+
+    switch (type) {
+        case LIBHAL_PROPERTY_TYPE_INT32:
+            {
+                dbus_int32_t hal_value = iter ? libhal_psi_get_int(iter) :
+                    libhal_device_get_property_int(plugin->hal_ctx, udi, key,
+                            error);
+                if (!dbus_error_is_set(error)) {
+                    val = ohm_value_from_int(hal_value);
+                    OHM_DEBUG(DBG_HAL, "int: '%i'", hal_value);
+                }
+                break;
+            }
+        case LIBHAL_PROPERTY_TYPE_STRING:
+            {
+                /* freed with the property set if read from one */
+                char *hal_value = iter ? libhal_psi_get_string(iter) :
+                    libhal_device_get_property_string(plugin->hal_ctx, udi,
+                            key, error);
+                if (hal_value) {
+                    val = ohm_value_from_string(hal_value);
+                    OHM_DEBUG(DBG_HAL, "string: '%s'", hal_value);
+                    if (!iter)
+                        libhal_free_string(hal_value);
+                }
+                break;
+            }
+        case LIBHAL_PROPERTY_TYPE_STRLIST:
+            {
+#define STRING_DELIMITER "\\"
+                /* freed with the property set if read from one */
+                char **strlist = iter ? libhal_psi_get_strlist(iter) :
+                    libhal_device_get_property_strlist(plugin->hal_ctx, udi,
+                            key, error);
+                if (strlist) {
+                    gchar *escaped_string = g_strjoinv(STRING_DELIMITER, strlist);
+                    val = ohm_value_from_string(escaped_string);
+                    OHM_DEBUG(DBG_HAL, "escaped string: '%s'", escaped_string);
+                    g_free(escaped_string);
+                    if (!iter)
+                        libhal_free_string_array(strlist);
+                }
+                break;
+#undef STRING_DELIMITER
+            }
+        case LIBHAL_PROPERTY_TYPE_BOOLEAN:
+            {
+                dbus_bool_t hal_value = iter ? libhal_psi_get_bool(iter) :
+                    libhal_device_get_property_bool(plugin->hal_ctx, udi, key,
+                            error);
+                if (!dbus_error_is_set(error)) {
+                    val = ohm_value_from_int((hal_value == TRUE) ? 1 : 0);
+                    OHM_DEBUG(DBG_HAL, "boolean: '%s'",
+                              (hal_value == TRUE) ? "TRUE" : "FALSE");
+                }
+                break;
+            }
+        default:
+            OHM_DEBUG(DBG_HAL, "error with value (%i)", type);
+            /* error case, currently means that FactStore doesn't
+             * support the type yet */
+            break;
+    }
+
+    return val;
+}
+
 static OhmFact * create_fact(hal_plugin *plugin, const char *udi,
         const char *capability, LibHalPropertySet *properties)
 {
     /* Create an OhmFact based on the properties of a HAL object */
 
-    (void) plugin;
-
     LibHalPropertySetIterator iter;
+    DBusError error;
     OhmFact *fact = NULL;
     int i, len;
     GValue *val = NULL;
@@ -218,61 +296,18 @@ static OhmFact * create_fact(hal_plugin *plugin, const char *udi,
         return fact;
 
     libhal_psi_init(&iter, properties);
+    dbus_error_init(&error);
     
-    /* TODO error handling */
-
     len = libhal_property_set_get_num_elems(properties);
 
     for (i = 0; i < len; i++, libhal_psi_next(&iter)) {
         char *key = libhal_psi_get_key(&iter);
         LibHalPropertyType type = libhal_psi_get_type(&iter);
-        val = NULL;
 
         OHM_DEBUG(DBG_HAL, "key: '%s', ", key);
-        /* Not good to duplicate the switch, consider strategy pattern. Still,
-         * it is a good idea to fetch the properties only once. */
-        switch (type) {
-            case LIBHAL_PROPERTY_TYPE_INT32:
-                {
-                    dbus_int32_t hal_value = libhal_psi_get_int(&iter);
-                    val = ohm_value_from_int(hal_value);
-                    OHM_DEBUG(DBG_HAL, "int: '%i'", hal_value);
-                    break;
-                }
-            case LIBHAL_PROPERTY_TYPE_STRING:
-                {
-                    /* freed with propertyset */
-                    char *hal_value = libhal_psi_get_string(&iter);
-                    val = ohm_value_from_string(hal_value);
-                    OHM_DEBUG(DBG_HAL, "string: '%s'", hal_value);
-                    break;
-                }
-            case LIBHAL_PROPERTY_TYPE_STRLIST:
-                {
-#define STRING_DELIMITER "\\"
-                    /* freed with propertyset */
-                    char **strlist = libhal_psi_get_strlist(&iter);
-                    gchar *escaped_string = g_strjoinv(STRING_DELIMITER, strlist);
-                    val = ohm_value_from_string(escaped_string);
-                    OHM_DEBUG(DBG_HAL, "escaped string: '%s'", escaped_string);
-                    g_free(escaped_string);
-                    break;
-#undef STRING_DELIMITER
-                }
-            case LIBHAL_PROPERTY_TYPE_BOOLEAN:
-                {
-                    dbus_bool_t hal_value = libhal_psi_get_bool(&iter);
-                    int intval = (hal_value == TRUE) ? 1 : 0;
-                    val = ohm_value_from_int(intval);
-                    OHM_DEBUG(DBG_HAL, "boolean: '%s'", (hal_value == TRUE) ? "TRUE" : "FALSE");
-                    break;
-                }
-            default:
-                OHM_DEBUG(DBG_HAL, "error with value (%i)", type);
-                /* error case, currently means that FactStore doesn't
-                 * support the type yet */
-                break;
-        }
+
+        /* the properties were fetched only once, with the whole set */
+        val = property_value(plugin, udi, key, type, &iter, &error);
 
         if (val) {
             ohm_fact_set(fact, key, val);
@@ -311,6 +346,14 @@ static gboolean process_decoration(hal_plugin *plugin, decorator *dec,
         }
 
         fact = create_fact(plugin, udi, dec->capability, properties);
+
+        /* keep the fact for applying later property changes to it */
+        if (removed || fact == NULL)
+            g_hash_table_remove(dec->facts, udi);
+        else
+            g_hash_table_replace(dec->facts, g_strdup(udi),
+                    g_object_ref(fact));
+
         dec->cb(fact, dec->capability, added, removed, dec->user_data);
         if (fact)
             g_object_unref(fact);
@@ -398,6 +441,8 @@ static void hal_capability_lost_cb (LibHalContext *ctx,
                     OHM_DEBUG(DBG_FACTS, "Device was not found from the decorator list!\n");
                 }
                 process_decoration(plugin, dec, FALSE, TRUE, udi);
+                if (!has_udi(dec, udi))
+                    g_hash_table_remove(dec->facts, udi);
             }
         }
     }
@@ -488,6 +533,8 @@ static void hal_device_removed_cb (LibHalContext *ctx, const char *udi)
             else {
                 OHM_DEBUG(DBG_FACTS, "Device was not found from the decorator list!\n");
             }
+            if (!has_udi(dec, udi))
+                g_hash_table_remove(dec->facts, udi);
         }
     }
 
@@ -497,26 +544,156 @@ static void hal_device_removed_cb (LibHalContext *ctx, const char *udi)
     return;
 }
 
+static GValue * get_property_value(hal_plugin *plugin, const char *udi,
+        const char *key)
+{
+    /* Fetch a single property of a HAL object as an OhmFact value */
+
+    DBusError error;
+    LibHalPropertyType type;
+    GValue *val = NULL;
+
+    dbus_error_init(&error);
+
+    type = libhal_device_get_property_type(plugin->hal_ctx, udi, key, &error);
+
+    if (!dbus_error_is_set(&error))
+        val = property_value(plugin, udi, key, type, NULL, &error);
+
+    if (dbus_error_is_set(&error)) {
+        OHM_DEBUG(DBG_HAL, "Error getting property '%s' of %s. '%s': '%s'",
+                  key, udi, error.name, error.message);
+        dbus_error_free(&error);
+    }
+
+    return val;
+}
+
+static void free_value(gpointer data)
+{
+    GValue *val = data;
+
+    if (val) {
+        g_value_unset(val);
+        g_free(val);
+    }
+}
+
+static void process_modified_device(hal_plugin *plugin,
+        hal_modified_device *device)
+{
+    /* Apply the changed properties of a device to the facts of the
+     * decorators interested in it. Each property is fetched only once,
+     * however many decorators there are. */
+
+    GHashTable *values = NULL;
+    GHashTableIter iter;
+    gpointer key, change;
+    GSList *e = NULL;
+
+    values = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_value);
+
+    g_hash_table_iter_init(&iter, device->keys);
+    while (g_hash_table_iter_next(&iter, &key, &change)) {
+        GValue *val;
+
+        if (change != PROPERTY_CHANGED)
+            continue;
+
+        /* a property we failed to fetch keeps its old value */
+        if ((val = get_property_value(plugin, device->udi, key)) != NULL)
+            g_hash_table_insert(values, key, val);
+    }
+
+    for (e = plugin->decorators; e != NULL; e = g_slist_next(e)) {
+        decorator *dec = e->data;
+        OhmFact *fact = NULL;
+
+        if (!has_udi(dec, device->udi))
+            continue;
+
+        if ((fact = g_hash_table_lookup(dec->facts, device->udi)) == NULL) {
+            /* no earlier fact to update, rebuild it */
+            process_decoration(plugin, dec, FALSE, FALSE, device->udi);
+            continue;
+        }
+
+        g_hash_table_iter_init(&iter, device->keys);
+        while (g_hash_table_iter_next(&iter, &key, &change)) {
+            GValue *val = g_hash_table_lookup(values, key);
+
+            if (change == PROPERTY_REMOVED) {
+                OHM_DEBUG(DBG_HAL, "%s: remove '%s'", device->udi,
+                          (char *)key);
+                ohm_fact_del(fact, key);
+            }
+            else if (val) {
+                /* the fact takes the ownership of the value */
+                GValue *copy = g_new0(GValue, 1);
+
+                OHM_DEBUG(DBG_HAL, "%s: update '%s'", device->udi,
+                          (char *)key);
+
+                g_value_init(copy, G_VALUE_TYPE(val));
+                g_value_copy(val, copy);
+                ohm_fact_set(fact, key, copy);
+            }
+        }
+
+        g_object_ref(fact);
+        dec->cb(fact, dec->capability, FALSE, FALSE, dec->user_data);
+        g_object_unref(fact);
+    }
+
+    g_hash_table_destroy(values);
+}
+
+static void free_modified_device(gpointer data)
+{
+    hal_modified_device *device = data;
+
+    g_hash_table_destroy(device->keys);
+    g_free(device->udi);
+    g_free(device);
+}
+
+static void drop_modified_properties(hal_plugin *plugin)
+{
+    if (plugin->modified_id) {
+        g_source_remove(plugin->modified_id);
+        plugin->modified_id = 0;
+    }
+
+    g_slist_free(plugin->modified_udis);
+    plugin->modified_udis = NULL;
+
+    if (plugin->modified) {
+        g_hash_table_destroy(plugin->modified);
+        plugin->modified = NULL;
+    }
+}
+
 static gboolean process_modified_properties(gpointer data)
 {
     hal_plugin *plugin = (hal_plugin *) data;
+    GHashTable *modified = plugin->modified;
+    GSList *udis = g_slist_reverse(plugin->modified_udis);
     GSList *e = NULL;
 
     OHM_DEBUG(DBG_FACTS, "> process_modified_properties\n");
 
-    for (e = plugin->modified_properties; e != NULL; e = g_slist_next(e)) {
-
-        hal_modified_property *modified_property = e->data;
-        process_udi(plugin, FALSE, FALSE, modified_property->udi);
+    /* changes arriving while we process these go to a new batch */
+    plugin->modified = NULL;
+    plugin->modified_udis = NULL;
+    plugin->modified_id = 0;
 
-        g_free(modified_property->udi);
-        g_free(modified_property->key);
-        g_free(modified_property);
-        e->data = NULL;
+    for (e = udis; e != NULL; e = g_slist_next(e)) {
+        hal_modified_device *device = g_hash_table_lookup(modified, e->data);
+        process_modified_device(plugin, device);
     }
 
-    g_slist_free(plugin->modified_properties);
-    plugin->modified_properties = NULL;
+    g_slist_free(udis);
+    g_hash_table_destroy(modified);
 
     /* do not call again */
     return FALSE;
@@ -531,9 +708,10 @@ static void hal_property_modified_cb (LibHalContext *ctx,
 
     /* This function is called several times when a signal that contains
      * information of multiple HAL property modifications arrives.
-     * Schedule a delayed processing of data in the idle loop. */
+     * Collect the changed keys per device and process them in the idle
+     * loop. */
 
-    hal_modified_property *modified_property = NULL;
+    hal_modified_device *device = NULL;
     hal_plugin *plugin = (hal_plugin *) libhal_ctx_get_user_data(ctx);
 
     OHM_DEBUG(DBG_FACTS,"> hal_property_modified_cb: udi '%s', key '%s', %s, %s\n",
@@ -541,20 +719,25 @@ static void hal_property_modified_cb (LibHalContext *ctx,
               is_removed ? "removed" : "not removed",
               is_added ? "added" : "not added");
 
-    if (!plugin->modified_properties) {
-        g_idle_add(process_modified_properties, plugin);
+    if (!plugin->modified) {
+        plugin->modified = g_hash_table_new_full(g_str_hash, g_str_equal,
+                NULL, free_modified_device);
+        plugin->modified_id = g_idle_add(process_modified_properties, plugin);
     }
 
-    modified_property = g_new0(hal_modified_property, 1);
-    
-    modified_property->udi = g_strdup(udi);
-    modified_property->key = g_strdup(key);
-    modified_property->is_removed = is_removed;
-    modified_property->is_added = is_added;
+    if ((device = g_hash_table_lookup(plugin->modified, udi)) == NULL) {
+        device = g_new0(hal_modified_device, 1);
+        device->udi = g_strdup(udi);
+        device->keys = g_hash_table_new_full(g_str_hash, g_str_equal,
+                g_free, NULL);
 
-    /* keep the order (even if O(n)) :-P */
-    plugin->modified_properties = g_slist_append(plugin->modified_properties,
-            modified_property);
+        g_hash_table_insert(plugin->modified, device->udi, device);
+        plugin->modified_udis = g_slist_prepend(plugin->modified_udis,
+                device->udi);
+    }
+
+    g_hash_table_replace(device->keys, g_strdup(key),
+            is_removed ? PROPERTY_REMOVED : PROPERTY_CHANGED);
 
     return;
 }
@@ -604,6 +787,9 @@ gboolean decorate(hal_plugin *plugin, const gchar *capability, hal_cb cb, void *
     if ((dec = g_new0(decorator, 1)) == NULL)
         goto error;
 
+    dec->facts = g_hash_table_new_full(g_str_hash, g_str_equal,
+            g_free, g_object_unref);
+
     /* printf("allocated decorator '%p'\n", dec); */
     dec->cb = cb;
     dec->user_data = user_data;
@@ -631,6 +817,7 @@ static void free_decorator(decorator *dec) {
         g_free(f->data);
     }
     g_slist_free(dec->devices);
+    g_hash_table_destroy(dec->facts);
     g_free(dec);
 
 }
@@ -717,6 +904,8 @@ error:
 
 static void delete_hal_context(hal_plugin *plugin)
 {
+    drop_modified_properties(plugin);
+
     if (plugin->hal_ctx) {
 
         remove_all_watches(plugin);
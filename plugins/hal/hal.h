@@ -55,7 +55,9 @@ typedef gboolean (*hal_cb) (OhmFact *hal_fact, gchar *capability, gboolean added
 typedef struct _hal_plugin {
     LibHalContext *hal_ctx;
     DBusConnection *c;
-    GSList *modified_properties;
+    GHashTable *modified;       /* udi -> pending property changes */
+    GSList *modified_udis;      /* udis in the order of their first change */
+    guint modified_id;          /* idle source for processing the changes */
     GSList *decorators;
     GSList *watched;
     /* GSList *all_devices; */
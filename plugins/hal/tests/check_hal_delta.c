@@ -0,0 +1,665 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_hal_delta.c
+ * @brief HAL property change processing against a fake HAL
+ */
+
+#include <check.h>
+#include <hal/libhal.h>
+#include <ohm/ohm-fact.h>
+
+/* count the fact mutations of hal-internal.c */
+static void test_fact_set(OhmFact *fact, const char *key, GValue *value);
+static void test_fact_del(OhmFact *fact, const char *key);
+
+#define ohm_fact_set test_fact_set
+#define ohm_fact_del test_fact_del
+#include "../hal-internal.c"
+#undef ohm_fact_set
+#undef ohm_fact_del
+
+#define CAPABILITY "button"
+#define NDEVICE    4
+#define NPROPERTY  8
+
+typedef struct {
+    const char         *key;
+    LibHalPropertyType  type;
+    int                 integer;
+    char                string[32];
+} fake_property_t;
+
+typedef struct {
+    char             udi[64];
+    fake_property_t  props[NPROPERTY];
+} fake_device_t;
+
+struct LibHalContext_s {
+    void *user_data;
+};
+
+struct LibHalPropertySet_s {
+    fake_device_t *dev;
+};
+
+static struct LibHalContext_s fake_ctx;
+static fake_device_t devices[NDEVICE];
+
+static int nfetch_all;          /* libhal_device_get_all_properties calls */
+static int nfetch;              /* single property fetches */
+static int nset;                /* fact fields set */
+static int ndel;                /* fact fields deleted */
+static int ncb;                 /* observer callbacks */
+static OhmFact *last_fact[NDEVICE];
+static const char *broken;      /* property HAL fails to return */
+
+static hal_plugin *plugin;
+static int user_data;
+
+
+static void test_fact_set(OhmFact *fact, const char *key, GValue *value)
+{
+    nset++;
+    ohm_fact_set(fact, key, value);
+}
+
+static void test_fact_del(OhmFact *fact, const char *key)
+{
+    ndel++;
+    ohm_fact_del(fact, key);
+}
+
+
+/*
+ * fake HAL
+ */
+
+static fake_device_t *find_device(const char *udi)
+{
+    int i;
+
+    for (i = 0; i < NDEVICE; i++)
+        if (!strcmp(devices[i].udi, udi))
+            return devices + i;
+
+    return NULL;
+}
+
+static fake_property_t *find_property(const char *udi, const char *key)
+{
+    fake_device_t *dev = find_device(udi);
+    int            i;
+
+    for (i = 0; dev != NULL && i < NPROPERTY; i++)
+        if (dev->props[i].key && !strcmp(dev->props[i].key, key))
+            return dev->props + i;
+
+    return NULL;
+}
+
+static void set_property(int d, const char *key, LibHalPropertyType type,
+                         int integer, const char *string)
+{
+    fake_property_t *prop = find_property(devices[d].udi, key);
+    int              i;
+
+    for (i = 0; prop == NULL && i < NPROPERTY; i++)
+        if (devices[d].props[i].key == NULL)
+            prop = devices[d].props + i;
+
+    prop->key     = key;
+    prop->type    = type;
+    prop->integer = integer;
+    strncpy(prop->string, string ? string : "", sizeof(prop->string) - 1);
+}
+
+static void del_property(int d, const char *key)
+{
+    fake_property_t *prop = find_property(devices[d].udi, key);
+
+    if (prop != NULL)
+        memset(prop, 0, sizeof(*prop));
+}
+
+LibHalContext *libhal_ctx_new(void) { return &fake_ctx; }
+dbus_bool_t libhal_ctx_free(LibHalContext *ctx) { (void)ctx; return TRUE; }
+
+dbus_bool_t libhal_ctx_init(LibHalContext *ctx, DBusError *error)
+{
+    (void)ctx;
+    (void)error;
+    return TRUE;
+}
+
+dbus_bool_t libhal_ctx_shutdown(LibHalContext *ctx, DBusError *error)
+{
+    (void)ctx;
+    (void)error;
+    return TRUE;
+}
+
+dbus_bool_t libhal_ctx_set_dbus_connection(LibHalContext *ctx,
+                                           DBusConnection *conn)
+{
+    (void)ctx;
+    (void)conn;
+    return TRUE;
+}
+
+dbus_bool_t libhal_ctx_set_user_data(LibHalContext *ctx, void *data)
+{
+    ctx->user_data = data;
+    return TRUE;
+}
+
+void *libhal_ctx_get_user_data(LibHalContext *ctx)
+{
+    return ctx->user_data;
+}
+
+#define SETTER(name, type)                                              \
+    dbus_bool_t name(LibHalContext *ctx, type callback)                 \
+    {                                                                   \
+        (void)ctx;                                                      \
+        (void)callback;                                                 \
+        return TRUE;                                                    \
+    }
+
+SETTER(libhal_ctx_set_device_added           , LibHalDeviceAdded)
+SETTER(libhal_ctx_set_device_removed         , LibHalDeviceRemoved)
+SETTER(libhal_ctx_set_device_new_capability  , LibHalDeviceNewCapability)
+SETTER(libhal_ctx_set_device_lost_capability , LibHalDeviceLostCapability)
+SETTER(libhal_ctx_set_device_property_modified,
+       LibHalDevicePropertyModified)
+
+#undef SETTER
+
+dbus_bool_t libhal_device_add_property_watch(LibHalContext *ctx,
+                                             const char *udi,
+                                             DBusError *error)
+{
+    (void)ctx;
+    (void)udi;
+    (void)error;
+    return TRUE;
+}
+
+dbus_bool_t libhal_device_remove_property_watch(LibHalContext *ctx,
+                                                const char *udi,
+                                                DBusError *error)
+{
+    (void)ctx;
+    (void)udi;
+    (void)error;
+    return TRUE;
+}
+
+dbus_bool_t libhal_device_query_capability(LibHalContext *ctx,
+                                           const char *udi,
+                                           const char *capability,
+                                           DBusError *error)
+{
+    (void)ctx;
+    (void)error;
+    return find_device(udi) != NULL && !strcmp(capability, CAPABILITY);
+}
+
+char **libhal_find_device_by_capability(LibHalContext *ctx,
+                                        const char *capability,
+                                        int *num_devices,
+                                        DBusError *error)
+{
+    char **udis;
+    int    i;
+
+    (void)ctx;
+    (void)error;
+
+    *num_devices = strcmp(capability, CAPABILITY) ? 0 : NDEVICE;
+    udis = calloc(*num_devices + 1, sizeof(char *));
+
+    for (i = 0; i < *num_devices; i++)
+        udis[i] = strdup(devices[i].udi);
+
+    return udis;
+}
+
+void libhal_free_string_array(char **str_array)
+{
+    char **s;
+
+    for (s = str_array; s && *s; s++)
+        free(*s);
+
+    free(str_array);
+}
+
+void libhal_free_string(char *str)
+{
+    free(str);
+}
+
+LibHalPropertySet *libhal_device_get_all_properties(LibHalContext *ctx,
+                                                    const char *udi,
+                                                    DBusError *error)
+{
+    LibHalPropertySet *set = malloc(sizeof(*set));
+
+    (void)ctx;
+    (void)error;
+
+    nfetch_all++;
+    set->dev = find_device(udi);
+
+    return set;
+}
+
+void libhal_free_property_set(LibHalPropertySet *set)
+{
+    free(set);
+}
+
+unsigned int libhal_property_set_get_num_elems(LibHalPropertySet *set)
+{
+    return NPROPERTY;
+}
+
+void libhal_psi_init(LibHalPropertySetIterator *iter, LibHalPropertySet *set)
+{
+    iter->set = set;
+    iter->idx = 0;
+}
+
+void libhal_psi_next(LibHalPropertySetIterator *iter)
+{
+    iter->idx++;
+}
+
+static fake_property_t *psi_property(LibHalPropertySetIterator *iter)
+{
+    return iter->set->dev->props + iter->idx;
+}
+
+LibHalPropertyType libhal_psi_get_type(LibHalPropertySetIterator *iter)
+{
+    fake_property_t *prop = psi_property(iter);
+
+    return prop->key ? prop->type : LIBHAL_PROPERTY_TYPE_INVALID;
+}
+
+char *libhal_psi_get_key(LibHalPropertySetIterator *iter)
+{
+    return (char *)(psi_property(iter)->key ? psi_property(iter)->key : "");
+}
+
+dbus_int32_t libhal_psi_get_int(LibHalPropertySetIterator *iter)
+{
+    return psi_property(iter)->integer;
+}
+
+char *libhal_psi_get_string(LibHalPropertySetIterator *iter)
+{
+    return psi_property(iter)->string;
+}
+
+dbus_bool_t libhal_psi_get_bool(LibHalPropertySetIterator *iter)
+{
+    return psi_property(iter)->integer ? TRUE : FALSE;
+}
+
+char **libhal_psi_get_strlist(LibHalPropertySetIterator *iter)
+{
+    (void)iter;
+    return NULL;
+}
+
+LibHalPropertyType libhal_device_get_property_type(LibHalContext *ctx,
+                                                   const char *udi,
+                                                   const char *key,
+                                                   DBusError *error)
+{
+    fake_property_t *prop = find_property(udi, key);
+
+    (void)ctx;
+
+    nfetch++;
+
+    if (broken != NULL && !strcmp(key, broken)) {
+        dbus_set_error_const(error, "org.freedesktop.DBus.Error.NoReply",
+                             key);
+        return LIBHAL_PROPERTY_TYPE_INVALID;
+    }
+
+    if (prop == NULL) {
+        dbus_set_error_const(error, "org.freedesktop.Hal.NoSuchProperty",
+                             key);
+        return LIBHAL_PROPERTY_TYPE_INVALID;
+    }
+
+    return prop->type;
+}
+
+dbus_int32_t libhal_device_get_property_int(LibHalContext *ctx,
+                                            const char *udi,
+                                            const char *key,
+                                            DBusError *error)
+{
+    (void)ctx;
+    (void)error;
+    return find_property(udi, key)->integer;
+}
+
+char *libhal_device_get_property_string(LibHalContext *ctx,
+                                        const char *udi,
+                                        const char *key,
+                                        DBusError *error)
+{
+    (void)ctx;
+    (void)error;
+    return strdup(find_property(udi, key)->string);
+}
+
+dbus_bool_t libhal_device_get_property_bool(LibHalContext *ctx,
+                                            const char *udi,
+                                            const char *key,
+                                            DBusError *error)
+{
+    (void)ctx;
+    (void)error;
+    return find_property(udi, key)->integer ? TRUE : FALSE;
+}
+
+char **libhal_device_get_property_strlist(LibHalContext *ctx,
+                                          const char *udi,
+                                          const char *key,
+                                          DBusError *error)
+{
+    (void)ctx;
+    (void)udi;
+    (void)key;
+    (void)error;
+    return NULL;
+}
+
+
+/*
+ * helpers
+ */
+
+static gboolean observer(OhmFact *fact, gchar *capability, gboolean added,
+                         gboolean removed, void *cb_user_data)
+{
+    GValue *gudi = ohm_fact_get(fact, "udi");
+    int     i;
+
+    fail_unless(cb_user_data == &user_data, "User data doesn't match");
+    fail_if(strcmp(capability, CAPABILITY), "Wrong capability");
+    fail_if(added || removed, "unexpected added/removed flags");
+
+    ncb++;
+
+    for (i = 0; i < NDEVICE; i++) {
+        if (!strcmp(devices[i].udi, g_value_get_string(gudi))) {
+            if (last_fact[i] != NULL)
+                g_object_unref(last_fact[i]);
+            last_fact[i] = g_object_ref(fact);
+        }
+    }
+
+    return TRUE;
+}
+
+static void modified(int d, const char *key, int removed, int added)
+{
+    hal_property_modified_cb(&fake_ctx, devices[d].udi, key, removed, added);
+}
+
+static void run_mainloop(void)
+{
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+}
+
+/* check that the fact has the same fields as a freshly built one */
+static void check_fact(int d)
+{
+    LibHalPropertySet  set = { devices + d };
+    OhmFact           *full;
+    GSList            *fields, *f;
+    GValue            *v1, *v2;
+    const char        *key;
+
+    full = create_fact(plugin, devices[d].udi, CAPABILITY, &set);
+
+    fail_unless(last_fact[d] != NULL, "no fact for device %d", d);
+
+    fields = ohm_fact_get_fields(full);
+    fail_unless(g_slist_length(fields) ==
+                g_slist_length(ohm_fact_get_fields(last_fact[d])),
+                "device %d: number of fields differ", d);
+
+    for (f = fields; f != NULL; f = g_slist_next(f)) {
+        key = g_quark_to_string((GQuark)GPOINTER_TO_INT(f->data));
+        v1  = ohm_fact_get(full, key);
+        v2  = ohm_fact_get(last_fact[d], key);
+
+        fail_unless(v2 != NULL, "device %d: field '%s' missing", d, key);
+        fail_unless(G_VALUE_TYPE(v1) == G_VALUE_TYPE(v2),
+                    "device %d: type of field '%s' differs", d, key);
+
+        if (G_VALUE_TYPE(v1) == G_TYPE_STRING)
+            fail_if(strcmp(g_value_get_string(v1), g_value_get_string(v2)),
+                    "device %d: field '%s' differs", d, key);
+        else
+            fail_unless(g_value_get_int(v1) == g_value_get_int(v2),
+                        "device %d: field '%s' differs", d, key);
+    }
+
+    g_object_unref(full);
+}
+
+static void setup(void)
+{
+    int i;
+
+    g_type_init();
+
+    memset(devices, 0, sizeof(devices));
+
+    for (i = 0; i < NDEVICE; i++) {
+        snprintf(devices[i].udi, sizeof(devices[i].udi),
+                 "/org/freedesktop/Hal/devices/button_%d", i);
+        set_property(i, "info.capabilities", LIBHAL_PROPERTY_TYPE_STRING, 0,
+                     CAPABILITY);
+        set_property(i, "button.state.value", LIBHAL_PROPERTY_TYPE_BOOLEAN,
+                     0, NULL);
+        set_property(i, "button.type", LIBHAL_PROPERTY_TYPE_STRING, 0,
+                     "proximity");
+        set_property(i, "info.old", LIBHAL_PROPERTY_TYPE_INT32, 1, NULL);
+    }
+
+    plugin = init_hal(NULL, 0, 0);
+    fail_if(plugin == NULL, "Plugin not initialized correctly");
+
+    fail_unless(decorate(plugin, CAPABILITY, observer, &user_data),
+                "Decoration failed");
+
+    /* forget the facts reported by the decoration itself */
+    for (i = 0; i < NDEVICE; i++) {
+        if (last_fact[i] != NULL) {
+            g_object_unref(last_fact[i]);
+            last_fact[i] = NULL;
+        }
+    }
+
+    nfetch_all = nfetch = nset = ndel = ncb = 0;
+    broken = NULL;
+}
+
+static void teardown(void)
+{
+    int i;
+
+    deinit_hal(plugin);
+
+    for (i = 0; i < NDEVICE; i++) {
+        if (last_fact[i] != NULL) {
+            g_object_unref(last_fact[i]);
+            last_fact[i] = NULL;
+        }
+    }
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_hal_delta_burst)
+{
+    int i;
+
+    /* a burst of button presses on device 0 */
+    for (i = 0; i < 100; i++) {
+        set_property(0, "button.state.value", LIBHAL_PROPERTY_TYPE_BOOLEAN,
+                     i & 1, NULL);
+        modified(0, "button.state.value", FALSE, FALSE);
+    }
+
+    /* a property added to device 1 and one removed from it */
+    set_property(1, "button.extra", LIBHAL_PROPERTY_TYPE_INT32, 42, NULL);
+    modified(1, "button.extra", FALSE, TRUE);
+    del_property(1, "info.old");
+    modified(1, "info.old", TRUE, FALSE);
+
+    /* a property of device 2 changes back and forth */
+    for (i = 0; i < 10; i++) {
+        set_property(2, "button.type", LIBHAL_PROPERTY_TYPE_STRING, 0,
+                     (i & 1) ? "proximity" : "lid");
+        modified(2, "button.type", FALSE, FALSE);
+    }
+
+    fail_unless(ncb == 0 && nfetch == 0, "changes processed synchronously");
+
+    run_mainloop();
+
+    printf("%d property changes: %d full fetches, %d property fetches, "
+           "%d fields set, %d fields deleted, %d callbacks\n",
+           100 + 2 + 10, nfetch_all, nfetch, nset, ndel, ncb);
+
+    fail_unless(nfetch_all == 0, "%d devices refetched", nfetch_all);
+    fail_unless(nfetch == 3, "%d properties fetched instead of 3", nfetch);
+    fail_unless(nset == 3, "%d fields set instead of 3", nset);
+    fail_unless(ndel == 1, "%d fields deleted instead of 1", ndel);
+    fail_unless(ncb == 3, "%d callbacks instead of 3", ncb);
+    fail_unless(last_fact[3] == NULL, "unchanged device reported");
+
+    for (i = 0; i < 3; i++)
+        check_fact(i);
+}
+END_TEST
+
+START_TEST (test_hal_delta_fetch_failed)
+{
+    GValue *val;
+
+    /* the fetch of a changed property fails, another one is removed */
+    broken = "button.type";
+    set_property(0, "button.type", LIBHAL_PROPERTY_TYPE_STRING, 0, "lid");
+    modified(0, "button.type", FALSE, FALSE);
+    set_property(0, "button.state.value", LIBHAL_PROPERTY_TYPE_BOOLEAN, 1,
+                 NULL);
+    modified(0, "button.state.value", FALSE, FALSE);
+    del_property(0, "info.old");
+    modified(0, "info.old", TRUE, FALSE);
+
+    run_mainloop();
+
+    fail_unless(nfetch == 2, "%d properties fetched instead of 2", nfetch);
+    fail_unless(nset == 1, "%d fields set instead of 1", nset);
+    fail_unless(ndel == 1, "%d fields deleted instead of 1", ndel);
+    fail_unless(ncb == 1, "%d callbacks instead of 1", ncb);
+
+    /* the property we could not fetch keeps its old value */
+    val = ohm_fact_get(last_fact[0], "button.type");
+    fail_unless(val != NULL, "unfetched property removed from the fact");
+    fail_if(strcmp(g_value_get_string(val), "proximity"),
+            "unfetched property changed to '%s'", g_value_get_string(val));
+    fail_unless(ohm_fact_get(last_fact[0], "info.old") == NULL,
+                "removed property left in the fact");
+    fail_unless(g_value_get_int(ohm_fact_get(last_fact[0],
+                                             "button.state.value")) == 1,
+                "fetched property not updated");
+}
+END_TEST
+
+START_TEST (test_hal_delta_pending_dropped)
+{
+    modified(0, "button.state.value", FALSE, FALSE);
+
+    /* pending changes must not be processed after the context is gone */
+    deinit_hal(plugin);
+    plugin = init_hal(NULL, 0, 0);
+
+    run_mainloop();
+
+    fail_unless(ncb == 0 && nfetch == 0, "stale change processed");
+}
+END_TEST
+
+Suite *ohm_hal_delta_suite(void)
+{
+    Suite *suite = suite_create("ohm_hal_delta");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_hal_delta_burst);
+    tcase_add_test(tc_all, test_hal_delta_fetch_failed);
+    tcase_add_test(tc_all, test_hal_delta_pending_dropped);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_hal_delta_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
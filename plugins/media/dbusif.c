@@ -45,20 +45,39 @@ typedef struct {
 typedef enum {
     unknown_bus = 0,
     system_bus,
-    session_bus
+    session_bus,
+    bus_max
 } bus_type_t;
 
+typedef enum {
+    signal_other = -1,          /* never coalesced */
+    signal_privacy,
+    signal_bluetooth,
+    signal_mute,
+    signal_max
+} signal_kind_t;
+
 typedef struct msg_queue_s {
     struct msg_queue_s *next;
     bus_type_t          bus;
-    DBusMessage        *msg;
+    signal_kind_t       kind;
+    DBusMessage        *msg;    /* NULL if superseded by an immediate send */
 } msg_queue_t;
 
+typedef struct {
+    msg_queue_t        *head;
+    msg_queue_t       **tail;   /* where to hook the next entry */
+    msg_queue_t        *latest[bus_max][signal_max]; /* pending, by kind */
+} msg_fifo_t;
+
 
 static DBusConnection    *sys_conn;      /* connection for D-Bus system bus */
 static DBusConnection    *sess_conn;     /* connection for D-Bus session bus */
 static int                timeout;       /* message timeout in msec */
-static msg_queue_t       *msg_que;       /* queued messages */
+static msg_fifo_t         msg_que = {    /* queued messages */
+    .head = NULL,
+    .tail = &msg_que.head
+};
 
 static void system_bus_init(void);
 static void session_bus_init(const char *);
@@ -73,8 +92,10 @@ static DBusMessage *bluetooth_get_message(DBusMessage *);
 static DBusMessage *mute_req_message( DBusMessage *);
 static DBusMessage *mute_get_message(DBusMessage *);
 
-static void send_message(bus_type_t, DBusMessage *, int);
-static void queue_message(bus_type_t, DBusMessage *);
+static void send_message(bus_type_t, signal_kind_t, DBusMessage *, int);
+static void deliver_message(bus_type_t, DBusMessage *);
+static void queue_message(bus_type_t, signal_kind_t, DBusMessage *);
+static void queue_cancel(bus_type_t, signal_kind_t);
 static void queue_flush(void);
 static void queue_purge(bus_type_t);
 
@@ -187,7 +208,7 @@ void dbusif_signal_privacy_override(int value, int send_now)
                                            DBUS_TYPE_INVALID);
 
         if (success)
-            send_message(session_bus, msg, send_now);
+            send_message(session_bus, signal_privacy, msg, send_now);
         else
             OHM_ERROR("media [%s]: failed to build message", __FUNCTION__);
     }
@@ -213,7 +234,7 @@ void dbusif_signal_bluetooth_override(int value, int send_now)
                                             DBUS_TYPE_INVALID);
 
         if (success)
-            send_message(session_bus, msg, send_now);
+            send_message(session_bus, signal_bluetooth, msg, send_now);
         else
             OHM_ERROR("media [%s]: failed to build message", __FUNCTION__);
     }
@@ -239,7 +260,7 @@ void dbusif_signal_mute(int value, int send_now)
                                            DBUS_TYPE_INVALID);
 
         if (success)
-            send_message(session_bus, msg, send_now);
+            send_message(session_bus, signal_mute, msg, send_now);
         else
             OHM_ERROR("media [%s]: failed to build message", __FUNCTION__);
     }
@@ -437,7 +458,7 @@ static void session_bus_cleanup(void)
         dbus_connection_unregister_object_path(sess_conn,
                                                DBUS_MEDIA_MANAGER_PATH);
         
-        queue_purge(DBUS_BUS_SESSION);
+        queue_purge(session_bus);
         
         dbus_connection_unref(sess_conn);
         sess_conn = NULL;
@@ -722,45 +743,83 @@ static DBusMessage *mute_get_message(DBusMessage *msg)
     return reply;    
 }
 
-static void send_message(bus_type_t bus, DBusMessage *msg, int send_now)
+static void send_message(bus_type_t bus, signal_kind_t kind,
+                         DBusMessage *msg, int send_now)
 {
-    DBusConnection *conn;
-
     if (!send_now)
-        queue_message(bus, msg);
+        queue_message(bus, kind, msg);
     else {
-        switch (bus) {
-        case system_bus:   conn = sys_conn;    break;
-        case session_bus:  conn = sess_conn;   break;
-        default:           conn = NULL;        break;
-        }
+        queue_cancel(bus, kind);
+        deliver_message(bus, msg);
+    }
+}
 
-        if (conn == NULL)
-            OHM_ERROR("media: invalid bus for message sending");
-        else {
-            if (!dbus_connection_send(conn, msg, NULL))
-                OHM_ERROR("media: failed to send D-Bus message");
-            
-            dbus_message_unref(msg);
-        }
+static void deliver_message(bus_type_t bus, DBusMessage *msg)
+{
+    DBusConnection *conn;
+
+    switch (bus) {
+    case system_bus:   conn = sys_conn;    break;
+    case session_bus:  conn = sess_conn;   break;
+    default:           conn = NULL;        break;
+    }
+
+    if (conn == NULL)
+        OHM_ERROR("media: invalid bus for message sending");
+    else {
+        if (!dbus_connection_send(conn, msg, NULL))
+            OHM_ERROR("media: failed to send D-Bus message");
     }
+
+    dbus_message_unref(msg);
 }
 
-static void queue_message(bus_type_t bus, DBusMessage *msg)
+static void queue_message(bus_type_t bus, signal_kind_t kind, DBusMessage *msg)
 {
-    msg_queue_t *entry, *last;
+    msg_queue_t *entry;
 
-    for (last = (msg_queue_t *)&msg_que;  last->next;   last = last->next)
-        ;
+    /*
+     * A signal of a kind that is already queued replaces the pending
+     * one in its place. Only the latest value gets emitted at flush.
+     */
+    if (kind != signal_other && (entry = msg_que.latest[bus][kind]) != NULL) {
+        OHM_DEBUG(DBG_DBUS, "coalescing queued %s signal",
+                  dbus_message_get_member(msg));
 
-    if ((entry = malloc(sizeof(msg_queue_t))) == NULL)
+        dbus_message_unref(entry->msg);
+        entry->msg = msg;
+
+        return;
+    }
+
+    if ((entry = malloc(sizeof(msg_queue_t))) == NULL) {
         OHM_ERROR("media: can't get memory to queue D-Bus message");
+        dbus_message_unref(msg);
+    }
     else {
         memset(entry, 0, sizeof(msg_queue_t));
-        entry->bus = bus;
-        entry->msg = msg;
+        entry->bus  = bus;
+        entry->kind = kind;
+        entry->msg  = msg;
 
-        last->next = entry;
+        *msg_que.tail = entry;
+        msg_que.tail  = &entry->next;
+
+        if (kind != signal_other)
+            msg_que.latest[bus][kind] = entry;
+    }
+}
+
+static void queue_cancel(bus_type_t bus, signal_kind_t kind)
+{
+    msg_queue_t *entry;
+
+    /* an immediately sent signal supersedes the queued one of its kind */
+    if (kind != signal_other && (entry = msg_que.latest[bus][kind]) != NULL) {
+        dbus_message_unref(entry->msg);
+        entry->msg = NULL;
+
+        msg_que.latest[bus][kind] = NULL;
     }
 }
 
@@ -768,39 +827,41 @@ static void queue_flush(void)
 {
     msg_queue_t *entry, *next;
 
-    for (entry = msg_que;   entry;   entry = next) {
+    entry = msg_que.head;
+
+    msg_que.head = NULL;
+    msg_que.tail = &msg_que.head;
+    memset(msg_que.latest, 0, sizeof(msg_que.latest));
+
+    for ( ;   entry;   entry = next) {
         next = entry->next;
 
-        send_message(entry->bus, entry->msg, DBUSIF_SEND_NOW);
+        if (entry->msg != NULL)
+            deliver_message(entry->bus, entry->msg);
 
         free(entry);
     } /* for */
-
-    msg_que = NULL;
 }
 
 static void queue_purge(bus_type_t bus)
 {
-    msg_queue_t *entry = msg_que, *prev = NULL, *next;
+    msg_queue_t **prev, *entry;
 
-    while (entry) {
-        next = entry->next;
-
-        if (entry->bus == bus) {
-            if (entry == msg_que)
-                msg_que = next;
+    for (prev = &msg_que.head;   (entry = *prev) != NULL;   ) {
+        if (entry->bus != bus)
+            prev = &entry->next;
+        else {
+            *prev = entry->next;
 
-            if (prev)
-                prev->next = next;
+            if (entry->msg != NULL)
+                dbus_message_unref(entry->msg);
 
-            dbus_message_unref(entry->msg);
             free(entry);
-        } else {
-            prev = entry;
         }
-
-        entry = next;
     }
+
+    msg_que.tail = prev;
+    memset(msg_que.latest[bus], 0, sizeof(msg_que.latest[bus]));
 }
 
 /* 
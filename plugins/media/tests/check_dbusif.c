@@ -0,0 +1,386 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_dbusif.c
+ * @brief outbound signal queue of the media D-Bus interface against
+ *        mock connections
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <check.h>
+#include <dbus/dbus.h>
+
+#define NBURST   100            /* overrides in one decision */
+#define NLOG     (4 * NBURST)   /* sent messages recorded */
+
+static dbus_bool_t fake_connection_send(DBusConnection *, DBusMessage *,
+                                        dbus_uint32_t *);
+
+#define dbus_connection_send  fake_connection_send
+
+#include "../dbusif.c"
+
+int DBG_PRIVACY, DBG_MUTE, DBG_BT, DBG_AUDIO, DBG_DBUS, DBG_FS, DBG_DRES;
+
+static int fake_system, fake_session;   /* the mock connections */
+
+static struct {
+    DBusConnection *conn;
+    char            member[64];
+    int             value;
+} sent[NLOG];                   /* signals in the order they were sent */
+static int          nsent;
+static int          nreply;     /* method replies */
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * mock connections
+ */
+
+static dbus_bool_t fake_connection_send(DBusConnection *conn, DBusMessage *msg,
+                                        dbus_uint32_t *serial)
+{
+    DBusMessageIter it;
+    dbus_bool_t     b;
+    dbus_int32_t    i;
+
+    (void)serial;
+
+    fail_unless(conn == (DBusConnection *)&fake_system ||
+                conn == (DBusConnection *)&fake_session,
+                "message sent on unknown connection");
+
+    if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL) {
+        nreply++;
+        return TRUE;
+    }
+
+    fail_unless(nsent < NLOG, "too many signals sent");
+
+    sent[nsent].conn = conn;
+    strncpy(sent[nsent].member, dbus_message_get_member(msg),
+            sizeof(sent[nsent].member) - 1);
+
+    dbus_message_iter_init(msg, &it);
+
+    if (dbus_message_iter_get_arg_type(&it) == DBUS_TYPE_BOOLEAN) {
+        dbus_message_iter_get_basic(&it, &b);
+        sent[nsent].value = b;
+    }
+    else {
+        dbus_message_iter_get_basic(&it, &i);
+        sent[nsent].value = i;
+    }
+
+    nsent++;
+
+    return TRUE;
+}
+
+
+/*
+ * mock policy requests, each decision flips the state back and forth
+ * before settling
+ */
+
+static int burst(void (*signal)(int, int), int value)
+{
+    int i;
+
+    for (i = 0;  i < NBURST - 1;  i++)
+        signal(i & 1, DBUSIF_QUEUE);
+
+    signal(value, DBUSIF_QUEUE);
+
+    return TRUE;
+}
+
+int privacy_request(int value)
+{
+    return burst(dbusif_signal_privacy_override, value);
+}
+
+int bluetooth_request(int value)
+{
+    /* the mute state follows the bluetooth override in this decision */
+    burst(dbusif_signal_mute, !value);
+
+    return burst(dbusif_signal_bluetooth_override, value);
+}
+
+int mute_request(int value)
+{
+    return burst(dbusif_signal_mute, value);
+}
+
+int privacy_query(void)   { return TRUE; }
+int bluetooth_query(void) { return TRUE; }
+int mute_query(void)      { return TRUE; }
+
+void resctl_init(void)    { }
+void resctl_exit(void)    { }
+void resctl_acquire(void) { }
+void resctl_release(void) { }
+
+
+/*
+ * helpers
+ */
+
+static int count(const char *member)
+{
+    int i, n;
+
+    for (i = n = 0;  i < nsent;  i++)
+        if (!strcmp(sent[i].member, member))
+            n++;
+
+    return n;
+}
+
+static int last_value(const char *member)
+{
+    int i;
+
+    for (i = nsent - 1;  i >= 0;  i--)
+        if (!strcmp(sent[i].member, member))
+            return sent[i].value;
+
+    return -1;
+}
+
+static void request(const char *member, int value)
+{
+    DBusMessage *msg;
+    dbus_bool_t  arg = value;
+
+    msg = dbus_message_new_method_call(DBUS_MEDIA_SERVICE,
+                                       DBUS_MEDIA_MANAGER_PATH,
+                                       DBUS_MEDIA_MANAGER_INTERFACE,
+                                       member);
+    dbus_message_append_args(msg, DBUS_TYPE_BOOLEAN, &arg, DBUS_TYPE_INVALID);
+    dbus_message_set_serial(msg, 1);
+
+    method(sess_conn, msg, NULL);
+
+    dbus_message_unref(msg);
+}
+
+static int queue_length(void)
+{
+    msg_queue_t *entry;
+    int          n;
+
+    for (n = 0, entry = msg_que.head;  entry;  entry = entry->next)
+        n++;
+
+    return n;
+}
+
+static void setup(void)
+{
+    sys_conn  = (DBusConnection *)&fake_system;
+    sess_conn = (DBusConnection *)&fake_session;
+
+    nsent = nreply = 0;
+    memset(sent, 0, sizeof(sent));
+}
+
+static void teardown(void)
+{
+    queue_purge(system_bus);
+    queue_purge(session_bus);
+
+    sys_conn = sess_conn = NULL;
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_dbusif_coalesce_burst)
+{
+    request(DBUS_MEDIA_REQ_PRIVACY_METHOD, TRUE);
+
+    fail_unless(nreply == 1, "%d replies", nreply);
+    fail_unless(nsent == 1, "%d signals for %d privacy overrides",
+                nsent, NBURST);
+    fail_unless(last_value(DBUS_PRIVACY_SIGNAL) == TRUE, "stale privacy");
+
+    request(DBUS_MEDIA_REQ_BLUETOOTH_METHOD, FALSE);
+
+    fail_unless(nsent == 3, "%d signals for %d overrides", nsent, 3 * NBURST);
+    fail_unless(count(DBUS_BLUETOOTH_SIGNAL) == 1 &&
+                count(DBUS_MUTE_SIGNAL) == 1, "%d bluetooth and %d mute "
+                "signals", count(DBUS_BLUETOOTH_SIGNAL),
+                count(DBUS_MUTE_SIGNAL));
+    fail_unless(last_value(DBUS_BLUETOOTH_SIGNAL) == FALSE &&
+                last_value(DBUS_MUTE_SIGNAL) == TRUE, "stale values sent");
+
+    /* signals keep the order their kinds were first queued in */
+    fail_unless(!strcmp(sent[1].member, DBUS_MUTE_SIGNAL) &&
+                !strcmp(sent[2].member, DBUS_BLUETOOTH_SIGNAL),
+                "signals reordered");
+
+    fail_unless(msg_que.head == NULL && msg_que.tail == &msg_que.head,
+                "queue not empty after flush");
+}
+END_TEST
+
+START_TEST (test_dbusif_send_now_supersedes)
+{
+    dbusif_signal_privacy_override(TRUE, DBUSIF_QUEUE);
+    dbusif_signal_mute(TRUE, DBUSIF_QUEUE);
+    dbusif_signal_privacy_override(FALSE, DBUSIF_SEND_NOW);
+
+    fail_unless(nsent == 1 && sent[0].value == FALSE, "immediate send");
+
+    /* the queued privacy signal is stale by now */
+    queue_flush();
+
+    fail_unless(nsent == 2, "%d signals sent", nsent);
+    fail_unless(count(DBUS_PRIVACY_SIGNAL) == 1, "stale privacy signal sent");
+    fail_unless(last_value(DBUS_PRIVACY_SIGNAL) == FALSE, "stale privacy");
+
+    /* queuing after an immediate send starts over */
+    dbusif_signal_privacy_override(TRUE, DBUSIF_QUEUE);
+    queue_flush();
+
+    fail_unless(count(DBUS_PRIVACY_SIGNAL) == 2 &&
+                last_value(DBUS_PRIVACY_SIGNAL) == TRUE, "privacy lost");
+}
+END_TEST
+
+START_TEST (test_dbusif_purge)
+{
+    DBusMessage *msg;
+    int          i;
+
+    /* uncoalesced system bus traffic interleaved with session signals */
+    for (i = 0;  i < NBURST;  i++) {
+        msg = dbus_message_new_signal(DBUS_POLICY_DECISION_PATH,
+                                      DBUS_POLICY_DECISION_INTERFACE,
+                                      DBUS_NOTIFY_SIGNAL);
+        dbus_message_append_args(msg, DBUS_TYPE_INT32, &i, DBUS_TYPE_INVALID);
+        queue_message(system_bus, signal_other, msg);
+
+        dbusif_signal_mute(i & 1, DBUSIF_QUEUE);
+    }
+
+    dbusif_signal_bluetooth_override(1, DBUSIF_QUEUE);
+
+    fail_unless(queue_length() == NBURST + 2, "%d entries queued",
+                queue_length());
+
+    queue_purge(session_bus);
+
+    fail_unless(queue_length() == NBURST, "%d entries left after purge",
+                queue_length());
+
+    /* the tail and the coalescing state survive the purge */
+    dbusif_signal_mute(TRUE, DBUSIF_QUEUE);
+    dbusif_signal_mute(FALSE, DBUSIF_QUEUE);
+
+    fail_unless(queue_length() == NBURST + 1, "%d entries queued",
+                queue_length());
+
+    queue_flush();
+
+    fail_unless(nsent == NBURST + 1, "%d signals sent", nsent);
+    fail_unless(count(DBUS_BLUETOOTH_SIGNAL) == 0, "purged signal sent");
+
+    for (i = 0;  i < NBURST;  i++)
+        fail_unless(sent[i].conn == sys_conn && sent[i].value == i,
+                    "system bus signal %d out of order", i);
+
+    fail_unless(sent[NBURST].conn == sess_conn &&
+                !strcmp(sent[NBURST].member, DBUS_MUTE_SIGNAL) &&
+                sent[NBURST].value == FALSE, "wrong mute signal");
+
+    /* purging the last entry rewinds the tail */
+    dbusif_signal_mute(TRUE, DBUSIF_QUEUE);
+    queue_purge(session_bus);
+
+    fail_unless(msg_que.tail == &msg_que.head, "dangling tail");
+}
+END_TEST
+
+Suite *ohm_dbusif_suite(void)
+{
+    Suite *suite = suite_create("ohm_media_dbusif");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_dbusif_coalesce_burst);
+    tcase_add_test(tc_all, test_dbusif_send_now_supersedes);
+    tcase_add_test(tc_all, test_dbusif_purge);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_dbusif_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
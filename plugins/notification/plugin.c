@@ -101,11 +101,11 @@ static void plugin_init(OhmPlugin *plugin)
 
 static void plugin_destroy(OhmPlugin *plugin)
 {
-    (void)plugin;
-
     if (id) {
         g_source_remove(id);
     }
+
+    ruleif_exit(plugin);
 }
 
 
@@ -26,9 +26,13 @@ USA.
 #include <errno.h>
 
 
+#include <ohm/ohm-fact.h>
+
 #include "plugin.h"
 #include "ruleif.h"
 
+#define CACHE_MAX  64           /* max. number of cached rule results */
+
 #define IMPORT(name, func) {name, (char **)&func##_SIGNATURE, (void **)&func} 
 
 typedef struct {
@@ -43,6 +47,23 @@ typedef struct {
     int  *rule;
 } rule_def_t;
 
+typedef struct {
+    char   *what;               /* input of the rule */
+    char  **entry;              /* copy of the result entry or NULL */
+} cache_entry_t;
+
+typedef struct {
+    GHashTable   *results;      /* 'what' -> cache_entry_t */
+    GHashTable   *facts;        /* facts the rule reads, NULL if unknown */
+    OhmFactStore *fs;
+    gulong        inserted;     /* factstore signal handlers */
+    gulong        removed;
+    gulong        updated;
+    unsigned int  hit;          /* statistics */
+    unsigned int  miss;
+    unsigned int  flush;
+} cache_t;
+
 
 OHM_IMPORTABLE(void, rules_free_result, (void *retval));
 OHM_IMPORTABLE(void, rules_dump_result, (void *retval));
@@ -54,7 +75,21 @@ static int    notreq  = -1;          /* 'notification_request' rule */
 static int    notevnt = -1;          /* 'notification_events' rule  */
 static int    notplsh = -1;          /* 'notification-play_short' rule */
 
-static int copy_value(char *, int, void *, char **);
+static cache_t cache;
+
+static int            copy_value(char *, int, void *, char **);
+static cache_entry_t *evaluate_request(const char *);
+static void           cache_init(const char *, const char *);
+static void           cache_exit(void);
+static void           cache_flush(const char *);
+static void           cache_entry_free(void *);
+static char         **copy_entry(char **);
+static void           free_entry(char **);
+static void           fact_changed(OhmFact *);
+static void           fact_inserted_cb(void *, OhmFact *, gpointer);
+static void           fact_removed_cb(void *, OhmFact *, gpointer);
+static void           fact_updated_cb(void *, OhmFact *, GQuark, gpointer,
+                                      gpointer);
 
 
 static int lookup_rules(void)
@@ -120,70 +155,77 @@ static int lookup_rules(void)
 
 void ruleif_init(OhmPlugin *plugin)
 {
-    (void)plugin;
-
     ENTER;
     
     lookup_rules();
 
+    cache_init(ohm_plugin_get_param(plugin, "rule-cache"),
+               ohm_plugin_get_param(plugin, "rule-cache-facts"));
+
     LEAVE;
 }
 
+void ruleif_exit(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    cache_exit();
+}
+
 int ruleif_notification_request(const char *what, ...)
 {
-    va_list  ap;
-    char    *argv[16];
-    char  ***retval;
-    char    *name;
-    int      type;
-    void    *value;
-    int      i;
-    int      status;
-    int      success = FALSE;
+    va_list        ap;
+    cache_entry_t *ce;
+    char          *name;
+    int            type;
+    void          *value;
+    int            cached;
+    int            success = FALSE;
 
     if (notreq < 0)
         lookup_rules();
 
     if (notreq >= 0) {
-        retval = NULL;
-
-        argv[i=0] = (char *)'s';
-        argv[++i] = (char *)what;
-
-        status = rule_eval(notreq, &retval, (void **)argv, (i+1)/2);
-
-        OHM_DEBUG(DBG_RULE, "rule_eval returned %d (retval %p)",status,retval);
-
-        if (status <= 0) {
-            if (retval && status < 0)
-                rules_dump_result(retval);
+        cached = (cache.results != NULL && what != NULL);
+
+        if (!cached)
+            ce = evaluate_request(what);
+        else if ((ce = g_hash_table_lookup(cache.results, what)) != NULL) {
+            cache.hit++;
+            OHM_DEBUG(DBG_RULE, "cached result for '%s' (%u hits, %u misses)",
+                      what, cache.hit, cache.miss);
         }
         else {
-            if (OHM_LOGGED(INFO))
-                rules_dump_result(retval);
+            cache.miss++;
 
-            if (retval && retval[0] != NULL && retval[1] == NULL) {
+            if ((ce = evaluate_request(what)) != NULL) {
+                if (g_hash_table_size(cache.results) >= CACHE_MAX)
+                    cache_flush("cache is full");
 
-                success = TRUE;
+                g_hash_table_insert(cache.results, ce->what, ce);
+            }
+        }
 
-                va_start(ap, what);
+        if (ce != NULL && ce->entry != NULL) {
+            success = TRUE;
 
-                while ((name = va_arg(ap, char *)) != NULL) {
-                    type  = va_arg(ap, int);
-                    value = va_arg(ap, void *);
+            va_start(ap, what);
 
-                    if (!copy_value(name, type, value, retval[0])) {
-                        success = FALSE;
-                        break;
-                    }
+            while ((name = va_arg(ap, char *)) != NULL) {
+                type  = va_arg(ap, int);
+                value = va_arg(ap, void *);
+
+                if (!copy_value(name, type, value, ce->entry)) {
+                    success = FALSE;
+                    break;
                 }
-                    
-                va_end(ap);                    
             }
+
+            va_end(ap);
         }
 
-        if (retval)
-            rules_free_result(retval);
+        if (!cached)
+            cache_entry_free(ce);
     }
 
     OHM_DEBUG(DBG_RULE, "%s", success ? "succeeded" : "failed");
@@ -326,6 +368,214 @@ int ruleif_notification_play_short(int id, int *play_ret)
  * @}
  */
 
+static cache_entry_t *evaluate_request(const char *what)
+{
+    cache_entry_t *ce;
+    char          *argv[16];
+    char        ***retval;
+    int            i;
+    int            status;
+
+    if ((ce = malloc(sizeof(*ce))) == NULL)
+        return NULL;
+
+    ce->what  = what ? strdup(what) : NULL;
+    ce->entry = NULL;
+
+    retval = NULL;
+
+    argv[i=0] = (char *)'s';
+    argv[++i] = (char *)what;
+
+    status = rule_eval(notreq, &retval, (void **)argv, (i+1)/2);
+
+    OHM_DEBUG(DBG_RULE, "rule_eval returned %d (retval %p)", status, retval);
+
+    if (status <= 0) {
+        if (retval && status < 0)
+            rules_dump_result(retval);
+    }
+    else {
+        if (OHM_LOGGED(INFO))
+            rules_dump_result(retval);
+
+        if (retval && retval[0] != NULL && retval[1] == NULL)
+            ce->entry = copy_entry(retval[0]);
+    }
+
+    if (retval)
+        rules_free_result(retval);
+
+    return ce;
+}
+
+static void cache_init(const char *enabled, const char *facts)
+{
+    char *list, *name, *save;
+
+    if (enabled != NULL && strcmp(enabled, "yes")) {
+        OHM_INFO("notification: rule result cache is disabled");
+        return;
+    }
+
+    cache.results = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          NULL, cache_entry_free);
+
+    if (facts != NULL && (list = strdup(facts)) != NULL) {
+        cache.facts = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            free, NULL);
+
+        for (name = strtok_r(list, " ,", &save);
+             name != NULL;
+             name = strtok_r(NULL, " ,", &save))
+        {
+            g_hash_table_insert(cache.facts, strdup(name), (gpointer)TRUE);
+        }
+
+        free(list);
+    }
+
+    cache.fs       = ohm_fact_store_get_fact_store();
+    cache.inserted = g_signal_connect(G_OBJECT(cache.fs), "inserted",
+                                      G_CALLBACK(fact_inserted_cb), NULL);
+    cache.removed  = g_signal_connect(G_OBJECT(cache.fs), "removed",
+                                      G_CALLBACK(fact_removed_cb), NULL);
+    cache.updated  = g_signal_connect(G_OBJECT(cache.fs), "updated",
+                                      G_CALLBACK(fact_updated_cb), NULL);
+
+    OHM_INFO("notification: rule results are cached until %s changes",
+             cache.facts ? facts : "the factstore");
+}
+
+static void cache_exit(void)
+{
+    if (cache.results == NULL)
+        return;
+
+    g_signal_handler_disconnect(G_OBJECT(cache.fs), cache.inserted);
+    g_signal_handler_disconnect(G_OBJECT(cache.fs), cache.removed);
+    g_signal_handler_disconnect(G_OBJECT(cache.fs), cache.updated);
+
+    OHM_INFO("notification: rule result cache: %u hits, %u misses, "
+             "%u flushes", cache.hit, cache.miss, cache.flush);
+
+    g_hash_table_destroy(cache.results);
+
+    if (cache.facts != NULL)
+        g_hash_table_destroy(cache.facts);
+
+    memset(&cache, 0, sizeof(cache));
+}
+
+static void cache_flush(const char *reason)
+{
+    if (cache.results != NULL && g_hash_table_size(cache.results) > 0) {
+        OHM_DEBUG(DBG_RULE, "flushing rule result cache: %s", reason);
+
+        g_hash_table_remove_all(cache.results);
+        cache.flush++;
+    }
+}
+
+static void cache_entry_free(void *data)
+{
+    cache_entry_t *ce = (cache_entry_t *)data;
+
+    if (ce != NULL) {
+        free(ce->what);
+        free_entry(ce->entry);
+        free(ce);
+    }
+}
+
+static void fact_changed(OhmFact *fact)
+{
+    const char *name;
+
+    if (cache.results == NULL || fact == NULL)
+        return;
+
+    name = ohm_structure_get_name(OHM_STRUCTURE(fact));
+
+    if (cache.facts == NULL || g_hash_table_lookup(cache.facts, name))
+        cache_flush(name);
+}
+
+static void fact_inserted_cb(void *data, OhmFact *fact, gpointer user_data)
+{
+    (void)data;
+    (void)user_data;
+
+    fact_changed(fact);
+}
+
+static void fact_removed_cb(void *data, OhmFact *fact, gpointer user_data)
+{
+    (void)data;
+    (void)user_data;
+
+    fact_changed(fact);
+}
+
+static void fact_updated_cb(void *data, OhmFact *fact, GQuark field,
+                            gpointer value, gpointer user_data)
+{
+    (void)data;
+    (void)field;
+    (void)value;
+    (void)user_data;
+
+    fact_changed(fact);
+}
+
+static char **copy_entry(char **entry)
+{
+    char **copy;
+    int    i, n;
+
+    for (n = 0;  entry[n];  n += 3)
+        ;
+
+    if ((copy = calloc(n + 1, sizeof(char *))) == NULL)
+        return NULL;
+
+    for (i = 0;  i < n;  i += 3) {
+        copy[i]   = strdup(entry[i]);
+        copy[i+1] = entry[i+1];
+
+        switch ((int)entry[i+1]) {
+        case 's':
+            copy[i+2] = strdup(entry[i+2]);
+            break;
+        case 'd':
+            if ((copy[i+2] = malloc(sizeof(double))) != NULL)
+                *(double *)copy[i+2] = *(double *)entry[i+2];
+            break;
+        default:
+            copy[i+2] = entry[i+2];
+            break;
+        }
+    }
+
+    return copy;
+}
+
+static void free_entry(char **entry)
+{
+    int i;
+
+    if (entry != NULL) {
+        for (i = 0;  entry[i];  i += 3) {
+            free(entry[i]);
+
+            if ((int)entry[i+1] == 's' || (int)entry[i+1] == 'd')
+                free(entry[i+2]);
+        }
+
+        free(entry);
+    }
+}
+
 static int copy_value(char *name, int type, void *value, char **entry)
 {
     int   i;
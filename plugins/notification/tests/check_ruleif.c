@@ -0,0 +1,357 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_ruleif.c
+ * @brief notification_request rule result cache against a mock resolver
+ */
+
+#include <check.h>
+#include "../ruleif.c"
+
+#define FACT_MODE   "com.nokia.policy.test_mode"
+#define FACT_OTHER  "com.nokia.policy.test_other"
+
+#define NREQUEST    20000       /* notifications in the storm */
+#define NCHANGE     500         /* notifications between mode changes */
+#define NOTHER      50          /* notifications between unrelated changes */
+
+int DBG_INIT, DBG_RULE;
+
+static int neval;               /* resolver invocations */
+static int mode;                /* what the mock rule reads from FACT_MODE */
+
+static OhmFactStore *fs;
+static OhmFact      *mode_fact;
+static OhmFact      *other_fact;
+
+static char *events[] = {
+    "sms", "email", "im", "calendar", "battery", "denied", "ringtone", "clock"
+};
+
+typedef struct {
+    int      type;
+    char     event[64];
+    char     error[64];
+    int      mand;
+    int      opt;
+    int      multiple;
+} decision_t;
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+void plugin_print_timestamp(const char *function, const char *phase)
+{
+    (void)function;
+    (void)phase;
+}
+
+
+/*
+ * mock rule engine
+ */
+
+static int mock_rule_find(char *name, int arity)
+{
+    (void)arity;
+
+    if (!strcmp(name, "notification_request"))
+        return 0;
+    if (!strcmp(name, "notification_events"))
+        return 1;
+    if (!strcmp(name, "notification_play_short"))
+        return 2;
+
+    return -1;
+}
+
+static int mock_rule_eval(int rule, void *retval, void **args, int narg)
+{
+    char  *what = (char *)args[1];
+    char **entry;
+    char ***result;
+    int    i;
+
+    (void)narg;
+
+    if (rule != 0)
+        return -1;
+
+    neval++;
+
+    /* the silent mode denies everything but the clock */
+    if (!strcmp(what, "denied") || (mode && strcmp(what, "clock")))
+        return 0;
+
+    result = calloc(2, sizeof(char **));
+    entry  = calloc(22, sizeof(char *));
+
+#define STRING(n, v)                            \
+    do {                                        \
+        entry[i++] = n;                         \
+        entry[i++] = (char *)'s';               \
+        entry[i++] = v;                         \
+    } while (0)
+
+#define INTEGER(n, v)                           \
+    do {                                        \
+        entry[i++] = n;                         \
+        entry[i++] = (char *)'i';               \
+        entry[i++] = (char *)(long)(v);         \
+    } while (0)
+
+    i = 0;
+    STRING  ("name"          , "notification");
+    INTEGER ("type"          , 0);
+    STRING  ("event"         , mode ? "silent" : what);
+    INTEGER ("mandatory"     , 1 + mode);
+    INTEGER ("optional"      , strlen(what));
+    INTEGER ("allow_multiple", !strcmp(what, "im"));
+    STRING  ("proclaimer"    , "none");
+
+#undef STRING
+#undef INTEGER
+
+    result[0] = entry;
+    *(char ****)retval = result;
+
+    return 1;
+}
+
+static void mock_rules_free_result(void *retval)
+{
+    char ***result = (char ***)retval;
+
+    free(result[0]);
+    free(result);
+}
+
+static void mock_rules_dump_result(void *retval)
+{
+    (void)retval;
+}
+
+
+/*
+ * helpers
+ */
+
+static void set_mode(int value)
+{
+    mode = value;
+    ohm_fact_set(mode_fact, "value", ohm_value_from_int(value));
+}
+
+static void request(const char *what, decision_t *d)
+{
+    char *event = NULL, *error = NULL, *proclaimer = NULL;
+
+    memset(d, 0, sizeof(*d));
+
+    if (!ruleif_notification_request(what,
+                     RULEIF_INTEGER_ARG ("type"           , d->type    ),
+                     RULEIF_STRING_ARG  ("event"          , event      ),
+                     RULEIF_STRING_ARG  ("error"          , error      ),
+                     RULEIF_INTEGER_ARG ("mandatory"      , d->mand    ),
+                     RULEIF_INTEGER_ARG ("optional"       , d->opt     ),
+                     RULEIF_INTEGER_ARG ("allow_multiple" , d->multiple),
+                     RULEIF_STRING_ARG  ("proclaimer"     , proclaimer ),
+                     RULEIF_ARGLIST_END                    ))
+        d->type = -1;
+
+    if (event != NULL)
+        strncpy(d->event, event, sizeof(d->event) - 1);
+    if (error != NULL)
+        strncpy(d->error, error, sizeof(d->error) - 1);
+
+    free(event);
+    free(error);
+    free(proclaimer);
+}
+
+/* replay a notification storm with occasional policy changes */
+static void storm(decision_t *decisions)
+{
+    int i;
+
+    set_mode(0);
+
+    for (i = 0; i < NREQUEST; i++) {
+        if (i > 0 && (i % NCHANGE) == 0)
+            set_mode(!mode);
+
+        /* unrelated factstore traffic */
+        if ((i % NOTHER) == 0)
+            ohm_fact_set(other_fact, "value", ohm_value_from_int(i));
+
+        request(events[i % DIM(events)], decisions + i);
+    }
+}
+
+static void setup(void)
+{
+    rules_free_result = mock_rules_free_result;
+    rules_dump_result = mock_rules_dump_result;
+    rule_find         = mock_rule_find;
+    rule_eval         = mock_rule_eval;
+
+    fs = ohm_fact_store_get_fact_store();
+
+    mode_fact  = ohm_fact_new(FACT_MODE);
+    other_fact = ohm_fact_new(FACT_OTHER);
+
+    ohm_fact_store_insert(fs, mode_fact);
+    ohm_fact_store_insert(fs, other_fact);
+
+    neval = 0;
+}
+
+static void teardown(void)
+{
+    cache_exit();
+
+    ohm_fact_store_remove(fs, mode_fact);
+    ohm_fact_store_remove(fs, other_fact);
+
+    g_object_unref(mode_fact);
+    g_object_unref(other_fact);
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_ruleif_cache_storm)
+{
+    static decision_t uncached[NREQUEST], cached[NREQUEST];
+
+    int nuncached, i;
+
+    cache_init("no", NULL);
+    storm(uncached);
+    nuncached = neval;
+    cache_exit();
+
+    fail_unless(nuncached == NREQUEST, "%d resolver calls for %d requests",
+                nuncached, NREQUEST);
+
+    neval = 0;
+    cache_init("yes", FACT_MODE);
+    storm(cached);
+
+    for (i = 0; i < NREQUEST; i++) {
+        fail_unless(!memcmp(uncached + i, cached + i, sizeof(decision_t)),
+                    "request %d ('%s') decided differently", i,
+                    events[i % DIM(events)]);
+    }
+
+    fail_unless(neval == DIM(events) * (NREQUEST / NCHANGE),
+                "%d resolver calls with cache", neval);
+    fail_unless(cache.hit + cache.miss == NREQUEST, "%u hits %u misses",
+                cache.hit, cache.miss);
+
+    printf("%d notifications: %d resolver calls uncached, %d cached "
+           "(%d saved, %u flushes)\n", NREQUEST, nuncached, neval,
+           nuncached - neval, cache.flush);
+}
+END_TEST
+
+START_TEST (test_ruleif_cache_any_fact)
+{
+    static decision_t uncached[NREQUEST], cached[NREQUEST];
+
+    int i;
+
+    cache_init("no", NULL);
+    storm(uncached);
+    cache_exit();
+
+    /* without a fact list any factstore change invalidates the cache */
+    neval = 0;
+    cache_init("yes", NULL);
+    storm(cached);
+
+    for (i = 0; i < NREQUEST; i++) {
+        fail_unless(!memcmp(uncached + i, cached + i, sizeof(decision_t)),
+                    "request %d ('%s') decided differently", i,
+                    events[i % DIM(events)]);
+    }
+
+    fail_unless(neval < NREQUEST, "no resolver calls saved");
+    fail_unless(cache.flush >= NREQUEST / NOTHER - 1,
+                "%u flushes", cache.flush);
+}
+END_TEST
+
+Suite *ohm_notification_ruleif_suite(void)
+{
+    Suite *suite = suite_create("ohm_notification_ruleif");
+
+    TCase *tc_all = tcase_create("All");
+
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+    tcase_add_test(tc_all, test_ruleif_cache_storm);
+    tcase_add_test(tc_all, test_ruleif_cache_any_fact);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    g_type_init();
+
+    suite = ohm_notification_ruleif_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -21,8 +21,11 @@ USA.
 #define SELIST_DIM 3
 
 static client_listhead_t  cl_head;
+static GHashTable        *cl_index;  /* dbusid -> hash of object -> client */
 
-static int init_selist(client_t *, fsif_field_t *, int);
+static int  init_selist(client_t *, fsif_field_t *, int);
+static void index_client(client_t *);
+static void unindex_client(client_t *);
 
 static void client_init(OhmPlugin *plugin)
 {
@@ -33,6 +36,9 @@ static void client_init(OhmPlugin *plugin)
     cl_head.next = (void *)&cl_head;
     cl_head.prev = (void *)&cl_head;
 
+    cl_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                     (GDestroyNotify)g_hash_table_destroy);
+
     (void)plugin;
 }
 
@@ -74,6 +80,8 @@ static client_t *client_create(char *dbusid, char *object,
                 
                 next->prev = cl;
                 cl->prev   = prev;
+
+                index_client(cl);
                 
                 dbusif_watch_client(dbusid, TRUE);
 
@@ -111,8 +119,6 @@ static void client_destroy(client_t *cl)
 
         dbusif_watch_client(cl->dbusid, FALSE);
 
-        free(cl->dbusid);
-        free(cl->object);
         free(cl->pid);
         free(cl->stream);
         free(cl->group);
@@ -129,26 +135,27 @@ static void client_destroy(client_t *cl)
         if (cl->rqplayhint.evsrc != 0)
             g_source_remove(cl->rqplayhint.evsrc);
 
+        unindex_client(cl);
+
         next = cl->next;
         prev = cl->prev;
 
         prev->next = cl->next;
         next->prev = cl->prev;
 
+        free(cl->dbusid);
+        free(cl->object);
         free(cl);
     }
 }
 
 static client_t *client_find_by_dbus(char *dbusid, char *object)
 {
-    client_t *cl;
+    GHashTable *objects;
 
-    if (dbusid && object) {
-        for (cl = cl_head.next;   cl != (void *)&cl_head;   cl = cl->next){
-            if (cl->dbusid && !strcmp(dbusid, cl->dbusid) &&
-                cl->object && !strcmp(object, cl->object)   )
-                return cl;
-        }
+    if (dbusid && object && cl_index != NULL) {
+        if ((objects = g_hash_table_lookup(cl_index, dbusid)) != NULL)
+            return g_hash_table_lookup(objects, object);
     }
     
     return NULL;
@@ -173,16 +180,27 @@ static client_t *client_find_by_stream(char *pid, char *stream)
     return NULL;
 }
 
+static gboolean first_client(gpointer key, gpointer value, gpointer data)
+{
+    (void)key;
+    (void)value;
+    (void)data;
+
+    return TRUE;
+}
+
 static void client_purge(char *dbusid)
 {
-    client_t *cl, *nxcl;
+    GHashTable *objects;
+    client_t   *cl;
 
-    for (cl = cl_head.next;  cl != (void *)&cl_head;  cl = nxcl) {
-        nxcl = cl->next;
+    if (dbusid == NULL || cl_index == NULL)
+        return;
 
-        if (cl->dbusid && !strcmp(dbusid, cl->dbusid))
-            client_destroy(cl);
-    }
+    /* the hash of objects is gone with the last client of dbusid */
+    while ((objects = g_hash_table_lookup(cl_index, dbusid)) != NULL &&
+           (cl = g_hash_table_find(objects, first_client, NULL)) != NULL)
+        client_destroy(cl);
 }
 
 static int client_add_factstore_entry(char *dbusid, char *object,
@@ -418,6 +436,37 @@ static int init_selist(client_t *cl, fsif_field_t *selist, int dim)
 
     return FALSE;
 }
+static void index_client(client_t *cl)
+{
+    GHashTable *objects;
+
+    if (cl->dbusid == NULL || cl->object == NULL)
+        return;
+
+    if ((objects = g_hash_table_lookup(cl_index, cl->dbusid)) == NULL) {
+        objects = g_hash_table_new(g_str_hash, g_str_equal);
+        g_hash_table_insert(cl_index, g_strdup(cl->dbusid), objects);
+    }
+
+    g_hash_table_insert(objects, cl->object, cl);
+}
+
+static void unindex_client(client_t *cl)
+{
+    GHashTable *objects;
+
+    if (cl->dbusid == NULL || cl->object == NULL)
+        return;
+
+    if ((objects = g_hash_table_lookup(cl_index, cl->dbusid)) != NULL) {
+        if (g_hash_table_lookup(objects, cl->object) == cl)
+            g_hash_table_remove(objects, cl->object);
+
+        if (g_hash_table_size(objects) == 0)
+            g_hash_table_remove(cl_index, cl->dbusid);
+    }
+}
+
 
 /* 
  * Local Variables:
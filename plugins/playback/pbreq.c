@@ -19,6 +19,8 @@ USA.
 
 
 static pbreq_listhead_t  rq_head;
+static GHashTable       *rq_bytrid;   /* trid -> request */
+static GHashTable       *rq_byclient; /* client -> GQueue of requests */
 
 static void pbreq_init(OhmPlugin *plugin)
 {
@@ -26,6 +28,10 @@ static void pbreq_init(OhmPlugin *plugin)
 
     rq_head.next = (void *)&rq_head;
     rq_head.prev = (void *)&rq_head;
+
+    rq_bytrid   = g_hash_table_new(g_direct_hash, g_direct_equal);
+    rq_byclient = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                        (GDestroyNotify)g_queue_free);
 }
 
 static pbreq_t *pbreq_create(client_t *cl, DBusMessage *msg)
@@ -33,6 +39,7 @@ static pbreq_t *pbreq_create(client_t *cl, DBusMessage *msg)
     static int trid = 1;
 
     pbreq_t *req, *next, *prev;
+    GQueue  *clq;
 
     if (msg == NULL)
         req = NULL;
@@ -54,6 +61,14 @@ static pbreq_t *pbreq_create(client_t *cl, DBusMessage *msg)
             next->prev = req;
             req->prev  = prev;
 
+            if ((clq = g_hash_table_lookup(rq_byclient, cl)) == NULL) {
+                clq = g_queue_new();
+                g_hash_table_insert(rq_byclient, cl, clq);
+            }
+
+            g_queue_push_tail(clq, req);
+            g_hash_table_insert(rq_bytrid, GINT_TO_POINTER(req->trid), req);
+
             OHM_DEBUG(DBG_QUE, "playback request %d created", req->trid);
         }
     }
@@ -64,11 +79,21 @@ static pbreq_t *pbreq_create(client_t *cl, DBusMessage *msg)
 static void pbreq_destroy(pbreq_t *req)
 {
     pbreq_t *prev, *next;
+    GQueue  *clq;
 
     if (req != NULL) {
         OHM_DEBUG(DBG_QUE, "playback request %d is going to be destroyed",
                   req->trid);
 
+        g_hash_table_remove(rq_bytrid, GINT_TO_POINTER(req->trid));
+
+        if ((clq = g_hash_table_lookup(rq_byclient, req->cl)) != NULL) {
+            g_queue_remove(clq, req);
+
+            if (g_queue_is_empty(clq))
+                g_hash_table_remove(rq_byclient, req->cl);
+        }
+
         prev = req->prev;
         next = req->next;
 
@@ -99,38 +124,25 @@ static void pbreq_destroy(pbreq_t *req)
 
 static pbreq_t *pbreq_get_first(client_t *cl)
 {
-    pbreq_t *req;
+    GQueue *clq;
 
-    for (req = rq_head.next;   req != (void *)&rq_head;   req = req->next) {
-        if (req->cl == cl)
-            return req;
-    }
+    if ((clq = g_hash_table_lookup(rq_byclient, cl)) == NULL)
+        return NULL;
 
-    return NULL;
+    return g_queue_peek_head(clq);
 }
 
 static pbreq_t *pbreq_get_by_trid(int trid)
 {
-    pbreq_t *req;
-
-    for (req = rq_head.next;   req != (void *)&rq_head;   req = req->next) {
-        if (req->trid == trid)
-            return req;
-    }
-
-    return NULL;
+    return g_hash_table_lookup(rq_bytrid, GINT_TO_POINTER(trid));
 }
 
 static void pbreq_purge(client_t *cl)
 {
-    pbreq_t *req, *nxreq;
-
-    for (req = rq_head.next;   req != (void *)&rq_head;   req = nxreq) {
-        nxreq = req->next;
+    pbreq_t *req;
 
-        if (cl == req->cl)
-            pbreq_destroy(req);
-    }
+    while ((req = pbreq_get_first(cl)) != NULL)
+        pbreq_destroy(req);
 }
 
 
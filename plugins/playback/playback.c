@@ -24,6 +24,7 @@ USA.
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <time.h>
 
 #include <glib.h>
 #include <glib-object.h>
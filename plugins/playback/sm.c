@@ -49,10 +49,12 @@ typedef struct {
     sm_stdef_t    stdef[stid_max]; /* state definitions */
 } sm_def_t;
 
-typedef struct {
-    sm_t         *sm;
-    sm_evdata_t  *evdata;
-    sm_evfree_t   evfree;
+typedef struct sm_schedule_s {
+    struct sm_schedule_s *next;
+    sm_t                 *sm;
+    sm_evdata_t          *evdata;
+    sm_evfree_t           evfree;
+    unsigned long         stamp;   /* when it was scheduled, in usecs */
 } sm_schedule_t;
 
 
@@ -263,6 +265,8 @@ sm_def_t  sm_def = {
 
 static void  verify_state_machine(void);
 static int   fire_scheduled_event(void *);
+static void  purge_scheduled_events(sm_t *);
+static unsigned long schedule_time(void);
 static int   fire_setstate_changed_event(void *);
 static int   fire_playhint_changed_event(void *);
 static void  fire_hello_signal_event(char *, char *);
@@ -349,6 +353,14 @@ static int sm_destroy(sm_t *sm)
     if (sm->sched != 0)
         g_source_remove(sm->sched);
 
+    purge_scheduled_events(sm);
+
+    OHM_DEBUG(DBG_SM, "[%s] event statistics: %u scheduled, %u fired, "
+              "%u dropped, max. queue length %u, max. latency %lu usec",
+              sm->name, sm->evstat.scheduled, sm->evstat.fired,
+              sm->evstat.dropped, sm->evstat.maxlength,
+              sm->evstat.maxlatency);
+
     free(sm->name);
     free(sm);
 
@@ -452,6 +464,7 @@ static int sm_process_event(sm_t *sm, sm_evdata_t *evdata)
 
 static void sm_schedule_event(sm_t *sm, sm_evdata_t *evdata,sm_evfree_t evfree)
 {
+    sm_evqueue_t  *evq;
     sm_schedule_t *schedule;
 
     if (!sm || !evdata) {
@@ -466,35 +479,58 @@ static void sm_schedule_event(sm_t *sm, sm_evdata_t *evdata,sm_evfree_t evfree)
         return;
     }
 
-    if (sm->sched != 0) {
-        OHM_ERROR("[%s] failed to schedule event: multiple requests",sm->name);
-        return;
+    evq = &sm->evq;
+
+    if (evq->length >= SM_EVQUEUE_MAX) {
+        OHM_ERROR("[%s] failed to schedule event '%s': queue is full "
+                  "(%u events)", sm->name, evdef[evdata->evid].name,
+                  evq->length);
+        goto drop;
     }
 
     if ((schedule = malloc(sizeof(*schedule))) == NULL) {
         OHM_ERROR("[%s] failed to schedule event: malloc failed", sm->name);
-        return;
+        goto drop;
     }
 
+    if (sm->sched == 0 &&
+        (sm->sched = g_idle_add(fire_scheduled_event, sm)) == 0)
+    {
+        OHM_ERROR("[%s] failed to schedule event: g_idle_add() failed",
+                  sm->name);
+        free(schedule);
+        goto drop;
+    }
+
+    schedule->next   = NULL;
     schedule->sm     = sm;
     schedule->evdata = evdata;
     schedule->evfree = evfree;
+    schedule->stamp  = schedule_time();
+
+    if (evq->tail != NULL)
+        evq->tail->next = schedule;
+    else
+        evq->head = schedule;
 
-    sm->sched = g_idle_add(fire_scheduled_event, schedule);
+    evq->tail = schedule;
+    evq->length++;
 
-    if (sm->sched == 0) {
-        OHM_ERROR("[%s] failed to schedule event: g_idle_add() failed",
-                  sm->name);
+    sm->evstat.scheduled++;
 
-        free(schedule);
+    if (evq->length > sm->evstat.maxlength)
+        sm->evstat.maxlength = evq->length;
 
-        if (evfree != NULL)
-            evfree(evdata);
-    }
-    else {
-        OHM_DEBUG(DBG_SM, "[%s] schedule event '%s'",
-                  sm->name, evdef[evdata->evid].name);
-    }
+    OHM_DEBUG(DBG_SM, "[%s] schedule event '%s' (%u pending)",
+              sm->name, evdef[evdata->evid].name, evq->length);
+
+    return;
+
+ drop:
+    sm->evstat.dropped++;
+
+    if (evfree != NULL)
+        evfree(evdata);
 }
 
 static void sm_free_evdata(sm_evdata_t *evdata)
@@ -588,22 +624,80 @@ static void verify_state_machine()
 
 static int fire_scheduled_event(void *data)
 {
-    sm_schedule_t *schedule = (sm_schedule_t *)data;
-    sm_t          *sm       = schedule->sm;
-    sm_evdata_t   *evdata   = schedule->evdata;
+    sm_t          *sm  = (sm_t *)data;
+    sm_evqueue_t  *evq = &sm->evq;
+    sm_schedule_t *schedule;
+    sm_evdata_t   *evdata;
+    unsigned long  latency;
+
+    /*
+     * Fire one event per iteration so that a busy state machine can't
+     * starve the others. Events scheduled by the transition functions are
+     * appended to the queue and fired in subsequent iterations.
+     */
+
+    if ((schedule = evq->head) != NULL) {
+        if ((evq->head = schedule->next) == NULL)
+            evq->tail = NULL;
+        evq->length--;
+
+        evdata  = schedule->evdata;
+        latency = schedule_time() - schedule->stamp;
+
+        sm->evstat.fired++;
+        sm->evstat.sumlatency += latency;
+
+        if (latency > sm->evstat.maxlatency)
+            sm->evstat.maxlatency = latency;
+
+        OHM_DEBUG(DBG_SM, "[%s] fire event (latency %lu usec)",
+                  sm->name, latency);
+
+        sm_process_event(sm, evdata);
+
+        if (schedule->evfree != NULL)
+            schedule->evfree(evdata);
+
+        free(schedule);
+    }
+
+    if (evq->head != NULL)
+        return TRUE;            /* keep on firing */
 
     sm->sched = 0;
 
-    OHM_DEBUG(DBG_SM, "[%s] fire event", sm->name);
+    return FALSE;
+}
+
+static void purge_scheduled_events(sm_t *sm)
+{
+    sm_evqueue_t  *evq = &sm->evq;
+    sm_schedule_t *schedule;
 
-    sm_process_event(sm, evdata);
+    while ((schedule = evq->head) != NULL) {
+        evq->head = schedule->next;
 
-    if (schedule->evfree != NULL)
-        schedule->evfree(evdata);
+        OHM_DEBUG(DBG_SM, "[%s] drop pending event '%s'", sm->name,
+                  evdef[schedule->evdata->evid].name);
 
-    free(schedule);
+        if (schedule->evfree != NULL)
+            schedule->evfree(schedule->evdata);
 
-    return FALSE;               /* run only once */
+        free(schedule);
+    }
+
+    evq->tail   = NULL;
+    evq->length = 0;
+}
+
+static unsigned long schedule_time(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+
+    return (unsigned long)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
 }
 
 static int fire_setstate_changed_event(void *data)
@@ -53,11 +53,32 @@ typedef enum {
     stid_max
 } sm_stid_t;
 
+#define SM_EVQUEUE_MAX  32   /* max. number of pending scheduled events */
+
+struct sm_schedule_s;
+
+typedef struct {
+    struct sm_schedule_s *head;      /* next event to fire */
+    struct sm_schedule_s *tail;      /* last scheduled event */
+    unsigned int          length;    /* number of pending events */
+} sm_evqueue_t;
+
+typedef struct {
+    unsigned int  scheduled;  /* events put to the queue */
+    unsigned int  fired;      /* events taken out from the queue */
+    unsigned int  dropped;    /* events dropped due to a full queue */
+    unsigned int  maxlength;  /* max. observed queue length */
+    unsigned long maxlatency; /* max. scheduling latency in usecs */
+    unsigned long sumlatency; /* sum of scheduling latencies in usecs */
+} sm_evstat_t;
+
 typedef struct {
     char         *name;       /* name of the state machine instance */
     sm_stid_t     stid;       /* ID of the current state */
     int           busy;       /* to prevent nested event processing */
-    unsigned int  sched;      /* event source for scheduled event if any */
+    unsigned int  sched;      /* event source for scheduled events if any */
+    sm_evqueue_t  evq;        /* scheduled events in FIFO order */
+    sm_evstat_t   evstat;     /* scheduling statistics */
     void         *data;       /* passed to trfunc() as second arg */
 } sm_t;
 
@@ -0,0 +1,479 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_playback.c
+ * @brief client indexes and state machine event queue tests against
+ *        mock D-Bus, dres and factstore interfaces
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+
+#include <glib.h>
+#include <check.h>
+#include <ohm/ohm-plugin.h>
+
+#include "playback.h"
+#include "client.h"
+#include "pbreq.h"
+#include "sm.h"
+#include "dbusif.h"
+#include "dresif.h"
+#include "fsif.h"
+
+#define NCLIENT  300            /* number of simulated players */
+#define NOBJECT  2              /* players per D-Bus connection */
+
+static int DBG_CLIENT, DBG_SM, DBG_TRANS, DBG_QUE;
+
+static void (*timestamp_add)(const char *);
+
+#include "../client.c"
+#include "../pbreq.c"
+#include "../sm.c"
+
+static int nsetprop;            /* State properties written to players */
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * mock D-Bus interface
+ */
+
+static int dbusif_watch_client(const char *dbusid, int add)
+{
+    (void)dbusid;
+    (void)add;
+
+    return TRUE;
+}
+
+static void dbusif_reply_to_req_state(DBusMessage *msg, const char *state)
+{
+    (void)msg;
+    (void)state;
+}
+
+static void dbusif_reply_with_error(DBusMessage *msg, const char *error,
+                                    const char *description)
+{
+    (void)msg;
+    (void)error;
+    (void)description;
+}
+
+static void dbusif_get_property(char *dbusid, char *object, char *prname,
+                                get_property_cb_t usercb)
+{
+    (void)dbusid;
+    (void)object;
+    (void)prname;
+    (void)usercb;
+}
+
+static void dbusif_set_property(char *dbusid, char *object, char *prname,
+                                char *prvalue, set_property_cb_t usercb)
+{
+    (void)dbusid;
+    (void)object;
+    (void)prvalue;
+    (void)usercb;
+
+    if (!strcmp(prname, "State"))
+        nsetprop++;
+}
+
+static void dbusif_add_property_notification(char *prname,
+                                             notify_property_cb_t cb)
+{
+    (void)prname;
+    (void)cb;
+}
+
+static void dbusif_signal_privacy_override(int value)   { (void)value; }
+static void dbusif_signal_bluetooth_override(int value) { (void)value; }
+static void dbusif_signal_mute(int value)               { (void)value; }
+static void dbusif_add_hello_notification(hello_cb_t cb)   { (void)cb; }
+static void dbusif_add_goodbye_notification(hello_cb_t cb) { (void)cb; }
+
+static void dbusif_send_stream_info_to_pep(char *oper, char *group,
+                                           char *pid, char *stream)
+{
+    (void)oper;
+    (void)group;
+    (void)pid;
+    (void)stream;
+}
+
+
+/*
+ * mock dres interface
+ */
+
+static int dresif_playback_state_request(client_t *cl, char *state, int trid)
+{
+    (void)cl;
+    (void)state;
+    (void)trid;
+
+    return TRUE;
+}
+
+
+/*
+ * mock factstore interface
+ */
+
+static int fsif_add_factstore_entry(char *name, fsif_field_t *fldlist)
+{
+    (void)name;
+    (void)fldlist;
+
+    return TRUE;
+}
+
+static int fsif_delete_factstore_entry(char *name, fsif_field_t *selist)
+{
+    (void)name;
+    (void)selist;
+
+    return TRUE;
+}
+
+static int fsif_update_factstore_entry(char *name, fsif_field_t *selist,
+                                       fsif_field_t *fldlist)
+{
+    (void)name;
+    (void)selist;
+    (void)fldlist;
+
+    return TRUE;
+}
+
+static void fsif_get_field_by_entry(fsif_entry_t *entry, fsif_fldtype_t type,
+                                    char *name, void *vptr)
+{
+    (void)entry;
+    (void)type;
+    (void)name;
+    (void)vptr;
+}
+
+static int fsif_add_field_watch(char *factname, fsif_field_t *selist,
+                                char *fldname, fsif_field_watch_cb_t callback,
+                                void *usrdata)
+{
+    (void)factname;
+    (void)selist;
+    (void)fldname;
+    (void)callback;
+    (void)usrdata;
+
+    return TRUE;
+}
+
+
+/*
+ * helpers
+ */
+
+static client_t *clients[NCLIENT];
+
+static void client_name(int i, char *dbusid, char *object)
+{
+    sprintf(dbusid, ":1.%d", i / NOBJECT);
+    sprintf(object, "/org/maemo/playback/%d", i % NOBJECT);
+}
+
+static void schedule(client_t *cl, sm_evid_t evid, char *value)
+{
+    sm_evdata_t *evdata = malloc(sizeof(*evdata));
+
+    memset(evdata, 0, sizeof(*evdata));
+
+    switch (evid) {
+    case evid_setstate_changed:
+        evdata->watch.evid  = evid;
+        evdata->watch.value = strdup(value);
+        break;
+    default:
+        evdata->property.evid  = evid;
+        evdata->property.name  = strdup("State");
+        evdata->property.value = strdup(value);
+        break;
+    }
+
+    sm_schedule_event(cl->sm, evdata, sm_free_evdata);
+}
+
+static void run_mainloop(void)
+{
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+}
+
+static void setup(void)
+{
+    char dbusid[64], object[64], pid[16];
+    int  i;
+
+    client_init(NULL);
+    pbreq_init(NULL);
+    sm_init(NULL);
+
+    nsetprop = 0;
+
+    for (i = 0; i < NCLIENT; i++) {
+        client_name(i, dbusid, object);
+        sprintf(pid, "%d", 1000 + i);
+
+        clients[i] = client_create(dbusid, object, pid, "player");
+        clients[i]->sm->stid = stid_idle;
+    }
+}
+
+static void teardown(void)
+{
+    char dbusid[64], object[64];
+    int  i;
+
+    for (i = 0; i < NCLIENT; i += NOBJECT) {
+        client_name(i, dbusid, object);
+        client_purge(dbusid);
+    }
+
+    g_hash_table_destroy(cl_index);
+    g_hash_table_destroy(rq_bytrid);
+    g_hash_table_destroy(rq_byclient);
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_client_index)
+{
+    char      dbusid[64], object[64];
+    client_t *cl;
+    int       i;
+
+    for (i = 0; i < NCLIENT; i++) {
+        client_name(i, dbusid, object);
+        cl = client_find_by_dbus(dbusid, object);
+
+        fail_unless(cl == clients[i], "client %s%s not found", dbusid,object);
+    }
+
+    fail_unless(client_find_by_dbus(":1.9999", object) == NULL,
+                "unknown client found");
+
+    client_name(0, dbusid, object);
+    client_purge(dbusid);
+
+    for (i = 0; i < NOBJECT; i++) {
+        client_name(i, dbusid, object);
+        fail_unless(client_find_by_dbus(dbusid, object) == NULL,
+                    "purged client %s%s found", dbusid, object);
+    }
+
+    client_name(NOBJECT, dbusid, object);
+    fail_unless(client_find_by_dbus(dbusid, object) == clients[NOBJECT],
+                "client of another connection purged");
+}
+END_TEST
+
+START_TEST (test_pbreq_index)
+{
+    DBusMessage *msg;
+    pbreq_t     *req[3];
+    client_t    *cl  = clients[0];
+    client_t    *cl2 = clients[1];
+    int          i;
+
+    msg = dbus_message_new_method_call(DBUS_PLAYBACK_SERVICE, "/",
+                                       DBUS_PLAYBACK_INTERFACE,
+                                       DBUS_PLAYBACK_REQ_STATE_METHOD);
+
+    for (i = 0; i < 3; i++)
+        req[i] = pbreq_create(i == 1 ? cl2 : cl, msg);
+
+    fail_unless(pbreq_get_first(cl)  == req[0], "wrong first request");
+    fail_unless(pbreq_get_first(cl2) == req[1], "wrong first request");
+
+    for (i = 0; i < 3; i++)
+        fail_unless(pbreq_get_by_trid(req[i]->trid) == req[i],
+                    "request %d not found by trid", req[i]->trid);
+
+    pbreq_destroy(req[0]);
+    fail_unless(pbreq_get_first(cl) == req[2], "requests out of order");
+
+    pbreq_purge(cl);
+    fail_unless(pbreq_get_first(cl)  == NULL, "request not purged");
+    fail_unless(pbreq_get_first(cl2) == req[1], "wrong request purged");
+
+    pbreq_purge(cl2);
+    fail_unless(rq_head.next == (void *)&rq_head, "request list not empty");
+
+    dbus_message_unref(msg);
+}
+END_TEST
+
+START_TEST (test_sm_event_burst)
+{
+    static char *states[] = { "play", "pause", "stop" };
+
+    client_t     *cl;
+    unsigned int  fired = 0, dropped = 0;
+    unsigned long maxlat = 0, sumlat = 0;
+    char          value[16];
+    int           i, j;
+
+    /* every player gets play, pause and stop right after each other */
+    for (i = 0; i < NCLIENT; i++) {
+        cl = clients[i];
+
+        for (j = 0; j < 3; j++) {
+            strcpy(value, states[j]);
+            schedule(cl, evid_setstate_changed, value);
+
+            value[0] = toupper(value[0]);
+            schedule(cl, evid_setprop_succeeded, value);
+            schedule(cl, evid_state_signal, value);
+        }
+    }
+
+    run_mainloop();
+
+    for (i = 0; i < NCLIENT; i++) {
+        cl = clients[i];
+
+        fail_unless(cl->sm->stid == stid_idle, "%s: not in idle state",
+                    cl->sm->name);
+        fail_unless(cl->sm->sched == 0 && cl->sm->evq.length == 0,
+                    "%s: pending events", cl->sm->name);
+        fail_unless(cl->state && !strcmp(cl->state, "stop"),
+                    "%s: state is '%s' instead of 'stop'", cl->sm->name,
+                    cl->state ? cl->state : "<null>");
+
+        fired   += cl->sm->evstat.fired;
+        dropped += cl->sm->evstat.dropped;
+        sumlat  += cl->sm->evstat.sumlatency;
+
+        if (cl->sm->evstat.maxlatency > maxlat)
+            maxlat = cl->sm->evstat.maxlatency;
+    }
+
+    fail_unless(dropped == 0, "%u events dropped", dropped);
+    fail_unless(fired == NCLIENT * 9, "%u events fired instead of %u",
+                fired, NCLIENT * 9);
+    fail_unless(nsetprop == NCLIENT * 3, "%d state changes instead of %d",
+                nsetprop, NCLIENT * 3);
+
+    printf("%u events, dispatch latency avg. %lu usec, max. %lu usec\n",
+           fired, sumlat / fired, maxlat);
+}
+END_TEST
+
+START_TEST (test_sm_queue_limit)
+{
+    sm_t *sm = clients[0]->sm;
+    int   i;
+
+    for (i = 0; i < SM_EVQUEUE_MAX + 8; i++)
+        schedule(clients[0], evid_state_signal, "Play");
+
+    fail_unless(sm->evq.length == SM_EVQUEUE_MAX, "queue length %u",
+                sm->evq.length);
+    fail_unless(sm->evstat.dropped == 8, "%u events dropped instead of 8",
+                sm->evstat.dropped);
+
+    run_mainloop();
+
+    fail_unless(sm->evstat.fired == SM_EVQUEUE_MAX, "%u events fired",
+                sm->evstat.fired);
+
+    /* pending events are released with the state machine */
+    for (i = 0; i < 4; i++)
+        schedule(clients[0], evid_state_signal, "Stop");
+}
+END_TEST
+
+Suite *ohm_playback_suite(void)
+{
+    Suite *suite = suite_create("ohm_playback");
+
+    TCase *tc_all = tcase_create("All");
+
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+    tcase_add_test(tc_all, test_client_index);
+    tcase_add_test(tc_all, test_pbreq_index);
+    tcase_add_test(tc_all, test_sm_event_burst);
+    tcase_add_test(tc_all, test_sm_queue_limit);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_playback_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
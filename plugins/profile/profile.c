@@ -29,7 +29,9 @@ USA.
 #include "profile.h"
 
 static int  profile_load_state(void);
-static int  profile_save_state(OhmFact *fact);
+static void profile_save_state(OhmFact *fact);
+static int  profile_write_state(OhmFact *fact);
+static void profile_flush_state(void);
 static void reconnect_profile(void);
 
 static int DBG_PROFILE, DBG_FACTS;
@@ -41,15 +43,46 @@ OHM_DEBUG_PLUGIN(profile,
 static profile_plugin *profile_plugin_p;
 static DBusConnection *bus_conn;
 
+/*
+ * write-behind state of the saved profile fact
+ */
+static struct {
+    OhmFact      *fact;                     /* fact to save, if pending */
+    guint         timer;                    /* write-behind timer */
+    guint         delay;                    /* coalescing window (ms) */
+    unsigned int  nchange;                  /* changes since last write */
+    unsigned int  nwrite;                   /* number of state file writes */
+} saver = { NULL, 0, PROFILE_SAVE_DELAY, 0, 0 };
+
 static void plugin_init(OhmPlugin * plugin)
 {
-    (void) plugin;
+    const char    *delay;
+    char          *end;
+    unsigned long  value;
 
     if (!OHM_DEBUG_INIT(profile))
         g_warning("Failed to initialize profile plugin debugging.");
     
     OHM_DEBUG(DBG_PROFILE, "> Profile plugin init");
 
+    delay = ohm_plugin_get_param(plugin, "save-delay");
+
+    if (delay != NULL) {
+        errno = 0;
+        value = strtoul(delay, &end, 10);
+
+        /* strtoul would take leading blanks and a sign, we don't */
+        if (errno != 0 || *delay < '0' || *delay > '9' || *end != '\0' ||
+            value > G_MAXUINT)
+            OHM_ERROR("profile: invalid save delay '%s', using %u ms",
+                      delay, saver.delay);
+        else {
+            saver.delay = (guint)value;
+            OHM_INFO("profile: using save delay %u ms", saver.delay);
+        }
+        errno = 0;
+    }
+
     /* We could remove this if installing ohm created /var/lib/ohm. */
     mkdir(PROFILE_SAVE_DIR, 0755);
 
@@ -63,6 +96,8 @@ static void plugin_exit(OhmPlugin * plugin)
 {
     (void) plugin;
 
+    profile_flush_state();
+
     if (profile_plugin_p) {
         deinit_profile(profile_plugin_p);
     }
@@ -323,16 +358,87 @@ static int load_field(FILE *fp, char *key, size_t size, GValue **value)
 }
 
 
-static int profile_save_state(OhmFact *fact)
+static gboolean profile_save_timeout(gpointer data)
+{
+    (void)data;
+
+    saver.timer = 0;
+    profile_flush_state();
+
+    return FALSE;
+}
+
+
+static void profile_save_state(OhmFact *fact)
+{
+    /*
+     * Notes: Profile changes tend to come in bursts (a profile switch
+     *   updates every key of the fact). Rather than rewriting the state
+     *   file for each of them we only remember that the fact needs to
+     *   be saved and write it once the changes have settled down.
+     */
+
+    if (fact != saver.fact) {
+        if (saver.fact != NULL)
+            g_object_unref(saver.fact);
+        saver.fact = g_object_ref(fact);
+    }
+
+    saver.nchange++;
+
+    if (saver.delay == 0) {
+        profile_flush_state();
+        return;
+    }
+
+    if (!saver.timer)
+        saver.timer = g_timeout_add(saver.delay, profile_save_timeout, NULL);
+}
+
+
+static void profile_flush_state(void)
+{
+    OhmFact *fact = saver.fact;
+    int      err;
+
+    if (saver.timer) {
+        g_source_remove(saver.timer);
+        saver.timer = 0;
+    }
+
+    if (fact == NULL)
+        return;
+
+    saver.fact = NULL;
+
+    if ((err = profile_write_state(fact)) != 0)
+        OHM_ERROR("profile: failed to save state to %s (%d: %s)",
+                  PROFILE_SAVE_PATH, err, strerror(err));
+    else
+        OHM_DEBUG(DBG_PROFILE, "saved %u change(s) with write #%u",
+                  saver.nchange, saver.nwrite);
+
+    saver.nchange = 0;
+    g_object_unref(fact);
+}
+
+
+static int profile_write_state(OhmFact *fact)
 {
     FILE *fp;
     GSList *l;
     GQuark  q;
     const gchar *key;
     GValue *value;
-    int err;
+    int err, dir;
     
-    if ((fp = fopen(PROFILE_SAVE_PATH, "w")) == NULL)
+    /*
+     * Notes: The state is written to a temporary file which then replaces
+     *   the old one, so a crash in the middle of a write leaves us with
+     *   either the previous or the new state but never with a mixture.
+     */
+
+    if ((fp = fopen(PROFILE_SAVE_TEMP, "w")) == NULL)
         return errno;
 
     for (l = ohm_fact_get_fields(fact); l != NULL; l = l->next) {
@@ -342,14 +448,31 @@ static int profile_save_state(OhmFact *fact)
 
         if ((err = save_field(fp, key, value)) != 0) {
             fclose(fp);
-            unlink(PROFILE_SAVE_PATH);
+            unlink(PROFILE_SAVE_TEMP);
             return err;
         }
     }
     
-    fflush(fp);
-    /* fdatasync(fileno(fp)); */
-    fclose(fp);
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+        err = errno;
+        fclose(fp);
+        unlink(PROFILE_SAVE_TEMP);
+        return err;
+    }
+
+    if (fclose(fp) != 0 || rename(PROFILE_SAVE_TEMP, PROFILE_SAVE_PATH) != 0) {
+        err = errno;
+        unlink(PROFILE_SAVE_TEMP);
+        return err;
+    }
+
+    /* make the rename itself durable */
+    if ((dir = open(PROFILE_SAVE_DIR, O_RDONLY)) >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+
+    saver.nwrite++;
 
     OHM_INFO("Profile state saved.");
     return 0;
@@ -364,8 +487,11 @@ static int profile_load_state(void)
     gchar key[128];
     GValue *value;
     FILE *fp;
-    int err;
+    int err, nfield;
     
+    /* a leftover temporary file is from an interrupted write, ignore it */
+    unlink(PROFILE_SAVE_TEMP);
+
     if ((fp = fopen(PROFILE_SAVE_PATH, "r")) == NULL) {
         if (errno != ENOENT)
             OHM_ERROR("profile: could not load saved state from %s (%d: %s)",
@@ -388,15 +514,29 @@ static int profile_load_state(void)
         return ENOMEM;
     }
     
-    while ((err = load_field(fp, key, sizeof(key), &value)) == 0)
+    nfield = 0;
+    while ((err = load_field(fp, key, sizeof(key), &value)) == 0) {
         ohm_fact_set(fact, key, value);
+        nfield++;
+    }
     
     fclose(fp);
     
+    /*
+     * A damaged (eg. truncated) state file still has its fields intact
+     * up to the point of damage. Use those and rewrite the file on the
+     * next save rather than throwing away all of the saved state.
+     */
+
     if (err != ENOENT) {
-        g_object_unref(fact);
-        OHM_ERROR("profile: failed to load saved state");
-        return err;
+        if (nfield == 0) {
+            g_object_unref(fact);
+            OHM_ERROR("profile: failed to load saved state");
+            return err;
+        }
+
+        OHM_WARNING("profile: saved state is damaged, recovered %d field%s",
+                    nfield, nfield == 1 ? "" : "s");
     }
 
     ohm_fact_store_insert(fs, fact);
@@ -448,6 +588,14 @@ static void profile_value_change(const char *profile, const char *key,
 
         OHM_DEBUG(DBG_PROFILE, "changing key %s with new value '%s'", key, val);
         ohm_fact_set(fact, key, gval);
+
+        /*
+         * The saved state is loaded into the fact store at startup, before
+         * the profile daemon is reachable. If only profile switches were
+         * saved, a value changed within the active profile (eg. a volume)
+         * would be loaded back with its value from before the change.
+         */
+        profile_save_state(fact);
     }
     else {
         OHM_DEBUG(DBG_PROFILE, "Error, no facts or empty key");
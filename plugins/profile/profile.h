@@ -37,6 +37,7 @@ USA.
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <fcntl.h>
 #include <time.h>
 
 #include <glib.h>
@@ -56,8 +57,12 @@ USA.
 
 #define DBUS_INTERFACE_POLICY   "com.nokia.policy"
 #define DBUS_POLICY_NEW_SESSION "NewSession"
+#ifndef PROFILE_SAVE_DIR
 #define PROFILE_SAVE_DIR  "/var/lib/ohm"
+#endif
 #define PROFILE_SAVE_PATH PROFILE_SAVE_DIR"/profile"
+#define PROFILE_SAVE_TEMP PROFILE_SAVE_PATH".tmp"
+#define PROFILE_SAVE_DELAY 1000         /* default write-behind delay, ms */
 
 typedef struct _profile_plugin {
     gchar *current_profile;
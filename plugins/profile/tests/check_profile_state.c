@@ -0,0 +1,292 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_profile_state.c
+ * @brief write-behind saving and loading of the profile state
+ */
+
+#include <check.h>
+
+#define PROFILE_SAVE_DIR "/tmp/check-profile-state"
+
+#include "../profile.h"
+#include "../profile.c"
+
+#define NCHANGE     1000        /* changes in the burst */
+#define SAVE_DELAY  20          /* write-behind delay used in the tests */
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * helpers
+ */
+
+static OhmFact *current_fact(void)
+{
+    OhmFactStore *fs   = ohm_fact_store_get_fact_store();
+    GSList       *list = ohm_fact_store_get_facts_by_name(fs, FACTSTORE_PROFILE);
+
+    fail_unless(g_slist_length(list) == 1, "%d profile facts",
+                g_slist_length(list));
+
+    return list->data;
+}
+
+static void remove_facts(void)
+{
+    OhmFactStore *fs = ohm_fact_store_get_fact_store();
+    GSList       *l, *n;
+
+    l = ohm_fact_store_get_facts_by_name(fs, FACTSTORE_PROFILE);
+    while (l != NULL) {
+        n = l->next;
+        ohm_fact_store_remove(fs, l->data);
+        l = n;
+    }
+}
+
+static const char *field_value(OhmFact *fact, const char *key)
+{
+    GValue *value = ohm_fact_get(fact, key);
+
+    if (value == NULL || G_VALUE_TYPE(value) != G_TYPE_STRING)
+        return NULL;
+
+    return g_value_get_string(value);
+}
+
+static long elapsed_ms(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (now.tv_sec - start->tv_sec) * 1000 +
+        (now.tv_usec - start->tv_usec) / 1000;
+}
+
+static void setup(void)
+{
+    g_type_init();
+
+    mkdir(PROFILE_SAVE_DIR, 0755);
+    unlink(PROFILE_SAVE_PATH);
+    unlink(PROFILE_SAVE_TEMP);
+
+    saver.delay  = SAVE_DELAY;
+    saver.nwrite = 0;
+}
+
+static void teardown(void)
+{
+    profile_flush_state();
+    remove_facts();
+
+    unlink(PROFILE_SAVE_PATH);
+    unlink(PROFILE_SAVE_TEMP);
+    rmdir(PROFILE_SAVE_DIR);
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_profile_state_burst)
+{
+    struct timeval start;
+    char           val[32];
+    long           ms;
+    int            i;
+
+    profile_create_fact("general", NULL);
+
+    gettimeofday(&start, NULL);
+
+    for (i = 0; i < NCHANGE; i++) {
+        snprintf(val, sizeof(val), "tone-%d.mp3", i);
+        profile_value_change("general", "ringing.alert.tone", val, "string",
+                             NULL);
+
+        /* let the main loop run between the changes */
+        usleep(100);
+        while (g_main_context_iteration(NULL, FALSE))
+            ;
+    }
+
+    ms = elapsed_ms(&start);
+
+    /* plugin shutdown */
+    profile_flush_state();
+
+    printf("%d changes in %ld ms: %u state file writes (delay %d ms)\n",
+           NCHANGE + 1, ms, saver.nwrite, SAVE_DELAY);
+
+    fail_unless(saver.nwrite >= 1, "state never saved");
+    fail_unless(saver.nwrite <= (unsigned int)(ms / SAVE_DELAY + 2),
+                "%u writes in %ld ms", saver.nwrite, ms);
+    fail_unless(access(PROFILE_SAVE_TEMP, F_OK) != 0,
+                "temporary file left behind");
+
+    /* the last change must have made it to the disk */
+    remove_facts();
+    fail_unless(profile_load_state() == 0, "failed to load state");
+
+    snprintf(val, sizeof(val), "tone-%d.mp3", NCHANGE - 1);
+    fail_if(strcmp(field_value(current_fact(), "ringing.alert.tone"), val),
+            "last change lost");
+    fail_if(strcmp(field_value(current_fact(), PROFILE_NAME_KEY), "general"),
+            "profile name lost");
+}
+END_TEST
+
+START_TEST (test_profile_state_torn_write)
+{
+    static profileval_t values[] = {
+        { "ringing.alert.tone"  , "tone.mp3", "string" },
+        { "ringing.alert.volume", "40"      , "string" },
+        { "vibrating.alert"     , "On"      , "string" },
+        { NULL                  , NULL      , NULL     }
+    };
+
+    char     saved[1024];
+    size_t   size, len, i;
+    int      complete, nfield, j;
+    FILE    *fp;
+    OhmFact *fact;
+    GSList  *f;
+
+    profile_create_fact("meeting", values);
+    profile_flush_state();
+
+    fp = fopen(PROFILE_SAVE_PATH, "r");
+    fail_if(fp == NULL, "state not saved");
+    size = fread(saved, 1, sizeof(saved), fp);
+    fclose(fp);
+
+    /* simulate a crash after every possible number of written bytes */
+    for (len = 0; len <= size; len++) {
+        fp = fopen(PROFILE_SAVE_PATH, "w");
+        fwrite(saved, 1, len, fp);
+        fclose(fp);
+
+        /* an interrupted write of the next state */
+        fp = fopen(PROFILE_SAVE_TEMP, "w");
+        fwrite(saved, 1, size / 2, fp);
+        fclose(fp);
+
+        remove_facts();
+
+        for (i = 0, complete = 0; i < len; i++)
+            if (saved[i] == '\n')
+                complete++;
+        complete /= 2;
+
+        if (complete == 0 && len > 0) {
+            fail_unless(profile_load_state() != 0,
+                        "%zu bytes: garbage accepted", len);
+            continue;
+        }
+
+        fail_unless(profile_load_state() == 0, "%zu bytes: load failed", len);
+        fail_unless(access(PROFILE_SAVE_TEMP, F_OK) != 0,
+                    "%zu bytes: temporary file not removed", len);
+
+        fact   = current_fact();
+        nfield = 0;
+
+        for (f = ohm_fact_get_fields(fact); f != NULL; f = f->next) {
+            const char *key = g_quark_to_string(GPOINTER_TO_INT(f->data));
+            const char *val = field_value(fact, key);
+            const char *exp = NULL;
+
+            if (!strcmp(key, PROFILE_NAME_KEY))
+                exp = "meeting";
+            for (j = 0; exp == NULL && values[j].pv_key != NULL; j++)
+                if (!strcmp(key, values[j].pv_key))
+                    exp = values[j].pv_val;
+
+            fail_unless(exp != NULL && val != NULL && !strcmp(val, exp),
+                        "%zu bytes: field '%s' has value '%s'", len, key,
+                        val ? val : "<none>");
+            nfield++;
+        }
+
+        fail_unless(nfield == complete, "%zu bytes: %d fields, expected %d",
+                    len, nfield, complete);
+    }
+}
+END_TEST
+
+Suite *ohm_profile_state_suite(void)
+{
+    Suite *suite = suite_create("ohm_profile_state");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 30);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_profile_state_burst);
+    tcase_add_test(tc_all, test_profile_state_torn_write);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_profile_state_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
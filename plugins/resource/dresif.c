@@ -93,9 +93,9 @@ int dresif_resource_request(uint32_t  manager_id,
 #endif
     vars[++i] = NULL;
 
-    timestamp_add("resource request -- resolving start");
+    timestamp_add("resource request -- resolving start", manager_id,client_id);
     status = resolve("resource_request", vars);
-    timestamp_add("resource request -- resolving end");
+    timestamp_add("resource request -- resolving end", manager_id, status);
     
     if (status < 0) {
         OHM_DEBUG(DBG_DRES, "resolving resource_request for %s/%d "
@@ -725,7 +725,8 @@ static void block_cb(fsif_entry_t *entry,
                 if ((resset->mode & RESOURCE_AUTO_RELEASE) == 0)
                     resource_set_send_release_request(rs);
                 else
-                    resource_set_add_idle_task(rs, forced_auto_release);
+                    resource_set_add_idle_task(rs, forced_auto_release,
+                                               resource_set_task_urgent);
             }
 
             rs->block = block;
@@ -36,6 +36,12 @@ USA.
 #include "dresif.h"
 #include "ruleif.h"
 #include "auth.h"
+#include "resource-set.h"
+
+#define IMPORT_METHOD(name, ptr) ({                                     \
+            signature = (char *)ptr##_SIGNATURE;                        \
+            ohm_module_find_method((name), &signature, (void *)&(ptr)); \
+        })
 
 /* these are the manually set up equivalents of OHM_EXPORTABLE */
 static const char *OHM_VAR(internalif_timer_add,_SIGNATURE) =
@@ -49,6 +55,11 @@ int DBG_INIT, DBG_MGR, DBG_SET, DBG_DBUS, DBG_INTERNAL;
 int DBG_DRES, DBG_FS, DBG_QUE, DBG_TRANSACT, DBG_MEDIA, DBG_AUTH;
 int DBG_RULE;
 
+OHM_IMPORTABLE(int, add_command, (char *name, void (*handler)(char *)));
+
+static void console_init(void);
+static void console_command(char *);
+
 OHM_DEBUG_PLUGIN(resource,
     OHM_DEBUG_FLAG( "init"    , "init sequence"      , &DBG_INIT     ),
     OHM_DEBUG_FLAG( "manager" , "resource manager"   , &DBG_MGR      ),
@@ -100,6 +111,7 @@ static void plugin_init(OhmPlugin *plugin)
     resource_spec_init(plugin);
     transaction_init(plugin);
     auth_init(plugin);
+    console_init();
 
 #if 0    
     DBG_MGR = DBG_SET = DBG_DBUS = DBG_INTERNAL = DBG_DRES =
@@ -109,6 +121,42 @@ static void plugin_init(OhmPlugin *plugin)
     LEAVE;
 }
 
+static void console_init(void)
+{
+    char *signature;
+
+    if (IMPORT_METHOD("dres.add_command", add_command)) {
+        add_command("resource", console_command);
+        OHM_INFO("resource: registered resource console command handler");
+    }
+    else
+        OHM_INFO("resource: console command extensions not available");
+}
+
+static void console_command(char *cmd)
+{
+    resource_set_workq_stats_t stats;
+
+    while (*cmd == ' ' || *cmd == '\t')
+        cmd++;
+
+    if (!strcmp(cmd, "workq")) {
+        resource_set_workq_stats(&stats);
+
+        printf("resource set work queue:\n");
+        printf("  depth:      %u (max %u)\n", stats.depth, stats.max_depth);
+        printf("  queued:     %u\n", stats.queued);
+        printf("  coalesced:  %u\n", stats.coalesced);
+        printf("  rejected:   %u\n", stats.rejected);
+        printf("  dispatches: %u (%u out of time budget)\n",
+               stats.dispatches, stats.deferred);
+    }
+    else {
+        printf("resource help         show this help\n");
+        printf("resource workq        show work queue statistics\n");
+    }
+}
+
 static void plugin_destroy(OhmPlugin *plugin)
 {
     auth_exit(plugin);
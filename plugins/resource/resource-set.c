@@ -43,9 +43,25 @@ USA.
 
 #define SELIST_DIM  2
 
+#define WORKQ_BUDGET  0.005     /* max. seconds spent in one idle dispatch */
+
+typedef struct {
+    resource_set_t  *head;
+    resource_set_t  *tail;
+} workq_t;
+
 static resource_set_t  *hash_table[HASH_DIM];
 
-static gboolean idle_task(gpointer);
+static workq_t                     workq[resource_set_task_prio_max];
+static guint                       workq_srcid;
+static GTimer                     *workq_timer;
+static resource_set_t             *workq_current;
+static resource_set_workq_stats_t  workq_stats;
+
+static gboolean workq_dispatch(gpointer);
+static void workq_push(resource_set_t *, int);
+static resource_set_t *workq_pop(void);
+static void workq_remove(resource_set_t *);
 
 static void enqueue_send_request(resource_set_t *, resource_set_field_id_t,
                                  uint32_t, uint32_t);
@@ -138,8 +154,8 @@ void resource_set_destroy(resset_t *resset)
                 resource_spec_destroy(spec);
             }
 
-            if (rs->idle.srcid)
-                g_source_remove(rs->idle.srcid);
+            workq_remove(rs);
+            workq_stats.depth -= rs->idle.ntask;
 
             destroy_queue(rs, resource_set_granted);
             destroy_queue(rs, resource_set_advice);
@@ -297,19 +313,76 @@ void resource_set_send_release_request(resource_set_t *rs)
     }
 }
 
-int resource_set_add_idle_task(resource_set_t *rs, resource_set_task_t task)
+int resource_set_add_idle_task(resource_set_t           *rs,
+                               resource_set_task_t       task,
+                               resource_set_task_prio_t  prio)
 {
-    int success;
-    if (rs->idle.srcid != 0)
-        success = FALSE;
-    else {
-        rs->idle.srcid = g_idle_add(idle_task, (gpointer)rs);
-        rs->idle.task  = task;
+    resset_t *resset;
+    int       i;
 
-        success = rs->idle.srcid ? TRUE : FALSE;
+    if (rs == NULL || (resset = rs->resset) == NULL || task == NULL ||
+        prio < 0 || prio >= resource_set_task_prio_max)
+    {
+        OHM_ERROR("resource: refuse to add idle task: argument error");
+        return FALSE;
     }
 
-    return success;
+    for (i = 0;  i < rs->idle.ntask;  i++) {
+        if (rs->idle.task[i] == task) {
+            OHM_DEBUG(DBG_QUE, "%s/%u (manager id %u) idle task coalesced "
+                      "with a pending one",
+                      resset->peer, resset->id, rs->manager_id);
+            workq_stats.coalesced++;
+
+            if (rs->idle.queued && prio > rs->idle.prio) {
+                workq_remove(rs);
+                workq_push(rs, prio);
+            }
+
+            return TRUE;
+        }
+    }
+
+    if (rs->idle.ntask >= RESOURCE_SET_TASK_MAX) {
+        OHM_ERROR("resource: can't add idle task to %s/%u (manager id %u): "
+                  "too many pending tasks",
+                  resset->peer, resset->id, rs->manager_id);
+        workq_stats.rejected++;
+        return FALSE;
+    }
+
+    if (!workq_srcid) {
+        if (!(workq_srcid = g_idle_add(workq_dispatch, NULL))) {
+            OHM_ERROR("resource: failed to add idle source for work queue");
+            return FALSE;
+        }
+    }
+
+    rs->idle.task[rs->idle.ntask++] = task;
+
+    if (!rs->idle.queued)
+        workq_push(rs, prio);
+    else if (prio > rs->idle.prio) {
+        workq_remove(rs);
+        workq_push(rs, prio);
+    }
+
+    workq_stats.queued++;
+
+    if (++workq_stats.depth > workq_stats.max_depth)
+        workq_stats.max_depth = workq_stats.depth;
+
+    OHM_DEBUG(DBG_QUE, "%s/%u (manager id %u) idle task queued "
+              "(queue depth %u)", resset->peer, resset->id, rs->manager_id,
+              workq_stats.depth);
+
+    return TRUE;
+}
+
+void resource_set_workq_stats(resource_set_workq_stats_t *stats)
+{
+    if (stats != NULL)
+        *stats = workq_stats;
 }
 
 resource_set_t *resource_set_find(fsif_entry_t *entry)
@@ -357,22 +430,151 @@ void resource_set_dump_message(resmsg_t *msg,resset_t *resset,const char *dir)
  * @}
  */
 
-static gboolean idle_task(gpointer data)
+static gboolean workq_dispatch(gpointer data)
 {
-    resource_set_t *rs = (resource_set_t *)data;
+    resource_set_t      *rs;
+    resource_set_task_t  task;
+    int                  i;
+
+    (void)data;
+
+    if (workq_timer == NULL)
+        workq_timer = g_timer_new();
+    else
+        g_timer_start(workq_timer);
+
+    workq_stats.dispatches++;
+
+    /*
+     * Tasks of a set are executed in the order they were added. A task
+     * might destroy its own set, in which case resource_set_destroy()
+     * clears workq_current and we move on to the next set.
+     */
+    while ((rs = workq_pop()) != NULL) {
+        workq_current = rs;
+
+        while (workq_current == rs && rs->idle.ntask > 0) {
+            task = rs->idle.task[0];
+
+            for (i = 1;  i < rs->idle.ntask;  i++)
+                rs->idle.task[i-1] = rs->idle.task[i];
+
+            rs->idle.ntask--;
+            workq_stats.depth--;
+
+            task(rs);
+
+            if (g_timer_elapsed(workq_timer, NULL) > WORKQ_BUDGET)
+                break;
+        }
 
-    if (rs) {
-        if (rs->idle.task)
-            rs->idle.task(rs);
+        if (workq_current == rs && rs->idle.ntask > 0 && !rs->idle.queued)
+            workq_push(rs, -1);
 
-        if (rs->idle.srcid) {
-            g_source_remove(rs->idle.srcid);
-            rs->idle.srcid = 0;
+        workq_current = NULL;
+
+        if (g_timer_elapsed(workq_timer, NULL) > WORKQ_BUDGET) {
+            if (workq_stats.depth > 0) {
+                OHM_DEBUG(DBG_QUE, "idle task budget exhausted; %u task(s) "
+                          "deferred", workq_stats.depth);
+                workq_stats.deferred++;
+                return TRUE;
+            }
+            break;
         }
     }
+
+    workq_srcid = 0;
+
     return FALSE;
 }
 
+/*
+ * Link rs to the work queue of the given priority. A negative priority
+ * puts it back to the head of its previous queue, so that a set which
+ * was preempted by the time budget keeps its position.
+ */
+static void workq_push(resource_set_t *rs, int prio)
+{
+    workq_t *q;
+
+    if (prio < 0) {
+        q = &workq[rs->idle.prio];
+
+        if ((rs->idle.next = q->head) == NULL)
+            q->tail = rs;
+        q->head = rs;
+    }
+    else {
+        q = &workq[prio];
+
+        rs->idle.next = NULL;
+        rs->idle.prio = prio;
+
+        if (q->tail != NULL)
+            q->tail->idle.next = rs;
+        else
+            q->head = rs;
+        q->tail = rs;
+    }
+
+    rs->idle.queued = TRUE;
+}
+
+static resource_set_t *workq_pop(void)
+{
+    workq_t        *q;
+    resource_set_t *rs;
+    int             prio;
+
+    for (prio = resource_set_task_prio_max - 1;  prio >= 0;  prio--) {
+        q = &workq[prio];
+
+        if ((rs = q->head) != NULL) {
+            if ((q->head = rs->idle.next) == NULL)
+                q->tail = NULL;
+
+            rs->idle.next   = NULL;
+            rs->idle.queued = FALSE;
+
+            return rs;
+        }
+    }
+
+    return NULL;
+}
+
+static void workq_remove(resource_set_t *rs)
+{
+    workq_t        *q;
+    resource_set_t *prev;
+    resource_set_t *cur;
+
+    if (rs == workq_current)
+        workq_current = NULL;
+
+    if (rs->idle.queued) {
+        q = &workq[rs->idle.prio];
+
+        for (prev = NULL, cur = q->head;  cur;  prev = cur, cur=cur->idle.next){
+            if (cur == rs) {
+                if (prev == NULL)
+                    q->head = rs->idle.next;
+                else
+                    prev->idle.next = rs->idle.next;
+
+                if (q->tail == rs)
+                    q->tail = prev;
+
+                break;
+            }
+        }
+
+        rs->idle.next   = NULL;
+        rs->idle.queued = FALSE;
+    }
+}
+
 static resource_set_queue_t* queue_pop_head(resource_set_qhead_t *qhead)
 {
     resource_set_queue_t *qentry;
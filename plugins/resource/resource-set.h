@@ -28,6 +28,8 @@ USA.
 
 #define INVALID_MANAGER_ID (~(uint32_t)0)
 
+#define RESOURCE_SET_TASK_MAX  4 /* max. pending idle tasks per set */
+
 /* hack to avoid multiple includes */
 typedef struct _OhmPlugin OhmPlugin;
 struct _OhmFact;
@@ -36,6 +38,12 @@ union resource_spec_u;
 
 typedef void (*resource_set_task_t)(struct resource_set_s *);
 
+typedef enum {
+    resource_set_task_normal = 0,
+    resource_set_task_urgent,
+    resource_set_task_prio_max
+} resource_set_task_prio_t;
+
 typedef enum {
     resource_set_unknown_field = 0,
     resource_set_granted,
@@ -81,11 +89,24 @@ typedef struct resource_set_s {
     resource_set_qhead_t     qhead;      /* queue for delayed responses */
     uint32_t                 reqno;
     struct {
-        uint32_t            srcid;
-        resource_set_task_t task;
-    }                        idle;       /* idle task source ID (gmainloop) */
+        struct resource_set_s   *next;   /* next set in the work queue */
+        int                      queued; /* linked to the work queue */
+        resource_set_task_prio_t prio;   /* priority of the queue we're in */
+        int                      ntask;  /* number of pending tasks */
+        resource_set_task_t      task[RESOURCE_SET_TASK_MAX];
+    }                        idle;       /* pending idle tasks */
 } resource_set_t;
 
+typedef struct {
+    uint32_t                 depth;      /* currently pending tasks */
+    uint32_t                 max_depth;  /* high watermark of depth */
+    uint32_t                 queued;     /* accepted tasks */
+    uint32_t                 coalesced;  /* merged with a pending one */
+    uint32_t                 rejected;   /* per-set queue was full */
+    uint32_t                 dispatches; /* idle callback invocations */
+    uint32_t                 deferred;   /* dispatches out of time budget */
+} resource_set_workq_stats_t;
+
 typedef enum {
     update_nothing = 0,
     update_flags,
@@ -105,7 +126,9 @@ void resource_set_queue_change(resource_set_t *, uint32_t,
                                uint32_t, resource_set_field_id_t);
 void resource_set_send_queued_changes(uint32_t, uint32_t);
 void resource_set_send_release_request(resource_set_t *);
-int  resource_set_add_idle_task(resource_set_t *, resource_set_task_t);
+int  resource_set_add_idle_task(resource_set_t *, resource_set_task_t,
+                                resource_set_task_prio_t);
+void resource_set_workq_stats(resource_set_workq_stats_t *);
 resource_set_t *resource_set_find(struct _OhmFact *);
 
 void resource_set_dump_message(resmsg_t *, resset_t *, const char *);
@@ -0,0 +1,190 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_transaction.c
+ * @brief stress tests for the resource transaction table
+ */
+
+#include <check.h>
+#include "../transaction.c"
+
+#define NTRANSACTION  5000
+#define NRESSET       64
+
+int DBG_TRANSACT;
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list     ap;
+    FILE       *out;
+    const char *prefix;
+    
+    switch (level) {
+    case OHM_LOG_ERROR:   prefix = "E: "; out = stderr; break;
+    case OHM_LOG_WARNING: prefix = "W: "; out = stderr; break;
+    case OHM_LOG_INFO:    prefix = "I: "; out = stdout; break;
+    default:                                           return;
+    }
+
+    va_start(ap, format);
+
+    fputs(prefix, out);
+    vfprintf(out, format, ap);
+    fputs("\n", out);
+
+    va_end(ap);
+}
+
+void plugin_print_timestamp(const char *function, const char *phase)
+{
+    (void)function;
+    (void)phase;
+}
+
+static uint32_t  txids[NTRANSACTION];
+static int       ncompleted;
+static uint32_t  last_completed;
+static int       errors;
+
+static void completion_cb(uint32_t *ids, int nid, uint32_t txid, void *data)
+{
+    uint32_t idx = (uint32_t)(unsigned long)data;
+    int      i;
+
+    if (txid != txids[idx] || txid <= last_completed)
+        errors++;
+
+    if (nid != NRESSET)
+        errors++;
+
+    for (i = 0;  i < nid;  i++) {
+        if (ids[i] != (uint32_t)i * 7)
+            errors++;
+    }
+
+    last_completed = txid;
+    ncompleted++;
+}
+
+START_TEST (test_transaction_many_concurrent)
+
+    uint32_t i;
+    int      j;
+
+    ncompleted = 0;
+    errors     = 0;
+
+    /* open thousands of transactions at once */
+    for (i = 0;  i < NTRANSACTION;  i++) {
+        txids[i] = transaction_create(completion_cb, (void *)(unsigned long)i);
+        fail_if(txids[i] == NO_TRANSACTION, "failed to create transaction");
+    }
+
+    /* add resource sets, every one twice to exercise duplicate detection */
+    for (j = 0;  j < 2 * NRESSET;  j++) {
+        for (i = 0;  i < NTRANSACTION;  i++) {
+            fail_unless(transaction_add_resource_set(txids[i],
+                                                     (j % NRESSET) * 7),
+                        "failed to add resource set to transaction %u",
+                        txids[i]);
+        }
+    }
+
+    /* unref in reverse order: nothing completes until the first one does */
+    for (i = NTRANSACTION - 1;  i > 0;  i--)
+        fail_unless(transaction_unref(txids[i]), "unref failed");
+
+    fail_unless(ncompleted == 0, "%d transactions completed out of order",
+                ncompleted);
+
+    fail_unless(transaction_unref(txids[0]), "unref failed");
+
+    fail_unless(ncompleted == NTRANSACTION, "only %d of %d transactions "
+                "completed", ncompleted, NTRANSACTION);
+    fail_unless(errors == 0, "%d errors in completion callbacks", errors);
+    fail_unless(txtable.count == 0, "%u transactions left in the table",
+                txtable.count);
+
+    /* completed transactions must not be found any more */
+    fail_if(transaction_ref(txids[NTRANSACTION / 2]),
+            "completed transaction still referable");
+
+END_TEST
+
+START_TEST (test_transaction_interleaved)
+
+    uint32_t txid[4];
+    int      round, k;
+
+    ncompleted = 0;
+
+    /* a sliding window of overlapping transactions */
+    for (round = 0;  round < NTRANSACTION;  round++) {
+        for (k = 0;  k < 4;  k++) {
+            txid[k] = transaction_create(NULL, NULL);
+            fail_if(txid[k] == NO_TRANSACTION, "failed to create transaction");
+            fail_unless(transaction_add_resource_set(txid[k], round),
+                        "failed to add resource set");
+            fail_unless(transaction_ref(txid[k]), "ref failed");
+        }
+        for (k = 3;  k >= 0;  k--) {
+            fail_unless(transaction_unref(txid[k]), "unref failed");
+            fail_unless(transaction_unref(txid[k]), "unref failed");
+        }
+    }
+
+    fail_unless(txtable.count == 0, "%u transactions left in the table",
+                txtable.count);
+
+END_TEST
+
+Suite *ohm_resource_transaction_suite(void)
+{
+    Suite *suite = suite_create("ohm_resource_transaction");
+
+    TCase *tc_all = tcase_create("All");
+
+    tcase_add_test(tc_all, test_transaction_many_concurrent);
+    tcase_add_test(tc_all, test_transaction_interleaved);
+    
+    tcase_set_timeout(tc_all, 120);
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_resource_transaction_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
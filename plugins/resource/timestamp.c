@@ -24,11 +24,13 @@ USA.
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <stdint.h>
 
 #include "plugin.h"
 #include "timestamp.h"
 
-OHM_IMPORTABLE(void, _timestamp_add, (const char *step));
+OHM_IMPORTABLE(void, _timestamp_trace, (const char *id,
+                                        uint32_t arg0, uint32_t arg1));
 
 /*! \addtogroup pubif
  *  Functions
@@ -37,15 +39,16 @@ OHM_IMPORTABLE(void, _timestamp_add, (const char *step));
 
 void timestamp_init(OhmPlugin *plugin)
 {
-    char *signature = (char *)_timestamp_add_SIGNATURE;
+    char *signature = (char *)_timestamp_trace_SIGNATURE;
 
     (void)plugin;
 
     ENTER;
  
-    ohm_module_find_method("timestamp", &signature, (void *)&_timestamp_add);
+    ohm_module_find_method("timestamp_trace", &signature,
+                           (void *)&_timestamp_trace);
 
-    if (_timestamp_add != NULL)
+    if (_timestamp_trace != NULL)
         OHM_INFO("resource: timestamping is enabled.");
     else
         OHM_INFO("resource: timestamping is disabled.");
@@ -53,19 +56,10 @@ void timestamp_init(OhmPlugin *plugin)
     LEAVE;
 }
 
-void timestamp_add(const char *fmt, ...)
+void timestamp_add(const char *id, uint32_t arg0, uint32_t arg1)
 {
-    va_list ap;
-    char    buf[512];
-
-    if (fmt != NULL && _timestamp_add != NULL) {
-
-        va_start(ap, fmt);
-        vsnprintf(buf, sizeof(buf), fmt, ap);
-        va_end(ap);
-
-        _timestamp_add(buf);
-    }
+    if (_timestamp_trace != NULL)
+        _timestamp_trace(id, arg0, arg1);
 }
 
 
@@ -21,11 +21,13 @@ USA.
 #ifndef __OHM_RESOURCE_TIMESTAMP_H__
 #define __OHM_RESOURCE_TIMESTAMP_H__
 
+#include <stdint.h>
+
 /* hack to avoid multiple includes */
 typedef struct _OhmPlugin OhmPlugin;
 
 void timestamp_init(OhmPlugin *);
-void timestamp_add(const char *, ...);
+void timestamp_add(const char *, uint32_t, uint32_t);
 
 #endif	/* __OHM_RESOURCE_TIMESTAMP_H__ */
 
@@ -28,19 +28,19 @@ USA.
 #include "plugin.h"
 #include "transaction.h"
 
-#define HASH_BITS      10
-#define HASH_DIM       (1 << HASH_BITS)
-#define HASH_MASK      (HASH_DIM - 1)
-#define HASH_INDEX(i)  ((i) & HASH_MASK)
+#define HASH_MIN_BITS  6
+#define HASH_HIGH(n)   (((n) * 3) / 4)   /* grow above 75% load */
 
-#define ALLOC_DIM      1024
-#define ALLOC_JUNK     (ALLOC_DIM * sizeof(uint32_t))
+#define IDSET_LINEAR   8                 /* scan linearly up to this */
+#define IDSET_HASH(i)  ((uint32_t)(i) * 2654435761U)
 
 
 typedef struct {
-    int       junks;
+    int       size;
     int       length;
-    uint32_t *table;    
+    uint32_t *table;    /* resource set ids in insertion order */
+    int       hsize;
+    int      *hash;     /* open addressed index of table (+1), 0 if empty */
 } resset_table_t;
 
 typedef struct {
@@ -48,23 +48,35 @@ typedef struct {
     void                   *user_data;
 } completion_t;
 
-typedef struct {
-    uint32_t           id;
-    int                refcnt;
-    resset_table_t     resset;
-    completion_t       completion;
+typedef struct transaction_s {
+    struct transaction_s  *next;
+    uint32_t               id;
+    int                    refcnt;
+    resset_table_t         resset;
+    completion_t           completion;
 } transaction_t;
 
+typedef struct {
+    transaction_t  **buckets;
+    uint32_t         dim;       /* always a power of two */
+    uint32_t         count;
+} transaction_table_t;
+
 
-static transaction_t   transactions[HASH_DIM];
-static uint32_t        txwrite;
-static uint32_t        txread = 1;
+static transaction_table_t  txtable;
+static uint32_t             txwrite;
+static uint32_t             txread = 1;
 
 static transaction_t *find_transaction(uint32_t);
+static int add_transaction(transaction_t *, uint32_t);
+static void remove_transaction(transaction_t *);
+static int resize_table(uint32_t);
 static int add_resource_set(transaction_t *, uint32_t);
+static int rehash_resource_sets(resset_table_t *, int);
 static void complete_transaction(uint32_t);
 
 
+
 /*! \addtogroup pubif
  *  Functions
  *  @{
@@ -83,17 +95,23 @@ uint32_t transaction_create(transaction_callback_t callback, void *user_data)
 {
     static uint32_t  count = NO_TRANSACTION;
 
-    uint32_t       txid = ++count;
-    int            idx  = HASH_INDEX(txid);
-    transaction_t *tx   = transactions + idx;
+    uint32_t       txid;
+    transaction_t *tx;
 
-    if (tx->id != NO_TRANSACTION) {
-        OHM_ERROR("resource: transaction table overflow: transaction %u",txid);
+    if (++count == NO_TRANSACTION)
+        ++count;
+
+    txid = count;
+
+    if ((tx = malloc(sizeof(transaction_t))) == NULL ||
+        !add_transaction(tx, txid))
+    {
+        OHM_ERROR("resource: can't create transaction %u: out of memory",txid);
+        free(tx);
         txid = NO_TRANSACTION;
     }
     else {
-        memset(tx, 0, sizeof(transaction_t));
-        tx->id     = txid;
+        memset(&tx->resset, 0, sizeof(tx->resset));
         tx->refcnt = 1;
 
         tx->completion.function  = callback;
@@ -171,39 +189,167 @@ int transaction_unref(uint32_t txid)
 
 static transaction_t *find_transaction(uint32_t txid)
 {
-    int            idx = HASH_INDEX(txid);
-    transaction_t *tx  = transactions + idx;
+    transaction_t *tx;
+
+    if (txid == NO_TRANSACTION || txtable.buckets == NULL)
+        return NULL;
+
+    for (tx = txtable.buckets[txid & (txtable.dim - 1)];  tx;  tx = tx->next) {
+        if (tx->id == txid)
+            return tx;
+    }
+
+    return NULL;
+}
+
+static int add_transaction(transaction_t *tx, uint32_t txid)
+{
+    uint32_t idx;
+
+    if (txtable.buckets == NULL || txtable.count+1 > HASH_HIGH(txtable.dim)) {
+        if (!resize_table(txtable.dim ? txtable.dim * 2 : 1 << HASH_MIN_BITS))
+            return FALSE;
+    }
+
+    idx = txid & (txtable.dim - 1);
+
+    tx->id   = txid;
+    tx->next = txtable.buckets[idx];
+    txtable.buckets[idx] = tx;
+    txtable.count++;
+
+    return TRUE;
+}
+
+static void remove_transaction(transaction_t *tx)
+{
+    transaction_t **prev;
+
+    for (prev = &txtable.buckets[tx->id & (txtable.dim - 1)];
+         *prev != NULL;
+         prev = &(*prev)->next)
+    {
+        if (*prev == tx) {
+            *prev = tx->next;
+            txtable.count--;
+            return;
+        }
+    }
+
+    OHM_ERROR("resource: failed to remove transaction %u: not found", tx->id);
+}
+
+static int resize_table(uint32_t dim)
+{
+    transaction_t **buckets;
+    transaction_t  *tx, *next;
+    uint32_t        i, idx;
+
+    if ((buckets = calloc(dim, sizeof(transaction_t *))) == NULL)
+        return FALSE;
+
+    for (i = 0;  i < txtable.dim;  i++) {
+        for (tx = txtable.buckets[i];  tx != NULL;  tx = next) {
+            next = tx->next;
+            idx  = tx->id & (dim - 1);
+
+            tx->next = buckets[idx];
+            buckets[idx] = tx;
+        }
+    }
+
+    OHM_DEBUG(DBG_TRANSACT, "transaction table resized %u -> %u (%u entries)",
+              txtable.dim, dim, txtable.count);
+
+    free(txtable.buckets);
+
+    txtable.buckets = buckets;
+    txtable.dim     = dim;
 
-    return (txid != NO_TRANSACTION && txid == tx->id) ? tx : NULL;
+    return TRUE;
 }
 
 
 static int add_resource_set(transaction_t *tx, uint32_t rsid)
 {
-    int   idx   = tx->resset.length;
-    int   junks;
-    int   size;
-    void *mem;
-    int   i;
-
-    for (i = 0;    i < tx->resset.length;   i++) {
-        if (tx->resset.table[i] == rsid)
-            return TRUE;        /* it is already there */
+    resset_table_t *rt = &tx->resset;
+    uint32_t        mask;
+    uint32_t        h;
+    int             size;
+    void           *mem;
+    int             i;
+
+    if (rt->hash == NULL) {
+        for (i = 0;    i < rt->length;   i++) {
+            if (rt->table[i] == rsid)
+                return TRUE;    /* it is already there */
+        }
     }
-    
-    if ((junks = (idx + ALLOC_JUNK) / ALLOC_JUNK) > tx->resset.junks) {
-        size = junks * ALLOC_JUNK * sizeof(uint32_t *);
-        mem  = realloc(tx->resset.table, size);
-        
+    else {
+        mask = rt->hsize - 1;
+
+        for (h = IDSET_HASH(rsid) & mask;  (i = rt->hash[h]);  h = (h+1) & mask){
+            if (rt->table[i - 1] == rsid)
+                return TRUE;    /* it is already there */
+        }
+    }
+
+    if (rt->length >= rt->size) {
+        size = rt->size ? rt->size * 2 : IDSET_LINEAR;
+        mem  = realloc(rt->table, size * sizeof(uint32_t));
+
         if (mem == NULL)
             return FALSE;
 
-        tx->resset.junks = junks;
-        tx->resset.table = mem;
+        rt->size  = size;
+        rt->table = mem;
+    }
+
+    rt->table[rt->length++] = rsid;
+
+    if (rt->length > IDSET_LINEAR) {
+        if (rt->hash == NULL || rt->length > HASH_HIGH(rt->hsize)) {
+            if (!rehash_resource_sets(rt, rt->hsize ? rt->hsize * 2 :
+                                                      IDSET_LINEAR * 4))
+            {
+                rt->length--;
+                return FALSE;
+            }
+        }
+        else {
+            mask = rt->hsize - 1;
+
+            for (h = IDSET_HASH(rsid) & mask;  rt->hash[h];  h = (h+1) & mask)
+                ;
+
+            rt->hash[h] = rt->length;
+        }
     }
 
-    tx->resset.length = idx + 1;
-    tx->resset.table[idx] = rsid;
+    return TRUE;
+}
+
+static int rehash_resource_sets(resset_table_t *rt, int hsize)
+{
+    int      *hash;
+    uint32_t  mask = hsize - 1;
+    uint32_t  h;
+    int       i;
+
+    if ((hash = calloc(hsize, sizeof(int))) == NULL)
+        return FALSE;
+
+    for (i = 0;  i < rt->length;  i++) {
+        for (h = IDSET_HASH(rt->table[i]) & mask;  hash[h];  h = (h+1) & mask)
+            ;
+
+        hash[h] = i + 1;
+    }
+
+    free(rt->hash);
+
+    rt->hash  = hash;
+    rt->hsize = hsize;
 
     return TRUE;
 }
@@ -231,15 +377,17 @@ static void complete_transaction(uint32_t txid)
                                         tx->id, tx->completion.user_data);
             }
         
+            remove_transaction(tx);
+
             free(tx->resset.table);
-            memset(tx, 0, sizeof(*tx));
+            free(tx->resset.hash);
+            free(tx);
             
             txread = id + 1;
         }
     }
 }
 
-
 /* 
  * Local Variables:
  * c-basic-offset: 4
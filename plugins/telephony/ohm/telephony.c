@@ -37,10 +37,10 @@ USA.
 #include "telephony.h"
 #include "list.h"
 
-/* (sp_)timestamping macros */
+/* (sp_)timestamping macros, step must be a static string */
 #define TIMESTAMP_ADD(step) do {                \
-        if (timestamp_add)                      \
-            timestamp_add(step);                \
+        if (timestamp_trace)                    \
+            timestamp_trace(step, 0, 0);        \
     } while (0)
 
 #define PLUGIN_NAME   "telephony"
@@ -59,11 +59,32 @@ OHM_DEBUG_PLUGIN(telephony,
                  OHM_DEBUG_FLAG("call", "call events", &DBG_CALL));
 
 OHM_IMPORTABLE(int, resolve, (char *goal, char **locals));
-OHM_IMPORTABLE(void, timestamp_add, (const char *step));
+OHM_IMPORTABLE(void, timestamp_trace, (const char *id,
+                                       uint32_t arg0, uint32_t arg1));
 OHM_IMPORTABLE(void *, timer_add  , (uint32_t delay,
                                      resconn_timercb_t callback,
                                      void *data));
 OHM_IMPORTABLE(void  , timer_del  , (void *timer));
+OHM_IMPORTABLE(int, add_signal, (DBusBusType type,
+                                 const char *path, const char *interface,
+                                 const char *member, const char *signature,
+                                 const char *sender,
+                                 DBusObjectPathMessageFunction handler,
+                                 void *data));
+OHM_IMPORTABLE(int, del_signal, (DBusBusType type,
+                                 const char *path, const char *interface,
+                                 const char *member, const char *signature,
+                                 const char *sender,
+                                 DBusObjectPathMessageFunction handler,
+                                 void *data));
+OHM_IMPORTABLE(int, add_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
+OHM_IMPORTABLE(int, del_watch, (DBusBusType type, const char *name,
+                                void (*handler)(const char *, const char *,
+                                                const char *, void *),
+                                void *data));
 
 
 
@@ -111,6 +132,93 @@ DBUS_METHOD_HANDLER(dtmf_start_request);
 DBUS_METHOD_HANDLER(dtmf_stop_request);
 DBUS_SIGNAL_HANDLER(name_owner_changed);
 
+static void se_owner_changed(const char *name, const char *before,
+                             const char *after, void *data);
+
+
+/*
+ * Telepathy signals we are interested in. If the dbus plugin is available
+ * and we are on the shared session bus connection we let it route each
+ * signal directly to its handler, so unrelated traffic never reaches us.
+ * On a private connection (and for replaying deferred events) we filter
+ * the signals ourselves and look the handler up by the interned interface
+ * and member names, so signals and method calls arrive on the same
+ * connection.
+ */
+
+#define SIG_MATCH 0x1                   /* needs a match rule when filtering */
+#define SIG_ROUTE 0x2                   /* routed by the dbus plugin */
+
+typedef struct {
+    const char                    *interface;
+    const char                    *member;
+    DBusObjectPathMessageFunction  handler;
+    int                            flags;      /* SIG_* */
+    GQuark                         iq;         /* interned interface */
+    GQuark                         mq;         /* interned member */
+} bus_signal_t;
+
+#define BUS_SIGNAL(i, m, h, flags) { i, m, h, flags, 0, 0 }
+#define SIG_BOTH (SIG_MATCH | SIG_ROUTE)
+
+static bus_signal_t bus_signals[] = {
+    BUS_SIGNAL(DBUS_INTERFACE_DBUS  , "NameOwnerChanged"    ,
+               name_owner_changed                           , 0        ),
+    BUS_SIGNAL(TP_CONNECTION        , NEW_CHANNEL           ,
+               channel_new                                  , SIG_ROUTE),
+    BUS_SIGNAL(TP_CONN_IFREQ        , NEW_CHANNELS          ,
+               channels_new                                 , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL           , CHANNEL_CLOSED        ,
+               channel_closed                               , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_GROUP     , MEMBERS_CHANGED       ,
+               members_changed                              , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_MEDIA     , STREAM_ADDED          ,
+               stream_added                                 , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_MEDIA     , STREAM_REMOVED        ,
+               stream_removed                               , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_CALL_DRAFT, CONTENT_ADDED         ,
+               content_added                                , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_CALL_DRAFT, CONTENT_REMOVED       ,
+               content_removed                              , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_HOLD      , HOLD_STATE_CHANGED    ,
+               hold_state_changed                           , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_STATE     , CALL_STATE_CHANGED    ,
+               call_state_changed                           , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_CALL_DRAFT, CALL_STATE_CHANGED    ,
+               call_draft_state_changed                     , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_CONF_DRAFT, CHANNEL_MERGED        ,
+               channel_merged                               , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_CONF_DRAFT, CHANNEL_REMOVED       ,
+               channel_removed                              , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_CONF      , CHANNEL_MERGED        ,
+               channel_merged                               , SIG_BOTH ),
+    BUS_SIGNAL(TP_CHANNEL_CONF      , CHANNEL_REMOVED       ,
+               channel_removed                              , SIG_BOTH ),
+    BUS_SIGNAL(TP_CONFERENCE        , MEMBER_CHANNEL_ADDED  ,
+               member_channel_added                         , SIG_BOTH ),
+    BUS_SIGNAL(TP_CONFERENCE        , MEMBER_CHANNEL_REMOVED,
+               member_channel_removed                       , SIG_BOTH ),
+    BUS_SIGNAL(TELEPHONY_INTERFACE  , CALL_ENDED            ,
+               call_end                                     , SIG_BOTH ),
+    BUS_SIGNAL(TP_DIALSTRINGS       , SENDING_DIALSTRING    ,
+               sending_dialstring                           , SIG_BOTH ),
+    BUS_SIGNAL(TP_DIALSTRINGS       , STOPPED_DIALSTRING    ,
+               stopped_dialstring                           , SIG_BOTH ),
+    BUS_SIGNAL(NULL, NULL, NULL, 0)
+};
+
+#undef SIG_BOTH
+#undef BUS_SIGNAL
+
+static GHashTable *signal_table;         /* bus_signals by (iq, mq) */
+static int         signal_routed;        /* routed by the dbus plugin */
+static int         bus_private;          /* bus is our own connection */
+
+static int  signal_table_init(void);
+static void signal_table_exit(void);
+static int  signal_register(void);
+static void signal_unregister(void);
+
 
 static int tp_start_dtmf(call_t *call, unsigned int stream, int tone);
 static int tp_stop_dtmf (call_t *call, unsigned int stream);
@@ -141,6 +249,7 @@ static inline int need_video(void);
  */
 
 static GHashTable *calls;                       /* table of current calls */
+static GHashTable *callids;                     /* calls by ID quark */
 static int         ncscall;                     /* number of CS calls */
 static int         nipcall;                     /* number of ohter calls */
 static int         nvideo;                      /* number of calls with video */
@@ -327,6 +436,8 @@ bus_init(const char *address)
 
     dbus_error_init(&err);
 
+    bus_private = (address != NULL);
+
     if (address == NULL) {
         if ((bus = dbus_bus_get(DBUS_BUS_SESSION, &err)) == NULL) {
             if (dbus_error_is_set(&err))
@@ -368,72 +479,10 @@ bus_init(const char *address)
      * set up DBUS signal handling
      */
     
-    if (!bus_add_match("signal", TELEPHONY_INTERFACE, NULL, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_GROUP, MEMBERS_CHANGED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CONN_IFREQ, NEW_CHANNELS, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL, CHANNEL_CLOSED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_HOLD, HOLD_STATE_CHANGED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_STATE, CALL_STATE_CHANGED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_CALL_DRAFT, CALL_STATE_CHANGED,
-                       NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_CALL_DRAFT, CONTENT_ADDED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_CALL_DRAFT, CONTENT_REMOVED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_DIALSTRINGS, SENDING_DIALSTRING, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_DIALSTRINGS, STOPPED_DIALSTRING, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_MEDIA, STREAM_ADDED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_MEDIA, STREAM_REMOVED, NULL))
-        exit(1);
-
-    if (!bus_add_match("signal", TP_CHANNEL_CONF_DRAFT, CHANNEL_MERGED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_CHANNEL_CONF_DRAFT, CHANNEL_REMOVED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_CHANNEL_CONF, CHANNEL_MERGED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_CHANNEL_CONF, CHANNEL_REMOVED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_CONFERENCE, MEMBER_CHANNEL_ADDED, NULL))
-        exit(1);
-    
-    if (!bus_add_match("signal", TP_CONFERENCE, MEMBER_CHANNEL_REMOVED, NULL))
+    if (!signal_register())
         exit(1);
 
     bus_query_name(TP_STREAMENGINE_NAME, se_name_query_cb, NULL);
-    bus_track_name(TP_STREAMENGINE_NAME, TRUE);
-    
-    if (!dbus_connection_add_filter(bus, dispatch_signal, NULL, NULL)) {
-        OHM_ERROR("Failed to add DBUS filter for signal dispatching.");
-        exit(1);
-    }
-
     
     /*
      * set up our DBUS methods
@@ -486,26 +535,8 @@ bus_exit(void)
         dbus_error_init(&err);
     }
     dbus_connection_unregister_object_path(bus, TELEPHONY_PATH);
-    dbus_connection_remove_filter(bus, dispatch_signal, NULL);
-
-    bus_track_name(TP_STREAMENGINE_NAME, FALSE);
-    bus_del_match("signal", TELEPHONY_INTERFACE, NULL, NULL);
-    bus_del_match("signal", TP_CHANNEL_GROUP, MEMBERS_CHANGED, NULL);
-    bus_del_match("signal", TP_CONN_IFREQ, NEW_CHANNELS, NULL);
-    bus_del_match("signal", TP_CHANNEL, CHANNEL_CLOSED, NULL);
-    bus_del_match("signal", TP_CHANNEL_HOLD, HOLD_STATE_CHANGED, NULL);
-    bus_del_match("signal", TP_CHANNEL_STATE, CALL_STATE_CHANGED, NULL);
-    bus_del_match("signal", TP_CHANNEL_CALL_DRAFT, CALL_STATE_CHANGED, NULL);
-    bus_del_match("signal", TP_DIALSTRINGS, SENDING_DIALSTRING, NULL);
-    bus_del_match("signal", TP_DIALSTRINGS, STOPPED_DIALSTRING, NULL);
-    bus_del_match("signal", TP_CHANNEL_MEDIA, STREAM_ADDED, NULL);
-    bus_del_match("signal", TP_CHANNEL_MEDIA, STREAM_REMOVED, NULL);
-    bus_del_match("signal", TP_CHANNEL_CONF_DRAFT, CHANNEL_MERGED, NULL);
-    bus_del_match("signal", TP_CHANNEL_CONF_DRAFT, CHANNEL_REMOVED, NULL);
-    bus_del_match("signal", TP_CHANNEL_CONF, CHANNEL_MERGED, NULL);
-    bus_del_match("signal", TP_CHANNEL_CONF, CHANNEL_REMOVED, NULL);
-    bus_del_match("signal", TP_CONFERENCE, MEMBER_CHANNEL_ADDED, NULL);
-    bus_del_match("signal", TP_CONFERENCE, MEMBER_CHANNEL_REMOVED, NULL);
+
+    signal_unregister();
     
     dbus_connection_unref(bus);
     bus = NULL;
@@ -894,83 +925,188 @@ short_path(const char *path)
 static DBusHandlerResult
 dispatch_signal(DBusConnection *c, DBusMessage *msg, void *data)
 {
-#define MATCHES(i, m) (!strcmp(interface, (i)) && !strcmp(member, (m)))
-
-    const char *interface = dbus_message_get_interface(msg);
-    const char *member    = dbus_message_get_member(msg);
+    const char   *interface = dbus_message_get_interface(msg);
+    const char   *member    = dbus_message_get_member(msg);
+    bus_signal_t  key, *sig;
 
     if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL)
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    if (!interface || !member)
+    if (!interface || !member || signal_table == NULL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    /* names we have never interned cannot be in the table */
+    if (!(key.iq = g_quark_try_string(interface)) ||
+        !(key.mq = g_quark_try_string(member)))
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    if ((sig = g_hash_table_lookup(signal_table, &key)) == NULL)
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    if (MATCHES("org.freedesktop.DBus", "NameOwnerChanged"))
-        return name_owner_changed(c, msg, data);
+    return sig->handler(c, msg, data);
+}
+
+
+/********************
+ * signal_hash
+ ********************/
+static guint
+signal_hash(gconstpointer key)
+{
+    const bus_signal_t *sig = (const bus_signal_t *)key;
+
+    return (sig->iq * 2654435761U) ^ sig->mq;
+}
+
+
+/********************
+ * signal_equal
+ ********************/
+static gboolean
+signal_equal(gconstpointer key1, gconstpointer key2)
+{
+    const bus_signal_t *sig1 = (const bus_signal_t *)key1;
+    const bus_signal_t *sig2 = (const bus_signal_t *)key2;
+
+    return sig1->iq == sig2->iq && sig1->mq == sig2->mq;
+}
 
-    if (MATCHES(TP_CONNECTION, NEW_CHANNEL))
-        return channel_new(c, msg, data);
 
-    if (MATCHES(TP_CONN_IFREQ, NEW_CHANNELS))
-        return channels_new(c, msg, data);
+/********************
+ * signal_table_init
+ ********************/
+static int
+signal_table_init(void)
+{
+    bus_signal_t *sig;
 
-    if (MATCHES(TP_CHANNEL, CHANNEL_CLOSED))
-        return channel_closed(c, msg, data);
+    if (signal_table != NULL)
+        return TRUE;
 
-    if (MATCHES(TP_CHANNEL_GROUP, MEMBERS_CHANGED))
-        return members_changed(c, msg, data);
+    if ((signal_table = g_hash_table_new(signal_hash, signal_equal)) == NULL)
+        return FALSE;
 
-    if (MATCHES(TP_CHANNEL_MEDIA, STREAM_ADDED))
-        return stream_added(c, msg, data);
+    for (sig = bus_signals; sig->interface != NULL; sig++) {
+        sig->iq = g_quark_from_static_string(sig->interface);
+        sig->mq = g_quark_from_static_string(sig->member);
+        g_hash_table_insert(signal_table, sig, sig);
+    }
 
-    if (MATCHES(TP_CHANNEL_MEDIA, STREAM_REMOVED))
-        return stream_removed(c, msg, data);
+    return TRUE;
+}
 
-    if (MATCHES(TP_CHANNEL_CALL_DRAFT, CONTENT_ADDED))
-        return content_added(c, msg, data);
 
-    if (MATCHES(TP_CHANNEL_CALL_DRAFT, CONTENT_REMOVED))
-        return content_removed(c, msg, data);
-    
-    if (MATCHES(TP_CHANNEL_HOLD, HOLD_STATE_CHANGED))
-        return hold_state_changed(c, msg, data);
+/********************
+ * signal_table_exit
+ ********************/
+static void
+signal_table_exit(void)
+{
+    if (signal_table != NULL) {
+        g_hash_table_destroy(signal_table);
+        signal_table = NULL;
+    }
+}
 
-    if (MATCHES(TP_CHANNEL_STATE, CALL_STATE_CHANGED))
-        return call_state_changed(c, msg, data);
 
-    if (MATCHES(TP_CHANNEL_CALL_DRAFT, CALL_STATE_CHANGED))
-        return call_draft_state_changed(c, msg, data);
+/********************
+ * signal_register
+ ********************/
+static int
+signal_register(void)
+{
+#define IMPORT_METHOD(name, ptr) ({                                     \
+            signature = (char *)ptr##_SIGNATURE;                        \
+            ohm_module_find_method((name), &signature, (void *)&(ptr)); \
+        })
 
-    if (MATCHES(TP_CHANNEL_CONF_DRAFT, CHANNEL_MERGED))
-        return channel_merged(c, msg, data);
+    bus_signal_t *sig;
+    char         *signature;
 
-    if (MATCHES(TP_CHANNEL_CONF_DRAFT, CHANNEL_REMOVED))
-        return channel_removed(c, msg, data);
+    if (!signal_table_init()) {
+        OHM_ERROR("Failed to create DBUS signal dispatch table.");
+        return FALSE;
+    }
 
-    if (MATCHES(TP_CHANNEL_CONF, CHANNEL_MERGED))
-        return channel_merged(c, msg, data);
+    /* the dbus plugin can only route signals of the shared connection */
+    signal_routed = !bus_private &&
+        IMPORT_METHOD("dbus.add_signal", add_signal) &&
+        IMPORT_METHOD("dbus.del_signal", del_signal) &&
+        IMPORT_METHOD("dbus.add_watch" , add_watch)  &&
+        IMPORT_METHOD("dbus.del_watch" , del_watch);
+
+    if (signal_routed) {
+        for (sig = bus_signals; sig->interface != NULL; sig++) {
+            if (!(sig->flags & SIG_ROUTE))
+                continue;
+            
+            if (!add_signal(DBUS_BUS_SESSION, NULL, sig->interface,
+                            sig->member, NULL, NULL, sig->handler, NULL)) {
+                OHM_ERROR("Failed to register DBUS signal %s.%s.",
+                          sig->interface, sig->member);
+                return FALSE;
+            }
+        }
 
-    if (MATCHES(TP_CHANNEL_CONF, CHANNEL_REMOVED))
-        return channel_removed(c, msg, data);
+        if (!add_watch(DBUS_BUS_SESSION, TP_STREAMENGINE_NAME,
+                       se_owner_changed, NULL))
+            OHM_ERROR("Failed to track DBUS name %s.", TP_STREAMENGINE_NAME);
+    }
+    else {
+        for (sig = bus_signals; sig->interface != NULL; sig++) {
+            if (!(sig->flags & SIG_MATCH))
+                continue;
 
-    if (MATCHES(TP_CONFERENCE, MEMBER_CHANNEL_ADDED))
-        return member_channel_added(c, msg, data);
+            if (!bus_add_match("signal", (char *)sig->interface,
+                               (char *)sig->member, NULL))
+                return FALSE;
+        }
 
-    if (MATCHES(TP_CONFERENCE, MEMBER_CHANNEL_REMOVED))
-        return member_channel_removed(c, msg, data);
+        bus_track_name(TP_STREAMENGINE_NAME, TRUE);
     
-    if (MATCHES(TELEPHONY_INTERFACE, CALL_ENDED))
-        return call_end(c, msg, data);
+        if (!dbus_connection_add_filter(bus, dispatch_signal, NULL, NULL)) {
+            OHM_ERROR("Failed to add DBUS filter for signal dispatching.");
+            return FALSE;
+        }
+    }
 
-    if (MATCHES(TP_DIALSTRINGS, SENDING_DIALSTRING))
-        return sending_dialstring(c, msg, data);
+    return TRUE;
 
-    if (MATCHES(TP_DIALSTRINGS, STOPPED_DIALSTRING))
-        return stopped_dialstring(c, msg, data);
-        
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+#undef IMPORT_METHOD
+}
+
+
+/********************
+ * signal_unregister
+ ********************/
+static void
+signal_unregister(void)
+{
+    bus_signal_t *sig;
+
+    if (signal_routed) {
+        for (sig = bus_signals; sig->interface != NULL; sig++) {
+            if (sig->flags & SIG_ROUTE)
+                del_signal(DBUS_BUS_SESSION, NULL, sig->interface,
+                           sig->member, NULL, NULL, sig->handler, NULL);
+        }
+
+        del_watch(DBUS_BUS_SESSION, TP_STREAMENGINE_NAME,
+                  se_owner_changed, NULL);
 
-#undef MATCHES
+        signal_routed = FALSE;
+    }
+    else {
+        dbus_connection_remove_filter(bus, dispatch_signal, NULL);
+
+        bus_track_name(TP_STREAMENGINE_NAME, FALSE);
+        
+        for (sig = bus_signals; sig->interface != NULL; sig++) {
+            if (sig->flags & SIG_MATCH)
+                bus_del_match("signal", (char *)sig->interface,
+                              (char *)sig->member, NULL);
+        }
+    }
 }
 
 
@@ -981,6 +1117,7 @@ static DBusHandlerResult
 channel_new(DBusConnection *c, DBusMessage *msg, void *data)
 {
     char            *path, *type;
+    char            *interfaces[1] = { NULL };
     channel_event_t  event;
     
     (void)c;
@@ -991,7 +1128,16 @@ channel_new(DBusConnection *c, DBusMessage *msg, void *data)
                               DBUS_TYPE_STRING, &type,
                               DBUS_TYPE_INVALID)) {
         if (!strcmp(type, TP_CHANNEL_MEDIA)) {
-            event.type = EVENT_NEW_CHANNEL;
+            /*
+             * NewChannel carries no channel properties, so register the
+             * call with no peer, members or interfaces and an unknown
+             * direction, unlike NewChannels below.
+             */
+            memset(&event, 0, sizeof(event));
+            event.type       = EVENT_NEW_CHANNEL;
+            event.call_type  = CALL_TYPE_SM;
+            event.dir        = DIR_UNKNOWN;
+            event.interfaces = &interfaces[0];
             event.name = dbus_message_get_sender(msg);
             event.path = path;
             if ((event.call = call_lookup(path)) != NULL)
@@ -2159,6 +2305,23 @@ name_owner_changed(DBusConnection *c, DBusMessage *msg, void *data)
     if (strcmp(name, TP_STREAMENGINE_NAME))
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
+    se_owner_changed(name, before, after, NULL);
+    
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+/********************
+ * se_owner_changed
+ ********************/
+static void
+se_owner_changed(const char *name, const char *before, const char *after,
+                 void *data)
+{
+    (void)name;
+    (void)before;
+    (void)data;
+
     if (!after || !after[0]) {
         OHM_INFO("Telepathy stream engine went down.");
         video_pid = 0;
@@ -2170,8 +2333,6 @@ name_owner_changed(DBusConnection *c, DBusMessage *msg, void *data)
         
         bus_query_pid(after, se_pid_query_cb, NULL);
     }
-    
-    return DBUS_HANDLER_RESULT_HANDLED;
 }
 
 
@@ -2969,6 +3130,11 @@ call_init(void)
         exit(1);
     }
 
+    if ((callids = g_hash_table_new(g_direct_hash, g_direct_equal)) == NULL) {
+        OHM_ERROR("failed to allocate call ID table");
+        exit(1);
+    }
+
     fptr = (GDestroyNotify)event_destroy;
     if ((deferred = g_hash_table_new_full(hptr, eptr, NULL, fptr)) == NULL) {
         OHM_ERROR("failed to allocate delayed event table");
@@ -2985,13 +3151,16 @@ call_init(void)
 void
 call_exit(void)
 {
+    if (callids != NULL)
+        g_hash_table_destroy(callids);
+
     if (calls != NULL)
         g_hash_table_destroy(calls);
 
     if (deferred != NULL)
         g_hash_table_destroy(deferred);
 
-    calls = deferred = NULL;
+    calls = deferred = callids = NULL;
     ncscall = 0;
     nipcall = 0;
 }
@@ -3053,6 +3222,7 @@ call_register(call_type_t type, const char *path, const char *name,
               char **interfaces)
 {
     call_t *call;
+    char    id[16];
 
     TIMESTAMP_ADD("telephony: call_register");
 
@@ -3095,7 +3265,15 @@ call_register(call_type_t type, const char *path, const char *name,
     call->id    = callid++;
     call->state = STATE_UNKNOWN;
 
+    /*
+     * Policy actions are keyed by the decimal call ID as fact field names,
+     * so index calls by the same quark to resolve actions without parsing.
+     */
+    snprintf(id, sizeof(id), "%d", call->id);
+    call->idq = g_quark_from_string(id);
+
     g_hash_table_insert(calls, call->path, call);
+    g_hash_table_insert(callids, GUINT_TO_POINTER(call->idq), call);
     
     if (IS_CELLULAR(path))
         ncscall++;
@@ -3144,6 +3322,7 @@ call_unregister(const char *path)
     
     cs = !strncmp(path, TP_RING, sizeof(TP_RING) - 1);
 
+    g_hash_table_remove(callids, GUINT_TO_POINTER(call->idq));
     g_hash_table_remove(calls, path);
     
     if (cs)
@@ -3172,17 +3351,15 @@ call_lookup(const char *path)
 
 
 /********************
- * has_id
+ * call_find_quark
  ********************/
-static gboolean
-has_id(gpointer key, gpointer value, gpointer data)
+static call_t *
+call_find_quark(GQuark idq)
 {
-    call_t *call = (call_t *)value;
-    int     id   = (int)data;
-
-    (void)key;
-
-    return call->id == id;
+    if (idq == 0)
+        return NULL;
+    else
+        return g_hash_table_lookup(callids, GUINT_TO_POINTER(idq));
 }
 
 
@@ -3192,7 +3369,10 @@ has_id(gpointer key, gpointer value, gpointer data)
 call_t *
 call_find(int id)
 {
-    return g_hash_table_find(calls, has_id, (gpointer)id);
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "%d", id);
+    return call_find_quark(g_quark_try_string(buf));
 }
 
 
@@ -4004,9 +4184,9 @@ policy_enforce(event_t *event)
     GValue     *value;
     GQuark      quark;
     GSList     *l;
-    char       *field, *end;
+    char       *field;
     const char *action;
-    int         id, status, err;
+    int         status, err;
     call_t     *call;
 
     if ((l = ohm_fact_store_get_facts_by_name(store, FACT_ACTIONS)) == NULL) {
@@ -4044,16 +4224,9 @@ policy_enforce(event_t *event)
         }
 
         action = g_value_get_string(value);
-        id     = strtoul(field, &end, 10);
 
-        if (end != NULL && *end != '\0') {
-            OHM_ERROR("Invalid call id %s.", field);
-            status = EINVAL;
-            continue;
-        }
-
-        if ((call = call_find(id)) == NULL) {
-            OHM_ERROR("Action %s for unknown call #%d.", action, id);
+        if ((call = call_find_quark(quark)) == NULL) {
+            OHM_ERROR("Action %s for unknown call #%s.", action, field);
             status = EINVAL;
             continue;
         }
@@ -4161,9 +4334,15 @@ run_hook(hook_type_t which)
 int
 set_string_field(OhmFact *fact, const char *field, const char *value)
 {
-    GValue *gval = ohm_value_from_string(value);
+    GValue *gval = ohm_fact_get(fact, field);
+
+    /* don't trigger a factstore update for an unchanged value */
+    if (gval != NULL && G_VALUE_TYPE(gval) == G_TYPE_STRING &&
+        value != NULL && g_value_get_string(gval) != NULL &&
+        !strcmp(g_value_get_string(gval), value))
+        return TRUE;
 
-    if (gval == NULL)
+    if ((gval = ohm_value_from_string(value)) == NULL)
         return FALSE;
 
     ohm_fact_set(fact, field, gval);
@@ -4177,9 +4356,13 @@ set_string_field(OhmFact *fact, const char *field, const char *value)
 int
 set_int_field(OhmFact *fact, const char *field, int value)
 {
-    GValue *gval = ohm_value_from_int(value);
+    GValue *gval = ohm_fact_get(fact, field);
+
+    if (gval != NULL && G_VALUE_TYPE(gval) == G_TYPE_INT &&
+        g_value_get_int(gval) == value)
+        return TRUE;
 
-    if (gval == NULL)
+    if ((gval = ohm_value_from_int(value)) == NULL)
         return FALSE;
 
     ohm_fact_set(fact, field, gval);
@@ -4255,7 +4438,7 @@ policy_call_update(call_t *call, int fields)
     OhmFact    *fact;
     const char *state, *dir, *parent, *video;
     char        id[16];
-    int         order, emerg, conn;
+    int         order, emerg, conn, success;
     
     if (call == NULL)
         return FALSE;
@@ -4272,9 +4455,17 @@ policy_call_update(call_t *call, int fields)
     conn   = (fields & UPDATE_CONNECT) ? call->connected : 0;
     video  = (fields & UPDATE_VIDEO)   ? (call->video ? "yes" : "no") : NULL;
 
+    /*
+     * Apply all field changes in a single factstore transaction. The store
+     * still emits an updated signal for each field that is set, so the
+     * setters below skip the fields whose value did not change.
+     */
+    ohm_fact_store_transaction_push(store);
+
     if (fields & UPDATE_PARENT) {
         if (call->parent == NULL) {
-            ohm_fact_set(fact, FACT_FIELD_PARENT, NULL);
+            if (ohm_fact_get(fact, FACT_FIELD_PARENT) != NULL)
+                ohm_fact_set(fact, FACT_FIELD_PARENT, NULL);
             parent = NULL;
         }
         else {
@@ -4285,21 +4476,18 @@ policy_call_update(call_t *call, int fields)
     else
         parent = NULL;
     
-    if ((state  && !set_string_field(fact, FACT_FIELD_STATE    , state))  ||
-        (dir    && !set_string_field(fact, FACT_FIELD_DIR      , dir))    ||
-        (parent && !set_string_field(fact, FACT_FIELD_PARENT   , parent)) ||
-        (order  && !set_int_field   (fact, FACT_FIELD_ORDER    , order))  ||
-        (conn   && !set_string_field(fact, FACT_FIELD_CONNECTED, "yes"))) {
-        OHM_ERROR("Failed to update fact for call %s", short_path(call->path));
-        return FALSE;
-    }
-    
-    if (emerg && !set_string_field(fact, FACT_FIELD_EMERG, "yes")) {
-        OHM_ERROR("Failed to update fact for call %s", short_path(call->path));
-        return FALSE;
-    }
+    success =
+        (!state  || set_string_field(fact, FACT_FIELD_STATE    , state))  &&
+        (!dir    || set_string_field(fact, FACT_FIELD_DIR      , dir))    &&
+        (!parent || set_string_field(fact, FACT_FIELD_PARENT   , parent)) &&
+        (!order  || set_int_field   (fact, FACT_FIELD_ORDER    , order))  &&
+        (!conn   || set_string_field(fact, FACT_FIELD_CONNECTED, "yes")) &&
+        (!emerg  || set_string_field(fact, FACT_FIELD_EMERG    , "yes")) &&
+        (!video  || set_string_field(fact, FACT_FIELD_VIDEO    , video));
+
+    ohm_fact_store_transaction_pop(store, FALSE);
 
-    if (video && !set_string_field(fact, FACT_FIELD_VIDEO, video)) {
+    if (!success) {
         OHM_ERROR("Failed to update fact for call %s", short_path(call->path));
         return FALSE;
     }
@@ -4708,9 +4896,10 @@ static void timestamp_init(void)
 {
     char *signature;
   
-    signature = (char *)timestamp_add_SIGNATURE;
+    signature = (char *)timestamp_trace_SIGNATURE;
   
-    if (ohm_module_find_method("timestamp", &signature,(void *)&timestamp_add))
+    if (ohm_module_find_method("timestamp_trace", &signature,
+                               (void *)&timestamp_trace))
         OHM_INFO("telephony: timestamping is enabled.");
     else
         OHM_INFO("telephony: timestamping is disabled.");
@@ -4767,6 +4956,7 @@ plugin_exit(OhmPlugin *plugin)
  
     RESCTL_EXIT();
     bus_exit();
+    signal_table_exit();
     call_exit();
     policy_exit();
 }
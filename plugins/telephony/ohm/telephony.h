@@ -181,6 +181,7 @@ typedef struct call_s call_t;
 struct call_s {
     call_type_t   type;                        /* CALL_TYPE_* */
     int           id;                          /* our call ID */
+    GQuark        idq;                         /* our call ID as a quark */
     char         *name;                        /* channel D-BUS name */
     char         *path;                        /* channel object path */
     char         *peer;                        /* URI of peer if known */
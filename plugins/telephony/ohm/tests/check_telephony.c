@@ -0,0 +1,552 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_telephony.c
+ * @brief conference call stress benchmark: N-party conferences are
+ *        created, merged, split and torn down through the event path
+ *        against a mock policy, measuring the event to decision latency
+ *        and the factstore traffic of the call facts
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include <check.h>
+#include <dbus/dbus.h>
+#include <ohm/ohm-fact.h>
+
+#define MAX_PARTY  256                  /* largest conference benchmarked */
+#define NLOOKUP    100000               /* lookups in the index benchmark */
+
+static dbus_bool_t fake_connection_send(DBusConnection *, DBusMessage *,
+                                        dbus_uint32_t *);
+static void counted_fact_set(OhmFact *, const char *, GValue *);
+static void counted_transaction_push(OhmFactStore *);
+static void counted_transaction_pop(OhmFactStore *, gboolean);
+
+#define dbus_connection_send            fake_connection_send
+#define ohm_fact_set                    counted_fact_set
+#define ohm_fact_store_transaction_push counted_transaction_push
+#define ohm_fact_store_transaction_pop  counted_transaction_pop
+
+#include "../telephony.c"
+
+#undef ohm_fact_set
+#undef ohm_fact_store_transaction_push
+#undef ohm_fact_store_transaction_pop
+
+static int fake_session;                /* the mock session bus */
+
+static struct {
+    int nsend;                          /* telepathy requests sent */
+    int nset;                           /* call fact fields set */
+    int nupdated;                       /* factstore updated signals */
+    int npush;                          /* factstore transactions */
+    int npop;
+    int nresolve;                       /* policy requests */
+    int naction;                        /* policy actions decided */
+} stats;
+
+static char paths[MAX_PARTY + 1][128];  /* members and the conference */
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * mock session bus, counted factstore and mock policy
+ */
+
+static dbus_bool_t fake_connection_send(DBusConnection *conn, DBusMessage *msg,
+                                        dbus_uint32_t *serial)
+{
+    (void)msg;
+    (void)serial;
+
+    fail_unless(conn == (DBusConnection *)&fake_session, "unknown connection");
+
+    stats.nsend++;
+
+    return TRUE;
+}
+
+static void counted_fact_set(OhmFact *fact, const char *field, GValue *value)
+{
+    stats.nset++;
+    ohm_fact_set(fact, field, value);
+}
+
+static void counted_transaction_push(OhmFactStore *fs)
+{
+    stats.npush++;
+    ohm_fact_store_transaction_push(fs);
+}
+
+static void counted_transaction_pop(OhmFactStore *fs, gboolean discard)
+{
+    stats.npop++;
+    ohm_fact_store_transaction_pop(fs, discard);
+}
+
+static void count_updated(OhmFactStore *fs, OhmFact *fact, GQuark field,
+                          GValue *value, gpointer data)
+{
+    (void)fs;
+    (void)fact;
+    (void)field;
+    (void)value;
+    (void)data;
+
+    stats.nupdated++;
+}
+
+static void decide(OhmFact *actions, call_t *call, const char *action)
+{
+    char id[16];
+
+    snprintf(id, sizeof(id), "%d", call->id);
+    ohm_fact_set(actions, id, ohm_value_from_string(action));
+
+    stats.naction++;
+}
+
+static void autohold_others(gpointer key, gpointer value, gpointer data)
+{
+    call_t  *call    = (call_t *)value;
+    OhmFact *actions = (OhmFact *)data;
+
+    (void)key;
+
+    if (call->state == STATE_ACTIVE && !IS_CONF_MEMBER(call))
+        decide(actions, call, "autohold");
+}
+
+/*
+ * A one-active-call policy: the call the event is about gets the state it
+ * asked for and any other active call outside a conference is autoheld.
+ */
+static int fake_resolve(char *goal, char **locals)
+{
+    OhmFact    *actions;
+    call_t     *call;
+    const char *state;
+
+    stats.nresolve++;
+
+    if (strcmp(goal, "telephony_request"))
+        return TRUE;
+
+    call  = call_find(atoi(locals[1]));
+    state = locals[3];
+
+    fail_unless(call != NULL, "policy request for unknown call %s", locals[1]);
+
+    actions = ohm_fact_new(FACT_ACTIONS);
+
+    if (!strcmp(state, "active")) {
+        call->state = STATE_UNKNOWN;    /* not to autohold itself */
+        g_hash_table_foreach(calls, autohold_others, actions);
+        decide(actions, call, "active");
+    }
+    else if (!strcmp(state, "created") || !strcmp(state, "callout"))
+        decide(actions, call, "created");
+    else
+        decide(actions, call, "disconnected");
+
+    ohm_fact_store_insert(store, actions);
+
+    return TRUE;
+}
+
+
+/*
+ * events
+ */
+
+static void new_channel(const char *path, int conference)
+{
+    static char *ifaces[]      = { TP_CHANNEL_HOLD, NULL };
+    static char *conf_ifaces[] = { TP_CONFERENCE, TP_CHANNEL_HOLD, NULL };
+    static char *members[]     = { NULL };
+
+    event_t event;
+
+    memset(&event, 0, sizeof(event));
+    event.channel.type       = EVENT_NEW_CHANNEL;
+    event.channel.name       = ":1.7";
+    event.channel.path       = path;
+    event.channel.call_type  = CALL_TYPE_SM;
+    event.channel.dir        = DIR_INCOMING;
+    event.channel.interfaces = conference ? conf_ifaces : ifaces;
+    event.channel.members    = conference ? members : NULL;
+
+    event_handler(&event);
+}
+
+static void call_event(const char *path, event_id_t type)
+{
+    event_t event;
+
+    memset(&event, 0, sizeof(event));
+    event.any.type = type;
+    event.any.name = ":1.7";
+    event.any.path = path;
+    event.any.call = call_lookup(path);
+
+    fail_unless(event.any.call != NULL, "event for unknown call %s", path);
+
+    event_handler(&event);
+}
+
+static void conf_signal(const char *conf, const char *member, const char *name,
+                        DBusObjectPathMessageFunction handler)
+{
+    DBusMessage *msg;
+
+    msg = dbus_message_new_signal(conf, TP_CONFERENCE, name);
+    dbus_message_append_args(msg, DBUS_TYPE_OBJECT_PATH, &member,
+                             DBUS_TYPE_INVALID);
+
+    fail_unless(handler(NULL, msg, NULL) == DBUS_HANDLER_RESULT_HANDLED,
+                "%s not handled", name);
+
+    dbus_message_unref(msg);
+}
+
+
+/*
+ * helpers
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void report(const char *phase, int nparty, int nevent, double usecs)
+{
+    printf("%3d parties, %-8s %4d events %9.1f us/event "
+           "%6d actions %6d field sets %5d transactions %5d requests\n",
+           nparty, phase, nevent, usecs / nevent, stats.naction, stats.nset,
+           stats.npush, stats.nsend);
+
+    fail_unless(stats.npush == stats.npop, "unbalanced transactions");
+
+    memset(&stats, 0, sizeof(stats));
+}
+
+static int count_state(call_state_t state)
+{
+    GHashTableIter  it;
+    gpointer        key, value;
+    int             n = 0;
+
+    g_hash_table_iter_init(&it, calls);
+    while (g_hash_table_iter_next(&it, &key, &value))
+        if (((call_t *)value)->state == state)
+            n++;
+
+    return n;
+}
+
+static const char *fact_state(call_t *call)
+{
+    GValue *value = ohm_fact_get(call->fact, FACT_FIELD_STATE);
+
+    return value ? g_value_get_string(value) : "";
+}
+
+static void setup(void)
+{
+    int i;
+
+    g_type_init();
+
+    resolve = fake_resolve;
+    bus     = (DBusConnection *)&fake_session;
+
+    resctl_disabled = TRUE;
+
+    policy_init();
+    call_init();
+
+    for (i = 0; i < MAX_PARTY; i++)
+        snprintf(paths[i], sizeof(paths[i]), "%s/call%d", TP_RING, i);
+    snprintf(paths[MAX_PARTY], sizeof(paths[MAX_PARTY]), "%s/conf0", TP_RING);
+
+    memset(&stats, 0, sizeof(stats));
+}
+
+static void teardown(void)
+{
+    call_exit();
+
+    bus     = NULL;
+    resolve = NULL;
+}
+
+/*
+ * Create N calls one by one, each new call autoholding the active one,
+ * merge them into a conference, split one member out and hang up.
+ */
+static void conference(int nparty)
+{
+    const char *conf = paths[MAX_PARTY];
+    call_t     *call;
+    double      t;
+    int         i;
+
+    t = now();
+    for (i = 0; i < nparty; i++) {
+        new_channel(paths[i], FALSE);
+        call_event(paths[i], EVENT_CALL_ACCEPTED);
+    }
+    report("create", nparty, 2 * nparty, now() - t);
+
+    fail_unless(count_state(STATE_ACTIVE) == 1 &&
+                count_state(STATE_AUTOHOLD) == nparty - 1,
+                "%d active, %d autoheld calls", count_state(STATE_ACTIVE),
+                count_state(STATE_AUTOHOLD));
+
+    t = now();
+    new_channel(conf, TRUE);
+    for (i = 0; i < nparty; i++)
+        conf_signal(conf, paths[i], MEMBER_CHANNEL_ADDED,
+                    member_channel_added);
+    call_event(conf, EVENT_CALL_ACCEPTED);
+    report("merge", nparty, nparty + 2, now() - t);
+
+    fail_unless(count_state(STATE_CONFERENCE) == nparty &&
+                call_lookup(conf)->state == STATE_ACTIVE,
+                "conference not set up");
+
+    /* the split member becomes active and the conference gets autoheld */
+    t = now();
+    call = call_lookup(paths[0]);
+    conf_signal(conf, paths[0], MEMBER_CHANNEL_REMOVED,
+                member_channel_removed);
+    call_event(paths[0], EVENT_CALL_ACTIVATED);
+    report("split", nparty, 2, now() - t);
+
+    fail_unless(call->state == STATE_ACTIVE && call->parent == NULL &&
+                !strcmp(fact_state(call), "active"), "split member not active");
+    fail_unless(call_lookup(conf)->state == STATE_AUTOHOLD &&
+                !strcmp(fact_state(call_lookup(conf)), "autohold"),
+                "conference not autoheld");
+    fail_unless(count_state(STATE_CONFERENCE) == nparty - 1,
+                "%d calls left in conference", count_state(STATE_CONFERENCE));
+
+    t = now();
+    for (i = 0; i < nparty; i++)
+        call_event(paths[i], EVENT_CHANNEL_CLOSED);
+    call_event(conf, EVENT_CHANNEL_CLOSED);
+    report("hangup", nparty, nparty + 1, now() - t);
+
+    fail_unless(g_hash_table_size(calls) == 0 &&
+                g_hash_table_size(callids) == 0, "calls left behind");
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_telephony_conference)
+{
+    int n;
+
+    for (n = 4; n <= MAX_PARTY; n *= 4) {
+        conference(n);
+        call_exit();
+        call_init();
+    }
+}
+END_TEST
+
+START_TEST (test_telephony_batching)
+{
+    call_t *call;
+    gulong  id;
+
+    new_channel(paths[0], FALSE);
+    call = call_lookup(paths[0]);
+
+    memset(&stats, 0, sizeof(stats));
+    id = g_signal_connect(G_OBJECT(store), "updated",
+                          G_CALLBACK(count_updated), NULL);
+
+    /*
+     * One call change is one transaction and unchanged fields are not set.
+     * The transaction does not coalesce the updated signals: listeners
+     * still see one per changed field, but none for the unchanged ones.
+     */
+    call->state     = STATE_ACTIVE;
+    call->order     = 3;
+    call->connected = TRUE;
+    policy_call_update(call, UPDATE_STATE | UPDATE_ORDER | UPDATE_CONNECT |
+                       UPDATE_DIR);
+
+    fail_unless(stats.npush == 1 && stats.npop == 1, "%d transactions",
+                stats.npush);
+    fail_unless(stats.nset == 3, "%d fields set for 3 changes", stats.nset);
+    fail_unless(stats.nupdated == 3, "%d updates for 3 changes of 4 fields",
+                stats.nupdated);
+
+    policy_call_update(call, UPDATE_STATE | UPDATE_ORDER | UPDATE_CONNECT |
+                       UPDATE_DIR);
+
+    fail_unless(stats.nset == 3, "unchanged fields set again");
+    fail_unless(stats.nupdated == 3, "updates for unchanged fields");
+
+    g_signal_handler_disconnect(G_OBJECT(store), id);
+}
+END_TEST
+
+START_TEST (test_telephony_new_channel)
+{
+    DBusMessage *msg;
+    const char  *path = paths[0];
+    const char  *type = TP_CHANNEL_MEDIA;
+    call_t      *call;
+
+    /* the old NewChannel signal carries no channel properties */
+    msg = dbus_message_new_signal(TP_RING, TP_CONNECTION, NEW_CHANNEL);
+    dbus_message_set_sender(msg, ":1.7");
+    dbus_message_append_args(msg, DBUS_TYPE_OBJECT_PATH, &path,
+                             DBUS_TYPE_STRING, &type, DBUS_TYPE_INVALID);
+
+    fail_unless(channel_new(NULL, msg, NULL) == DBUS_HANDLER_RESULT_HANDLED,
+                "%s not handled", NEW_CHANNEL);
+    dbus_message_unref(msg);
+
+    call = call_lookup(path);
+
+    fail_unless(call != NULL, "no call for %s", NEW_CHANNEL);
+    fail_unless(call->type == CALL_TYPE_SM, "call type %d", call->type);
+    fail_unless(call->dir == DIR_UNKNOWN, "call direction %d", call->dir);
+    fail_unless(call->peer == NULL, "call peer %s", call->peer);
+    fail_unless(call->parent == NULL, "call is a conference");
+    fail_unless(!call->emergency, "call is an emergency call");
+    fail_unless(call->nmember == 0, "call has %d members", call->nmember);
+}
+END_TEST
+
+static gboolean has_id(gpointer key, gpointer value, gpointer data)
+{
+    (void)key;
+
+    return ((call_t *)value)->id == GPOINTER_TO_INT(data);
+}
+
+START_TEST (test_telephony_index)
+{
+    call_t *call;
+    double  t, tscan, tindex;
+    int     i, id;
+
+    for (i = 0; i < MAX_PARTY; i++)
+        new_channel(paths[i], FALSE);
+
+    /* the lookup policy_enforce did before, a full scan per action */
+    t = now();
+    for (i = 0; i < NLOOKUP; i++) {
+        id   = 1 + i % MAX_PARTY;
+        call = g_hash_table_find(calls, has_id, GINT_TO_POINTER(id));
+        fail_unless(call != NULL && call->id == id, "scan failed");
+    }
+    tscan = now() - t;
+
+    t = now();
+    for (i = 0; i < NLOOKUP; i++) {
+        id   = 1 + i % MAX_PARTY;
+        call = call_find_quark(call_lookup(paths[id - 1])->idq);
+        fail_unless(call != NULL && call->id == id, "index lookup failed");
+    }
+    tindex = now() - t;
+
+    printf("%d calls: %.1f ns per scan, %.1f ns per index lookup\n",
+           MAX_PARTY, 1e3 * tscan / NLOOKUP, 1e3 * tindex / NLOOKUP);
+
+    fail_unless(call_find(MAX_PARTY + 1) == NULL, "found unknown call");
+}
+END_TEST
+
+Suite *ohm_telephony_suite(void)
+{
+    Suite *suite = suite_create("ohm_telephony");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 120);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_telephony_conference);
+    tcase_add_test(tc_all, test_telephony_batching);
+    tcase_add_test(tc_all, test_telephony_new_channel);
+    tcase_add_test(tc_all, test_telephony_index);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_telephony_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -18,6 +18,19 @@ USA.
 *************************************************************************/
 
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
 #include <ohm/ohm-plugin.h>
 #include <ohm/ohm-plugin-log.h>
 #include <ohm/ohm-plugin-debug.h>
@@ -26,7 +39,53 @@ USA.
 
 #define PLUGIN_PREFIX   timestamp
 #define PLUGIN_NAME    "timestamp"
-#define PLUGIN_VERSION "0.0.1"
+#define PLUGIN_VERSION "0.0.2"
+
+#define TRACE_BITS      12
+#define TRACE_SIZE      (1 << TRACE_BITS)
+#define TRACE_MASK      (TRACE_SIZE - 1)
+#define TRACE_DUMPFILE  "/tmp/ohm-trace.log"
+
+#define IMPORT_METHOD(name, ptr) ({                                     \
+            signature = (char *)ptr##_SIGNATURE;                        \
+            ohm_module_find_method((name), &signature, (void *)&(ptr)); \
+        })
+
+/*
+ * In trace mode every timestamp is a fixed size binary record in a ring
+ * buffer. The id must be a static string; it is only dereferenced when
+ * the buffer is dumped. Writers claim a slot with an atomic increment and
+ * publish it by storing the claimed sequence number (+1) last, so a dump
+ * can skip slots that are being written or have been overwritten.
+ */
+typedef struct {
+    volatile uint32_t  seq;                  /* claimed index + 1 */
+    uint32_t           arg[2];               /* numeric arguments */
+    const char        *id;                   /* static string id */
+    struct timespec    ts;                   /* CLOCK_MONOTONIC */
+} trace_entry_t;
+
+typedef enum {
+    MODE_SP = 0,                             /* forward to sp_timestamp */
+    MODE_TRACE,                              /* binary ring buffer */
+} timestamp_mode_t;
+
+OHM_IMPORTABLE(int, add_command, (char *name, void (*handler)(char *)));
+
+static timestamp_mode_t   mode;
+static trace_entry_t     *ring;
+static volatile uint32_t  ring_next;
+static char              *dump_file;
+static int                sigpipe[2] = { -1, -1 };
+static guint              sigwatch;
+
+static void trace_record(const char *, uint32_t, uint32_t);
+static void trace_dump(FILE *);
+static void trace_dump_to_file(const char *);
+static int  signal_init(int);
+static void signal_exit(void);
+static void console_init(void);
+static void console_command(char *);
 
 
 /********************
@@ -35,7 +94,49 @@ USA.
 static void
 plugin_init(OhmPlugin *plugin)
 {
-    (void)plugin;
+    const char *cfgmode = ohm_plugin_get_param(plugin, "mode");
+    const char *cfgfile = ohm_plugin_get_param(plugin, "dump-file");
+    const char *cfgsig  = ohm_plugin_get_param(plugin, "dump-signal");
+    int         sig;
+
+    if (cfgmode == NULL || !strcmp(cfgmode, "sp"))
+        mode = MODE_SP;
+    else if (!strcmp(cfgmode, "trace"))
+        mode = MODE_TRACE;
+    else {
+        OHM_WARNING("timestamp: unknown mode '%s', using 'sp'", cfgmode);
+        mode = MODE_SP;
+    }
+
+    if (mode != MODE_TRACE)
+        return;
+
+    if ((ring = calloc(TRACE_SIZE, sizeof(*ring))) == NULL) {
+        OHM_ERROR("timestamp: failed to allocate trace buffer, using 'sp'");
+        mode = MODE_SP;
+        return;
+    }
+
+    dump_file = strdup(cfgfile ? cfgfile : TRACE_DUMPFILE);
+
+    if (cfgsig == NULL || !strcmp(cfgsig, "SIGUSR2"))
+        sig = SIGUSR2;
+    else if (!strcmp(cfgsig, "SIGUSR1"))
+        sig = SIGUSR1;
+    else if (!strcmp(cfgsig, "none"))
+        sig = 0;
+    else {
+        OHM_WARNING("timestamp: unknown dump-signal '%s', using SIGUSR2",
+                    cfgsig);
+        sig = SIGUSR2;
+    }
+
+    if (sig)
+        signal_init(sig);
+
+    console_init();
+
+    OHM_INFO("timestamp: tracing into a %d entry ring buffer", TRACE_SIZE);
 }
 
 
@@ -46,6 +147,274 @@ static void
 plugin_exit(OhmPlugin *plugin)
 {
     (void)plugin;
+
+    signal_exit();
+
+    free(ring);
+    ring = NULL;
+
+    free(dump_file);
+    dump_file = NULL;
+}
+
+
+/********************
+ * trace_record
+ ********************/
+static void
+trace_record(const char *id, uint32_t arg0, uint32_t arg1)
+{
+    trace_entry_t *e;
+    uint32_t       idx;
+
+    idx = __sync_fetch_and_add(&ring_next, 1);
+    e   = ring + (idx & TRACE_MASK);
+
+    e->seq = 0;
+    __sync_synchronize();
+
+    clock_gettime(CLOCK_MONOTONIC, &e->ts);
+    e->id     = id;
+    e->arg[0] = arg0;
+    e->arg[1] = arg1;
+
+    __sync_synchronize();
+    e->seq = idx + 1;
+}
+
+
+/********************
+ * trace_dump
+ ********************/
+static void
+trace_dump(FILE *fp)
+{
+    trace_entry_t   e;
+    struct timespec prev = { 0, 0 };
+    uint32_t        first, last, idx;
+    long            delta;
+
+    last  = ring_next;
+    first = last > TRACE_SIZE ? last - TRACE_SIZE : 0;
+
+    for (idx = first;  idx != last;  idx++) {
+        e = ring[idx & TRACE_MASK];
+        __sync_synchronize();
+
+        if (e.seq != idx + 1 || ring[idx & TRACE_MASK].seq != idx + 1)
+            continue;                   /* being written or overwritten */
+
+        if (prev.tv_sec || prev.tv_nsec)
+            delta = (e.ts.tv_sec  - prev.tv_sec)  * 1000000 +
+                    (e.ts.tv_nsec - prev.tv_nsec) / 1000;
+        else
+            delta = 0;
+
+        fprintf(fp, "%lu.%06lu +%ldus %s %u %u\n",
+                (unsigned long)e.ts.tv_sec,
+                (unsigned long)e.ts.tv_nsec / 1000, delta,
+                e.id ? e.id : "<unknown>", e.arg[0], e.arg[1]);
+
+        prev = e.ts;
+    }
+
+    fflush(fp);
+}
+
+
+/********************
+ * trace_dump_to_file
+ ********************/
+static void
+trace_dump_to_file(const char *path)
+{
+    struct stat  st;
+    FILE        *fp;
+    int          fd;
+
+    /*
+     * The dump file usually lives in a world-writable directory, so never
+     * follow a symlink and only reuse a regular file that is ours and has
+     * no other links to it.
+     */
+    fd = open(path, O_WRONLY | O_CREAT | O_NOFOLLOW | O_NOCTTY, 0600);
+
+    if (fd < 0) {
+        OHM_ERROR("timestamp: failed to open '%s' (%d: %s)", path,
+                  errno, strerror(errno));
+        return;
+    }
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+        st.st_uid != geteuid() || st.st_nlink != 1) {
+        OHM_ERROR("timestamp: refusing to dump to '%s', not a private "
+                  "regular file", path);
+        close(fd);
+        return;
+    }
+
+    if (ftruncate(fd, 0) < 0 || (fp = fdopen(fd, "w")) == NULL) {
+        OHM_ERROR("timestamp: failed to open '%s' (%d: %s)", path,
+                  errno, strerror(errno));
+        close(fd);
+        return;
+    }
+
+    trace_dump(fp);
+    fclose(fp);
+
+    OHM_INFO("timestamp: trace buffer dumped to %s", path);
+}
+
+
+/********************
+ * signal_handler
+ ********************/
+static void
+signal_handler(int sig)
+{
+    int saved_errno = errno;
+    int n;
+
+    (void)sig;
+
+    n = write(sigpipe[1], "d", 1);
+    (void)n;
+
+    errno = saved_errno;
+}
+
+
+/********************
+ * signal_cb
+ ********************/
+static gboolean
+signal_cb(GIOChannel *chnl, GIOCondition mask, gpointer data)
+{
+    char buf[32];
+    int  n;
+
+    (void)chnl;
+    (void)mask;
+    (void)data;
+
+    while ((n = read(sigpipe[0], buf, sizeof(buf))) > 0)
+        ;
+
+    trace_dump_to_file(dump_file);
+
+    return TRUE;
+}
+
+
+/********************
+ * signal_init
+ ********************/
+static int
+signal_init(int sig)
+{
+    struct sigaction  sa;
+    GIOChannel       *chnl;
+
+    if (pipe(sigpipe) < 0) {
+        OHM_ERROR("timestamp: failed to create pipe (%d: %s)",
+                  errno, strerror(errno));
+        return FALSE;
+    }
+
+    fcntl(sigpipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(sigpipe[1], F_SETFL, O_NONBLOCK);
+    fcntl(sigpipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(sigpipe[1], F_SETFD, FD_CLOEXEC);
+
+    if ((chnl = g_io_channel_unix_new(sigpipe[0])) == NULL) {
+        signal_exit();
+        return FALSE;
+    }
+
+    sigwatch = g_io_add_watch(chnl, G_IO_IN, signal_cb, NULL);
+    g_io_channel_unref(chnl);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+
+    if (sigaction(sig, &sa, NULL) < 0) {
+        OHM_ERROR("timestamp: failed to set up signal handler (%d: %s)",
+                  errno, strerror(errno));
+        signal_exit();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/********************
+ * signal_exit
+ ********************/
+static void
+signal_exit(void)
+{
+    if (sigwatch) {
+        g_source_remove(sigwatch);
+        sigwatch = 0;
+    }
+
+    if (sigpipe[0] >= 0) {
+        close(sigpipe[0]);
+        close(sigpipe[1]);
+        sigpipe[0] = sigpipe[1] = -1;
+    }
+}
+
+
+/********************
+ * console_init
+ ********************/
+static void
+console_init(void)
+{
+    char *signature;
+
+    if (IMPORT_METHOD("dres.add_command", add_command)) {
+        add_command("timestamp", console_command);
+        OHM_INFO("timestamp: registered timestamp console command handler");
+    }
+    else
+        OHM_INFO("timestamp: console command extensions not available");
+}
+
+
+/********************
+ * console_command
+ ********************/
+static void
+console_command(char *cmd)
+{
+    while (*cmd == ' ' || *cmd == '\t')
+        cmd++;
+
+    if (!strcmp(cmd, "help")) {
+        printf("timestamp help        show this help\n");
+        printf("timestamp dump        dump the trace buffer\n");
+        printf("timestamp save [file] save the trace buffer to a file\n");
+        printf("timestamp reset       clear the trace buffer\n");
+    }
+    else if (!strcmp(cmd, "dump"))
+        trace_dump(stdout);
+    else if (!strncmp(cmd, "save", 4)) {
+        for (cmd += 4;  *cmd == ' ' || *cmd == '\t';  cmd++)
+            ;
+        trace_dump_to_file(*cmd ? cmd : dump_file);
+    }
+    else if (!strcmp(cmd, "reset")) {
+        memset(ring, 0, TRACE_SIZE * sizeof(*ring));
+        ring_next = 0;
+    }
+    else
+        printf("timestamp: unknown command '%s'\n", cmd);
 }
 
 
@@ -58,7 +427,34 @@ plugin_exit(OhmPlugin *plugin)
  ********************/
 OHM_EXPORTABLE(void, timestamp_add, (const char *step))
 {
-    sp_timestamp(step);
+    if (mode == MODE_TRACE)
+        trace_record(step, 0, 0);
+    else
+        sp_timestamp(step);
+}
+
+
+/********************
+ * timestamp_trace
+ ********************/
+OHM_EXPORTABLE(void, timestamp_trace, (const char *id,
+                                       uint32_t arg0, uint32_t arg1))
+{
+    /* the arguments are recorded only in trace mode, sp output is
+     * kept the same as with timestamp_add */
+    if (mode == MODE_TRACE)
+        trace_record(id, arg0, arg1);
+    else
+        sp_timestamp(id);
+}
+
+
+/********************
+ * timestamp_tracing
+ ********************/
+OHM_EXPORTABLE(int, timestamp_tracing, (void))
+{
+    return mode == MODE_TRACE;
 }
 
 
@@ -72,8 +468,11 @@ OHM_PLUGIN_DESCRIPTION(PLUGIN_NAME,
                        OHM_LICENSE_LGPL, /* OHM_LICENSE_LGPL */
                        plugin_init, plugin_exit, NULL);
 
-OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 1,
-                            OHM_EXPORT(timestamp_add, "timestamp"));
+OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 3,
+                            OHM_EXPORT(timestamp_add, "timestamp"),
+                            OHM_EXPORT(timestamp_trace, "timestamp_trace"),
+                            OHM_EXPORT(timestamp_tracing,
+                                       "timestamp_tracing"));
 
 /* 
  * Local Variables:
@@ -0,0 +1,639 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_upstart.c
+ * @brief fact rules of the upstart plugin driven by synthetic factstore
+ *        updates, with a benchmark of the update path
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <check.h>
+#include <ohm/ohm-plugin.h>
+#include <ohm/ohm-fact.h>
+
+#define CALL_FACT   "com.nokia.policy.call"
+#define PLUGIN_FACT "com.nokia.policy.plugin"
+#define NEMIT       16                  /* emissions recorded */
+#define NUPDATE     100000              /* updates in the bench */
+
+static gboolean fake_spawn_async(const gchar *, gchar **, gchar **,
+                                 GSpawnFlags, GSpawnChildSetupFunc, gpointer,
+                                 GPid *, GError **);
+static guint fake_idle_add(GSourceFunc, gpointer);
+static gboolean fake_source_remove(guint);
+static DBusConnection *fake_bus_get(DBusBusType, DBusError *);
+static dbus_bool_t fake_connection_send(DBusConnection *, DBusMessage *,
+                                        dbus_uint32_t *);
+static void fake_connection_unref(DBusConnection *);
+static const char *fake_get_param(OhmPlugin *, const char *);
+static GValue *counted_fact_get(OhmFact *, const char *);
+
+#define g_spawn_async             fake_spawn_async
+#define g_idle_add                fake_idle_add
+#define g_source_remove           fake_source_remove
+#define dbus_bus_get              fake_bus_get
+#define dbus_connection_send      fake_connection_send
+#define dbus_connection_unref     fake_connection_unref
+#define ohm_plugin_get_param(p,k) fake_get_param(p, k)
+#define ohm_fact_get              counted_fact_get
+
+#include "../upstart.c"
+
+#undef ohm_fact_get
+
+static char config[] = "/tmp/check_upstart.XXXXXX";
+static int  use_defaults;               /* no rules parameter */
+
+static const char *config_data =
+    "[ohm-running]\n"
+    "fact = com.nokia.policy.plugin\n"
+    "select = name:signaling\n"
+    "field = state\n"
+    "value = signaled\n"
+    "event = ohm-running\n"
+    "once = true\n"
+    "\n"
+    "[call-active]\n"
+    "fact = com.nokia.policy.call\n"
+    "select = id:1\n"
+    "field = state\n"
+    "value = active\n"
+    "edge = both\n"
+    "path = /com/nokia/policy/call\n"
+    "interface = com.nokia.policy.call\n"
+    "signal = CallActive\n"
+    "\n"
+    "[call-ended]\n"
+    "fact = com.nokia.policy.call\n"
+    "select = id:1\n"
+    "field = state\n"
+    "value = active\n"
+    "edge = falling\n"
+    "event = call-ended\n"
+    "\n"
+    "[broken-edge]\n"
+    "fact = com.nokia.policy.call\n"
+    "field = state\n"
+    "value = active\n"
+    "edge = sideways\n"
+    "event = broken\n"
+    "\n"
+    "[broken-selector]\n"
+    "fact = com.nokia.policy.call\n"
+    "select = id\n"
+    "field = state\n"
+    "value = active\n"
+    "event = broken\n"
+    "\n"
+    "[broken-action]\n"
+    "fact = com.nokia.policy.call\n"
+    "field = state\n"
+    "value = active\n"
+    "signal = Broken\n";
+
+static int fake_system;                 /* the mock system bus */
+
+static struct {
+    char member[64];                    /* event or signal name */
+    int  value;                         /* signal argument, -1 for events */
+} emitted[NEMIT];                       /* emissions in order */
+static int nemit;
+
+static GSourceFunc idle_cb;             /* the scheduled idle callback */
+static int         nidle;               /* idle callbacks scheduled */
+static int         nfact_get;           /* fact lookups by the plugin */
+
+static OhmFactStore *store;
+static OhmFact      *signaling, *calls[3];
+static gulong        handler_id;
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+
+/*
+ * mock initctl, main loop, system bus and plugin parameters
+ */
+
+static gboolean fake_spawn_async(const gchar *dir, gchar **argv, gchar **envp,
+                                 GSpawnFlags flags, GSpawnChildSetupFunc setup,
+                                 gpointer data, GPid *pid, GError **error)
+{
+    (void)dir;
+    (void)envp;
+    (void)flags;
+    (void)setup;
+    (void)data;
+    (void)pid;
+    (void)error;
+
+    fail_unless(nemit < NEMIT, "too many emissions");
+    fail_unless(!strcmp(argv[0], "/sbin/initctl") && !strcmp(argv[1], "emit")
+                && argv[3] == NULL, "bad initctl command line");
+
+    strncpy(emitted[nemit].member, argv[2], sizeof(emitted[nemit].member) - 1);
+    emitted[nemit].value = -1;
+    nemit++;
+
+    return TRUE;
+}
+
+static guint fake_idle_add(GSourceFunc cb, gpointer data)
+{
+    (void)data;
+
+    idle_cb = cb;
+    nidle++;
+
+    return 1;
+}
+
+static gboolean fake_source_remove(guint id)
+{
+    (void)id;
+
+    idle_cb = NULL;
+
+    return TRUE;
+}
+
+static DBusConnection *fake_bus_get(DBusBusType type, DBusError *error)
+{
+    (void)error;
+
+    fail_unless(type == DBUS_BUS_SYSTEM, "signal sent on the session bus");
+
+    return (DBusConnection *)&fake_system;
+}
+
+static dbus_bool_t fake_connection_send(DBusConnection *conn, DBusMessage *msg,
+                                        dbus_uint32_t *serial)
+{
+    dbus_bool_t value;
+
+    (void)serial;
+
+    fail_unless(conn == (DBusConnection *)&fake_system, "unknown connection");
+    fail_unless(nemit < NEMIT, "too many emissions");
+    fail_unless(!strcmp(dbus_message_get_path(msg), "/com/nokia/policy/call"),
+                "signal sent to wrong path");
+    fail_unless(dbus_message_get_args(msg, NULL, DBUS_TYPE_BOOLEAN, &value,
+                                      DBUS_TYPE_INVALID), "bad signal args");
+
+    strncpy(emitted[nemit].member, dbus_message_get_member(msg),
+            sizeof(emitted[nemit].member) - 1);
+    emitted[nemit].value = value;
+    nemit++;
+
+    return TRUE;
+}
+
+static void fake_connection_unref(DBusConnection *conn)
+{
+    (void)conn;
+}
+
+static const char *fake_get_param(OhmPlugin *plugin, const char *key)
+{
+    (void)plugin;
+
+    if (use_defaults || strcmp(key, "rules"))
+        return NULL;
+
+    return config;
+}
+
+static GValue *counted_fact_get(OhmFact *fact, const char *field)
+{
+    nfact_get++;
+
+    return ohm_fact_get(fact, field);
+}
+
+
+/*
+ * helpers
+ */
+
+static void set(OhmFact *fact, const char *field, const char *value)
+{
+    ohm_fact_set(fact, field, ohm_value_from_string(value));
+}
+
+static void flush(void)
+{
+    GSourceFunc cb = idle_cb;
+
+    idle_cb = NULL;
+
+    if (cb != NULL)
+        fail_unless(cb(NULL) == FALSE, "idle callback wants to rerun");
+}
+
+static int count(const char *member)
+{
+    int i, n;
+
+    for (i = n = 0; i < nemit; i++)
+        if (!strcmp(emitted[i].member, member))
+            n++;
+
+    return n;
+}
+
+static OhmFact *new_call(int id, const char *state)
+{
+    OhmFact *fact = ohm_fact_new(CALL_FACT);
+
+    ohm_fact_set(fact, "id", ohm_value_from_int(id));
+    set(fact, "state", state);
+    ohm_fact_store_insert(store, fact);
+
+    return fact;
+}
+
+static void start(void)
+{
+    fail_unless(rules_init(NULL), "failed to load the rules");
+
+    handler_id = updated_id = g_signal_connect(G_OBJECT(store), "updated",
+                                               G_CALLBACK(updated_cb), NULL);
+    removed_id = g_signal_connect(G_OBJECT(store), "removed",
+                                  G_CALLBACK(removed_cb), NULL);
+    inserted_id = g_signal_connect(G_OBJECT(store), "inserted",
+                                   G_CALLBACK(inserted_cb), NULL);
+}
+
+static void setup(void)
+{
+    int fd;
+
+    g_type_init();
+
+    store = ohm_fact_store_get_fact_store();
+
+    fd = mkstemp(config);
+    fail_unless(fd >= 0, "failed to create the rules file");
+    fail_unless(write(fd, config_data, strlen(config_data)) ==
+                (ssize_t)strlen(config_data), "failed to write the rules");
+    close(fd);
+
+    signaling = ohm_fact_new(PLUGIN_FACT);
+    set(signaling, "name", "signaling");
+    set(signaling, "state", "starting");
+    ohm_fact_store_insert(store, signaling);
+
+    /* the call already in progress must not trigger anything */
+    calls[0] = new_call(0, "idle");
+    calls[1] = new_call(1, "active");
+    calls[2] = new_call(2, "idle");
+
+    use_defaults = FALSE;
+    nemit = nidle = nfact_get = 0;
+    memset(emitted, 0, sizeof(emitted));
+}
+
+static void teardown(void)
+{
+    int i;
+
+    if (updated_id != 0)
+        g_signal_handler_disconnect(G_OBJECT(store), handler_id);
+    if (removed_id != 0)
+        g_signal_handler_disconnect(G_OBJECT(store), removed_id);
+    if (inserted_id != 0)
+        g_signal_handler_disconnect(G_OBJECT(store), inserted_id);
+    updated_id = removed_id = inserted_id = 0;
+
+    rules_exit();
+
+    ohm_fact_store_remove(store, signaling);
+    g_object_unref(signaling);
+
+    for (i = 0; i < 3; i++) {
+        ohm_fact_store_remove(store, calls[i]);
+        g_object_unref(calls[i]);
+    }
+
+    unlink(config);
+    strcpy(config, "/tmp/check_upstart.XXXXXX");
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_upstart_rules)
+{
+    start();
+
+    fail_unless(nrule == 3, "%d rules loaded", nrule);
+    fail_unless(g_hash_table_size(rules_by_fact) == 2, "%d facts watched",
+                g_hash_table_size(rules_by_fact));
+    fail_unless(rules[1].active && rules[1].reported,
+                "current call state not picked up");
+    fail_unless(nidle == 0 && nemit == 0, "loading the rules triggered");
+}
+END_TEST
+
+START_TEST (test_upstart_edges)
+{
+    start();
+
+    /* the call ends: both call rules trigger on the falling edge */
+    set(calls[1], "state", "idle");
+    flush();
+
+    fail_unless(nemit == 2, "%d emissions", nemit);
+    fail_unless(!strcmp(emitted[0].member, "CallActive") &&
+                emitted[0].value == FALSE, "bad CallActive signal");
+    fail_unless(!strcmp(emitted[1].member, "call-ended") &&
+                emitted[1].value == -1, "bad call-ended event");
+
+    /* a new call: only the signal rule has a rising edge */
+    set(calls[1], "state", "active");
+    flush();
+
+    fail_unless(nemit == 3 && emitted[2].value == TRUE, "%d emissions", nemit);
+
+    /* the other calls are not selected */
+    set(calls[0], "state", "active");
+    set(calls[2], "state", "active");
+    set(calls[2], "state", "idle");
+    flush();
+
+    fail_unless(nemit == 3, "unselected call triggered");
+
+    /* the call leaving the selection deactivates the rules */
+    ohm_fact_set(calls[1], "id", ohm_value_from_int(3));
+    flush();
+
+    fail_unless(nemit == 5 && count("call-ended") == 2 &&
+                emitted[3].value == FALSE, "%d emissions", nemit);
+
+    /* no rule is retired, the handler stays connected */
+    fail_unless(updated_id != 0, "handler disconnected");
+}
+END_TEST
+
+START_TEST (test_upstart_removed)
+{
+    start();
+
+    /* the active call goes away: a falling edge for both call rules */
+    ohm_fact_store_remove(store, calls[1]);
+    flush();
+
+    fail_unless(nemit == 2, "%d emissions", nemit);
+    fail_unless(!strcmp(emitted[0].member, "CallActive") &&
+                emitted[0].value == FALSE, "bad CallActive signal");
+    fail_unless(!strcmp(emitted[1].member, "call-ended"),
+                "bad call-ended event");
+    fail_unless(rules[1].current == NULL && rules[2].current == NULL,
+                "removed fact still selected");
+
+    /* removing an unselected call does nothing */
+    ohm_fact_store_remove(store, calls[0]);
+    flush();
+
+    fail_unless(nemit == 2, "unselected call triggered");
+
+    /* an unselected call shows up again */
+    ohm_fact_store_insert(store, calls[0]);
+    flush();
+
+    fail_unless(nemit == 2, "unselected call triggered");
+
+    /* the active call shows up again, inserting it is enough */
+    ohm_fact_store_insert(store, calls[1]);
+    flush();
+
+    fail_unless(nemit == 3 && emitted[2].value == TRUE, "%d emissions", nemit);
+    fail_unless(rules[1].current == calls[1] && rules[2].current == calls[1],
+                "inserted fact not selected");
+}
+END_TEST
+
+START_TEST (test_upstart_dedup)
+{
+    int i;
+
+    start();
+
+    /* repeated updates with the same value */
+    for (i = 0; i < 10; i++)
+        set(calls[1], "state", "active");
+
+    fail_unless(idle_cb == NULL, "no transition but idle scheduled");
+
+    for (i = 0; i < 10; i++)
+        set(calls[1], "state", "idle");
+    flush();
+
+    fail_unless(nemit == 2, "%d emissions", nemit);
+
+    /* glitches before the idle loop cancel out */
+    set(calls[1], "state", "active");
+    set(calls[1], "state", "idle");
+    set(calls[1], "state", "active");
+    set(calls[1], "state", "idle");
+
+    fail_unless(nidle == 2, "%d idle callbacks scheduled", nidle);
+
+    flush();
+
+    fail_unless(nemit == 2, "%d emissions after glitches", nemit);
+
+    /* only the net transition is reported */
+    set(calls[1], "state", "active");
+    set(calls[1], "state", "idle");
+    set(calls[1], "state", "active");
+    flush();
+
+    fail_unless(nemit == 3 && emitted[2].value == TRUE, "%d emissions", nemit);
+}
+END_TEST
+
+START_TEST (test_upstart_once)
+{
+    GValue *value;
+
+    use_defaults = TRUE;
+    start();
+
+    fail_unless(nrule == 1, "%d default rules", nrule);
+
+    set(signaling, "state", "initializing");
+    flush();
+
+    fail_unless(nemit == 0, "triggered on the wrong value");
+
+    set(signaling, "state", "signaled");
+    flush();
+
+    fail_unless(nemit == 1 && !strcmp(emitted[0].member, "ohm-running"),
+                "ohm-running not emitted");
+
+    /* the rule is retired and the plugin stops listening */
+    fail_unless(nlive == 0 && updated_id == 0, "rule not retired");
+
+    set(signaling, "state", "starting");
+
+    value = ohm_value_from_string("signaled");
+    updated_cb(store, signaling, g_quark_from_string("state"), value);
+    flush();
+
+    fail_unless(nemit == 1, "retired rule triggered");
+
+    g_value_unset(value);
+    g_free(value);
+}
+END_TEST
+
+START_TEST (test_upstart_fallback)
+{
+    /* a rules file that cannot be loaded leaves the built-in rule */
+    unlink(config);
+    start();
+
+    fail_unless(nrule == 1 && !strcmp(rules[0].event, "ohm-running"),
+                "%d rules without a rules file", nrule);
+
+    set(signaling, "state", "signaled");
+    flush();
+
+    fail_unless(nemit == 1 && !strcmp(emitted[0].member, "ohm-running"),
+                "ohm-running not emitted");
+}
+END_TEST
+
+START_TEST (test_upstart_bench)
+{
+    OhmFact  *other;
+    GValue   *value;
+    GQuark    state, level;
+    struct timespec t0, t1;
+    double    ns;
+    int       i;
+
+    start();
+
+    other = ohm_fact_new("com.nokia.policy.volume_limit");
+    value = ohm_value_from_string("active");
+    state = g_quark_from_string("state");
+    level = g_quark_from_string("level");
+
+    nfact_get = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    /* unrelated facts and unrelated fields of watched facts */
+    for (i = 0; i < NUPDATE; i++) {
+        updated_cb(store, other, state, value);
+        updated_cb(store, calls[1], level, value);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+
+    printf("%d unrelated updates: %.1f ns per update\n", 2 * NUPDATE,
+           ns / (2 * NUPDATE));
+
+    fail_unless(nfact_get == 0, "%d fact lookups for unrelated updates",
+                nfact_get);
+    fail_unless(nidle == 0 && nemit == 0, "unrelated update triggered");
+
+    /* a watched field of an unselected fact needs the selector only */
+    updated_cb(store, calls[0], state, value);
+
+    fail_unless(nfact_get == 2, "%d fact lookups", nfact_get);
+
+    g_value_unset(value);
+    g_free(value);
+    g_object_unref(other);
+}
+END_TEST
+
+Suite *ohm_upstart_suite(void)
+{
+    Suite *suite = suite_create("ohm_upstart");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_upstart_rules);
+    tcase_add_test(tc_all, test_upstart_edges);
+    tcase_add_test(tc_all, test_upstart_removed);
+    tcase_add_test(tc_all, test_upstart_fallback);
+    tcase_add_test(tc_all, test_upstart_dedup);
+    tcase_add_test(tc_all, test_upstart_once);
+    tcase_add_test(tc_all, test_upstart_bench);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_upstart_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
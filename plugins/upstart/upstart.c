@@ -32,6 +32,8 @@ USA.
 #include <glib.h>
 #include <glib-object.h>
 
+#include <dbus/dbus.h>
+
 #include <ohm/ohm-plugin.h>
 #include <ohm/ohm-plugin-log.h>
 #include <ohm/ohm-plugin-debug.h>
@@ -39,16 +41,49 @@ USA.
 
 /* This plugin has two features:
  *
- * First, it emits an upstart signal when ohmd enters the idle loop the
- * first time after running plugin init for all plugins. This tells the
- * applications depending on ohmd in the boot order that the ohm is now
- * at least somewhat ready for operation.
+ * First, it bridges factstore changes to upstart events and D-Bus
+ * signals. By default it emits an upstart signal when the signaling
+ * plugin fact enters the 'signaled' state, ie. when ohmd enters the idle
+ * loop the first time after running plugin init for all plugins. This
+ * tells the applications depending on ohmd in the boot order that the
+ * ohm is now at least somewhat ready for operation.
  *
  * Second, during the bootup, notification events (except for ringtone)
  * are suspended until the desktop is visible. This indication is done
  * by receiving desktop_ready signal.  In case the signal is never sent
  * (for instance in cases where ohmd is started when the desktop is
  * already visible), this plugin enables the notification events again.
+ *
+ * The bridge is driven by a rule table that is read from the file named
+ * by the 'rules' plugin parameter. Each group of the file is a rule:
+ *
+ * [ohm-running]
+ * fact = com.nokia.policy.plugin
+ * select = name:signaling
+ * field = state
+ * value = signaled
+ * edge = rising
+ * event = ohm-running
+ * once = true
+ *
+ * A rule is active while the selected fact has the given value in the
+ * given field. It becomes inactive when the fact is removed, and is
+ * evaluated again when a fact of that name is inserted. The selector is
+ * a comma separated list of field:value pairs and should pick a single
+ * fact. The edge (rising, falling or
+ * both) tells which transitions of the rule trigger it. A triggered rule
+ * either emits an upstart event (event = name) or a D-Bus signal on the
+ * system bus (path, interface and signal) with a boolean argument that
+ * tells whether the rule became active. Rules marked 'once' are retired
+ * after they have triggered.
+ *
+ * The triggers are emitted from the idle loop. A rule whose state flips
+ * back and forth before that is triggered only if its state differs from
+ * the one it was last triggered with, so transient glitches and repeated
+ * updates of the same value do not emit anything.
+ *
+ * Without the 'rules' parameter, or if the file cannot be loaded, the
+ * built-in rule above is used.
  */
 
 extern char **environ;
@@ -57,10 +92,63 @@ OHM_IMPORTABLE(int, resolve, (char *goal, char **locals));
 OHM_PLUGIN_REQUIRES_METHODS(upstart, 1,
     OHM_IMPORT("dres.resolve", resolve));
 
+#define EDGE_RISING  0x1
+#define EDGE_FALLING 0x2
+
+typedef struct {
+    GQuark  field;                      /* field to look at */
+    char   *value;                      /* value as a string */
+    int     ivalue;                     /* value as an integer */
+    int     isint;                      /* whether value is an integer */
+} match_t;
+
+typedef struct rule_s rule_t;
+
+struct rule_s {
+    char     *name;                     /* name of the rule */
+    char     *fact;                     /* fact name */
+    match_t  *select;                   /* selector of the fact */
+    int       nselect;
+    match_t   cond;                     /* condition on the fact */
+    int       edge;                     /* triggering transitions */
+    int       once;                     /* retire after triggering */
+    char     *event;                    /* upstart event to emit, or */
+    char     *path;                     /*   D-Bus signal to send */
+    char     *interface;
+    char     *signal;
+    OhmFact  *current;                  /* last selected fact */
+    int       active;                   /* rule is active */
+    int       reported;                 /* state last triggered with */
+    int       retired;                  /* rule has been retired */
+    rule_t   *next_pending;             /* next rule to check in idle */
+    int       pending;
+};
+
+static const char default_rules[] =
+    "[ohm-running]\n"
+    "fact = com.nokia.policy.plugin\n"
+    "select = name:signaling\n"
+    "field = state\n"
+    "value = signaled\n"
+    "edge = rising\n"
+    "event = ohm-running\n"
+    "once = true\n";
+
 static int DBG_UPSTART;
 
-static unsigned int init_id;
+static rule_t     *rules;               /* rule table */
+static int         nrule;
+static int         nlive;               /* rules not retired yet */
+static GHashTable *rules_by_fact;       /* fact name -> GSList of rules */
+static rule_t     *pending_head;        /* rules to check in idle */
+static rule_t    **pending_tail = &pending_head;
+
+static DBusConnection *sys_conn;
+
+static unsigned int flush_id;
 static gulong updated_id;
+static gulong removed_id;
+static gulong inserted_id;
 static gulong enable_notifications_id;
 
 OHM_DEBUG_PLUGIN(upstart,
@@ -88,29 +176,215 @@ static int enable_notifications_cb(void *data)
     return FALSE;
 }
 
-static int init_cb(void *data)
+static void disconnect_factstore(void)
 {
-    (void) data;
     OhmFactStore *fs = ohm_fact_store_get_fact_store();
 
+    if (fs != NULL && updated_id != 0 &&
+        g_signal_handler_is_connected(G_OBJECT(fs), updated_id)) {
+        g_signal_handler_disconnect(G_OBJECT(fs), updated_id);
+    }
+
+    if (fs != NULL && removed_id != 0 &&
+        g_signal_handler_is_connected(G_OBJECT(fs), removed_id)) {
+        g_signal_handler_disconnect(G_OBJECT(fs), removed_id);
+    }
+
+    if (fs != NULL && inserted_id != 0 &&
+        g_signal_handler_is_connected(G_OBJECT(fs), inserted_id)) {
+        g_signal_handler_disconnect(G_OBJECT(fs), inserted_id);
+    }
+
+    updated_id  = 0;
+    removed_id  = 0;
+    inserted_id = 0;
+}
+
+static void emit_event(rule_t *rule)
+{
     gboolean retval;
     GPid pid;
-    gchar *argv[] = { "/sbin/initctl", "emit", "ohm-running", NULL };
+    gchar *argv[] = { "/sbin/initctl", "emit", rule->event, NULL };
 
-    OHM_INFO("upstart: emitting the initialization signal");
+    OHM_INFO("upstart: emitting the %s signal", rule->event);
 
     /* no flags -- the child is automatically waited */
     retval = g_spawn_async(NULL, argv, NULL, 0, NULL, NULL, &pid, NULL);
 
-    /* no need to keep on listening to the signal */
-    if (g_signal_handler_is_connected(G_OBJECT(fs), updated_id)) {
-        g_signal_handler_disconnect(G_OBJECT(fs), updated_id);
-        updated_id = 0;
+    if (!retval) {
+        OHM_ERROR("upstart: failed to emit the %s signal", rule->event);
     }
+}
 
-    init_id = 0;
+static void emit_signal(rule_t *rule, int active)
+{
+    DBusMessage *msg;
+    dbus_bool_t  arg = active ? TRUE : FALSE;
+
+    if (sys_conn == NULL &&
+        (sys_conn = dbus_bus_get(DBUS_BUS_SYSTEM, NULL)) == NULL) {
+        OHM_ERROR("upstart: failed to get system D-Bus connection");
+        return;
+    }
+
+    msg = dbus_message_new_signal(rule->path, rule->interface, rule->signal);
+
+    if (msg == NULL) {
+        OHM_ERROR("upstart: failed to create %s signal", rule->signal);
+        return;
+    }
+
+    if (!dbus_message_append_args(msg, DBUS_TYPE_BOOLEAN, &arg,
+                                  DBUS_TYPE_INVALID) ||
+        !dbus_connection_send(sys_conn, msg, NULL)) {
+        OHM_ERROR("upstart: failed to send %s signal", rule->signal);
+    }
+
+    dbus_message_unref(msg);
+}
+
+static int flush_cb(void *data)
+{
+    rule_t *rule;
+    int     edge;
+
+    (void) data;
+
+    flush_id = 0;
+
+    while ((rule = pending_head) != NULL) {
+        pending_head = rule->next_pending;
+        rule->next_pending = NULL;
+        rule->pending = FALSE;
+
+        /* it flipped back before we got here */
+        if (rule->retired || rule->active == rule->reported)
+            continue;
+
+        rule->reported = rule->active;
+        edge = rule->active ? EDGE_RISING : EDGE_FALLING;
+
+        if (!(rule->edge & edge))
+            continue;
+
+        OHM_DEBUG(DBG_UPSTART, "rule %s triggered (%s edge)", rule->name,
+                  edge == EDGE_RISING ? "rising" : "falling");
+
+        if (rule->event != NULL)
+            emit_event(rule);
+        else
+            emit_signal(rule, rule->active);
+
+        if (rule->once) {
+            rule->retired = TRUE;
+            nlive--;
+        }
+    }
+
+    pending_tail = &pending_head;
+
+    /* no need to keep on listening to the signals */
+    if (nlive == 0)
+        disconnect_factstore();
+
+    return FALSE;
+}
+
+static int match_value(match_t *m, GValue *value)
+{
+    const char *s;
+
+    if (value == NULL)
+        return FALSE;
+
+    switch (G_VALUE_TYPE(value)) {
+    case G_TYPE_STRING:
+        s = g_value_get_string(value);
+        return s != NULL && !strcmp(s, m->value);
+    case G_TYPE_INT:
+        return m->isint && g_value_get_int(value) == m->ivalue;
+    case G_TYPE_UINT:
+        return m->isint && m->ivalue >= 0 &&
+            g_value_get_uint(value) == (guint)m->ivalue;
+    default:
+        return FALSE;
+    }
+}
+
+static GValue *field_value(OhmFact *fact, GQuark field,
+                           GQuark fldquark, GValue *value)
+{
+    /* the updated field is passed in, don't count on the fact having it */
+    if (field == fldquark)
+        return value;
+    else
+        return ohm_fact_get(fact, g_quark_to_string(field));
+}
+
+static int evaluate_rule(rule_t *rule, OhmFact *fact, GQuark fldquark,
+                         GValue *value)
+{
+    int i;
+
+    for (i = 0; i < rule->nselect; i++) {
+        if (!match_value(rule->select + i,
+                         field_value(fact, rule->select[i].field,
+                                     fldquark, value)))
+            break;
+    }
+
+    if (i < rule->nselect) {
+        /* not our fact, unless it just stopped being selected */
+        if (fact != rule->current)
+            return -1;
+        rule->current = NULL;
+        return FALSE;
+    }
+
+    rule->current = fact;
+
+    return match_value(&rule->cond,
+                       field_value(fact, rule->cond.field, fldquark, value));
+}
+
+static void set_active(rule_t *rule, int active)
+{
+    if (active == rule->active)
+        return;
+
+    rule->active = active;
+
+    if (!rule->pending) {
+        rule->pending = TRUE;
+        *pending_tail = rule;
+        pending_tail = &rule->next_pending;
+    }
+
+    /* emit the signal in the next idle loop */
+    if (flush_id == 0)
+        flush_id = g_idle_add(flush_cb, NULL);
+}
+
+static void update_rule(rule_t *rule, OhmFact *fact, GQuark fldquark,
+                        GValue *value)
+{
+    int active = evaluate_rule(rule, fact, fldquark, value);
+
+    if (active >= 0)
+        set_active(rule, active);
+}
+
+static int watches(rule_t *rule, GQuark fldquark)
+{
+    int i;
+
+    if (rule->cond.field == fldquark)
+        return TRUE;
+
+    for (i = 0; i < rule->nselect; i++)
+        if (rule->select[i].field == fldquark)
+            return TRUE;
 
-    /* this function is run only once */
     return FALSE;
 }
 
@@ -119,6 +393,8 @@ static void updated_cb(void *data, OhmFact *fact, GQuark fldquark, gpointer valu
     (void) data;
 
     GValue *gval = (GValue *)value;
+    GSList *l;
+    rule_t *rule;
     const char *name;
 
     if (fact == NULL) {
@@ -131,36 +407,328 @@ static void updated_cb(void *data, OhmFact *fact, GQuark fldquark, gpointer valu
         return;
     }
 
-    name = (char *) ohm_structure_get_name(OHM_STRUCTURE(fact));
-    if (!strcmp(name, "com.nokia.policy.plugin")) {
-        GValue *name;
-        if ((name = ohm_fact_get(fact, "name")) != NULL) {
-            if (G_VALUE_TYPE(name) == G_TYPE_STRING) {
-                if (!strcmp(g_value_get_string(name), "signaling")) {
+    name = ohm_structure_get_name(OHM_STRUCTURE(fact));
+    if (name == NULL)
+        return;
 
-                    /* there was a change in signaling plugin fact */
+    for (l = g_hash_table_lookup(rules_by_fact, name); l != NULL; l = l->next) {
+        rule = (rule_t *)l->data;
 
-                    char *fieldname = (char *) g_quark_to_string(fldquark);
+        if (!rule->retired && watches(rule, fldquark))
+            update_rule(rule, fact, fldquark, gval);
+    }
+}
 
-                    if (!strcmp(fieldname, "state") && G_VALUE_TYPE(gval) == G_TYPE_STRING) {
-                        /* it was the state that changed */
-                        if (!strcmp(g_value_get_string(gval), "signaled")) {
-                            /* emit the signal in the next idle loop */
-                            init_id = g_idle_add(init_cb, NULL);
-                        }
-                    }
-                }
-            }
+static void removed_cb(void *data, OhmFact *fact, gpointer user_data)
+{
+    GSList *l;
+    rule_t *rule;
+    const char *name;
+
+    (void) data;
+    (void) user_data;
+
+    if (fact == NULL)
+        return;
+
+    name = ohm_structure_get_name(OHM_STRUCTURE(fact));
+    if (name == NULL)
+        return;
+
+    /* the selected fact is gone, the rules watching it are not active */
+    for (l = g_hash_table_lookup(rules_by_fact, name); l != NULL; l = l->next) {
+        rule = (rule_t *)l->data;
+
+        if (!rule->retired && rule->current == fact) {
+            rule->current = NULL;
+            set_active(rule, FALSE);
         }
     }
 }
 
+static void inserted_cb(void *data, OhmFact *fact, gpointer user_data)
+{
+    GSList *l;
+    rule_t *rule;
+    const char *name;
+
+    (void) data;
+    (void) user_data;
+
+    if (fact == NULL)
+        return;
+
+    name = ohm_structure_get_name(OHM_STRUCTURE(fact));
+    if (name == NULL)
+        return;
+
+    /* a new fact may be the one selected, evaluate it as a whole */
+    for (l = g_hash_table_lookup(rules_by_fact, name); l != NULL; l = l->next) {
+        rule = (rule_t *)l->data;
+
+        if (!rule->retired)
+            update_rule(rule, fact, 0, NULL);
+    }
+}
+
+static int parse_match(match_t *m, const char *field, const char *value)
+{
+    char *end;
+
+    if (field == NULL || !*field || value == NULL)
+        return FALSE;
+
+    m->field = g_quark_from_string(field);
+    m->value = g_strdup(value);
+    m->ivalue = (int)strtol(value, &end, 10);
+    m->isint = *value && !*end;
+
+    return TRUE;
+}
+
+static int parse_selector(rule_t *rule, const char *selector)
+{
+    char **pairs, *colon;
+    int    n, i;
+
+    if (selector == NULL)
+        return TRUE;
+
+    pairs = g_strsplit(selector, ",", 0);
+
+    for (n = 0; pairs[n] != NULL; n++)
+        ;
+
+    rule->select = g_new0(match_t, n);
+
+    for (i = 0; i < n; i++) {
+        g_strstrip(pairs[i]);
+
+        if ((colon = strchr(pairs[i], ':')) == NULL)
+            break;
+
+        *colon = '\0';
+
+        if (!parse_match(rule->select + i, g_strstrip(pairs[i]),
+                         g_strstrip(colon + 1)))
+            break;
+
+        rule->nselect++;
+    }
+
+    g_strfreev(pairs);
+
+    return i == n;
+}
+
+static int parse_edge(const char *edge)
+{
+    if (edge == NULL || !strcmp(edge, "rising"))
+        return EDGE_RISING;
+    if (!strcmp(edge, "falling"))
+        return EDGE_FALLING;
+    if (!strcmp(edge, "both"))
+        return EDGE_RISING | EDGE_FALLING;
+
+    return 0;
+}
+
+static void free_rule(rule_t *rule)
+{
+    int i;
+
+    for (i = 0; i < rule->nselect; i++)
+        g_free(rule->select[i].value);
+
+    g_free(rule->select);
+    g_free(rule->cond.value);
+    g_free(rule->name);
+    g_free(rule->fact);
+    g_free(rule->event);
+    g_free(rule->path);
+    g_free(rule->interface);
+    g_free(rule->signal);
+}
+
+static int parse_rule(rule_t *rule, GKeyFile *keyfile, const char *group)
+{
+    char *selector, *field, *value, *edge;
+    int   success;
+
+    rule->name      = g_strdup(group);
+    rule->fact      = g_key_file_get_value(keyfile, group, "fact", NULL);
+    rule->event     = g_key_file_get_value(keyfile, group, "event", NULL);
+    rule->path      = g_key_file_get_value(keyfile, group, "path", NULL);
+    rule->interface = g_key_file_get_value(keyfile, group, "interface", NULL);
+    rule->signal    = g_key_file_get_value(keyfile, group, "signal", NULL);
+    rule->once      = g_key_file_get_boolean(keyfile, group, "once", NULL);
+
+    selector = g_key_file_get_value(keyfile, group, "select", NULL);
+    field    = g_key_file_get_value(keyfile, group, "field", NULL);
+    value    = g_key_file_get_value(keyfile, group, "value", NULL);
+    edge     = g_key_file_get_value(keyfile, group, "edge", NULL);
+
+    success = FALSE;
+
+    if (rule->fact == NULL)
+        OHM_ERROR("upstart: rule %s has no fact", group);
+    else if (!parse_selector(rule, selector))
+        OHM_ERROR("upstart: rule %s has invalid selector '%s'", group,
+                  selector);
+    else if (!parse_match(&rule->cond, field, value))
+        OHM_ERROR("upstart: rule %s has no field or value", group);
+    else if ((rule->edge = parse_edge(edge)) == 0)
+        OHM_ERROR("upstart: rule %s has invalid edge '%s'", group, edge);
+    else if (rule->event == NULL &&
+             (rule->path == NULL || rule->interface == NULL ||
+              rule->signal == NULL))
+        OHM_ERROR("upstart: rule %s has no event or signal", group);
+    else
+        success = TRUE;
+
+    g_free(selector);
+    g_free(field);
+    g_free(value);
+    g_free(edge);
+
+    return success;
+}
+
+static void init_rule(rule_t *rule)
+{
+    OhmFactStore *fs = ohm_fact_store_get_fact_store();
+    OhmFact *fact;
+    GSList  *l;
+    GQuark   field = rule->cond.field;
+    int      active;
+
+    /* pick up the current state so that only real transitions trigger */
+    for (l = ohm_fact_store_get_facts_by_name(fs, rule->fact); l; l = l->next) {
+        fact   = (OhmFact *)l->data;
+        active = evaluate_rule(rule, fact, field,
+                               ohm_fact_get(fact, g_quark_to_string(field)));
+
+        if (active >= 0) {
+            rule->active = rule->reported = active;
+            break;
+        }
+    }
+}
+
+static int rules_init(OhmPlugin *plugin)
+{
+    GKeyFile   *keyfile;
+    GError     *error = NULL;
+    const char *path;
+    gchar     **groups;
+    gsize       ngroup, i;
+    GSList     *list;
+    rule_t     *rule;
+    int         success;
+
+    path    = ohm_plugin_get_param(plugin, "rules");
+    keyfile = g_key_file_new();
+
+    if (path != NULL &&
+        !g_key_file_load_from_file(keyfile, path, 0, &error)) {
+        /* ohm-running must be emitted even with a broken rules file */
+        OHM_ERROR("upstart: failed to load rules from %s (%s), "
+                  "using the built-in rule", path,
+                  error ? error->message : "unknown error");
+        g_clear_error(&error);
+        g_key_file_free(keyfile);
+
+        keyfile = g_key_file_new();
+        path    = NULL;
+    }
+
+    if (path == NULL) {
+        success = g_key_file_load_from_data(keyfile, default_rules,
+                                            sizeof(default_rules) - 1, 0,
+                                            &error);
+        if (!success) {
+            OHM_ERROR("upstart: failed to load the built-in rules (%s)",
+                      error ? error->message : "unknown error");
+            g_clear_error(&error);
+            g_key_file_free(keyfile);
+            return FALSE;
+        }
+    }
+
+    groups = g_key_file_get_groups(keyfile, &ngroup);
+
+    rules         = g_new0(rule_t, ngroup);
+    rules_by_fact = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          NULL, (GDestroyNotify)g_slist_free);
+
+    for (i = 0; i < ngroup; i++) {
+        rule = rules + nrule;
+
+        if (!parse_rule(rule, keyfile, groups[i])) {
+            free_rule(rule);
+            memset(rule, 0, sizeof(*rule));
+            continue;
+        }
+
+        /* the key is owned by the first rule on the fact */
+        if ((list = g_hash_table_lookup(rules_by_fact, rule->fact)) != NULL)
+            g_slist_append(list, rule);
+        else
+            g_hash_table_insert(rules_by_fact, rule->fact,
+                                g_slist_append(NULL, rule));
+
+        nrule++;
+    }
+
+    g_strfreev(groups);
+    g_key_file_free(keyfile);
+
+    /* rules are in place, the state can be taken now */
+    for (i = 0; i < (gsize)nrule; i++)
+        init_rule(rules + i);
+
+    nlive = nrule;
+
+    OHM_INFO("upstart: %d fact rules loaded", nrule);
+
+    return TRUE;
+}
+
+static void rules_exit(void)
+{
+    int i;
+
+    if (flush_id != 0) {
+        g_source_remove(flush_id);
+        flush_id = 0;
+    }
+
+    pending_head = NULL;
+    pending_tail = &pending_head;
+
+    if (rules_by_fact != NULL) {
+        g_hash_table_destroy(rules_by_fact);
+        rules_by_fact = NULL;
+    }
+
+    for (i = 0; i < nrule; i++)
+        free_rule(rules + i);
+
+    g_free(rules);
+    rules = NULL;
+    nrule = nlive = 0;
+
+    if (sys_conn != NULL) {
+        dbus_connection_unref(sys_conn);
+        sys_conn = NULL;
+    }
+}
+
 #define DRES_VARTYPE(t)  (char *)(t)
 #define DRES_VARVALUE(s) (char *)(s)
 
 static void plugin_init(OhmPlugin *plugin)
 {
-    (void) plugin;
     OhmFactStore *fs = ohm_fact_store_get_fact_store();
     char *respawn = NULL;
     struct utmp query;
@@ -173,12 +741,11 @@ static void plugin_init(OhmPlugin *plugin)
 
     OHM_INFO("upstart: init ...");
 
-    /* Assumption: Since this plugin only exists to watch the bootup
-     * sequence, the signalling may only happen after the plugin has
-     * been initialized. Thus we don't check the signaling fact state
-     * here but instead assume that it has been initialized as something
-     * else than 'signaled'. */
-    updated_id = g_signal_connect(G_OBJECT(fs), "updated" , G_CALLBACK(updated_cb) , NULL);
+    if (rules_init(plugin) && nrule > 0) {
+        updated_id = g_signal_connect(G_OBJECT(fs), "updated" , G_CALLBACK(updated_cb) , NULL);
+        removed_id = g_signal_connect(G_OBJECT(fs), "removed" , G_CALLBACK(removed_cb) , NULL);
+        inserted_id = g_signal_connect(G_OBJECT(fs), "inserted", G_CALLBACK(inserted_cb), NULL);
+    }
 
     respawn = getenv("UPSTART_JOB_RESPAWNED");
 
@@ -240,18 +807,13 @@ static void plugin_exit(OhmPlugin *plugin)
         return;
     }
 
-    if (g_signal_handler_is_connected(G_OBJECT(fs), updated_id)) {
-        g_signal_handler_disconnect(G_OBJECT(fs), updated_id);
-        updated_id = 0;
-    }
+    disconnect_factstore();
 
     if (enable_notifications_id != 0) {
         g_source_remove(enable_notifications_id);
     }
 
-    if (init_id) {
-        g_source_remove(init_id);
-    }
+    rules_exit();
 }
 
 
@@ -18,23 +18,8 @@ USA.
 *************************************************************************/
 
 
-#define STRUCT_OFFSET(s,m) ((char *)&(((s *)0)->m) - (char *)0)
-
 typedef int (*action_t)(videoep_t *, void *);
 
-typedef enum {
-    argtype_invalid = 0,
-    argtype_string,
-    argtype_integer,
-    argtype_unsigned
-} argtype_t;
-
-typedef struct {		/* argument descriptor for actions */
-    argtype_t     type;
-    const char   *name;
-    int           offs;
-} argdsc_t; 
-
 typedef struct {		/* action descriptor */
     const char   *name;
     action_t      handler;
@@ -49,7 +34,6 @@ typedef struct {                /* video routing data structure */
 
 static int route_action(videoep_t *, void *);
 static int action_parser(actdsc_t *, videoep_t *);
-static int get_args(OhmFact *, argdsc_t *, void *);
 
 
 static gboolean txparser(GObject *conn, GObject *transaction, gpointer data)
@@ -155,10 +139,11 @@ static int action_parser(actdsc_t *action, videoep_t *videoep)
 {
     (void)videoep;
 
-    OhmFact *fact;
-    GSList  *list;
-    char    *data;
-    int      success;
+    OhmFact    *fact;
+    GSList     *list;
+    char       *data;
+    int         success;
+    ep_error_t  err;
 
     if ((data = malloc(action->datalen)) == NULL) {
         OHM_ERROR("Can't allocate %d byte memory", action->datalen);
@@ -176,8 +161,10 @@ static int action_parser(actdsc_t *action, videoep_t *videoep)
 
         memset(data, 0, action->datalen);
 
-        if (!get_args(fact, action->argdsc, data))
+        if (!ep_args_parse(fact, action->argdsc, data, &err)) {
+            OHM_ERROR("videoep: invalid action: %s", err.msg);
             success &= FALSE;
+        }
         else
             success &= action->handler(videoep, data);
     }
@@ -187,46 +174,6 @@ static int action_parser(actdsc_t *action, videoep_t *videoep)
     return success;
 }
 
-static int get_args(OhmFact *fact, argdsc_t *argdsc, void *args)
-{
-    argdsc_t *ad;
-    GValue   *gv;
-    void     *vptr;
-
-    if (fact == NULL)
-        return FALSE;
-
-    for (ad = argdsc;    ad->type != argtype_invalid;   ad++) {
-        vptr = args + ad->offs;
-
-        if ((gv = ohm_fact_get(fact, ad->name)) == NULL)
-            continue;
-
-        switch (ad->type) {
-
-        case argtype_string:
-            if (G_VALUE_TYPE(gv) == G_TYPE_STRING)
-                *(const char **)vptr = g_value_get_string(gv);
-            break;
-
-        case argtype_integer:
-            if (G_VALUE_TYPE(gv) == G_TYPE_LONG)
-                *(long *)vptr = g_value_get_long(gv);
-            break;
-
-        case argtype_unsigned:
-            if (G_VALUE_TYPE(gv) == G_TYPE_ULONG)
-                *(unsigned long *)vptr = g_value_get_ulong(gv);
-            break;
-
-        default:
-            break;
-        }
-    }
-
-    return TRUE;
-}
-
 /*
  * Local Variables:
  * c-basic-offset: 4
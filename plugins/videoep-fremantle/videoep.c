@@ -49,6 +49,7 @@ USA.
 #include "txparser.h"
 #include "xrt.h"
 #include "notify.h"
+#include "ep-args.h"
 
 typedef void (*internal_ep_cb_t) (GObject *ep, GObject *transaction, gboolean success);
 
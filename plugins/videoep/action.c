@@ -36,8 +36,7 @@ USA.
 #include "xif.h"
 #include "router.h"
 #include "videoipc.h"
-
-#define STRUCT_OFFSET(s,m) ((char *)&(((s *)0)->m) - (char *)0)
+#include "ep-args.h"
 
 /* in this module we need this to be signed */
 #ifdef  DIM
@@ -53,19 +52,6 @@ typedef void (*internal_ep_cb_t) (GObject *ep,
                                   gboolean success);
 typedef int (*action_t)(void *);
 
-typedef enum {
-    argtype_invalid = 0,
-    argtype_string,
-    argtype_integer,
-    argtype_unsigned
-} argtype_t;
-
-typedef struct {		/* argument descriptor for actions */
-    argtype_t     type;
-    const char   *name;
-    int           offs;
-} argdsc_t; 
-
 typedef struct {		/* action descriptor */
     const char   *name;
     action_t      handler;
@@ -105,7 +91,6 @@ static gboolean transaction_parser(GObject *, GObject *, gpointer);
 static int route_action(void *);
 static int xvuser_action(void *);
 static int action_parser(actdsc_t *);
-static int get_args(OhmFact *, argdsc_t *, void *);
 
 
 /*! \addtogroup pubif
@@ -330,10 +315,11 @@ static int xvuser_action(void *data)
 
 static int action_parser(actdsc_t *action)
 {
-    OhmFact *fact;
-    GSList  *list;
-    char    *data;
-    int      success;
+    OhmFact    *fact;
+    GSList     *list;
+    char       *data;
+    int         success;
+    ep_error_t  err;
 
     if ((data = malloc(action->datalen)) == NULL) {
         OHM_ERROR("videoep: Can't allocate %d byte memory", action->datalen);
@@ -351,8 +337,10 @@ static int action_parser(actdsc_t *action)
 
         memset(data, 0, action->datalen);
 
-        if (!get_args(fact, action->argdsc, data))
+        if (!ep_args_parse(fact, action->argdsc, data, &err)) {
+            OHM_ERROR("videoep: invalid action: %s", err.msg);
             success &= FALSE;
+        }
         else
             success &= action->handler(data);
     }
@@ -362,46 +350,6 @@ static int action_parser(actdsc_t *action)
     return success;
 }
 
-static int get_args(OhmFact *fact, argdsc_t *argdsc, void *args)
-{
-    argdsc_t *ad;
-    GValue   *gv;
-    void     *vptr;
-
-    if (fact == NULL)
-        return FALSE;
-
-    for (ad = argdsc;    ad->type != argtype_invalid;   ad++) {
-        vptr = args + ad->offs;
-
-        if ((gv = ohm_fact_get(fact, ad->name)) == NULL)
-            continue;
-
-        switch (ad->type) {
-
-        case argtype_string:
-            if (G_VALUE_TYPE(gv) == G_TYPE_STRING)
-                *(const char **)vptr = g_value_get_string(gv);
-            break;
-
-        case argtype_integer:
-            if (G_VALUE_TYPE(gv) == G_TYPE_INT)
-                *(int *)vptr = g_value_get_int(gv);
-            break;
-
-        case argtype_unsigned:
-            if (G_VALUE_TYPE(gv) == G_TYPE_ULONG)
-                *(unsigned long *)vptr = g_value_get_ulong(gv);
-            break;
-
-        default:
-            break;
-        }
-    }
-
-    return TRUE;
-}
-
 
 
 
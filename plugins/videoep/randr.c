@@ -44,6 +44,25 @@ typedef struct statecb_slot_s {
     void                   *data;
 } statecb_slot_t;
 
+typedef struct {
+    randr_crtc_t           *crtc;
+    int                     sync;
+    int32_t                 reqx;
+    int32_t                 reqy;
+    uint32_t                mode;
+    uint32_t                width;
+    uint32_t                height;
+    int                     noutput;
+    uint32_t               *outputs;
+} crtc_state_t;
+
+typedef struct {
+    int                     active;
+    int                     failed;
+    int                     nsaved;
+    crtc_state_t           *saved;  /* crtc requests before the transaction */
+} transaction_t;
+
 static int                  connup;
 static int                  ready;
 static uint32_t             nmode;
@@ -54,6 +73,7 @@ static randr_outprop_def_t *outprops;
 static statecb_slot_t      *statecbs;
 static int32_t              crtc_x;
 static int32_t              crtc_y;
+static transaction_t        transaction;
 
 static void connection_state(int, void *);
 
@@ -68,6 +88,8 @@ static int             screen_check_if_ready(randr_screen_t *);
 static void            screen_synchronize(randr_screen_t *);
 static void            screen_set_size(randr_screen_t *, uint32_t, uint32_t);
 static randr_screen_t *screen_find_by_rootwin(uint32_t);
+static void            screen_index(randr_screen_t *);
+static void            screen_index_free(randr_screen_t *);
 
 static randr_crtc_t   *crtc_register(randr_screen_t *, uint32_t);
 static void            crtc_unregister(randr_crtc_t *);
@@ -82,6 +104,7 @@ static void            crtc_synchronize(randr_crtc_t *, int);
 static uint32_t        crtc_horizontal_position(randr_crtc_t *);
 static uint32_t        crtc_vertical_position(randr_crtc_t *);
 static randr_crtc_t   *crtc_find_by_id(randr_screen_t *, uint32_t);
+static randr_crtc_t   *crtc_find_by_index(int, int);
 
 static randr_output_t *output_register(randr_screen_t *, uint32_t);
 static void            output_unregister(randr_output_t *);
@@ -119,6 +142,13 @@ static void            mode_synchronize(randr_mode_t *);
 static randr_mode_t   *mode_find_by_id(randr_screen_t *, uint32_t);
 static randr_mode_t   *mode_find_by_name(randr_screen_t *, char *);
 
+static void transaction_save(void);
+static void transaction_restore(void);
+static void transaction_release(void);
+static void transaction_fail(void);
+static int  transaction_validate(void);
+
+static int   same_xids(int, uint32_t *, int, uint32_t *);
 static char *print_xids(int, uint32_t *, char *, int);
 static char *print_propval(videoep_value_type_t, void *, char *, int);
 
@@ -214,46 +244,51 @@ void randr_mode_create(randr_mode_def_t *def)
 
 void randr_crtc_set_position(int screen_id, int crtc_id, uint32_t x,uint32_t y)
 {
-    randr_screen_t *screen;
     randr_crtc_t   *crtc;
 
-    if (screen_id >= 0 && screen_id < nscreen) {
-        screen = screens + screen_id;
-
-        if (crtc_id >=  0 && crtc_id < screen->ncrtc) {
-            crtc = screen->crtcs + crtc_id;
+    if ((crtc = crtc_find_by_index(screen_id, crtc_id)) != NULL) {
+        /* appended positions are resolved and checked at synchronization */
+        if ((x != POSITION_DONTCARE && x != POSITION_APPEND &&
+             (int32_t)x != crtc->x) ||
+            (y != POSITION_DONTCARE && y != POSITION_APPEND &&
+             (int32_t)y != crtc->y))
+            crtc->sync = TRUE;
 
-            crtc->reqx = x;
-            crtc->reqy = y;
-        }
+        crtc->reqx = x;
+        crtc->reqy = y;
     }
 }
 
 void randr_crtc_set_mode(int screen_id, int crtc_id, char *modname)
 {
-    randr_screen_t *screen;
     randr_crtc_t   *crtc;
     randr_mode_t   *mode;
+    uint32_t        xid, width, height;
 
-    if (screen_id >= 0 && screen_id < nscreen) {
-        screen = screens + screen_id;
+    if ((crtc = crtc_find_by_index(screen_id, crtc_id)) == NULL)
+        return;
 
-        if (crtc_id >=  0 && crtc_id < screen->ncrtc) {
-            crtc = screen->crtcs + crtc_id;
+    if (modname == NULL) {
+        xid    = 0;
+        width  = 0;
+        height = 0;
+    }
+    else if ((mode = mode_find_by_name(crtc->screen, modname)) != NULL) {
+        xid    = mode->xid;
+        width  = mode->width;
+        height = mode->height;
+    }
+    else {
+        OHM_ERROR("videoep: can't find mode '%s'", modname);
+        transaction_fail();
+        return;
+    }
 
-            if (modname == NULL) {
-                crtc->sync   = TRUE;
-                crtc->mode   = 0;
-                crtc->width  = 0;
-                crtc->height = 0;
-            }
-            else if ((mode = mode_find_by_name(screen, modname)) != NULL) {
-                crtc->sync   = TRUE;
-                crtc->mode   = mode->xid;
-                crtc->width  = mode->width;
-                crtc->height = mode->height;
-            }
-        }
+    if (xid != crtc->mode || width != crtc->width || height != crtc->height) {
+        crtc->sync   = TRUE;
+        crtc->mode   = xid;
+        crtc->width  = width;
+        crtc->height = height;
     }
 }
 
@@ -262,66 +297,68 @@ void randr_crtc_set_outputs(int        screen_id,
                             int        noutput,
                             char     **outnames)
 {
-    randr_screen_t *screen;
     randr_crtc_t   *crtc;
     randr_output_t *output;
     uint32_t       *outputs;
     int             valid;
     char            buf[256];
-    int             i;
+    int             i, j;
 
-    if (screen_id >= 0 && screen_id < nscreen) {
-        screen = screens + screen_id;
+    if ((crtc = crtc_find_by_index(screen_id, crtc_id)) == NULL)
+        return;
 
-        if (crtc_id >=  0 && crtc_id < screen->ncrtc) {
-            crtc = screen->crtcs + crtc_id;
+    if (noutput < 1 || outnames == NULL) {
+        noutput = 0;
+        outputs = NULL;
+    }
+    else {
+        if ((outputs = malloc(sizeof(uint32_t) * noutput)) == NULL) {
+            OHM_ERROR("videoep: can't allocate memory for crtc outputs");
+            transaction_fail();
+            return;
+        }
 
-            if (noutput < 1 || outnames == NULL) {
-                noutput = 0;
-                outputs = NULL;
+        for (i = 0;  i < noutput;  i++) {
+            if (!(output = output_find_by_name(crtc->screen, outnames[i]))) {
+                OHM_ERROR("videoep: can't find output '%s'",
+                          outnames[i] ? outnames[i] : "<null>");
+                free(outputs);
+                transaction_fail();
+                return;
             }
-            else {
-                if ((outputs = malloc(sizeof(uint32_t) * noutput)) != NULL) {
-
-                    for (i = 0;  i < noutput;  i++) {
-                        if (!(output=output_find_by_name(screen,outnames[i]))){
-                            OHM_ERROR("videoep: can't find output '%s'",
-                                      outnames[i] ? outnames[i] : "<null>");
-                            free(outputs);
-                            return;
-                        }
-
-                        for (i = 0, valid = FALSE;  i < crtc->npossible;  i++){
-                            if (output->xid == crtc->possibles[i]) {
-                                valid = TRUE;
-                                break;
-                            }
-                        }
-                      
-                        if (!valid) {
-                            OHM_ERROR("videoep: output '%s' is not "
-                                      "allowed for crtc 0x%x",
-                                      outnames[i] ? outnames[i]:"<null>",
-                                      crtc->xid);
-                            free(outputs);
-                            return;
-                        }
-
-                        outputs[i] = output->xid;
-                    } /* for */
+
+            for (j = 0, valid = FALSE;  j < crtc->npossible;  j++) {
+                if (output->xid == crtc->possibles[j]) {
+                    valid = TRUE;
+                    break;
                 }
             }
 
-            free(crtc->outputs);
-                
-            crtc->sync    = TRUE;
-            crtc->noutput = noutput;
-            crtc->outputs = outputs;
+            if (!valid) {
+                OHM_ERROR("videoep: output '%s' is not allowed for crtc 0x%x",
+                          outnames[i], crtc->xid);
+                free(outputs);
+                transaction_fail();
+                return;
+            }
 
-            OHM_DEBUG(DBG_RANDR, "setting outputs %s for crtc 0x%x",
-                      print_xids(noutput,outputs, buf,sizeof(buf)), crtc->xid);
-        }
+            outputs[i] = output->xid;
+        } /* for */
+    }
+
+    if (same_xids(noutput, outputs, crtc->noutput, crtc->outputs)) {
+        free(outputs);
+        return;
     }
+
+    free(crtc->outputs);
+
+    crtc->sync    = TRUE;
+    crtc->noutput = noutput;
+    crtc->outputs = outputs;
+
+    OHM_DEBUG(DBG_RANDR, "setting outputs %s for crtc 0x%x",
+              print_xids(noutput,outputs, buf,sizeof(buf)), crtc->xid);
 }
 
 void randr_output_define_property(char                 *output,
@@ -416,8 +453,66 @@ void randr_synchronize(void)
 {
     int i;
 
+    if (transaction.active)
+        randr_transaction_commit();
+    else {
+        xif_batch_begin();
+
+        for (i = 0;  i < nscreen;  i++)
+            screen_synchronize(screens + i);
+
+        xif_batch_end();
+    }
+}
+
+/*
+ * A transaction collects the crtc changes of a policy decision. They are
+ * validated against the registries at commit and sent to the X server in
+ * a single batch, or dropped altogether if anything was wrong with them.
+ */
+void randr_transaction_begin(void)
+{
+    if (transaction.active) {
+        OHM_ERROR("videoep: RandR transaction is already in progress");
+        return;
+    }
+
+    transaction_save();
+}
+
+int randr_transaction_commit(void)
+{
+    int i;
+
+    if (!transaction.active) {
+        OHM_ERROR("videoep: no RandR transaction to commit");
+        return -1;
+    }
+
+    if (transaction.failed || !transaction_validate()) {
+        OHM_ERROR("videoep: invalid RandR configuration; transaction aborted");
+        randr_transaction_abort();
+        return -1;
+    }
+
+    transaction_release();
+
+    xif_batch_begin();
+
     for (i = 0;  i < nscreen;  i++)
         screen_synchronize(screens + i);
+
+    xif_batch_end();
+
+    return 0;
+}
+
+void randr_transaction_abort(void)
+{
+    if (transaction.active) {
+        transaction_restore();
+        transaction_release();
+    }
 }
 
 
@@ -540,6 +635,8 @@ static void screen_reset(randr_screen_t *screen)
         free(screen->outputs);
         free(screen->modes);
 
+        screen_index_free(screen);
+
         memset(screen, 0, sizeof(randr_screen_t));
     }
 }
@@ -608,6 +705,7 @@ static int screen_check_if_ready(randr_screen_t *screen)
 
 static void screen_synchronize(randr_screen_t *screen)
 {
+    int changed;
     int i;
 
     if (screen->sync) {
@@ -620,8 +718,11 @@ static void screen_synchronize(randr_screen_t *screen)
     for (i = 0;  i < screen->noutput;  i++)
         output_synchronize(screen->outputs + i);
 
+    changed = FALSE;
+
     for (i = 0, crtc_x = crtc_y = 0;  i < screen->ncrtc;  i++) {
         crtc_synchronize(screen->crtcs + i, DRYRUN); /* sets crtc_[xy] */
+        changed |= screen->crtcs[i].sync;
         /*
          * The necessary conditions of CRTC disabling are undetermined, and
          * disabling of it leads to nasty blinking outputs, so let's update
@@ -631,7 +732,9 @@ static void screen_synchronize(randr_screen_t *screen)
          */
     }
 
-    screen_set_size(screen, crtc_x, crtc_y);
+    /* the screen size only follows the crtcs */
+    if (changed)
+        screen_set_size(screen, crtc_x, crtc_y);
 
     for (i = 0, crtc_x = crtc_y = 0;  i < screen->ncrtc;  i++)
         crtc_synchronize(screen->crtcs + i, SYNCHRONIZE);
@@ -670,6 +773,69 @@ static randr_screen_t *screen_find_by_rootwin(uint32_t rootwin)
     return NULL;
 }
 
+static void screen_index(randr_screen_t *screen)
+{
+    randr_crtc_t   *crtc;
+    randr_output_t *output;
+    randr_mode_t   *mode;
+    int             i;
+
+    if (screen->index.crtc == NULL) {
+        screen->index.crtc    = g_hash_table_new(g_direct_hash,g_direct_equal);
+        screen->index.output  = g_hash_table_new(g_direct_hash,g_direct_equal);
+        screen->index.outname = g_hash_table_new(g_str_hash, g_str_equal);
+        screen->index.mode    = g_hash_table_new(g_direct_hash,g_direct_equal);
+        screen->index.modname = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+    else {
+        g_hash_table_remove_all(screen->index.crtc);
+        g_hash_table_remove_all(screen->index.output);
+        g_hash_table_remove_all(screen->index.outname);
+        g_hash_table_remove_all(screen->index.mode);
+        g_hash_table_remove_all(screen->index.modname);
+    }
+
+    /*
+     * The registries are reallocated as they grow, so the tables are
+     * rebuilt whenever an entry is added or removed. Where a name is not
+     * unique the first entry is kept, as the linear lookup used to do.
+     */
+    for (i = 0;  i < screen->ncrtc;  i++) {
+        crtc = screen->crtcs + i;
+        g_hash_table_insert(screen->index.crtc,
+                            GUINT_TO_POINTER(crtc->xid), crtc);
+    }
+
+    for (i = screen->noutput - 1;  i >= 0;  i--) {
+        output = screen->outputs + i;
+        g_hash_table_insert(screen->index.output,
+                            GUINT_TO_POINTER(output->xid), output);
+        if (output->name != NULL)
+            g_hash_table_insert(screen->index.outname, output->name, output);
+    }
+
+    for (i = screen->nmode - 1;  i >= 0;  i--) {
+        mode = screen->modes + i;
+        g_hash_table_insert(screen->index.mode,
+                            GUINT_TO_POINTER(mode->xid), mode);
+        if (mode->name != NULL)
+            g_hash_table_insert(screen->index.modname, mode->name, mode);
+    }
+}
+
+static void screen_index_free(randr_screen_t *screen)
+{
+    if (screen->index.crtc != NULL) {
+        g_hash_table_destroy(screen->index.crtc);
+        g_hash_table_destroy(screen->index.output);
+        g_hash_table_destroy(screen->index.outname);
+        g_hash_table_destroy(screen->index.mode);
+        g_hash_table_destroy(screen->index.modname);
+
+        memset(&screen->index, 0, sizeof(screen->index));
+    }
+}
+
 static randr_crtc_t *crtc_register(randr_screen_t *screen, uint32_t xid)
 {
     randr_crtc_t  *crtc = NULL;
@@ -695,6 +861,8 @@ static randr_crtc_t *crtc_register(randr_screen_t *screen, uint32_t xid)
             crtc->xid    = xid;
             crtc->reqx   = POSITION_DONTCARE;
             crtc->reqy   = POSITION_DONTCARE;
+
+            screen_index(screen);
             
             crtc_query(screen->rootwin, xid, XCB_CURRENT_TIME);
         }
@@ -719,6 +887,8 @@ static void crtc_unregister(randr_crtc_t *crtc)
                 screen->crtcs[i] = screen->crtcs[i + 1];
 
             screen->ncrtc--;
+
+            screen_index(screen);
         }
     }
 }
@@ -957,6 +1127,10 @@ static void crtc_synchronize(randr_crtc_t *randr_crtc, int dryrun)
     x = crtc_horizontal_position(randr_crtc);
     y = crtc_vertical_position(randr_crtc);
 
+    if (randr_crtc->mode && ((int32_t)x != randr_crtc->x ||
+                             (int32_t)y != randr_crtc->y))
+        randr_crtc->sync = TRUE;
+
     if (randr_crtc->sync && !dryrun) {
         
         OHM_DEBUG(DBG_RANDR, "synchronizing crtc 0x%x on root window 0x%x "
@@ -983,10 +1157,15 @@ static void crtc_synchronize(randr_crtc_t *randr_crtc, int dryrun)
         xif_crtc_config(screen->tstamp, &xif_crtc);
 
         randr_crtc->sync = FALSE;
+        randr_crtc->x    = x;
+        randr_crtc->y    = y;
     }
 
-    crtc_x = x + randr_crtc->width;
-    crtc_y = y + randr_crtc->height;
+    /* disabled crtcs do not take space on the screen */
+    if (randr_crtc->mode) {
+        crtc_x = x + randr_crtc->width;
+        crtc_y = y + randr_crtc->height;
+    }
 }
 
 static uint32_t crtc_horizontal_position(randr_crtc_t *crtc)
@@ -1017,18 +1196,27 @@ static uint32_t crtc_vertical_position(randr_crtc_t *crtc)
 
 static randr_crtc_t *crtc_find_by_id(randr_screen_t *screen,uint32_t xid)
 {
-    randr_crtc_t *crtc;
-    int           i;
+    if (screen == NULL || screen->index.crtc == NULL)
+        return NULL;
 
-    if (screen != NULL) {
-        for (i = 0;   i < screen->ncrtc;   i++) {
-            crtc = screen->crtcs + i;
+    return g_hash_table_lookup(screen->index.crtc, GUINT_TO_POINTER(xid));
+}
 
-            if (xid == crtc->xid)
-                return crtc;
-        }
+static randr_crtc_t *crtc_find_by_index(int screen_id, int crtc_id)
+{
+    randr_screen_t *screen;
+
+    if (screen_id >= 0 && screen_id < nscreen) {
+        screen = screens + screen_id;
+
+        if (crtc_id >= 0 && crtc_id < screen->ncrtc)
+            return screen->crtcs + crtc_id;
     }
 
+    OHM_ERROR("videoep: can't find crtc %d on screen %d", crtc_id, screen_id);
+
+    transaction_fail();
+
     return NULL;
 }
 
@@ -1057,6 +1245,8 @@ static randr_output_t *output_register(randr_screen_t *screen, uint32_t xid)
             output->screen = screen;
             output->xid    = xid;
 
+            screen_index(screen);
+
             output_query(screen->rootwin, xid, XCB_CURRENT_TIME);
         }
     }
@@ -1081,6 +1271,8 @@ static void output_unregister(randr_output_t *output)
                 screen->outputs[i] = screen->outputs[i + 1];
 
             screen->noutput--;
+
+            screen_index(screen);
         }
     }
 }
@@ -1156,6 +1348,8 @@ static void output_query_finish(xif_output_t *xif_output, void *usrdata)
             modes[i] = xif_output->modes[i];
     }
 
+    screen_index(screen);
+
     OHM_DEBUG(DBG_RANDR, "output 0x%x query complete for rootwin 0x%x '%s' "
               "no.of clones %d modes %s state '%s'", xif_output->xid,
               xif_output->window, xif_output->name, xif_output->nclone,
@@ -1334,36 +1528,18 @@ static void output_synchronize(randr_output_t *output)
 
 static randr_output_t *output_find_by_id(randr_screen_t *screen, uint32_t xid)
 {
-    randr_output_t *output;
-    int             i;
-
-    if (screen != NULL) {
-        for (i = 0;   i < screen->noutput;    i++) {
-            output = screen->outputs + i;
+    if (screen == NULL || screen->index.output == NULL)
+        return NULL;
 
-            if (xid == output->xid)
-                return output;
-        }
-    }
-    
-    return NULL;
+    return g_hash_table_lookup(screen->index.output, GUINT_TO_POINTER(xid));
 }
 
 static randr_output_t *output_find_by_name(randr_screen_t *screen, char *name)
 {
-    randr_output_t *output;
-    int             i;
+    if (screen == NULL || name == NULL || screen->index.outname == NULL)
+        return NULL;
 
-    if (screen != NULL && name != NULL) {
-        for (i = 0;   i < screen->noutput;    i++) {
-            output = screen->outputs + i;
-
-            if (output->name != NULL && !strcmp(name, output->name))
-                return output;
-        }
-    }
-    
-    return NULL;
+    return g_hash_table_lookup(screen->index.outname, name);
 }
 
 
@@ -1665,6 +1841,8 @@ static randr_mode_t *mode_register(randr_screen_t *screen,xif_mode_t *xif_mode)
                       randr_mode->name, randr_mode->xid,
                       screen->rootwin, randr_mode->width,randr_mode->height,
                       randr_mode->clock, randr_mode->flags);
+
+            screen_index(screen);
         }
 
     }
@@ -1688,6 +1866,8 @@ static void mode_unregister(randr_mode_t *mode)
                 screen->modes[i] = screen->modes[i + 1];
 
             screen->nmode--;
+
+            screen_index(screen);
         }
     }
 }
@@ -1714,40 +1894,187 @@ static void mode_synchronize(randr_mode_t *mode)
 
 static randr_mode_t *mode_find_by_id(randr_screen_t *screen, uint32_t xid)
 {
-    randr_mode_t *mode;
-    int           i;
+    if (screen == NULL || screen->index.mode == NULL)
+        return NULL;
 
-    if (screen != NULL) {
-        for (i = 0;   i < screen->nmode;    i++) {
-            mode = screen->modes + i;
+    return g_hash_table_lookup(screen->index.mode, GUINT_TO_POINTER(xid));
+}
+
+
+static randr_mode_t *mode_find_by_name(randr_screen_t *screen, char *name)
+{
+    if (screen == NULL || name == NULL || screen->index.modname == NULL)
+        return NULL;
+
+    return g_hash_table_lookup(screen->index.modname, name);
+}
+
+
+static void transaction_save(void)
+{
+    randr_screen_t *screen;
+    randr_crtc_t   *crtc;
+    crtc_state_t   *st;
+    size_t          size;
+    int             i, j, n;
+
+    memset(&transaction, 0, sizeof(transaction));
+    transaction.active = TRUE;
+
+    for (i = 0, n = 0;  i < nscreen;  i++)
+        n += screens[i].ncrtc;
+
+    if (n == 0)
+        return;
+
+    if ((transaction.saved = calloc(n, sizeof(crtc_state_t))) == NULL) {
+        OHM_ERROR("videoep: can't allocate memory for RandR transaction");
+        transaction.failed = TRUE;
+        return;
+    }
+
+    for (i = 0;  i < nscreen;  i++) {
+        screen = screens + i;
 
-            if (xid == mode->xid)
-                return mode;
+        for (j = 0;  j < screen->ncrtc;  j++) {
+            crtc = screen->crtcs + j;
+            st   = transaction.saved + transaction.nsaved++;
+
+            st->crtc    = crtc;
+            st->sync    = crtc->sync;
+            st->reqx    = crtc->reqx;
+            st->reqy    = crtc->reqy;
+            st->mode    = crtc->mode;
+            st->width   = crtc->width;
+            st->height  = crtc->height;
+            st->noutput = crtc->noutput;
+
+            if (crtc->noutput > 0 && crtc->outputs != NULL) {
+                size = sizeof(uint32_t) * crtc->noutput;
+
+                if ((st->outputs = malloc(size)) == NULL) {
+                    OHM_ERROR("videoep: can't allocate memory for "
+                              "RandR transaction");
+                    transaction.failed = TRUE;
+                    st->noutput = 0;
+                }
+                else
+                    memcpy(st->outputs, crtc->outputs, size);
+            }
         }
     }
-    
-    return NULL;
 }
 
-
-static randr_mode_t *mode_find_by_name(randr_screen_t *screen, char *name)
+static void transaction_restore(void)
 {
-    randr_mode_t *mode;
+    randr_crtc_t *crtc;
+    crtc_state_t *st;
     int           i;
 
-    if (screen != NULL && name != NULL) {
-        for (i = 0;   i < screen->nmode;    i++) {
-            mode = screen->modes + i;
+    for (i = 0;  i < transaction.nsaved;  i++) {
+        st   = transaction.saved + i;
+        crtc = st->crtc;
+
+        free(crtc->outputs);
+
+        crtc->sync    = st->sync;
+        crtc->reqx    = st->reqx;
+        crtc->reqy    = st->reqy;
+        crtc->mode    = st->mode;
+        crtc->width   = st->width;
+        crtc->height  = st->height;
+        crtc->noutput = st->noutput;
+        crtc->outputs = st->outputs;
+
+        st->outputs = NULL;
+    }
+}
+
+static void transaction_release(void)
+{
+    int i;
+
+    for (i = 0;  i < transaction.nsaved;  i++)
+        free(transaction.saved[i].outputs);
+
+    free(transaction.saved);
 
-            if (mode->name != NULL && !strcmp(name, mode->name))
-                return mode;
+    memset(&transaction, 0, sizeof(transaction));
+}
+
+static void transaction_fail(void)
+{
+    if (transaction.active)
+        transaction.failed = TRUE;
+}
+
+static int transaction_validate(void)
+{
+    randr_screen_t *screen;
+    randr_crtc_t   *crtc;
+    randr_crtc_t   *owner;
+    GHashTable     *claimed;
+    gpointer        key;
+    int             valid;
+    int             i, j, k;
+
+    for (i = 0, valid = TRUE;  i < nscreen;  i++) {
+        screen  = screens + i;
+        claimed = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+        for (j = 0;  j < screen->ncrtc;  j++) {
+            crtc = screen->crtcs + j;
+
+            if (!crtc->sync)
+                continue;
+
+            if (crtc->mode && !mode_find_by_id(screen, crtc->mode)) {
+                OHM_ERROR("videoep: crtc 0x%x has unknown mode 0x%x",
+                          crtc->xid, crtc->mode);
+                valid = FALSE;
+            }
+
+            for (k = 0;  k < crtc->noutput;  k++) {
+                key = GUINT_TO_POINTER(crtc->outputs[k]);
+
+                if (!output_find_by_id(screen, crtc->outputs[k])) {
+                    OHM_ERROR("videoep: crtc 0x%x has unknown output 0x%x",
+                              crtc->xid, crtc->outputs[k]);
+                    valid = FALSE;
+                }
+                else if ((owner = g_hash_table_lookup(claimed, key))) {
+                    OHM_ERROR("videoep: output 0x%x is assigned to both "
+                              "crtc 0x%x and 0x%x", crtc->outputs[k],
+                              owner->xid, crtc->xid);
+                    valid = FALSE;
+                }
+                else
+                    g_hash_table_insert(claimed, key, crtc);
+            }
         }
+
+        g_hash_table_destroy(claimed);
     }
-    
-    return NULL;
+
+    return valid;
 }
 
 
+static int same_xids(int n1, uint32_t *xids1, int n2, uint32_t *xids2)
+{
+    int i;
+
+    if (n1 != n2)
+        return FALSE;
+
+    for (i = 0;  i < n1;  i++) {
+        if (xids1[i] != xids2[i])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
 static char *print_xids(int nxid, uint32_t *xids, char *buf, int len)
 {
     int   i;
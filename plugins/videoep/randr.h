@@ -22,6 +22,7 @@ USA.
 #define __OHM_VIDEOEP_RANDR_H__
 
 #include <stdint.h>
+#include <glib.h>
 
 #include "data-types.h"
 
@@ -152,6 +153,13 @@ typedef struct randr_screen_s {
     randr_output_t        *outputs;
     int                    nmode;
     randr_mode_t          *modes;
+    struct {                                    /* lookup tables */
+        GHashTable        *crtc;                /*   crtc by xid */
+        GHashTable        *output;              /*   output by xid */
+        GHashTable        *outname;             /*   output by name */
+        GHashTable        *mode;                /*   mode by xid */
+        GHashTable        *modname;             /*   mode by name */
+    }                      index;
 } randr_screen_t;
 
 
@@ -177,6 +185,10 @@ videoep_value_type_t randr_output_get_property_type(char *);
 
 void randr_synchronize(void);
 
+void randr_transaction_begin(void);
+int  randr_transaction_commit(void);
+void randr_transaction_abort(void);
+
 #endif /* __OHM_VIDEOEP_RANDR_H__ */
 
 /* 
@@ -336,6 +336,8 @@ int router_new_setup(char *new_device, char *new_tvstd, char *new_ratio)
         }
     }
 
+    randr_transaction_begin();
+
     if (device_changed)
         config_device(device);
 
@@ -345,7 +347,7 @@ int router_new_setup(char *new_device, char *new_tvstd, char *new_ratio)
     if (ratio_changed)
         config_ratio(ratio);
 
-    randr_synchronize();
+    randr_transaction_commit();
 
     return TRUE;
 }
@@ -361,10 +363,11 @@ static void randr_state(int ready, void *data)
     if (ready) {
         OHM_DEBUG(DBG_ROUTE, "randr is ready");
 
+        randr_transaction_begin();
         config_device(device);
         config_tvstd(tvstd);
         config_ratio(ratio);
-        randr_synchronize();
+        randr_transaction_commit();
     }
 }
 
@@ -0,0 +1,629 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_randr.c
+ * @brief RandR transaction tests against a mock xif backend
+ */
+
+#include <check.h>
+#include "../randr.c"
+
+#define ROOTWIN  0x100
+#define CRTC0    0x10
+#define CRTC1    0x11
+#define LCD      0x20
+#define TV       0x21
+#define MODE_LCD 0x30
+#define MODE_TV  0x31
+
+int DBG_RANDR;
+
+static int nrequest;           /* requests sent to the mock X server */
+static int nflush;             /* writes to the mock X server */
+static int unflushed;
+static int depth;
+static int nresize;            /* screen size changes requested */
+static uint32_t scrwidth;
+static uint32_t scrheight;
+
+typedef struct {
+    uint32_t xid;
+    int32_t  x;
+    int32_t  y;
+    uint32_t mode;
+    int      noutput;
+    uint32_t output;
+} crtc_config_t;
+
+static crtc_config_t configured[2];    /* last configuration of the crtcs */
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level != OHM_LOG_ERROR)
+        return;
+
+    va_start(ap, format);
+    fputs("E: ", stderr);
+    vfprintf(stderr, format, ap);
+    fputs("\n", stderr);
+    va_end(ap);
+}
+
+void plugin_print_timestamp(const char *function, const char *phase)
+{
+    (void)function;
+    (void)phase;
+}
+
+static void request(void)
+{
+    nrequest++;
+
+    if (depth > 0)
+        unflushed = TRUE;
+    else
+        nflush++;
+}
+
+void xif_batch_begin(void)
+{
+    depth++;
+}
+
+void xif_batch_end(void)
+{
+    if (depth > 0 && --depth == 0 && unflushed) {
+        unflushed = FALSE;
+        nflush++;
+    }
+}
+
+int xif_crtc_config(uint32_t cfgtime, xif_crtc_t *crtc)
+{
+    int i = (crtc->xid == CRTC1);
+
+    (void)cfgtime;
+
+    configured[i].xid     = crtc->xid;
+    configured[i].x       = crtc->x;
+    configured[i].y       = crtc->y;
+    configured[i].mode    = crtc->mode;
+    configured[i].noutput = crtc->noutput;
+    configured[i].output  = crtc->noutput > 0 ? crtc->outputs[0] : 0;
+
+    request();
+
+    return 0;
+}
+
+int xif_screen_set_size(uint32_t rootwin, uint32_t width, uint32_t height,
+                        uint32_t mm_width, uint32_t mm_height)
+{
+    (void)rootwin;
+    (void)mm_width;
+    (void)mm_height;
+
+    scrwidth  = width;
+    scrheight = height;
+    nresize++;
+
+    request();
+
+    return 0;
+}
+
+int xif_output_property_change(uint32_t output, uint32_t property,
+                               videoep_value_type_t type, uint32_t length,
+                               void *data)
+{
+    (void)output;
+    (void)property;
+    (void)type;
+    (void)length;
+    (void)data;
+
+    request();
+
+    return 0;
+}
+
+/* queries are answered by the test itself */
+int xif_crtc_query(uint32_t win, uint32_t crtc, uint32_t tstamp,
+                   xif_crtc_replycb_t replycb, void *usrdata)
+{
+    (void)win; (void)crtc; (void)tstamp; (void)replycb; (void)usrdata;
+    return 0;
+}
+
+int xif_output_query(uint32_t win, uint32_t output, uint32_t tstamp,
+                     xif_output_replycb_t replycb, void *usrdata)
+{
+    (void)win; (void)output; (void)tstamp; (void)replycb; (void)usrdata;
+    return 0;
+}
+
+int xif_output_property_query(uint32_t window, uint32_t output,
+                              uint32_t property, videoep_value_type_t type,
+                              uint32_t length, xif_outprop_replycb_t replycb,
+                              void *usrdata)
+{
+    (void)window; (void)output; (void)property; (void)type;
+    (void)length; (void)replycb; (void)usrdata;
+    return 0;
+}
+
+int xif_screen_query(uint32_t win, xif_screen_replycb_t replycb, void *data)
+{
+    (void)win; (void)replycb; (void)data;
+    return 0;
+}
+
+uint32_t xif_root_window_query(uint32_t *rwins, uint32_t len)
+{
+    (void)rwins; (void)len;
+    return 0;
+}
+
+int xif_create_mode(uint32_t screen, xif_mode_t *mode)
+{
+    (void)screen; (void)mode;
+    return 0;
+}
+
+int xif_track_randr_changes_on_window(uint32_t window, int track)
+{
+    (void)window; (void)track;
+    return 0;
+}
+
+int xif_add_connection_callback(xif_connectioncb_t cb, void *data)
+{
+    (void)cb; (void)data;
+    return 0;
+}
+
+int xif_remove_connection_callback(xif_connectioncb_t cb, void *data)
+{
+    (void)cb; (void)data;
+    return 0;
+}
+
+int xif_add_randr_crtc_change_callback(xif_crtc_notifycb_t cb, void *data)
+{
+    (void)cb; (void)data;
+    return 0;
+}
+
+int xif_remove_randr_crtc_change_callback(xif_crtc_notifycb_t cb, void *data)
+{
+    (void)cb; (void)data;
+    return 0;
+}
+
+int xif_add_randr_output_change_callback(xif_output_notifycb_t cb, void *data)
+{
+    (void)cb; (void)data;
+    return 0;
+}
+
+int xif_remove_randr_output_change_callback(xif_output_notifycb_t cb,
+                                            void *data)
+{
+    (void)cb; (void)data;
+    return 0;
+}
+
+uint32_t atom_create(const char *id, const char *name)
+{
+    (void)id; (void)name;
+    return ATOM_INVALID_INDEX;
+}
+
+int atom_add_query_callback(uint32_t aidx, atom_callback_t cb, void *data)
+{
+    (void)aidx; (void)cb; (void)data;
+    return -1;
+}
+
+
+static void setup(void)
+{
+    static uint32_t  crtcs[]   = { CRTC0, CRTC1 };
+    static uint32_t  outputs[] = { LCD, TV };
+    static uint32_t  clones[]  = { };
+    static char     *names[]   = { "LCD", "TV" };
+
+    xif_mode_t       modes[2];
+    xif_screen_t     xs;
+    xif_crtc_t       xc;
+    xif_output_t     xo;
+    uint32_t         omodes[2] = { MODE_LCD, MODE_TV };
+    int              i;
+
+    memset(modes, 0, sizeof(modes));
+    modes[0].xid  = MODE_LCD;  modes[0].name = "800x480";
+    modes[0].width = 800;      modes[0].height = 480;
+    modes[1].xid  = MODE_TV;   modes[1].name = "720x576";
+    modes[1].width = 720;      modes[1].height = 576;
+
+    memset(&xs, 0, sizeof(xs));
+    xs.window  = ROOTWIN;
+    xs.ncrtc   = 2;
+    xs.crtcs   = crtcs;
+    xs.noutput = 2;
+    xs.outputs = outputs;
+    xs.nmode   = 2;
+    xs.modes   = modes;
+    xs.hdpm    = 1.0;
+    xs.vdpm    = 1.0;
+
+    fail_unless(screen_register(&xs) != NULL, "failed to register screen");
+
+    for (i = 0;  i < 2;  i++) {
+        memset(&xc, 0, sizeof(xc));
+        xc.window    = ROOTWIN;
+        xc.xid       = crtcs[i];
+        xc.rotation  = 1;
+        xc.npossible = 2;
+        xc.possibles = outputs;
+        crtc_query_finish(&xc, NULL);
+
+        memset(&xo, 0, sizeof(xo));
+        xo.window = ROOTWIN;
+        xo.xid    = outputs[i];
+        xo.name   = names[i];
+        xo.state  = xif_connected;
+        xo.nclone = 0;
+        xo.clones = clones;
+        xo.nmode  = 2;
+        xo.modes  = omodes;
+        output_query_finish(&xo, NULL);
+    }
+
+    nrequest = nflush = nresize = 0;
+    scrwidth = scrheight = 0;
+    memset(configured, 0, sizeof(configured));
+}
+
+static void teardown(void)
+{
+    randr_transaction_abort();
+
+    while (nscreen > 0)
+        screen_unregister(screens);
+}
+
+static void decide_at(char *mode, char *output, uint32_t x, uint32_t y)
+{
+    char *outputs[1] = { output };
+
+    randr_transaction_begin();
+    randr_crtc_set_position(0, 0, x, y);
+    randr_crtc_set_mode(0, 0, mode);
+    randr_crtc_set_outputs(0, 0, output ? 1 : 0, outputs);
+}
+
+static void decide(char *mode, char *output)
+{
+    decide_at(mode, output, 0, 0);
+}
+
+/* a decision for both crtcs, a NULL mode turns the crtc off */
+typedef struct {
+    char     *mode[2];
+    char     *output[2];
+    uint32_t  x[2];
+    uint32_t  y[2];
+} decision_t;
+
+typedef struct {
+    struct {
+        int32_t  x;
+        int32_t  y;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mode;
+        int      noutput;
+        uint32_t output;
+        int      sync;
+    }        crtc[2];
+    struct {
+        uint32_t crtc;
+        uint32_t mode;
+        int      sync;
+    }        output[2];
+    uint32_t scrwidth;
+    uint32_t scrheight;
+} randr_state_t;
+
+static void apply(decision_t *d, int batched)
+{
+    char *outputs[1];
+    int   i;
+
+    if (batched)
+        randr_transaction_begin();
+
+    for (i = 0;  i < 2;  i++) {
+        outputs[0] = d->output[i];
+        randr_crtc_set_position(0, i, d->x[i], d->y[i]);
+        randr_crtc_set_mode(0, i, d->mode[i]);
+        randr_crtc_set_outputs(0, i, d->output[i] ? 1 : 0, outputs);
+    }
+
+    if (batched)
+        fail_unless(randr_transaction_commit() == 0, "commit failed");
+    else
+        randr_synchronize();
+}
+
+static void snapshot(randr_state_t *st)
+{
+    randr_screen_t *screen = screens;
+    randr_crtc_t   *crtc;
+    randr_output_t *output;
+    int             i;
+
+    memset(st, 0, sizeof(*st));
+
+    for (i = 0;  i < 2;  i++) {
+        crtc   = screen->crtcs + i;
+        output = screen->outputs + i;
+
+        st->crtc[i].x       = crtc->x;
+        st->crtc[i].y       = crtc->y;
+        st->crtc[i].width   = crtc->width;
+        st->crtc[i].height  = crtc->height;
+        st->crtc[i].mode    = crtc->mode;
+        st->crtc[i].noutput = crtc->noutput;
+        st->crtc[i].output  = crtc->noutput > 0 ? crtc->outputs[0] : 0;
+        st->crtc[i].sync    = crtc->sync;
+
+        st->output[i].crtc = output->crtc;
+        st->output[i].mode = output->mode;
+        st->output[i].sync = output->sync;
+    }
+
+    st->scrwidth  = scrwidth;
+    st->scrheight = scrheight;
+}
+
+START_TEST (test_randr_lookup)
+
+    randr_screen_t *screen = screens;
+    xif_mode_t      xm;
+    char            name[32];
+    int             i;
+
+    fail_unless(output_find_by_name(screen, "TV")->xid == TV,
+                "output lookup by name failed");
+    fail_unless(output_find_by_id(screen, LCD) == screen->outputs,
+                "output lookup by id failed");
+    fail_unless(crtc_find_by_id(screen, CRTC1) == screen->crtcs + 1,
+                "crtc lookup by id failed");
+
+    /* the index must follow the registry as it is reallocated */
+    for (i = 0;  i < 1000;  i++) {
+        memset(&xm, 0, sizeof(xm));
+        snprintf(name, sizeof(name), "mode%d", i);
+        xm.xid    = 0x1000 + i;
+        xm.name   = name;
+        xm.width  = i;
+        xm.height = i;
+        fail_unless(mode_register(screen, &xm) != NULL, "can't add mode");
+    }
+
+    for (i = 0;  i < 1000;  i++) {
+        snprintf(name, sizeof(name), "mode%d", i);
+        fail_unless(mode_find_by_name(screen, name)->xid == 0x1000 + i,
+                    "mode lookup by name failed for '%s'", name);
+        fail_unless(mode_find_by_id(screen, 0x1000 + i)->width == i,
+                    "mode lookup by id failed for 0x%x", 0x1000 + i);
+    }
+
+    fail_unless(mode_find_by_name(screen, "800x480")->xid == MODE_LCD,
+                "lookup of original mode failed");
+
+END_TEST
+
+START_TEST (test_randr_transaction_batched)
+
+    decide("800x480", "LCD");
+    fail_unless(nrequest == 0, "requests sent before commit");
+    fail_unless(randr_transaction_commit() == 0, "commit failed");
+
+    /* a crtc configuration and a screen resize written with one flush */
+    fail_unless(nrequest == 2, "%d requests for one decision", nrequest);
+    fail_unless(nflush == 1, "%d flushes for one decision", nflush);
+    fail_unless(nresize == 1 && scrwidth == 800 && scrheight == 480,
+                "screen resized %d times to %ux%u", nresize,
+                scrwidth, scrheight);
+
+    /* repeating the same decision does not touch the X server */
+    nrequest = nflush = 0;
+    decide("800x480", "LCD");
+    fail_unless(randr_transaction_commit() == 0, "commit failed");
+    fail_unless(nrequest == 0, "%d requests for unchanged decision",nrequest);
+    fail_unless(nflush == 0, "%d flushes for unchanged decision", nflush);
+
+    /* switching to the TV */
+    nrequest = nflush = 0;
+    decide("720x576", "TV");
+    fail_unless(randr_transaction_commit() == 0, "commit failed");
+    fail_unless(nrequest == 2, "%d requests for switching", nrequest);
+    fail_unless(nflush == 1, "%d flushes for switching", nflush);
+    fail_unless(scrwidth == 720 && scrheight == 576,
+                "screen resized to %ux%u", scrwidth, scrheight);
+
+END_TEST
+
+START_TEST (test_randr_transaction_position)
+
+    randr_crtc_t *crtc = screens[0].crtcs;
+
+    decide("800x480", "LCD");
+    fail_unless(randr_transaction_commit() == 0, "commit failed");
+    nrequest = nflush = nresize = 0;
+
+    /* moving the crtc without changing its mode or outputs */
+    decide_at("800x480", "LCD", 100, 0);
+    fail_unless(randr_transaction_commit() == 0, "commit failed");
+    fail_unless(nrequest == 2, "%d requests for a move", nrequest);
+    fail_unless(crtc->x == 100 && crtc->y == 0, "crtc at %d,%d",
+                crtc->x, crtc->y);
+    fail_unless(nresize == 1 && scrwidth == 900 && scrheight == 480,
+                "screen resized %d times to %ux%u", nresize,
+                scrwidth, scrheight);
+
+    /* staying at the same position */
+    nrequest = nflush = nresize = 0;
+    decide_at("800x480", "LCD", 100, 0);
+    fail_unless(randr_transaction_commit() == 0, "commit failed");
+    fail_unless(nrequest == 0, "%d requests for no move", nrequest);
+
+    /* a position that is left to the server is not a move */
+    randr_transaction_begin();
+    randr_crtc_set_position(0, 0, POSITION_DONTCARE, POSITION_DONTCARE);
+    fail_unless(randr_transaction_commit() == 0, "commit failed");
+    fail_unless(nrequest == 0, "%d requests for no move", nrequest);
+
+END_TEST
+
+START_TEST (test_randr_transaction_invalid)
+
+    randr_crtc_t *crtc = screens[0].crtcs;
+
+    decide("800x480", "LCD");
+    fail_unless(randr_transaction_commit() == 0, "commit failed");
+    nrequest = nflush = 0;
+
+    /* unknown output */
+    decide("720x576", "HDMI");
+    fail_unless(randr_transaction_commit() < 0, "invalid output accepted");
+    fail_unless(nrequest == 0, "%d requests for rejected decision", nrequest);
+    fail_unless(crtc->mode == MODE_LCD && crtc->noutput == 1 &&
+                crtc->outputs[0] == LCD, "crtc state not restored");
+
+    /* unknown mode */
+    decide("1920x1080", "TV");
+    fail_unless(randr_transaction_commit() < 0, "invalid mode accepted");
+    fail_unless(nrequest == 0, "%d requests for rejected decision", nrequest);
+
+    /* the same output on two crtcs */
+    {
+        char *outputs[1] = { "LCD" };
+
+        decide("720x576", "LCD");
+        randr_crtc_set_mode(0, 1, "720x576");
+        randr_crtc_set_outputs(0, 1, 1, outputs);
+        fail_unless(randr_transaction_commit() < 0,
+                    "output conflict accepted");
+        fail_unless(nrequest == 0, "%d requests for rejected decision",
+                    nrequest);
+        fail_unless(crtc->mode == MODE_LCD, "crtc state not restored");
+        fail_unless(!screens[0].crtcs[1].sync, "crtc sync not restored");
+    }
+
+END_TEST
+
+START_TEST (test_randr_transaction_equivalence)
+
+    static decision_t decisions[] = {
+        { { "800x480", NULL      }, { "LCD", NULL }, { 0  , 0   }, { 0, 0 } },
+        { { "720x576", NULL      }, { "TV" , NULL }, { 0  , 0   }, { 0, 0 } },
+        { { "800x480", NULL      }, { "LCD", NULL }, { 100, 0   }, { 0, 0 } },
+        { { "800x480", "720x576" }, { "LCD", "TV" }, { 0  , 800 }, { 0, 0 } },
+        { { "800x480", "720x576" }, { "LCD", "TV" }, { 0  , 800 }, { 0, 0 } },
+        { { "720x576", "800x480" }, { "TV" , "LCD"}, { 0  , 720 }, { 0, 0 } },
+        { { NULL     , NULL      }, { NULL , NULL }, { 0  , 0   }, { 0, 0 } },
+    };
+
+#define NDECISION (sizeof(decisions) / sizeof(decisions[0]))
+
+    randr_state_t batched[NDECISION], percall;
+    crtc_config_t sent[NDECISION][2];
+    unsigned int  i;
+
+    /*
+     * The same decisions through the transaction and through the old
+     * per-call setters followed by randr_synchronize must leave the same
+     * crtc and output state behind and send the same crtc configurations.
+     */
+    for (i = 0;  i < NDECISION;  i++) {
+        apply(decisions + i, TRUE);
+        snapshot(batched + i);
+        memcpy(sent[i], configured, sizeof(configured));
+    }
+
+    teardown();
+    setup();
+
+    for (i = 0;  i < NDECISION;  i++) {
+        apply(decisions + i, FALSE);
+        snapshot(&percall);
+
+        fail_unless(!memcmp(batched + i, &percall, sizeof(percall)),
+                    "state differs after decision %u", i);
+        fail_unless(!memcmp(sent[i], configured, sizeof(configured)),
+                    "crtcs configured differently after decision %u", i);
+    }
+
+#undef NDECISION
+
+END_TEST
+
+Suite *ohm_videoep_randr_suite(void)
+{
+    Suite *suite = suite_create("ohm_videoep_randr");
+
+    TCase *tc_all = tcase_create("All");
+
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+    tcase_add_test(tc_all, test_randr_lookup);
+    tcase_add_test(tc_all, test_randr_transaction_batched);
+    tcase_add_test(tc_all, test_randr_transaction_position);
+    tcase_add_test(tc_all, test_randr_transaction_invalid);
+    tcase_add_test(tc_all, test_randr_transaction_equivalence);
+    
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_videoep_randr_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
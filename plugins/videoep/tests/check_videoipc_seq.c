@@ -0,0 +1,186 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_videoipc_seq.c
+ * @brief stress tests for the videoipc shared memory change notification
+ */
+
+/* first, so that the installed header is checked to be self-contained */
+#include "videoipc-seq.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <check.h>
+
+#define NREADER   8
+#define NUPDATE   200000
+#define NPID      32
+
+typedef struct {
+    videoipc_seq_t seq;
+    uint32_t       pids[NPID];
+} shmem_t;
+
+static shmem_t shm;
+static volatile int writer_done;
+
+static void *writer(void *data)
+{
+    uint32_t i;
+    int      j;
+
+    (void)data;
+
+    for (i = 1;  i <= NUPDATE;  i++) {
+        videoipc_write_begin(&shm.seq);
+
+        for (j = 0;  j < NPID;  j++)
+            shm.pids[j] = i;
+
+        videoipc_write_end(&shm.seq, 1);
+    }
+
+    writer_done = 1;
+
+    return NULL;
+}
+
+static void *reader(void *data)
+{
+    long     *torn = data;
+    uint32_t  pids[NPID];
+    uint32_t  seq;
+    int       j;
+
+    while (!writer_done) {
+        do {
+            seq = videoipc_read_begin(&shm.seq);
+            memcpy(pids, shm.pids, sizeof(pids));
+        } while (videoipc_read_retry(&shm.seq, seq));
+
+        for (j = 1;  j < NPID;  j++) {
+            if (pids[j] != pids[0]) {
+                (*torn)++;
+                break;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void *waiter(void *data)
+{
+    long            *wakeups = data;
+    struct timespec  timeout = { 0, 100 * 1000 * 1000 };
+    uint32_t         seq;
+
+    seq = videoipc_read_begin(&shm.seq);
+
+    while (!writer_done) {
+        if (videoipc_wait(&shm.seq, seq, &timeout) == 0) {
+            seq = videoipc_read_begin(&shm.seq);
+            (*wakeups)++;
+        }
+    }
+
+    return NULL;
+}
+
+START_TEST (test_videoipc_seq_no_torn_reads)
+
+    pthread_t readers[NREADER], wthread, sleeper;
+    long      torn[NREADER], wakeups;
+    int       i;
+
+    memset(&shm, 0, sizeof(shm));
+    shm.seq.magic = VIDEOIPC_SEQ_MAGIC;
+    writer_done   = 0;
+    wakeups       = 0;
+
+    for (i = 0;  i < NREADER;  i++) {
+        torn[i] = 0;
+        fail_if(pthread_create(readers + i, NULL, reader, torn + i),
+                "failed to create reader thread");
+    }
+
+    fail_if(pthread_create(&sleeper, NULL, waiter, &wakeups),
+            "failed to create waiter thread");
+    fail_if(pthread_create(&wthread, NULL, writer, NULL),
+            "failed to create writer thread");
+
+    pthread_join(wthread, NULL);
+    pthread_join(sleeper, NULL);
+
+    for (i = 0;  i < NREADER;  i++) {
+        pthread_join(readers[i], NULL);
+        fail_unless(torn[i] == 0, "reader %d saw %ld torn snapshots",
+                    i, torn[i]);
+    }
+
+    fail_unless(shm.seq.seq == 2 * NUPDATE, "sequence is %u instead of %u",
+                shm.seq.seq, 2 * NUPDATE);
+    fail_unless(wakeups > 0, "waiter was never woken up");
+
+END_TEST
+
+START_TEST (test_videoipc_seq_wait_timeout)
+
+    struct timespec timeout = { 0, 10 * 1000 * 1000 };
+
+    memset(&shm, 0, sizeof(shm));
+
+    fail_unless(videoipc_wait(&shm.seq, 0, &timeout) < 0,
+                "wait without an update did not time out");
+    fail_unless(videoipc_wait(&shm.seq, 2, &timeout) == 0,
+                "wait for an already passed update did block");
+
+END_TEST
+
+Suite *ohm_videoipc_seq_suite(void)
+{
+    Suite *suite = suite_create("ohm_videoipc_seq");
+
+    TCase *tc_all = tcase_create("All");
+
+    tcase_add_test(tc_all, test_videoipc_seq_no_torn_reads);
+    tcase_add_test(tc_all, test_videoipc_seq_wait_timeout);
+    
+    tcase_set_timeout(tc_all, 120);
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_videoipc_seq_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,411 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/**
+ * @file check_xif.c
+ * @brief xif request queue tests and benchmark against a fake reply source
+ */
+
+#include <check.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+
+static xcb_intern_atom_cookie_t fake_intern_atom(xcb_connection_t *, uint8_t,
+                                                 uint16_t, const char *);
+static int  fake_poll_for_reply(xcb_connection_t *, unsigned int, void **,
+                                xcb_generic_error_t **);
+static void fake_discard_reply(xcb_connection_t *, unsigned int);
+static xcb_generic_event_t *fake_poll_for_event(xcb_connection_t *);
+static int  fake_connection_has_error(xcb_connection_t *);
+static int  fake_flush(xcb_connection_t *);
+static void fake_disconnect(xcb_connection_t *);
+
+#define xcb_intern_atom          fake_intern_atom
+#define xcb_poll_for_reply       fake_poll_for_reply
+#define xcb_discard_reply        fake_discard_reply
+#define xcb_poll_for_event       fake_poll_for_event
+#define xcb_connection_has_error fake_connection_has_error
+#define xcb_flush                fake_flush
+#define xcb_disconnect           fake_disconnect
+
+#include "../xif.c"
+
+#define NREQUEST_MAX 10000
+
+int DBG_XCB;
+
+static struct {
+    unsigned int sent;         /* last request sequence sent */
+    unsigned int replied;      /* last request sequence replied to */
+    unsigned int discarded;    /* last request sequence discarded */
+    int          npoll;        /* reply polls */
+    int          nflush;       /* writes to the server */
+} server;
+
+static int      fake_chan;     /* the mock X connection channel */
+static uint32_t expected;      /* atom of the next reply expected */
+static int      nreply;        /* replies delivered to the callers */
+static int      nerror;        /* errors logged */
+
+/**
+ * ohm_log:
+ **/
+void
+ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    (void)format;
+
+    if (level == OHM_LOG_ERROR)
+        nerror++;
+}
+
+void plugin_print_timestamp(const char *function, const char *phase)
+{
+    (void)function;
+    (void)phase;
+}
+
+int window_get_event_mask(uint32_t window, uint32_t *mask)
+{
+    (void)window;
+
+    *mask = 0;
+
+    return 0;
+}
+
+int window_set_event_mask(uint32_t window, uint32_t mask)
+{
+    (void)window;
+    (void)mask;
+
+    return 0;
+}
+
+
+/*
+ * mock X server, replies to the requests in order
+ */
+
+static xcb_intern_atom_cookie_t fake_intern_atom(xcb_connection_t *c,
+                                                 uint8_t           only,
+                                                 uint16_t          len,
+                                                 const char       *name)
+{
+    xcb_intern_atom_cookie_t ckie;
+
+    (void)c;
+    (void)only;
+    (void)len;
+    (void)name;
+
+    ckie.sequence = ++server.sent;
+
+    return ckie;
+}
+
+static int fake_poll_for_reply(xcb_connection_t     *c,
+                               unsigned int          seq,
+                               void                **reply,
+                               xcb_generic_error_t **e)
+{
+    xcb_intern_atom_reply_t *r;
+
+    (void)c;
+
+    server.npoll++;
+
+    *e = NULL;
+
+    if (seq > server.replied) {
+        *reply = NULL;
+        return 0;
+    }
+
+    /* the atom of a reply is the sequence of its request */
+    r = calloc(1, sizeof(*r));
+    r->atom = seq;
+    *reply  = r;
+
+    return 1;
+}
+
+static void fake_discard_reply(xcb_connection_t *c, unsigned int seq)
+{
+    (void)c;
+
+    server.discarded = seq;
+}
+
+static xcb_generic_event_t *fake_poll_for_event(xcb_connection_t *c)
+{
+    (void)c;
+
+    return NULL;
+}
+
+static int fake_connection_has_error(xcb_connection_t *c)
+{
+    (void)c;
+
+    return 0;
+}
+
+static int fake_flush(xcb_connection_t *c)
+{
+    (void)c;
+
+    server.nflush++;
+
+    return 1;
+}
+
+static void fake_disconnect(xcb_connection_t *c)
+{
+    (void)c;
+}
+
+
+/*
+ * helpers
+ */
+
+static void atom_reply(const char *name, uint32_t atom, void *data)
+{
+    (void)name;
+    (void)data;
+
+    fail_unless(atom == expected, "reply %u out of order, expected %u",
+                atom, expected);
+
+    expected++;
+    nreply++;
+}
+
+static void send_requests(int n)
+{
+    int i;
+
+    for (i = 0;  i < n;  i++)
+        fail_unless(xif_atom_query("_ATOM", atom_reply, NULL) == 0,
+                    "failed to send request %d", i);
+}
+
+/* let the server reply to n more requests and process the replies */
+static void reply_requests(int n)
+{
+    server.replied += n;
+
+    xio_cb((GIOChannel *)&fake_chan, G_IO_IN, xiface);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void setup(void)
+{
+    memset(&server, 0, sizeof(server));
+
+    expected = 1;
+    nreply   = 0;
+    nerror   = 0;
+
+    xiface = xif_create(NULL);
+    xiface->xconn = (xcb_connection_t *)&server;
+    xiface->chan  = (GIOChannel *)&fake_chan;
+}
+
+static void teardown(void)
+{
+    xiface->chan = NULL;
+
+    xif_destroy(xiface);
+    xiface = NULL;
+}
+
+
+/*
+ * tests
+ */
+
+START_TEST (test_xif_queue_order)
+{
+    rque_t *rque = &xiface->rque;
+
+    /* wrap the queue around, then grow it with the head in the middle */
+    send_requests(QUEUE_MIN);
+    reply_requests(QUEUE_MIN / 2 + 3);
+
+    fail_unless(nreply == QUEUE_MIN / 2 + 3, "%d replies", nreply);
+
+    send_requests(QUEUE_MIN);
+
+    fail_unless(rque->size == 2 * QUEUE_MIN, "queue size %d", rque->size);
+    fail_unless(rque->length == 3 * QUEUE_MIN / 2 - 3, "queue length %d",
+                rque->length);
+
+    reply_requests(2 * QUEUE_MIN);
+
+    fail_unless(nreply == 2 * QUEUE_MIN && rque->length == 0,
+                "%d replies, %d pending", nreply, rque->length);
+    fail_unless(rque->stats.completed == 2 * QUEUE_MIN, "%u completed",
+                rque->stats.completed);
+    fail_unless(nerror == 0, "%d errors", nerror);
+}
+END_TEST
+
+START_TEST (test_xif_queue_timeout)
+{
+    rque_t *rque = &xiface->rque;
+
+    send_requests(3);
+
+    /* no reply yet, nothing is given up on */
+    reply_requests(0);
+
+    fail_unless(rque->length == 3 && server.discarded == 0,
+                "request given up on too early");
+
+    /* the head request has been waiting for too long */
+    rque->requests[rque->head].stamp -= REQUEST_TIMEOUT;
+    reply_requests(0);
+
+    fail_unless(rque->length == 2 && server.discarded == 1,
+                "timed out request not discarded");
+    fail_unless(rque->stats.timedout == 1 && nerror > 0,
+                "timeout not counted and logged");
+    fail_unless(nreply == 0, "reply delivered for a timed out request");
+
+    /* the rest are replied to normally */
+    expected = 2;
+    reply_requests(3);
+
+    fail_unless(nreply == 2 && rque->length == 0, "%d replies, %d pending",
+                nreply, rque->length);
+}
+END_TEST
+
+START_TEST (test_xif_queue_purge)
+{
+    send_requests(100);
+    reply_requests(10);
+
+    /* pending request data is released by the handlers (see valgrind) */
+    xiface->chan = NULL;
+    disconnect_from_xserver(xiface);
+
+    fail_unless(nreply == 10, "%d replies", nreply);
+    fail_unless(xiface->rque.requests == NULL && xiface->rque.length == 0,
+                "requests left after disconnect");
+    fail_unless(nerror == 0, "%d errors for purged requests", nerror);
+}
+END_TEST
+
+START_TEST (test_xif_queue_bench)
+{
+    rque_t *rque = &xiface->rque;
+    double  t, tburst, tstream;
+    int     n, i, npoll;
+
+    for (n = 10;  n <= NREQUEST_MAX;  n *= 10) {
+
+        /* a burst of n outstanding requests, replied to in one go */
+        server.npoll = 0;
+        t = now();
+        send_requests(n);
+        reply_requests(n);
+        tburst = now() - t;
+        npoll  = server.npoll;
+
+        fail_unless(nreply == (int)server.sent && rque->length == 0,
+                    "%d of %u replies", nreply, server.sent);
+
+        /* n outstanding requests, a reply comes in for every new one */
+        send_requests(n);
+        t = now();
+        for (i = 0;  i < n;  i++) {
+            send_requests(1);
+            reply_requests(1);
+        }
+        tstream = now() - t;
+        reply_requests(n);
+
+        fail_unless(nreply == (int)server.sent && rque->length == 0,
+                    "%d of %u replies", nreply, server.sent);
+
+        printf("%5d outstanding: burst %6.1f ns/request (%d polls), "
+               "steady %6.1f ns/request, queue size %d\n",
+               n, tburst / n, npoll, tstream / n, rque->size);
+
+        /* each reply takes a single poll of the queue head */
+        fail_unless(npoll == n, "%d polls for %d replies", npoll, n);
+    }
+
+    fail_unless(rque->stats.maxlength == NREQUEST_MAX + 1, "max. %u pending",
+                rque->stats.maxlength);
+    fail_unless(nerror == 0, "%d errors", nerror);
+}
+END_TEST
+
+Suite *ohm_xif_suite(void)
+{
+    Suite *suite = suite_create("ohm_videoep_xif");
+
+    TCase *tc_all = tcase_create("All");
+    tcase_set_timeout(tc_all, 60);
+    tcase_add_checked_fixture(tc_all, setup, teardown);
+
+    tcase_add_test(tc_all, test_xif_queue_order);
+    tcase_add_test(tc_all, test_xif_queue_timeout);
+    tcase_add_test(tc_all, test_xif_queue_purge);
+    tcase_add_test(tc_all, test_xif_queue_bench);
+
+    suite_add_tcase(suite, tc_all);
+
+    return suite;
+}
+
+int main (void) {
+
+    int failed = 0;
+    Suite *suite;
+
+    suite = ohm_xif_suite();
+    SRunner *runner = srunner_create(suite);
+    srunner_run_all(runner, CK_NORMAL);
+
+    failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,134 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#ifndef __OHM_VIDEOEP_VIDEOIPC_SEQ_H__
+#define __OHM_VIDEOEP_VIDEOIPC_SEQ_H__
+
+/*
+ * Change notification for the videoipc shared memory.
+ *
+ * A videoipc_seq_t block follows the videoipc_t data in the shared memory
+ * object, at VIDEOIPC_SEQ_OFFSET. Its sequence number is odd while the
+ * plugin is updating the sections and even otherwise. Local readers can
+ * take a consistent snapshot of any section without an X connection:
+ *
+ *     do {
+ *         seq = videoipc_read_begin(vs);
+ *         ... copy the section(s) out of the shared memory ...
+ *     } while (videoipc_read_retry(vs, seq));
+ *
+ * and sleep until the next update with videoipc_wait(vs, seq, timeout),
+ * which is a futex wait on the sequence number in the shared mapping.
+ *
+ * This header is installed as <policy/videoipc-seq.h>, next to
+ * <policy/videoipc.h>, for the readers outside of the plugin. They map
+ * the shared memory object read-only and find the block at
+ * VIDEOIPC_SEQ_OFFSET, checking the magic as older plugins lack it.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/* <unistd.h> hides syscall(2) from strict ISO C readers */
+#ifndef __USE_MISC
+extern long int syscall(long int, ...);
+#endif
+
+#define VIDEOIPC_SEQ_MAGIC   0x76697371 /* 'visq' */
+
+/* offset of the sequence block; needs <policy/videoipc.h> for videoipc_t */
+#define VIDEOIPC_SEQ_OFFSET  (((sizeof(videoipc_t) + 63) / 64) * 64)
+
+typedef struct {
+    uint32_t           magic;           /* VIDEOIPC_SEQ_MAGIC if present */
+    volatile uint32_t  seq;             /* odd while updating */
+    volatile uint32_t  mask;            /* sections changed by last update */
+    uint32_t           pad;
+} videoipc_seq_t;
+
+
+static inline void videoipc_write_begin(videoipc_seq_t *vs)
+{
+    vs->seq++;
+    __sync_synchronize();
+}
+
+static inline void videoipc_write_end(videoipc_seq_t *vs, uint32_t mask)
+{
+    vs->mask = mask;
+    __sync_synchronize();
+    vs->seq++;
+
+    syscall(SYS_futex, &vs->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static inline uint32_t videoipc_read_begin(videoipc_seq_t *vs)
+{
+    uint32_t seq;
+
+    while ((seq = vs->seq) & 1)
+        sched_yield();
+
+    __sync_synchronize();
+
+    return seq;
+}
+
+static inline int videoipc_read_retry(videoipc_seq_t *vs, uint32_t seq)
+{
+    __sync_synchronize();
+
+    return vs->seq != seq;
+}
+
+/* wait until seq changes; timeout is relative, -1 on timeout or error */
+static inline int videoipc_wait(videoipc_seq_t        *vs,
+                                uint32_t               seq,
+                                const struct timespec *timeout)
+{
+    while (vs->seq == seq) {
+        if (syscall(SYS_futex, &vs->seq, FUTEX_WAIT, seq, timeout,
+                    NULL, 0) < 0) {
+            if (errno == EWOULDBLOCK || errno == EINTR)
+                continue;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+#endif /* __OHM_VIDEOEP_VIDEOIPC_SEQ_H__ */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
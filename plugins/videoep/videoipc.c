@@ -38,18 +38,21 @@ USA.
 
 #include "plugin.h"
 #include "videoipc.h"
+#include "videoipc-seq.h"
 #include "atom.h"
 #include "xif.h"
 
 typedef struct {
     uint32_t  mask;
     uint64_t  time;
+    int       writing;          /* seqlock taken for this update */
 } update_t;
 
 
 static int         fd;          /* file descriptor for shared memory */
 static int         length;      /* length of the shared memory */
 static videoipc_t *ipc;         /* shared memory data */
+static videoipc_seq_t *seq;     /* change notification of shared memory */
 static uint32_t    mtatomidx;   /* index of the message type atom */
 static update_t    update;
 
@@ -57,6 +60,7 @@ static update_t    update;
 static int  init_shmem(void);
 static void exit_shmem(void);
 static int  init_shfile(int, size_t);
+static int  same_pids(pid_t *, pid_t *, int);
 
 static int  init_message(void);
 static void exit_message(void);
@@ -90,12 +94,18 @@ void videoipc_update_start(void)
 
     gettimeofday(&tv, NULL);
 
-    update.mask = 0;
-    update.time = ((uint64_t)tv.tv_sec * 1000000ULL) + (uint64_t)tv.tv_usec;
+    update.mask    = 0;
+    update.time    = ((uint64_t)tv.tv_sec * 1000000ULL) + (uint64_t)tv.tv_usec;
+    update.writing = FALSE;
 }
 
 void videoipc_update_end(void)
 {
+    if (update.writing) {
+        videoipc_write_end(seq, update.mask);
+        update.writing = FALSE;
+    }
+
     send_message(update.mask);
 }
 
@@ -134,10 +144,15 @@ void videoipc_update_section(uint32_t mask, pid_t *pids, int npid)
             npid = maxpid;
         }
 
-        if (npid != oldset->npid || memcmp(pids, oldset->pids, npid)) {
+        if (npid != oldset->npid || !same_pids(pids, oldset->pids, npid)) {
             OHM_DEBUG(DBG_IPC, "%s section in videoipc shared memory updated. "
                       "New index is %u", secnam, newidx);
 
+            if (seq != NULL && !update.writing) {
+                videoipc_write_begin(seq);
+                update.writing = TRUE;
+            }
+
             newset->time = update.time;
             newset->npid = npid;
             memcpy(newset->pids, pids, npid * sizeof(pid_t));
@@ -165,7 +180,8 @@ static int init_shmem(void)
     
     do { /* not a loop */
         page   = sysconf(_SC_PAGESIZE);
-        length = ((sizeof(videoipc_t) + page - 1) / page) * page;
+        length = VIDEOIPC_SEQ_OFFSET + sizeof(videoipc_seq_t);
+        length = ((length + page - 1) / page) * page;
         
         if ((fd = shm_open(VIDEOIPC_SHARED_OBJECT, flags, mode)) < 0) {
             OHM_ERROR("videoep: can't create shared memory object '%s': %s",
@@ -214,6 +230,18 @@ static int init_shmem(void)
             }
         }
         
+        seq = (videoipc_seq_t *)((char *)ipc + VIDEOIPC_SEQ_OFFSET);
+
+        if (seq->magic != VIDEOIPC_SEQ_MAGIC) {
+            seq->seq   = 0;
+            seq->mask  = 0;
+            seq->magic = VIDEOIPC_SEQ_MAGIC;
+        }
+        else if (seq->seq & 1) {
+            /* we died in the middle of an update; release the readers */
+            videoipc_write_end(seq, 0);
+        }
+
         /* everything was OK */
         return TRUE;
         
@@ -231,6 +259,8 @@ static void exit_shmem(void)
 {
     if (ipc != NOIPC && length > 0)
         munmap((void *)ipc, length);
+
+    seq = NULL;
     
     if (fd >= 0)
         close(fd);
@@ -280,6 +310,18 @@ static int init_shfile(int fd, size_t size)
     return TRUE;
 }
 
+static int same_pids(pid_t *pids1, pid_t *pids2, int npid)
+{
+    int i;
+
+    for (i = 0;  i < npid;  i++) {
+        if (pids1[i] != pids2[i])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
 static int init_message(void)
 {
     mtatomidx = atom_create("videoipcmt", VIDEOIPC_CLIENT_MESSAGE);
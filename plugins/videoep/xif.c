@@ -27,6 +27,7 @@ USA.
 #include <netinet/in.h>
 #include <errno.h>
 #include <signal.h>
+#include <time.h>
 
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
@@ -43,22 +44,10 @@ USA.
 
 #define SCREEN_MAX 4
 
-#define QUEUE_BITS               5
-#define QUEUE_DIM                (1 << QUEUE_BITS)
-#define QUEUE_MASK               (QUEUE_DIM - 1)
-#define QUEUE_INDEX(i)           ((i) & QUEUE_MASK)
+#define QUEUE_MIN                32      /* initial request queue size */
+#define QUEUE_INDEX(q,i)         (((q)->head + (i)) & ((q)->size - 1))
 
-#define ATOM_QUERY_DIM           QUEUE_DIM
-#define ATOM_QUERY_INDEX(i)      QUEUE_INDEX(i)
-
-#define PROPERTY_QUERY_DIM       QUEUE_DIM
-#define PROPERTY_QUERY_INDEX(i)  QUEUE_INDEX(i)
-
-#define MODE_CREATE_DIM          QUEUE_DIM
-#define MODE_CREATE_INDEX(i)     QUEUE_INDEX(i)
-
-#define RANDR_QUERY_DIM          QUEUE_DIM
-#define RANDR_QUERY_INDEX(i)     QUEUE_INDEX(i)
+#define REQUEST_TIMEOUT          5000    /* msec to wait for a reply */
 
 struct xif_s;
 
@@ -68,13 +57,34 @@ typedef struct {
     unsigned int        sequence;
     reply_handler_t     handler;
     void               *data;
+    uint64_t            stamp;     /* msec when the request was sent */
 } request_t;
 
+/*
+ * Pending requests in the order they were sent. The X server replies in
+ * request order, so only the head of the queue can ever have a reply.
+ */
 typedef struct {
-    int                 length;
-    request_t           requests[QUEUE_DIM];
+    int                 size;      /* allocated entries, power of two */
+    int                 head;      /* index of the oldest request */
+    int                 length;    /* number of pending requests */
+    request_t          *requests;
+    int                 purging;   /* pending requests are being dropped */
+    struct {
+        uint32_t completed;        /* requests replied to */
+        uint32_t timedout;         /* requests given up on */
+        uint32_t maxlength;        /* longest queue seen */
+        uint32_t maxwait;          /* longest msec to get a reply */
+    }                   stats;
 } rque_t;
 
+/* a missing reply is an error unless the request was purged */
+#define REPLY_ERROR(xif, fmt, args...)                  \
+    do {                                                \
+        if (!(xif)->rque.purging)                       \
+            OHM_ERROR(fmt, ## args);                    \
+    } while (0)
+
 typedef struct conncb_s {
     struct conncb_s    *next;
     xif_connectioncb_t  callback;
@@ -222,15 +232,9 @@ typedef struct {
 static uint32_t       polltime = 1000; /* 1 sec */
 static xif_t         *xiface;
 static extension_t    randr;
-static atom_query_t   atom_qry[ATOM_QUERY_DIM];
-static uint32_t       atom_idx;
-static prop_query_t   prop_qry[PROPERTY_QUERY_DIM];
-static uint32_t       prop_idx;
-static mode_create_t  mode_creat[MODE_CREATE_DIM];
-static uint32_t       mode_idx;
-static randr_query_t  randr_qry[RANDR_QUERY_DIM];
-static uint32_t       randr_idx;
 static int            conn_warn = TRUE;
+static int            batch;     /* nesting depth of request batches */
+static int            unflushed; /* requests held back by batching */
 
 
 static xif_t   *xif_create(const char *);
@@ -271,11 +275,14 @@ static int  randr_event_handler(xif_t *, xcb_generic_event_t *);
 static xif_connstate_t randr_connection_to_state(uint8_t);
 
 static int  check_version(uint32_t, uint32_t, uint32_t, uint32_t);
+static void flush_requests(xcb_connection_t *);
 
-static int  rque_is_full(rque_t *);
+static uint64_t rque_now(void);
+static int  rque_reserve(rque_t *);
 static int  rque_append_request(rque_t *, unsigned int, reply_handler_t,void*);
 static int  rque_poll_reply(xcb_connection_t *, rque_t *,
                             void **, reply_handler_t *, void **);
+static void rque_purge(xif_t *, rque_t *);
 
 static gboolean xio_cb(GIOChannel *, GIOCondition, gpointer);
 static void xevent_cb(xif_t *, xcb_generic_event_t *);
@@ -723,7 +730,7 @@ int xif_track_randr_changes_on_window(uint32_t window, int track)
                 OHM_DEBUG(DBG_XCB, "%s tracking RandR changes on "
                           "window 0x%x", track_str, window);
 
-                xcb_flush(xiface->xconn);
+                flush_requests(xiface->xconn);
             }
         }
     }
@@ -920,7 +927,7 @@ int xif_output_property_change(uint32_t                output,
                     OHM_DEBUG(DBG_XCB, "changing RandR output 0x%x property "
                               "0x%x (num_units %u)", output, property, length);
 
-                    xcb_flush(xiface->xconn);
+                    flush_requests(xiface->xconn);
                 }
             }
         }
@@ -994,7 +1001,7 @@ int xif_send_client_message(uint32_t              window,
                     OHM_DEBUG(DBG_XCB, "sent client message to "
                               "window 0x%x", window);
 
-                    xcb_flush(xiface->xconn);
+                    flush_requests(xiface->xconn);
                 }
 
             } 
@@ -1007,6 +1014,25 @@ int xif_send_client_message(uint32_t              window,
 }                            
 
 
+/*
+ * Requests issued between xif_batch_begin() and xif_batch_end() are
+ * written to the X server with a single flush at the end of the batch.
+ */
+void xif_batch_begin(void)
+{
+    batch++;
+}
+
+void xif_batch_end(void)
+{
+    if (batch > 0 && --batch == 0 && unflushed) {
+        unflushed = FALSE;
+
+        if (xiface && xiface->xconn && !xcb_connection_has_error(xiface->xconn))
+            xcb_flush(xiface->xconn);
+    }
+}
+
 int xif_crtc_config(uint32_t cfgtime, xif_crtc_t *crtc)
 {
     int status;
@@ -1187,10 +1213,11 @@ static void disconnect_from_xserver(xif_t *xif)
         if (xif->chan != NULL)
             g_io_channel_unref(xif->chan);
 
+        rque_purge(xif, &xif->rque);
+
         if (xif->xconn != NULL)
             xcb_disconnect(xif->xconn);
 
-        memset(&xif->rque, 0, sizeof(xif->rque));
         memset( xif->root, 0, sizeof(xif->root));
 
         xif->propcb  = NULL;
@@ -1257,7 +1284,7 @@ static int event_select(xif_t    *xif,
 
     *mask = evmask;
 
-    xcb_flush(xif->xconn);
+    flush_requests(xif->xconn);
 
     return 0;
 }
@@ -1267,19 +1294,19 @@ static int atom_query(xif_t              *xif,
                       xif_atom_replycb_t  replycb,
                       void               *usrdata)
 {
-    atom_query_t             *aq = atom_qry + atom_idx;
+    atom_query_t             *aq;
     xcb_intern_atom_cookie_t  ckie;
 
     if (xif->xconn == NULL || xcb_connection_has_error(xif->xconn))
         return -1;
 
-    if (rque_is_full(&xif->rque)) {
-        OHM_ERROR("videoep: xif request queue is full");
+    if (!rque_reserve(&xif->rque)) {
+        OHM_ERROR("videoep: failed to grow xif request queue");
         return -1;
     }
 
-    if (aq->busy) {
-        OHM_ERROR("videoep: maximum number of pending atom queries reached");
+    if ((aq = calloc(1, sizeof(*aq))) == NULL) {
+        OHM_ERROR("videoep: failed to allocate request");
         return -1;
     }
 
@@ -1287,6 +1314,7 @@ static int atom_query(xif_t              *xif,
 
     if (xcb_connection_has_error(xif->xconn)) {
         OHM_ERROR("videoep: failed to query attribute def '%s'", name);
+        free(aq);
         return -1;
     }
 
@@ -1297,11 +1325,9 @@ static int atom_query(xif_t              *xif,
     aq->replycb = replycb;
     aq->usrdata = usrdata;
 
-    atom_idx = ATOM_QUERY_INDEX(atom_idx + 1);
-
     rque_append_request(&xif->rque, ckie.sequence, atom_query_finish, aq);
 
-    xcb_flush(xif->xconn);
+    flush_requests(xif->xconn);
 
     return 0;
 }
@@ -1311,19 +1337,16 @@ static void atom_query_finish(xif_t *xif, void *reply_data, void *data)
     xcb_intern_atom_reply_t *reply = reply_data;
     atom_query_t            *aq    = data;
 
-    (void)xif;
-
     if (!reply)
-        OHM_ERROR("videoep: could not make/get atom '%s'", aq->name);        
+        REPLY_ERROR(xif, "videoep: could not make/get atom '%s'", aq->name);
     else {
         OHM_DEBUG(DBG_XCB, "atom '%s' queried: %u", aq->name, reply->atom);
 
         aq->replycb(aq->name, reply->atom, aq->usrdata);
-
-        free((void *)aq->name);
     }
 
-    memset(aq, 0, sizeof(atom_query_t));
+    free((void *)aq->name);
+    free(aq);
 }
 
 
@@ -1335,20 +1358,19 @@ static int property_query(xif_t                *xif,
                           xif_prop_replycb_t    replycb,
                           void                 *usrdata)
 {
-    prop_query_t              *pq = prop_qry + prop_idx;
+    prop_query_t              *pq;
     xcb_get_property_cookie_t  ckie;
 
     if (xif->xconn == NULL || xcb_connection_has_error(xif->xconn))
         return -1;
 
-    if (rque_is_full(&xif->rque)) {
-        OHM_ERROR("videoep: xif request queue is full");
+    if (!rque_reserve(&xif->rque)) {
+        OHM_ERROR("videoep: failed to grow xif request queue");
         return -1;
     }
 
-    if (pq->busy) {
-        OHM_ERROR("videoep: maximum number of pending property "
-                  "queries reached");
+    if ((pq = calloc(1, sizeof(*pq))) == NULL) {
+        OHM_ERROR("videoep: failed to allocate request");
         return -1;
     }
 
@@ -1356,6 +1378,7 @@ static int property_query(xif_t                *xif,
 
     if (xcb_connection_has_error(xif->xconn)) {
         OHM_ERROR("videoep: failed to query property");
+        free(pq);
         return -1;
     }
 
@@ -1368,11 +1391,9 @@ static int property_query(xif_t                *xif,
     pq->replycb  = replycb;
     pq->usrdata  = usrdata;
 
-    prop_idx = PROPERTY_QUERY_INDEX(prop_idx + 1);
-
     rque_append_request(&xif->rque, ckie.sequence, property_query_finish, pq);
 
-    xcb_flush(xif->xconn);
+    flush_requests(xif->xconn);
 
     return 0;
 }
@@ -1385,10 +1406,8 @@ static void property_query_finish(xif_t *xif, void *reply_data, void *data)
     void                     *value;
     int                       length;
 
-    (void)xif;
-
     if (!reply)
-        OHM_ERROR("videoep: could not get property");        
+        REPLY_ERROR(xif, "videoep: could not get property");
     else {
         if (reply->type != pq->type || reply->bytes_after > 0)
             OHM_ERROR("videoep: failed to query property");
@@ -1410,7 +1429,7 @@ static void property_query_finish(xif_t *xif, void *reply_data, void *data)
 
     }
 
-    memset(pq, 0, sizeof(prop_query_t));
+    free(pq);
 }
 
 
@@ -1520,14 +1539,14 @@ static int randr_set_screen_size(xif_t        *xif,
     OHM_DEBUG(DBG_XCB, "setting screen of rootwin 0x%x size %ux%u pixels "
               "(%lux%lu mm)", rootwin, width,height, mm_width,mm_height);
 
-    xcb_flush(xif->xconn);
+    flush_requests(xif->xconn);
 
     return 0;    
 }
 
 static int randr_create_mode(xif_t *xif, xcb_window_t rwin, xif_mode_t *mode)
 {
-    mode_create_t                  *mc = mode_creat + mode_idx;
+    mode_create_t                  *mc;
     xcb_randr_create_mode_cookie_t  ckie;
     xcb_randr_mode_info_t           info;
     size_t                          namlen;
@@ -1535,13 +1554,13 @@ static int randr_create_mode(xif_t *xif, xcb_window_t rwin, xif_mode_t *mode)
     if (xif->xconn == NULL || xcb_connection_has_error(xif->xconn))
         return -1;
 
-    if (rque_is_full(&xif->rque)) {
-        OHM_ERROR("videoep: xif request queue is full");
+    if (!rque_reserve(&xif->rque)) {
+        OHM_ERROR("videoep: failed to grow xif request queue");
         return -1;
     }
 
-    if (mc->busy) {
-        OHM_ERROR("videoep: maximum number of pending mode cretation reached");
+    if ((mc = calloc(1, sizeof(*mc))) == NULL) {
+        OHM_ERROR("videoep: failed to allocate request");
         return -1;
     }
 
@@ -1565,18 +1584,17 @@ static int randr_create_mode(xif_t *xif, xcb_window_t rwin, xif_mode_t *mode)
 
     if (xcb_connection_has_error(xif->xconn)) {
         OHM_ERROR("videoep: failed to create new mode '%s'", mode->name);
+        free(mc);
         return -1;
     }
 
     mc->busy = TRUE;
     mc->name = strdup(mode->name);
 
-    mode_idx = MODE_CREATE_INDEX(mode_idx + 1);
-
     rque_append_request(&xif->rque, ckie.sequence,
                         randr_create_mode_finish, mc);
 
-    xcb_flush(xif->xconn);
+    flush_requests(xif->xconn);
 
     return 0;    
 
@@ -1596,12 +1614,10 @@ static void randr_create_mode_finish(xif_t *xif, void *reply_data, void *data)
     else {
         OHM_INFO("videoep: '%s' mode (0x%x) successfuly created",
                  mc->name, reply->mode);
-
-        free((void *)mc->name);
-        mc->name = NULL;
     }
 
-    memset(mc, 0, sizeof(mode_create_t));
+    free((void *)mc->name);
+    free(mc);
 }
 
 static int randr_query_screen(xif_t                *xif,
@@ -1609,7 +1625,7 @@ static int randr_query_screen(xif_t                *xif,
                               xif_screen_replycb_t  replycb,
                               void                 *usrdata)
 {
-    randr_query_t                           *rq = randr_qry + randr_idx;
+    randr_query_t                           *rq;
     xcb_randr_get_screen_resources_cookie_t  ckie;
 
     (void)xif;
@@ -1617,13 +1633,13 @@ static int randr_query_screen(xif_t                *xif,
     if (xif->xconn == NULL || xcb_connection_has_error(xif->xconn))
         return -1;
 
-    if (rque_is_full(&xif->rque)) {
-        OHM_ERROR("videoep: xif request queue is full");
+    if (!rque_reserve(&xif->rque)) {
+        OHM_ERROR("videoep: failed to grow xif request queue");
         return -1;
     }
 
-    if (rq->any.busy) {
-        OHM_ERROR("videoep: maximum number of pending RandR queries reached");
+    if ((rq = calloc(1, sizeof(*rq))) == NULL) {
+        OHM_ERROR("videoep: failed to allocate request");
         return -1;
     }
 
@@ -1631,6 +1647,7 @@ static int randr_query_screen(xif_t                *xif,
 
     if (xcb_connection_has_error(xif->xconn)) {
         OHM_ERROR("videoep: failed to query RandR screen resources");
+        free(rq);
         return -1;
     }
 
@@ -1642,11 +1659,9 @@ static int randr_query_screen(xif_t                *xif,
     rq->screen.replycb = replycb;
     rq->screen.usrdata = usrdata;
 
-    randr_idx = RANDR_QUERY_INDEX(randr_idx + 1);
-
     rque_append_request(&xif->rque, ckie.sequence,
                         randr_query_screen_finish, rq);
-    xcb_flush(xif->xconn);
+    flush_requests(xif->xconn);
 
     return 0;
 }
@@ -1674,10 +1689,8 @@ static void randr_query_screen_finish(xif_t *xif, void *reply_data, void *data)
     int                                     i;
     uint32_t                                j;
 
-    (void)xif;
-
     if (!reply)
-        OHM_ERROR("videoep: could not get RandR screen resources");
+        REPLY_ERROR(xif, "videoep: could not get RandR screen resources");
     else if (sq->type != query_screen)
         OHM_ERROR("videoep: %s() confused with type", __FUNCTION__);
     else {
@@ -1741,7 +1754,7 @@ static void randr_query_screen_finish(xif_t *xif, void *reply_data, void *data)
         sq->replycb(&st, sq->usrdata);
     }
 
-    memset(rq, 0, sizeof(randr_query_t));
+    free(rq);
 
 #undef MAX_MODES
 #undef NAME_LENGTH
@@ -1754,19 +1767,19 @@ static int randr_query_crtc(xif_t              *xif,
                             xif_crtc_replycb_t  replycb,
                             void               *usrdata)
 {
-    randr_query_t                    *rq = randr_qry + randr_idx;
+    randr_query_t                    *rq;
     xcb_randr_get_crtc_info_cookie_t  ckie;
 
     if (xif->xconn == NULL || xcb_connection_has_error(xif->xconn))
         return -1;
 
-    if (rque_is_full(&xif->rque)) {
-        OHM_ERROR("videoep: xif request queue is full");
+    if (!rque_reserve(&xif->rque)) {
+        OHM_ERROR("videoep: failed to grow xif request queue");
         return -1;
     }
 
-    if (rq->any.busy) {
-        OHM_ERROR("videoep: maximum number of pending RandR queries reached");
+    if ((rq = calloc(1, sizeof(*rq))) == NULL) {
+        OHM_ERROR("videoep: failed to allocate request");
         return -1;
     }
 
@@ -1774,6 +1787,7 @@ static int randr_query_crtc(xif_t              *xif,
 
     if (xcb_connection_has_error(xif->xconn)) {
         OHM_ERROR("videoep: failed to query RandR crtc");
+        free(rq);
         return -1;
     }
 
@@ -1786,11 +1800,9 @@ static int randr_query_crtc(xif_t              *xif,
     rq->crtc.replycb = replycb;
     rq->crtc.usrdata = usrdata;
 
-    randr_idx = RANDR_QUERY_INDEX(randr_idx + 1);
-
     rque_append_request(&xif->rque, ckie.sequence,
                         randr_query_crtc_finish, rq);
-    xcb_flush(xif->xconn);
+    flush_requests(xif->xconn);
 
     return 0;
 }
@@ -1802,10 +1814,8 @@ static void randr_query_crtc_finish(xif_t *xif, void *reply_data, void *data)
     randr_query_crtc_t              *cq    = &rq->crtc;
     xif_crtc_t                       ct;
 
-    (void)xif;
-
     if (!reply)
-        OHM_ERROR("videoep: could not get RandR crtc info");
+        REPLY_ERROR(xif, "videoep: could not get RandR crtc info");
     else if (cq->type != query_crtc)
         OHM_ERROR("videoep: %s() confused with type", __FUNCTION__);
     else {
@@ -1826,7 +1836,7 @@ static void randr_query_crtc_finish(xif_t *xif, void *reply_data, void *data)
         cq->replycb(&ct, cq->usrdata);
     }
 
-    memset(rq, 0, sizeof(randr_query_t));
+    free(rq);
 }
 
 static int randr_config_crtc(xif_t      *xif,
@@ -1856,7 +1866,10 @@ static int randr_config_crtc(xif_t      *xif,
 
     OHM_DEBUG(DBG_XCB, "configuring RandR crtc 0x%x", crtc->xid);
 
-    xcb_flush(xif->xconn);
+    /* nobody waits for the reply; don't let XCB keep it around */
+    xcb_discard_reply(xif->xconn, ckie.sequence);
+
+    flush_requests(xif->xconn);
 
     return 0;    
 }
@@ -1869,19 +1882,19 @@ static int randr_query_output(xif_t                *xif,
                               xif_output_replycb_t  replycb,
                               void                 *usrdata)
 {
-    randr_query_t                      *rq = randr_qry + randr_idx;
+    randr_query_t                      *rq;
     xcb_randr_get_output_info_cookie_t  ckie;
 
     if (xif->xconn == NULL || xcb_connection_has_error(xif->xconn))
         return -1;
 
-    if (rque_is_full(&xif->rque)) {
-        OHM_ERROR("videoep: xif request queue is full");
+    if (!rque_reserve(&xif->rque)) {
+        OHM_ERROR("videoep: failed to grow xif request queue");
         return -1;
     }
 
-    if (rq->any.busy) {
-        OHM_ERROR("videoep: maximum number of pending RandR queries reached");
+    if ((rq = calloc(1, sizeof(*rq))) == NULL) {
+        OHM_ERROR("videoep: failed to allocate request");
         return -1;
     }
 
@@ -1889,6 +1902,7 @@ static int randr_query_output(xif_t                *xif,
 
     if (xcb_connection_has_error(xif->xconn)) {
         OHM_ERROR("videoep: failed to query RandR output");
+        free(rq);
         return -1;
     }
 
@@ -1901,11 +1915,9 @@ static int randr_query_output(xif_t                *xif,
     rq->output.replycb = replycb;
     rq->output.usrdata = usrdata;
 
-    randr_idx = RANDR_QUERY_INDEX(randr_idx + 1);
-
     rque_append_request(&xif->rque, ckie.sequence,
                         randr_query_output_finish, rq);
-    xcb_flush(xif->xconn);
+    flush_requests(xif->xconn);
 
     return 0;
 }
@@ -1921,10 +1933,8 @@ static void randr_query_output_finish(xif_t *xif, void *reply_data, void *data)
     char                               name[NAME_MAX_LENGTH + 1];
     int                                length;
 
-    (void)xif;
-
     if (!reply)
-        OHM_ERROR("videoep: could not get RandR output info");
+        REPLY_ERROR(xif, "videoep: could not get RandR output info");
     else if (oq->type != query_output)
         OHM_ERROR("videoep: %s() confused with type", __FUNCTION__);
     else {
@@ -1952,7 +1962,7 @@ static void randr_query_output_finish(xif_t *xif, void *reply_data, void *data)
         oq->replycb(&ot, oq->usrdata);
     }
 
-    memset(rq, 0, sizeof(randr_query_t));
+    free(rq);
 
 #undef NAME_MAX_LENGTH
 }
@@ -1966,19 +1976,19 @@ static int randr_query_output_property(xif_t                  *xif,
                                        xif_outprop_replycb_t   replycb,
                                        void                   *usrdata)
 {
-    randr_query_t                          *rq = randr_qry + randr_idx;
+    randr_query_t                          *rq;
     xcb_randr_get_output_property_cookie_t  ckie;
 
     if (xif->xconn == NULL || xcb_connection_has_error(xif->xconn))
         return -1;
 
-    if (rque_is_full(&xif->rque)) {
-        OHM_ERROR("videoep: xif request queue is full");
+    if (!rque_reserve(&xif->rque)) {
+        OHM_ERROR("videoep: failed to grow xif request queue");
         return -1;
     }
 
-    if (rq->any.busy) {
-        OHM_ERROR("videoep: maximum number of pending RandR queries reached");
+    if ((rq = calloc(1, sizeof(*rq))) == NULL) {
+        OHM_ERROR("videoep: failed to allocate request");
         return -1;
     }
 
@@ -1987,6 +1997,7 @@ static int randr_query_output_property(xif_t                  *xif,
 
     if (xcb_connection_has_error(xif->xconn)) {
         OHM_ERROR("videoep: failed to query RandR output property");
+        free(rq);
         return -1;
     }
 
@@ -2001,11 +2012,9 @@ static int randr_query_output_property(xif_t                  *xif,
     rq->outprop.replycb = replycb;
     rq->outprop.usrdata = usrdata;
 
-    randr_idx = RANDR_QUERY_INDEX(randr_idx + 1);
-
     rque_append_request(&xif->rque, ckie.sequence,
                         randr_query_output_property_finish, rq);
-    xcb_flush(xif->xconn);
+    flush_requests(xif->xconn);
 
     return 0;
 }
@@ -2021,10 +2030,8 @@ static void randr_query_output_property_finish(xif_t *xif,
     void                                  *value;
     int                                    length;
 
-    (void)xif;
-
     if (!reply)
-        OHM_ERROR("videoep: could not get RandR output property info");
+        REPLY_ERROR(xif, "videoep: could not get RandR output property info");
     else if (pq->type != query_outprop)
         OHM_ERROR("videoep: %s() confused with type", __FUNCTION__);
     else {
@@ -2041,7 +2048,7 @@ static void randr_query_output_property_finish(xif_t *xif,
                     value, length, pq->usrdata);
     }
 
-    memset(rq, 0, sizeof(randr_query_t));
+    free(rq);
 }
 
 
@@ -2168,9 +2175,53 @@ static int check_version(uint32_t required_major_version,
 }
 
 
-static int rque_is_full(rque_t *rque)
+static uint64_t rque_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void flush_requests(xcb_connection_t *xconn)
+{
+    if (batch > 0)
+        unflushed = TRUE;
+    else
+        xcb_flush(xconn);
+}
+
+static int rque_reserve(rque_t *rque)
 {
-    return (rque->length >= QUEUE_DIM);
+    request_t *requests;
+    int        size;
+    int        tail;
+
+    if (rque->length < rque->size)
+        return TRUE;
+
+    size = rque->size ? rque->size * 2 : QUEUE_MIN;
+
+    if ((requests = realloc(rque->requests, size * sizeof(*requests))) == NULL)
+        return FALSE;
+
+    /* unwrap the entries that wrapped around the end of the old buffer */
+    if (rque->head > 0) {
+        tail = rque->size - rque->head;
+
+        memmove(requests + size - tail, requests + rque->head,
+                tail * sizeof(*requests));
+
+        rque->head = size - tail;
+    }
+
+    OHM_DEBUG(DBG_XCB, "xif request queue grown to %d entries", size);
+
+    rque->requests = requests;
+    rque->size     = size;
+
+    return TRUE;
 }
 
 static int rque_append_request(rque_t          *rque,
@@ -2180,14 +2231,18 @@ static int rque_append_request(rque_t          *rque,
 {
     request_t *req;
 
-    if (rque_is_full(rque))
+    if (!rque_reserve(rque))
         return -1;
     
-    req = rque->requests + rque->length++;
+    req = rque->requests + QUEUE_INDEX(rque, rque->length++);
 
     req->sequence = seq;
     req->handler  = hlr;
     req->data     = data;
+    req->stamp    = rque_now();
+
+    if ((uint32_t)rque->length > rque->stats.maxlength)
+        rque->stats.maxlength = rque->length;
 
     return 0;
 }
@@ -2199,37 +2254,75 @@ static int rque_poll_reply(xcb_connection_t *xconn,
                            void             **data_ret)
 {
     xcb_generic_error_t *e;
-    int i, j;
+    request_t           *req;
+    uint64_t             wait;
+    int                  done;
 
-    if (!reply || !hlr_ret || !data_ret)
+    if (!reply || !hlr_ret || !data_ret || rque->length <= 0)
         return 0;
 
-    for (i = 0;  i < rque->length;  i++) {
-        e = NULL;
+    req  = rque->requests + rque->head;
+    e    = NULL;
+    done = xcb_poll_for_reply(xconn, req->sequence, reply, &e);
+    wait = rque_now() - req->stamp;
 
-        if (xcb_poll_for_reply(xconn, rque->requests[i].sequence, reply, &e)) {
+    if (done) {
+        if (e != NULL) {
+            free(e);
+            free(*reply);
+            *reply = NULL;
+        }
 
-            *hlr_ret  = rque->requests[i].handler;
-            *data_ret = rque->requests[i].data;
- 
-            for (j = i+1;  j < rque->length;  j++) 
-                rque->requests[j-1] = rque->requests[j];
+        if (wait > rque->stats.maxwait)
+            rque->stats.maxwait = wait;
 
-            rque->length--;
+        rque->stats.completed++;
+    }
+    else {
+        if (wait < REQUEST_TIMEOUT)
+            return 0;
 
-            if (e == NULL && *reply != NULL) {
-                return 1;
-            }
+        OHM_ERROR("videoep: no reply for X request %u in %llu msec",
+                  req->sequence, (unsigned long long)wait);
 
-            if (e != NULL) {
-                free(e);
-                *reply = NULL;
-                return 1;
-            }
-        }
+        xcb_discard_reply(xconn, req->sequence);
+        *reply = NULL;
+
+        rque->stats.timedout++;
     }
 
-    return 0;
+    *hlr_ret  = req->handler;
+    *data_ret = req->data;
+
+    rque->head = QUEUE_INDEX(rque, 1);
+    rque->length--;
+
+    return 1;
+}
+
+static void rque_purge(xif_t *xif, rque_t *rque)
+{
+    request_t *req;
+
+    OHM_DEBUG(DBG_XCB, "xif request queue: %u replies, %u timeouts, "
+              "max. %u pending, max. %u msec wait", rque->stats.completed,
+              rque->stats.timedout, rque->stats.maxlength,
+              rque->stats.maxwait);
+
+    /* let the handlers release their pending request data */
+    rque->purging = TRUE;
+
+    while (rque->length > 0) {
+        req = rque->requests + rque->head;
+
+        rque->head = QUEUE_INDEX(rque, 1);
+        rque->length--;
+
+        req->handler(xif, NULL, req->data);
+    }
+
+    free(rque->requests);
+    memset(rque, 0, sizeof(*rque));
 }
 
 static gboolean xio_cb(GIOChannel *ch, GIOCondition cond, gpointer data)
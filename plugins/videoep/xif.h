@@ -162,6 +162,9 @@ int      xif_output_property_change(uint32_t,uint32_t, videoep_value_type_t,
 int      xif_send_client_message(uint32_t, uint32_t, int, videoep_value_type_t,
                                  uint32_t, void *);
 
+void xif_batch_begin(void);
+void xif_batch_end(void);
+
 int xif_crtc_config(uint32_t, xif_crtc_t *);
 
 #endif /* __OHM_VIDEOEP_XIF_H__ */